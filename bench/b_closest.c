@@ -0,0 +1,103 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Cell lookups by the kd-tree and by the SQL query, on square grids of 10^2
+ * to 10^5 datasets.
+ */
+
+#include <math.h>
+
+#include "../tests/common.h"
+
+#define LEN 8
+
+static void run(size_t side)
+{
+    size_t npts = side*side, nq_kd = 100000, nq_sql, i;
+    double *n, *T, t0, t_build, t_kd, t_sql;
+    unsigned long d[4];
+    lsdb_t *lsdb;
+
+    n = malloc(side*sizeof(double));
+    T = malloc(side*sizeof(double));
+    for (i = 0; i < side; i++) {
+        n[i] = 1e16*pow(100.0, (double) i/(side - 1));
+        T[i] = 1.0*pow(10.0, (double) i/(side - 1));
+    }
+
+    lsdb = test_create_db(test_tmpname("b_closest"));
+    if (!lsdb || test_add_grid(lsdb, n, side, T, side, LEN) != (int) npts) {
+        fprintf(stderr, "failed to create the DB\n");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(1);
+
+    /* the first lookup builds the index */
+    t0 = test_time();
+    lsdb_get_closest_dids(lsdb, TEST_MID, TEST_EID, TEST_LID, 3e16, 2.0,
+        &d[0], &d[1], &d[2], &d[3]);
+    t_build = test_time() - t0;
+
+    t0 = test_time();
+    for (i = 0; i < nq_kd; i++) {
+        double qn = 1e16*pow(100.0, (double) rand()/RAND_MAX);
+        double qT = pow(10.0, (double) rand()/RAND_MAX);
+        lsdb_get_closest_dids(lsdb, TEST_MID, TEST_EID, TEST_LID, qn, qT,
+            &d[0], &d[1], &d[2], &d[3]);
+    }
+    t_kd = (test_time() - t0)/nq_kd;
+
+    nq_sql = 1000000/npts;
+    if (nq_sql < 20) {
+        nq_sql = 20;
+    }
+    t0 = test_time();
+    for (i = 0; i < nq_sql; i++) {
+        double qn = 1e16*pow(100.0, (double) rand()/RAND_MAX);
+        double qT = pow(10.0, (double) rand()/RAND_MAX);
+        lsdb_get_closest_dids_sql(lsdb, TEST_MID, TEST_EID, TEST_LID, qn, qT,
+            &d[0], &d[1], &d[2], &d[3]);
+    }
+    t_sql = (test_time() - t0)/nq_sql;
+
+    printf("%8lu %12.3f %12.3f %12.1f %10.0f\n", (unsigned long) npts,
+        1e3*t_build, 1e6*t_kd, 1e6*t_sql, t_sql/t_kd);
+
+    lsdb_close(lsdb);
+    test_cleanup();
+    free(n);
+    free(T);
+}
+
+int main(void)
+{
+    printf("# closest datasets: kd-tree vs SQL\n");
+    printf("# %6s %12s %12s %12s %10s\n",
+        "points", "build, ms", "kd, us", "SQL, us", "speedup");
+
+    run(10);
+    run(32);
+    run(100);
+    run(316);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * The interpolation engines at random points of a 3x3 grid, for several
+ * len: the preparation (with the default morph cache), the evaluation at
+ * len points, and lsdb_get_interpolation() doing both.
+ */
+
+#include <math.h>
+
+#include "../tests/common.h"
+
+#define DSLEN  401
+#define NCALLS 1000
+
+static double urand(double a, double b)
+{
+    return a + (b - a)*rand()/RAND_MAX;
+}
+
+static void run(lsdb_t *lsdb, lsdb_interp_engine_t engine, unsigned int len)
+{
+    lsdb_interp_ws_t *ws = lsdb_interp_ws_new();
+    double *x = malloc(len*sizeof(double)), *y = malloc(len*sizeof(double));
+    double t0, t_prep = 0.0, t_eval = 0.0, t_get;
+    int nfailed = 0;
+
+    if (!ws || !x || !y) {
+        fprintf(stderr, "memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    lsdb_set_interp_engine(lsdb, engine);
+
+    srand(1);
+    for (int i = 0; i < NCALLS; i++) {
+        double n = exp(urand(log(1e16), log(4e16))), T = urand(1, 4);
+        const lsdb_interp_t *interp;
+        double xmin, xmax;
+
+        t0 = test_time();
+        interp = lsdb_prepare_interpolation_ws(lsdb, ws,
+            TEST_MID, TEST_EID, TEST_LID, n, T, len);
+        t_prep += test_time() - t0;
+        if (!interp) {
+            nfailed++;
+            continue;
+        }
+
+        lsdb_interp_get_domain(interp, &xmin, &xmax);
+        for (unsigned int k = 0; k < len; k++) {
+            x[k] = xmin + (xmax - xmin)*k/(len - 1);
+        }
+        t0 = test_time();
+        lsdb_interp_eval_array(interp, x, y, len, false);
+        t_eval += test_time() - t0;
+    }
+    t_prep /= NCALLS;
+    t_eval /= NCALLS;
+
+    srand(1);
+    t0 = test_time();
+    for (int i = 0; i < NCALLS; i++) {
+        double n = exp(urand(log(1e16), log(4e16))), T = urand(1, 4);
+        lsdb_dataset_data_t *ds;
+
+        ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+            n, T, len, 0.0, 0.0);
+        nfailed += ds == NULL;
+        lsdb_dataset_data_free(ds);
+    }
+    t_get = (test_time() - t0)/NCALLS;
+
+    printf("%-9s %6u %10.1f %10.1f %10.1f%s\n",
+        engine == LSDB_INTERP_MORPH ? "morph":"quantile", len,
+        1e6*t_prep, 1e6*t_eval, 1e6*t_get, nfailed ? " !":"");
+
+    free(x);
+    free(y);
+    lsdb_interp_ws_free(ws);
+}
+
+int main(void)
+{
+    static const unsigned int lens[4] = {101, 401, 1001, 4001};
+    const double n[3] = {1e16, 2e16, 4e16}, T[3] = {1, 2, 4};
+    lsdb_t *lsdb;
+
+    lsdb = test_create_db(test_tmpname("b_engines"));
+    if (!lsdb || test_add_grid(lsdb, n, 3, T, 3, DSLEN) != 9) {
+        fprintf(stderr, "failed to create the DB\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("# the interpolation engines, us per call\n");
+    printf("# %-7s %6s %10s %10s %10s\n", "engine", "len",
+        "prepare", "evaluate", "get");
+    for (int i = 0; i < 4; i++) {
+        run(lsdb, LSDB_INTERP_MORPH, lens[i]);
+        run(lsdb, LSDB_INTERP_QUANTILE, lens[i]);
+    }
+
+    lsdb_close(lsdb);
+    test_cleanup();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * lsdb_line_model_interpolate() against lsdb_get_interpolation() (with the
+ * default morph cache and without a dataset cache), at random points of a
+ * 16x16 grid and of as many scattered points; both in the same cell over and
+ * over, and in a random cell each time.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "../tests/common.h"
+
+#define NSIDE  16
+#define NPTS   (NSIDE*NSIDE)
+#define LEN    401
+#define NCALLS 2000
+
+static double urand(double a, double b)
+{
+    return a + (b - a)*rand()/RAND_MAX;
+}
+
+/* log-uniform in n between 1e16 and 1e18, uniform in T between 1 and 16 */
+static void random_point(double *n, double *T, bool one_cell)
+{
+    if (one_cell) {
+        *n = exp(urand(log(3e16), log(3.2e16)));
+        *T = urand(5, 5.5);
+    } else {
+        *n = exp(urand(log(1e16), log(1e18)));
+        *T = urand(1, 16);
+    }
+}
+
+static void run(lsdb_t *lsdb, const char *name, lsdb_interp_engine_t engine,
+    bool one_cell)
+{
+    static double x[LEN], y[LEN];
+    lsdb_line_model_t *lm;
+    lsdb_interp_ws_t *ws = lsdb_interp_ws_new();
+    double t0, t_get, t_lm, t_load;
+    int nfailed = 0;
+
+    lsdb_set_interp_engine(lsdb, engine);
+
+    t0 = test_time();
+    lm = lsdb_load_line_model(lsdb, TEST_MID, TEST_EID, TEST_LID);
+    t_load = test_time() - t0;
+    if (!lm || !ws) {
+        fprintf(stderr, "failed to load the line model\n");
+        exit(EXIT_FAILURE);
+    }
+
+    srand(1);
+    t0 = test_time();
+    for (int i = 0; i < NCALLS; i++) {
+        lsdb_dataset_data_t *ds;
+        double n, T;
+
+        random_point(&n, &T, one_cell);
+        ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+            n, T, LEN, 0.0, 0.0);
+        nfailed += ds == NULL;
+        lsdb_dataset_data_free(ds);
+    }
+    t_get = (test_time() - t0)/NCALLS;
+
+    srand(1);
+    t0 = test_time();
+    for (int i = 0; i < NCALLS; i++) {
+        double n, T;
+
+        random_point(&n, &T, one_cell);
+        nfailed += lsdb_line_model_interpolate(lm, ws, n, T, LEN, 0.0, 0.0,
+            x, y) != LSDB_SUCCESS;
+    }
+    t_lm = (test_time() - t0)/NCALLS;
+
+    printf("%-8s %-9s %-5s %10.2f %10.1f %10.1f %8.2f%s\n", name,
+        engine == LSDB_INTERP_MORPH ? "morph":"quantile",
+        one_cell ? "one":"any", 1e3*t_load, 1e6*t_get, 1e6*t_lm, t_get/t_lm,
+        nfailed ? " !":"");
+
+    lsdb_line_model_free(lm);
+    lsdb_interp_ws_free(ws);
+}
+
+static void run_all(lsdb_t *lsdb, const char *name)
+{
+    for (int one_cell = 1; one_cell >= 0; one_cell--) {
+        run(lsdb, name, LSDB_INTERP_MORPH, one_cell);
+        run(lsdb, name, LSDB_INTERP_QUANTILE, one_cell);
+    }
+}
+
+int main(void)
+{
+    double ngrid[NSIDE], Tgrid[NSIDE], n[NPTS], T[NPTS];
+    lsdb_t *lsdb;
+
+    /* slightly beyond the query ranges, so that all queries succeed */
+    for (int i = 0; i < NSIDE; i++) {
+        ngrid[i] = 0.99e16*pow(1.02e18/0.99e16, (double) i/(NSIDE - 1));
+        Tgrid[i] = 0.99 + (16.2 - 0.99)*i/(NSIDE - 1);
+    }
+
+    printf("# lsdb_get_interpolation() vs the line model, %d points\n", LEN);
+    printf("# %-6s %-9s %-5s %10s %10s %10s %8s\n", "data", "engine",
+        "cell", "load, ms", "get, us", "model, us", "ratio");
+
+    lsdb = test_create_db(test_tmpname("b_linemodel"));
+    if (!lsdb ||
+        test_add_grid(lsdb, ngrid, NSIDE, Tgrid, NSIDE, LEN) != NPTS) {
+        fprintf(stderr, "failed to create the DB\n");
+        return EXIT_FAILURE;
+    }
+    run_all(lsdb, "grid");
+    lsdb_close(lsdb);
+
+    /* the corners keep all queries inside */
+    srand(2);
+    for (int i = 0; i < NPTS; i++) {
+        n[i] = ngrid[(i & 1) ? NSIDE - 1:0];
+        T[i] = Tgrid[(i & 2) ? NSIDE - 1:0];
+        if (i >= 4) {
+            n[i] = exp(urand(log(ngrid[0]), log(ngrid[NSIDE - 1])));
+            T[i] = urand(Tgrid[0], Tgrid[NSIDE - 1]);
+        }
+    }
+    lsdb = test_create_db(test_tmpname("b_linemodel-scatter"));
+    if (!lsdb || test_add_points(lsdb, n, T, NPTS, LEN) != NPTS) {
+        fprintf(stderr, "failed to create the DB\n");
+        return EXIT_FAILURE;
+    }
+    run_all(lsdb, "scatter");
+    lsdb_close(lsdb);
+
+    test_cleanup();
+
+    return EXIT_SUCCESS;
+}
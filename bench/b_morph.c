@@ -0,0 +1,91 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * morph_init_ws() on profiles of len points and grids of np points, and,
+ * for comparison, the CDFs by integrating from the start of the domain to
+ * each grid point, as morph_init() used to.
+ */
+
+#include <math.h>
+#include <gsl/gsl_spline.h>
+
+#include <lsdb/morphP.h>
+
+#include "../tests/common.h"
+
+static void run(size_t len, size_t np)
+{
+    double *xf = malloc(len*sizeof(double)), *yf = malloc(len*sizeof(double));
+    double *xg = malloc(len*sizeof(double)), *yg = malloc(len*sizeof(double));
+    morph_workspace_t *ws = morph_workspace_new();
+    morph_t *m = morph_new(np);
+    gsl_spline *s = gsl_spline_alloc(gsl_interp_steffen, len);
+    gsl_interp_accel *acc = gsl_interp_accel_alloc();
+    double t0, t_init, t_direct, sum = 0.0;
+    size_t i, reps = 1 + 2000000/(len + np), nd = 1 + reps/50;
+
+    test_profile(1e16, 1.0, xf, yf, len);
+    test_profile(1e17, 4.0, xg, yg, len);
+
+    morph_init_ws(m, ws, xf, yf, len, xg, yg, len);
+    t0 = test_time();
+    for (i = 0; i < reps; i++) {
+        morph_init_ws(m, ws, xf, yf, len, xg, yg, len);
+    }
+    t_init = (test_time() - t0)/reps;
+
+    gsl_spline_init(s, xf, yf, len);
+    t0 = test_time();
+    for (i = 0; i < nd; i++) {
+        for (size_t k = 0; k < np; k++) {
+            sum += gsl_spline_eval_integ(s, ws->x[0], ws->x[k], acc);
+        }
+    }
+    t_direct = (test_time() - t0)/nd;
+
+    printf("%6lu %6lu %12.1f %12.1f %10.1f\n", (unsigned long) len,
+        (unsigned long) np, 1e6*t_init, 1e6*t_direct,
+        sum > 0 ? t_direct/t_init:0.0);
+
+    gsl_interp_accel_free(acc);
+    gsl_spline_free(s);
+    morph_free(m);
+    morph_workspace_free(ws);
+    free(xf);
+    free(yf);
+    free(xg);
+    free(yg);
+}
+
+int main(void)
+{
+    printf("# morph_init_ws() vs the direct integration of one CDF\n");
+    printf("# %4s %6s %12s %12s %10s\n",
+        "len", "np", "init, us", "direct, us", "ratio");
+
+    run(201, 201);
+    run(2001, 501);
+    run(2001, 2001);
+    run(2001, 8001);
+    run(10001, 2001);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Throughput of a thread-safe handle shared by 1 to 64 threads, on an 8x8
+ * grid: lsdb_get_interpolation() at random points (mostly new cells, so the
+ * morphs dominate), at random points of a single cell (morph cache hits),
+ * and catalog lookups.
+ */
+
+#include <math.h>
+#include <pthread.h>
+
+#include "../tests/common.h"
+
+#define NGRID  8
+#define LEN    401
+#define MAXTHR 64
+
+typedef enum {
+    MODE_GRID,
+    MODE_CELL,
+    MODE_LOOKUP
+} bench_mode_t;
+
+typedef struct {
+    const lsdb_t *lsdb;
+    bench_mode_t  mode;
+    size_t        ncalls;
+    unsigned int  seed;
+    int           nfailed;
+} job_t;
+
+static const double ngrid[NGRID] = {
+    1e16, 2e16, 5e16, 1e17, 2e17, 5e17, 1e18, 2e18
+};
+static const double Tgrid[NGRID] = {1, 1.5, 2, 3, 5, 7, 10, 15};
+
+static double urand(unsigned int *seed, double a, double b)
+{
+    return a + (b - a)*rand_r(seed)/RAND_MAX;
+}
+
+static void *worker(void *arg)
+{
+    job_t *job = arg;
+    const lsdb_t *lsdb = job->lsdb;
+
+    for (size_t i = 0; i < job->ncalls; i++) {
+        lsdb_dataset_data_t *ds;
+        double nmin, nmax, Tmin, Tmax;
+
+        switch (job->mode) {
+        case MODE_GRID:
+        case MODE_CELL:
+            if (job->mode == MODE_GRID) {
+                double ln = urand(&job->seed,
+                    log(ngrid[0]), log(ngrid[NGRID - 1]));
+                ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+                    exp(ln), urand(&job->seed, Tgrid[0], Tgrid[NGRID - 1]),
+                    LEN, 0.0, 0.0);
+            } else {
+                ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+                    urand(&job->seed, ngrid[3], ngrid[4]),
+                    urand(&job->seed, Tgrid[3], Tgrid[4]), LEN, 0.0, 0.0);
+            }
+            job->nfailed += ds == NULL;
+            lsdb_dataset_data_free(ds);
+            break;
+        case MODE_LOOKUP:
+            job->nfailed += lsdb_find_line(lsdb, 1, "Ly-alpha") != TEST_LID;
+            job->nfailed += lsdb_get_limits(lsdb, TEST_MID, TEST_EID, TEST_LID,
+                &nmin, &nmax, &Tmin, &Tmax) != LSDB_SUCCESS;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void run(const lsdb_t *lsdb, bench_mode_t mode, const char *name,
+    size_t ncalls)
+{
+    static job_t jobs[MAXTHR];
+    pthread_t tids[MAXTHR];
+    double rate1 = 0.0, rate = 0.0;
+
+    printf("%-8s", name);
+    for (int nthr = 1; nthr <= MAXTHR; nthr *= 2) {
+        double t0;
+        int nfailed = 0;
+
+        t0 = test_time();
+        for (int i = 0; i < nthr; i++) {
+            jobs[i].lsdb    = lsdb;
+            jobs[i].mode    = mode;
+            jobs[i].ncalls  = ncalls/nthr;
+            jobs[i].seed    = i + 1;
+            jobs[i].nfailed = 0;
+            pthread_create(&tids[i], NULL, worker, &jobs[i]);
+        }
+        for (int i = 0; i < nthr; i++) {
+            pthread_join(tids[i], NULL);
+            nfailed += jobs[i].nfailed;
+        }
+        rate = (ncalls/nthr)*nthr/(test_time() - t0);
+        if (nthr == 1) {
+            rate1 = rate;
+        }
+
+        printf(" %9.0f", rate);
+        if (nfailed) {
+            printf("!");
+        }
+    }
+    printf(" %7.2f\n", rate/rate1);
+}
+
+int main(void)
+{
+    lsdb_open_opts_t opts = {0};
+    const char *fname = test_tmpname("b_threads");
+    lsdb_t *lsdb;
+
+    lsdb = test_create_db(fname);
+    if (!lsdb || test_add_grid(lsdb, ngrid, NGRID, Tgrid, NGRID, LEN) !=
+        NGRID*NGRID) {
+        fprintf(stderr, "failed to create the DB\n");
+        return EXIT_FAILURE;
+    }
+    lsdb_close(lsdb);
+
+    opts.threadsafe = true;
+    opts.catalog    = true;
+    lsdb = lsdb_open_ex(fname, LSDB_ACCESS_RO, &opts);
+    if (!lsdb) {
+        return EXIT_FAILURE;
+    }
+
+    printf("# calls per second of a thread-safe handle, by threads\n");
+    printf("%-8s", "# mode");
+    for (int nthr = 1; nthr <= MAXTHR; nthr *= 2) {
+        printf(" %9d", nthr);
+    }
+    printf(" %7s\n", "64/1");
+
+    run(lsdb, MODE_GRID,   "grid",   2048);
+    run(lsdb, MODE_CELL,   "cell",   16384);
+    run(lsdb, MODE_LOOKUP, "lookup", 1 << 20);
+
+    lsdb_close(lsdb);
+    test_cleanup();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * lsdb_voigt_conv_batch() against one lsdb_voigt_conv() per spectrum, on
+ * 1000 spectra of 2001 points: with the same Voigt for all, with a different
+ * one for each, and with a padded length.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "../tests/common.h"
+
+#define COUNT 1000
+#define REPS  5
+
+static void fill(double *y, size_t stride, size_t len)
+{
+    double *x = malloc(len*sizeof(double));
+
+    for (size_t i = 0; i < COUNT; i++) {
+        test_profile(1e16*(1 + i%10), 1 + i%7, x, y + i*stride, len);
+    }
+
+    free(x);
+}
+
+static void run(const char *name, size_t len, bool vary)
+{
+    size_t stride = (len + 7) & ~(size_t) 7;
+    double *y = malloc(COUNT*stride*sizeof(double));
+    double *ref = malloc(COUNT*stride*sizeof(double));
+    double dx[COUNT], sigma[COUNT], gamma[COUNT];
+    double t0, t_single = HUGE_VAL, t_batch = HUGE_VAL, err = 0.0;
+    size_t i;
+    int r;
+
+    for (i = 0; i < COUNT; i++) {
+        dx[i]    = 0.01;
+        sigma[i] = vary ? 0.05 + 0.0001*i:0.05;
+        gamma[i] = vary ? 0.02 + 0.0001*i:0.02;
+    }
+
+    for (r = 0; r < REPS; r++) {
+        fill(ref, stride, len);
+        t0 = test_time();
+        for (i = 0; i < COUNT; i++) {
+            lsdb_voigt_conv(ref + i*stride, len, dx[i], sigma[i], gamma[i]);
+        }
+        t_single = fmin(t_single, test_time() - t0);
+
+        fill(y, stride, len);
+        t0 = test_time();
+        lsdb_voigt_conv_batch(y, stride, COUNT, len, dx, sigma, gamma);
+        t_batch = fmin(t_batch, test_time() - t0);
+    }
+
+    for (i = 0; i < COUNT; i++) {
+        err = fmax(err, test_rel_diff(y + i*stride, ref + i*stride, len));
+    }
+
+    printf("%-12s %6lu %12.0f %12.0f %8.2f %10.1e\n", name,
+        (unsigned long) len, COUNT/t_single, COUNT/t_batch,
+        t_single/t_batch, err);
+
+    free(y);
+    free(ref);
+}
+
+int main(void)
+{
+    printf("# Voigt convolution of %d spectra: spectra per second\n", COUNT);
+    printf("# %-10s %6s %12s %12s %8s %10s\n",
+        "case", "len", "single", "batch", "speedup", "max diff");
+
+    run("same", 2001, false);
+    run("varying", 2001, true);
+    run("same", 2000, false);
+    run("varying", 2000, true);
+
+    lsdb_fft_cleanup();
+
+    return EXIT_SUCCESS;
+}
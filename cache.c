@@ -0,0 +1,525 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Per-handle caches. Decoded datasets are kept in an LRU cache limited by
+ * the total size in bytes; the cache holds a reference to each dataset it
+ * keeps, so that evicted datasets stay valid for callers that still hold
+ * them. Initialized morphs between pairs of datasets are kept in a small
+ * LRU cache limited by the number of pairs; morphs are pinned while in use.
+ * The caches of thread-safe handles are only accessed under lsdb_cache_lock().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <lsdb/lsdbP.h>
+
+typedef struct _cache_entry_t cache_entry_t;
+
+struct _cache_entry_t {
+    int                  did;
+    lsdb_dataset_data_t *ds;
+    size_t               size;
+
+    /* LRU list, most recently used first */
+    cache_entry_t *prev, *next;
+    /* hash chain */
+    cache_entry_t *chain;
+};
+
+struct _lsdb_cache_t {
+    size_t budget;
+    size_t used;
+
+    cache_entry_t **buckets;
+    size_t          nbuckets;
+    size_t          count;
+
+    cache_entry_t *head, *tail;
+
+    lsdb_stamp_t stamp;
+
+    unsigned long nhits, nmisses, nevictions;
+};
+
+typedef struct {
+    unsigned long     didf, didg;
+    size_t            np;
+    lsdb_morph_pair_t p;
+    unsigned long     tick;
+    unsigned int      pins;
+    /* flushed while pinned; freed once released */
+    bool              stale;
+} morph_entry_t;
+
+struct _lsdb_morph_cache_t {
+    morph_entry_t *entries;
+    size_t         size;
+    size_t         count;
+
+    unsigned long  tick;
+
+    lsdb_stamp_t   stamp;
+
+    unsigned long  nhits, nmisses;
+};
+
+lsdb_cache_t *lsdb_cache_new(void)
+{
+    return calloc(1, sizeof(lsdb_cache_t));
+}
+
+static size_t hash_did(int did, size_t nbuckets)
+{
+    return ((unsigned int) did*2654435761U) & (nbuckets - 1);
+}
+
+static void lru_unlink(lsdb_cache_t *c, cache_entry_t *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        c->head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        c->tail = e->prev;
+    }
+    e->prev = e->next = NULL;
+}
+
+static void lru_push(lsdb_cache_t *c, cache_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = c->head;
+    if (c->head) {
+        c->head->prev = e;
+    } else {
+        c->tail = e;
+    }
+    c->head = e;
+}
+
+static void cache_remove(lsdb_cache_t *c, cache_entry_t *e)
+{
+    cache_entry_t **pe = &c->buckets[hash_did(e->did, c->nbuckets)];
+
+    while (*pe != e) {
+        pe = &(*pe)->chain;
+    }
+    *pe = e->chain;
+
+    lru_unlink(c, e);
+
+    c->used -= e->size;
+    c->count--;
+
+    lsdb_dataset_data_free(e->ds);
+    free(e);
+}
+
+static void cache_evict(lsdb_cache_t *c, size_t budget)
+{
+    while (c->tail && c->used > budget) {
+        cache_remove(c, c->tail);
+        c->nevictions++;
+    }
+}
+
+static void cache_flush(lsdb_cache_t *c)
+{
+    while (c->tail) {
+        cache_remove(c, c->tail);
+    }
+}
+
+void lsdb_cache_free(lsdb_cache_t *c)
+{
+    if (c) {
+        cache_flush(c);
+        free(c->buckets);
+        free(c);
+    }
+}
+
+static bool cache_grow(lsdb_cache_t *c)
+{
+    size_t nbuckets = c->nbuckets ? 2*c->nbuckets:64;
+    cache_entry_t **buckets;
+
+    buckets = calloc(nbuckets, sizeof(cache_entry_t *));
+    if (!buckets) {
+        return false;
+    }
+
+    for (size_t i = 0; i < c->nbuckets; i++) {
+        cache_entry_t *e = c->buckets[i];
+        while (e) {
+            cache_entry_t *next = e->chain;
+            size_t h = hash_did(e->did, nbuckets);
+            e->chain = buckets[h];
+            buckets[h] = e;
+            e = next;
+        }
+    }
+
+    free(c->buckets);
+    c->buckets  = buckets;
+    c->nbuckets = nbuckets;
+
+    return true;
+}
+
+int lsdb_set_cache_budget(lsdb_t *lsdb, size_t nbytes)
+{
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    lsdb_cache_lock(lsdb);
+    lsdb->cache->budget = nbytes;
+    cache_evict(lsdb->cache, nbytes);
+    lsdb_cache_unlock(lsdb);
+
+    return LSDB_SUCCESS;
+}
+
+size_t lsdb_get_cache_budget(const lsdb_t *lsdb)
+{
+    size_t budget;
+
+    lsdb_cache_lock(lsdb);
+    budget = lsdb->cache->budget;
+    lsdb_cache_unlock(lsdb);
+
+    return budget;
+}
+
+/* returns a new reference to the cached dataset, or NULL */
+lsdb_dataset_data_t *lsdb_cache_get(const lsdb_t *lsdb, int did)
+{
+    lsdb_cache_t *c = lsdb->cache;
+    lsdb_dataset_data_t *ds = NULL;
+    cache_entry_t *e;
+
+    lsdb_cache_lock(lsdb);
+
+    if (!c->budget) {
+        lsdb_cache_unlock(lsdb);
+        return NULL;
+    }
+
+    if (lsdb_data_changed(lsdb, &c->stamp)) {
+        cache_flush(c);
+    }
+
+    if (c->nbuckets) {
+        for (e = c->buckets[hash_did(did, c->nbuckets)]; e; e = e->chain) {
+            if (e->did == did) {
+                lru_unlink(c, e);
+                lru_push(c, e);
+                ds = lsdb_dataset_data_ref(e->ds);
+                break;
+            }
+        }
+    }
+
+    if (ds) {
+        c->nhits++;
+    } else {
+        c->nmisses++;
+    }
+
+    lsdb_cache_unlock(lsdb);
+
+    return ds;
+}
+
+/* keep a reference to a freshly fetched dataset, if it fits */
+void lsdb_cache_put(const lsdb_t *lsdb, int did, lsdb_dataset_data_t *ds)
+{
+    lsdb_cache_t *c = lsdb->cache;
+    cache_entry_t *e;
+    size_t size;
+
+    size = sizeof(lsdb_dataset_data_priv_t) + 2*ds->len*sizeof(double) +
+        sizeof(cache_entry_t);
+    if (((lsdb_dataset_data_priv_t *) ds)->q) {
+        size += LSDB_NQUANTILES*sizeof(double);
+    }
+
+    lsdb_cache_lock(lsdb);
+
+    /* another thread may have put it meanwhile */
+    if (c->nbuckets) {
+        for (e = c->buckets[hash_did(did, c->nbuckets)]; e; e = e->chain) {
+            if (e->did == did) {
+                lsdb_cache_unlock(lsdb);
+                return;
+            }
+        }
+    }
+
+    if (size > c->budget ||
+        (c->count >= c->nbuckets && !cache_grow(c))) {
+        lsdb_cache_unlock(lsdb);
+        return;
+    }
+
+    e = malloc(sizeof(cache_entry_t));
+    if (!e) {
+        lsdb_cache_unlock(lsdb);
+        return;
+    }
+    e->did  = did;
+    e->ds   = lsdb_dataset_data_ref(ds);
+    e->size = size;
+
+    cache_evict(c, c->budget - size);
+
+    e->chain = c->buckets[hash_did(did, c->nbuckets)];
+    c->buckets[hash_did(did, c->nbuckets)] = e;
+    lru_push(c, e);
+
+    c->used += size;
+    c->count++;
+
+    lsdb_cache_unlock(lsdb);
+}
+
+void lsdb_cache_get_stats(const lsdb_t *lsdb, lsdb_stats_t *stats)
+{
+    const lsdb_cache_t *c = lsdb->cache;
+
+    stats->cache_hits      = c->nhits;
+    stats->cache_misses    = c->nmisses;
+    stats->cache_evictions = c->nevictions;
+    stats->cache_bytes     = c->used;
+}
+
+lsdb_morph_cache_t *lsdb_morph_cache_new(size_t size)
+{
+    lsdb_morph_cache_t *mc = calloc(1, sizeof(lsdb_morph_cache_t));
+    if (!mc) {
+        return NULL;
+    }
+
+    if (size) {
+        mc->entries = calloc(size, sizeof(morph_entry_t));
+        if (!mc->entries) {
+            free(mc);
+            return NULL;
+        }
+    }
+    mc->size = size;
+
+    return mc;
+}
+
+static void morph_cache_remove(lsdb_morph_cache_t *mc, size_t i)
+{
+    morph_free(mc->entries[i].p.m);
+    mc->entries[i] = mc->entries[--mc->count];
+}
+
+static void morph_cache_flush(lsdb_morph_cache_t *mc)
+{
+    size_t i = 0;
+
+    while (i < mc->count) {
+        if (mc->entries[i].pins) {
+            mc->entries[i++].stale = true;
+        } else {
+            morph_cache_remove(mc, i);
+        }
+    }
+}
+
+void lsdb_morph_cache_free(lsdb_morph_cache_t *mc)
+{
+    if (mc) {
+        for (size_t i = 0; i < mc->count; i++) {
+            morph_free(mc->entries[i].p.m);
+        }
+        free(mc->entries);
+        free(mc);
+    }
+}
+
+int lsdb_set_morph_cache_size(lsdb_t *lsdb, size_t npairs)
+{
+    lsdb_morph_cache_t *mc;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    lsdb_cache_lock(lsdb);
+
+    for (size_t i = 0; i < lsdb->mcache->count; i++) {
+        if (lsdb->mcache->entries[i].pins) {
+            lsdb_errmsg(lsdb, "Cached morphs are in use\n");
+            lsdb_cache_unlock(lsdb);
+            return LSDB_FAILURE;
+        }
+    }
+
+    mc = lsdb_morph_cache_new(npairs);
+    if (!mc) {
+        lsdb_cache_unlock(lsdb);
+        return LSDB_FAILURE;
+    }
+
+    mc->nhits   = lsdb->mcache->nhits;
+    mc->nmisses = lsdb->mcache->nmisses;
+
+    lsdb_morph_cache_free(lsdb->mcache);
+    lsdb->mcache = mc;
+
+    lsdb_cache_unlock(lsdb);
+
+    return LSDB_SUCCESS;
+}
+
+/*
+ * On success, p refers to the cached morph, which is pinned (i.e., not
+ * evicted) until lsdb_morph_cache_release()
+ */
+bool lsdb_morph_cache_get(const lsdb_t *lsdb,
+    unsigned long didf, unsigned long didg, size_t np, lsdb_morph_pair_t *p)
+{
+    lsdb_morph_cache_t *mc;
+    bool found = false;
+
+    lsdb_cache_lock(lsdb);
+
+    mc = lsdb->mcache;
+    if (!mc->size) {
+        lsdb_cache_unlock(lsdb);
+        return false;
+    }
+
+    if (lsdb_data_changed(lsdb, &mc->stamp)) {
+        morph_cache_flush(mc);
+    }
+
+    for (size_t i = 0; i < mc->count; i++) {
+        morph_entry_t *e = &mc->entries[i];
+        if (!e->stale && e->didf == didf && e->didg == didg && e->np == np) {
+            e->tick = ++mc->tick;
+            e->pins++;
+            *p = e->p;
+            found = true;
+            break;
+        }
+    }
+
+    if (found) {
+        mc->nhits++;
+    } else {
+        mc->nmisses++;
+    }
+
+    lsdb_cache_unlock(lsdb);
+
+    return found;
+}
+
+/* on success, the cache takes over the morph, pinned as by the get */
+bool lsdb_morph_cache_put(const lsdb_t *lsdb,
+    unsigned long didf, unsigned long didg, size_t np,
+    const lsdb_morph_pair_t *p)
+{
+    lsdb_morph_cache_t *mc;
+    morph_entry_t *e = NULL;
+
+    lsdb_cache_lock(lsdb);
+
+    mc = lsdb->mcache;
+
+    /* another thread may have put it meanwhile */
+    for (size_t i = 0; i < mc->count; i++) {
+        morph_entry_t *ei = &mc->entries[i];
+        if (!ei->stale && ei->didf == didf && ei->didg == didg &&
+            ei->np == np) {
+            lsdb_cache_unlock(lsdb);
+            return false;
+        }
+    }
+
+    if (mc->count < mc->size) {
+        e = &mc->entries[mc->count++];
+    } else {
+        /* replace the least recently used one not in use */
+        for (size_t i = 0; i < mc->count; i++) {
+            morph_entry_t *ei = &mc->entries[i];
+            if (!ei->pins && (!e || ei->tick < e->tick)) {
+                e = ei;
+            }
+        }
+        if (e) {
+            morph_free(e->p.m);
+        }
+    }
+
+    if (e) {
+        e->didf  = didf;
+        e->didg  = didg;
+        e->np    = np;
+        e->p     = *p;
+        e->tick  = ++mc->tick;
+        e->pins  = 1;
+        e->stale = false;
+    }
+
+    lsdb_cache_unlock(lsdb);
+
+    return e != NULL;
+}
+
+void lsdb_morph_cache_release(const lsdb_t *lsdb, const lsdb_morph_pair_t *p)
+{
+    lsdb_morph_cache_t *mc;
+
+    lsdb_cache_lock(lsdb);
+
+    mc = lsdb->mcache;
+    for (size_t i = 0; i < mc->count; i++) {
+        morph_entry_t *e = &mc->entries[i];
+        if (e->p.m == p->m) {
+            if (--e->pins == 0 && e->stale) {
+                morph_cache_remove(mc, i);
+            }
+            break;
+        }
+    }
+
+    lsdb_cache_unlock(lsdb);
+}
+
+void lsdb_morph_cache_get_stats(const lsdb_t *lsdb, lsdb_stats_t *stats)
+{
+    const lsdb_morph_cache_t *mc = lsdb->mcache;
+
+    stats->morph_hits   = mc->nhits;
+    stats->morph_misses = mc->nmisses;
+}
@@ -0,0 +1,475 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * In-memory catalog of the radiators and lines, and of the (n, T) limits of
+ * each (mid, eid, lid) triple, with hash indices for the lookups by ID,
+ * radiator symbol and (rid, line name). It is built in a single pass of the
+ * catalog cursor, and rebuilt on the next lookup whenever the data may have
+ * changed. Thread-safe handles share it; lookups take lsdb_rdlock() only,
+ * and lsdb_lock() if it has to be rebuilt first.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <lsdb/lsdbP.h>
+
+/* string members are offsets in the pool */
+typedef struct {
+    unsigned long id;
+    size_t        sym;
+    double        mass;
+} cat_radiator_t;
+
+typedef struct {
+    unsigned long id;
+    unsigned long rid;
+    size_t        name;
+    double        energy;
+    double        mass;
+} cat_line_t;
+
+typedef struct {
+    unsigned long mid, eid, lid;
+    double        nmin, nmax;
+    double        Tmin, Tmax;
+} cat_limits_t;
+
+/* open addressing; slots hold array indices + 1, 0 is empty */
+typedef struct {
+    uint32_t *slots;
+    size_t    nslots;
+} cat_index_t;
+
+struct _lsdb_catalog_t {
+    lsdb_stamp_t stamp;
+    bool         valid;
+
+    cat_radiator_t *radiators;
+    size_t          nradiators, aradiators;
+    cat_line_t     *lines;
+    size_t          nlines, alines;
+    cat_limits_t   *limits;
+    size_t          nlimits, alimits;
+    char           *strings;
+    size_t          strings_size, astrings;
+
+    cat_index_t radiator_by_sym;
+    cat_index_t line_by_id;
+    cat_index_t line_by_name;
+    cat_index_t limits_by_key;
+
+    unsigned long nbuilds;
+};
+
+lsdb_catalog_t *lsdb_catalog_new(void)
+{
+    return calloc(1, sizeof(lsdb_catalog_t));
+}
+
+static void index_free(cat_index_t *idx)
+{
+    free(idx->slots);
+    idx->slots  = NULL;
+    idx->nslots = 0;
+}
+
+static void catalog_flush(lsdb_catalog_t *cat)
+{
+    cat->nradiators   = 0;
+    cat->nlines       = 0;
+    cat->nlimits      = 0;
+    cat->strings_size = 0;
+
+    index_free(&cat->radiator_by_sym);
+    index_free(&cat->line_by_id);
+    index_free(&cat->line_by_name);
+    index_free(&cat->limits_by_key);
+
+    cat->valid = false;
+}
+
+void lsdb_catalog_free(lsdb_catalog_t *cat)
+{
+    if (cat) {
+        catalog_flush(cat);
+        free(cat->radiators);
+        free(cat->lines);
+        free(cat->limits);
+        free(cat->strings);
+        free(cat);
+    }
+}
+
+unsigned long lsdb_catalog_nbuilds(const lsdb_catalog_t *cat)
+{
+    return cat ? cat->nbuilds:0;
+}
+
+static size_t hash_id(unsigned long id)
+{
+    return (size_t) (id*2654435761UL);
+}
+
+/* FNV-1a */
+static size_t hash_str(const char *s)
+{
+    uint32_t h = 2166136261U;
+
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static size_t hash_line_name(unsigned long rid, const char *name)
+{
+    return hash_str(name) ^ hash_id(rid);
+}
+
+static size_t hash_key(unsigned long mid, unsigned long eid, unsigned long lid)
+{
+    return hash_id(mid) ^ hash_id(eid + 0x9e3779b9UL) ^ hash_id(lid << 16);
+}
+
+static int add_string(lsdb_catalog_t *cat, const char *s, size_t *off)
+{
+    return lsdb_add_string(&cat->strings, &cat->strings_size, &cat->astrings,
+        s, off);
+}
+
+static int index_alloc(cat_index_t *idx, size_t n)
+{
+    idx->nslots = 16;
+    while (idx->nslots < 2*n) {
+        idx->nslots *= 2;
+    }
+
+    idx->slots = calloc(idx->nslots, sizeof(uint32_t));
+
+    return idx->slots ? LSDB_SUCCESS:LSDB_FAILURE;
+}
+
+static void index_put(cat_index_t *idx, size_t h, size_t i)
+{
+    size_t mask = idx->nslots - 1;
+
+    h &= mask;
+    while (idx->slots[h]) {
+        h = (h + 1) & mask;
+    }
+    idx->slots[h] = i + 1;
+}
+
+static int add_entry(lsdb_catalog_t *cat, const lsdb_catalog_entry_t *c,
+    double *mass)
+{
+    cat_limits_t *lim;
+
+    switch (c->kind) {
+    case LSDB_CATALOG_RADIATOR:
+        LSDB_APPEND(cat, radiators);
+        cat->radiators[cat->nradiators].id   = c->u.r.id;
+        cat->radiators[cat->nradiators].mass = c->u.r.mass;
+        if (add_string(cat, c->u.r.sym,
+                &cat->radiators[cat->nradiators].sym) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+        cat->nradiators++;
+        *mass = c->u.r.mass;
+        break;
+    case LSDB_CATALOG_LINE:
+        LSDB_APPEND(cat, lines);
+        cat->lines[cat->nlines].id     = c->u.l.id;
+        cat->lines[cat->nlines].rid    = c->rid;
+        cat->lines[cat->nlines].energy = c->u.l.energy;
+        cat->lines[cat->nlines].mass   = *mass;
+        if (add_string(cat, c->u.l.name,
+                &cat->lines[cat->nlines].name) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+        cat->nlines++;
+        break;
+    case LSDB_CATALOG_LINE_PROPERTY:
+        break;
+    case LSDB_CATALOG_DATASET:
+        /* datasets of a line come grouped by (mid, eid) */
+        lim = cat->nlimits ? &cat->limits[cat->nlimits - 1]:NULL;
+        if (!lim || lim->lid != c->lid ||
+            lim->mid != c->u.d.mid || lim->eid != c->u.d.eid) {
+            LSDB_APPEND(cat, limits);
+            lim = &cat->limits[cat->nlimits++];
+            lim->mid  = c->u.d.mid;
+            lim->eid  = c->u.d.eid;
+            lim->lid  = c->lid;
+            lim->nmin = lim->nmax = c->u.d.n;
+            lim->Tmin = lim->Tmax = c->u.d.T;
+        }
+        if (c->u.d.n < lim->nmin) lim->nmin = c->u.d.n;
+        if (c->u.d.n > lim->nmax) lim->nmax = c->u.d.n;
+        if (c->u.d.T < lim->Tmin) lim->Tmin = c->u.d.T;
+        if (c->u.d.T > lim->Tmax) lim->Tmax = c->u.d.T;
+        break;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static int catalog_build(const lsdb_t *lsdb, lsdb_catalog_t *cat)
+{
+    lsdb_catalog_entry_t rows[256];
+    lsdb_cursor_t *cur;
+    double mass = 0.0;
+    size_t i;
+    int n;
+
+    catalog_flush(cat);
+
+    cur = lsdb_cursor_catalog(lsdb);
+    if (!cur) {
+        return LSDB_FAILURE;
+    }
+    while ((n = lsdb_cursor_next(cur, rows, 256)) > 0) {
+        for (int k = 0; k < n; k++) {
+            if (add_entry(cat, &rows[k], &mass) != LSDB_SUCCESS) {
+                lsdb_errmsg(lsdb, "Memory allocation failed\n");
+                lsdb_cursor_close(cur);
+                return LSDB_FAILURE;
+            }
+        }
+    }
+    lsdb_cursor_close(cur);
+    if (n < 0) {
+        return LSDB_FAILURE;
+    }
+
+    if (index_alloc(&cat->radiator_by_sym, cat->nradiators) != LSDB_SUCCESS ||
+        index_alloc(&cat->line_by_id, cat->nlines) != LSDB_SUCCESS ||
+        index_alloc(&cat->line_by_name, cat->nlines) != LSDB_SUCCESS ||
+        index_alloc(&cat->limits_by_key, cat->nlimits) != LSDB_SUCCESS) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        catalog_flush(cat);
+        return LSDB_FAILURE;
+    }
+
+    for (i = 0; i < cat->nradiators; i++) {
+        index_put(&cat->radiator_by_sym,
+            hash_str(cat->strings + cat->radiators[i].sym), i);
+    }
+    for (i = 0; i < cat->nlines; i++) {
+        const cat_line_t *l = &cat->lines[i];
+        index_put(&cat->line_by_id, hash_id(l->id), i);
+        index_put(&cat->line_by_name,
+            hash_line_name(l->rid, cat->strings + l->name), i);
+    }
+    for (i = 0; i < cat->nlimits; i++) {
+        const cat_limits_t *lim = &cat->limits[i];
+        index_put(&cat->limits_by_key, hash_key(lim->mid, lim->eid, lim->lid),
+            i);
+    }
+
+    cat->valid = true;
+    cat->nbuilds++;
+
+    return LSDB_SUCCESS;
+}
+
+/* call under lsdb_lock() */
+static lsdb_catalog_t *catalog_get(const lsdb_t *lsdb)
+{
+    lsdb_catalog_t *cat = lsdb->catalog;
+
+    if (lsdb_data_changed(lsdb, &cat->stamp) || !cat->valid) {
+        if (catalog_build(lsdb, cat) != LSDB_SUCCESS) {
+            return NULL;
+        }
+    }
+
+    return cat;
+}
+
+/*
+ * The current catalog, under lsdb_rdlock() or lsdb_lock(); lsdb_unlock() it
+ * after use. On failure, nothing is held
+ */
+static const lsdb_catalog_t *catalog_acquire(const lsdb_t *lsdb)
+{
+    const lsdb_catalog_t *cat = lsdb->catalog;
+
+    lsdb_rdlock(lsdb);
+    if (cat->valid && !lsdb_data_stale(lsdb, &cat->stamp)) {
+        return cat;
+    }
+    lsdb_unlock(lsdb);
+
+    lsdb_lock(lsdb);
+    cat = catalog_get(lsdb);
+    if (!cat) {
+        lsdb_unlock(lsdb);
+    }
+
+    return cat;
+}
+
+int lsdb_catalog_refresh(const lsdb_t *lsdb)
+{
+    int rc;
+
+    lsdb_lock(lsdb);
+    rc = catalog_get(lsdb) ? LSDB_SUCCESS:LSDB_FAILURE;
+    lsdb_unlock(lsdb);
+
+    return rc;
+}
+
+static const cat_line_t *find_line(const lsdb_catalog_t *cat,
+    unsigned long lid)
+{
+    const cat_index_t *idx = &cat->line_by_id;
+    size_t mask = idx->nslots - 1, h = hash_id(lid) & mask;
+
+    for (; idx->slots[h]; h = (h + 1) & mask) {
+        const cat_line_t *l = &cat->lines[idx->slots[h] - 1];
+        if (l->id == lid) {
+            return l;
+        }
+    }
+
+    return NULL;
+}
+
+int lsdb_catalog_get_line_em(const lsdb_t *lsdb, unsigned long lid,
+    double *energy, double *mass)
+{
+    const lsdb_catalog_t *cat;
+    const cat_line_t *l;
+
+    cat = catalog_acquire(lsdb);
+    if (!cat) {
+        return LSDB_FAILURE;
+    }
+
+    l = find_line(cat, lid);
+    if (l) {
+        *energy = l->energy;
+        *mass   = l->mass;
+    } else {
+        lsdb_errmsg(lsdb, "Line %lu not found\n", lid);
+    }
+
+    lsdb_unlock(lsdb);
+
+    return l ? LSDB_SUCCESS:LSDB_FAILURE;
+}
+
+/* zeros if there are no datasets, as with the SQL query */
+int lsdb_catalog_get_limits(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double *nmin, double *nmax, double *Tmin, double *Tmax)
+{
+    const lsdb_catalog_t *cat;
+    const cat_index_t *idx;
+    size_t mask, h;
+
+    *nmin = *nmax = *Tmin = *Tmax = 0.0;
+
+    cat = catalog_acquire(lsdb);
+    if (!cat) {
+        return LSDB_FAILURE;
+    }
+
+    idx  = &cat->limits_by_key;
+    mask = idx->nslots - 1;
+    for (h = hash_key(mid, eid, lid) & mask; idx->slots[h];
+        h = (h + 1) & mask) {
+        const cat_limits_t *lim = &cat->limits[idx->slots[h] - 1];
+        if (lim->mid == mid && lim->eid == eid && lim->lid == lid) {
+            *nmin = lim->nmin;
+            *nmax = lim->nmax;
+            *Tmin = lim->Tmin;
+            *Tmax = lim->Tmax;
+            break;
+        }
+    }
+
+    lsdb_unlock(lsdb);
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_catalog_find_radiator(const lsdb_t *lsdb, const char *symbol)
+{
+    const lsdb_catalog_t *cat;
+    const cat_index_t *idx;
+    size_t mask, h;
+    int rid = -1;
+
+    cat = catalog_acquire(lsdb);
+    if (!cat) {
+        return -1;
+    }
+
+    idx  = &cat->radiator_by_sym;
+    mask = idx->nslots - 1;
+    for (h = hash_str(symbol) & mask; idx->slots[h]; h = (h + 1) & mask) {
+        const cat_radiator_t *r = &cat->radiators[idx->slots[h] - 1];
+        if (!strcmp(cat->strings + r->sym, symbol)) {
+            rid = r->id;
+            break;
+        }
+    }
+
+    lsdb_unlock(lsdb);
+
+    return rid;
+}
+
+int lsdb_catalog_find_line(const lsdb_t *lsdb,
+    unsigned long rid, const char *name)
+{
+    const lsdb_catalog_t *cat;
+    const cat_index_t *idx;
+    size_t mask, h;
+    int lid = -1;
+
+    cat = catalog_acquire(lsdb);
+    if (!cat) {
+        return -1;
+    }
+
+    idx  = &cat->line_by_name;
+    mask = idx->nslots - 1;
+    for (h = hash_line_name(rid, name) & mask; idx->slots[h];
+        h = (h + 1) & mask) {
+        const cat_line_t *l = &cat->lines[idx->slots[h] - 1];
+        if (l->rid == rid && !strcmp(cat->strings + l->name, name)) {
+            lid = l->id;
+            break;
+        }
+    }
+
+    lsdb_unlock(lsdb);
+
+    return lid;
+}
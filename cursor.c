@@ -0,0 +1,334 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Cursors: pull-style iteration over the entities, returning rows in blocks.
+ * On a DB, a cursor keeps its statement checked out of the statement cache
+ * until exhausted or closed; strings of a block are copied, since SQLite
+ * invalidates them on the next step. Snapshots are handled in lsdbx.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <lsdb/lsdbP.h>
+
+struct _lsdb_str_chunk_t {
+    lsdb_str_chunk_t *next;
+    size_t            size, used;
+    char              data[];
+};
+
+static const lsdb_stmt_id_t cursor_stmt[] = {
+    [LSDB_CURSOR_MODELS]          = LSDB_STMT_GET_MODELS,
+    [LSDB_CURSOR_ENVIRONMENTS]    = LSDB_STMT_GET_ENVIRONMENTS,
+    [LSDB_CURSOR_RADIATORS]       = LSDB_STMT_GET_RADIATORS,
+    [LSDB_CURSOR_LINES]           = LSDB_STMT_GET_LINES,
+    [LSDB_CURSOR_LINE_PROPERTIES] = LSDB_STMT_GET_LINE_PROPERTIES,
+    [LSDB_CURSOR_DATASETS]        = LSDB_STMT_GET_DATASETS,
+    [LSDB_CURSOR_CATALOG]         = LSDB_STMT_GET_CATALOG
+};
+
+static const size_t row_size[] = {
+    [LSDB_CURSOR_MODELS]          = sizeof(lsdb_model_t),
+    [LSDB_CURSOR_ENVIRONMENTS]    = sizeof(lsdb_environment_t),
+    [LSDB_CURSOR_RADIATORS]       = sizeof(lsdb_radiator_t),
+    [LSDB_CURSOR_LINES]           = sizeof(lsdb_line_t),
+    [LSDB_CURSOR_LINE_PROPERTIES] = sizeof(lsdb_line_property_t),
+    [LSDB_CURSOR_DATASETS]        = sizeof(lsdb_dataset_t),
+    [LSDB_CURSOR_CATALOG]         = sizeof(lsdb_catalog_entry_t)
+};
+
+static lsdb_cursor_t *cursor_open(const lsdb_t *lsdb,
+    lsdb_cursor_type_t type, unsigned long parent)
+{
+    lsdb_cursor_t *cur;
+
+    if (!lsdb) {
+        return NULL;
+    }
+
+    cur = calloc(1, sizeof(lsdb_cursor_t));
+    if (!cur) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return NULL;
+    }
+    cur->lsdb   = lsdb;
+    cur->type   = type;
+    cur->parent = parent;
+
+    if (lsdb->snap) {
+        return cur;
+    }
+
+    cur->stmt = lsdb_stmt_acquire(lsdb, cursor_stmt[type]);
+    if (!cur->stmt) {
+        free(cur);
+        return NULL;
+    }
+
+    if (type == LSDB_CURSOR_LINES || type == LSDB_CURSOR_LINE_PROPERTIES ||
+        type == LSDB_CURSOR_DATASETS) {
+        sqlite3_bind_int(cur->stmt, 1, parent);
+    }
+
+    return cur;
+}
+
+lsdb_cursor_t *lsdb_cursor_models(const lsdb_t *lsdb)
+{
+    return cursor_open(lsdb, LSDB_CURSOR_MODELS, 0);
+}
+
+lsdb_cursor_t *lsdb_cursor_environments(const lsdb_t *lsdb)
+{
+    return cursor_open(lsdb, LSDB_CURSOR_ENVIRONMENTS, 0);
+}
+
+lsdb_cursor_t *lsdb_cursor_radiators(const lsdb_t *lsdb)
+{
+    return cursor_open(lsdb, LSDB_CURSOR_RADIATORS, 0);
+}
+
+lsdb_cursor_t *lsdb_cursor_lines(const lsdb_t *lsdb, unsigned long rid)
+{
+    return cursor_open(lsdb, LSDB_CURSOR_LINES, rid);
+}
+
+lsdb_cursor_t *lsdb_cursor_line_properties(const lsdb_t *lsdb,
+    unsigned long lid)
+{
+    return cursor_open(lsdb, LSDB_CURSOR_LINE_PROPERTIES, lid);
+}
+
+lsdb_cursor_t *lsdb_cursor_datasets(const lsdb_t *lsdb, unsigned long lid)
+{
+    return cursor_open(lsdb, LSDB_CURSOR_DATASETS, lid);
+}
+
+lsdb_cursor_t *lsdb_cursor_catalog(const lsdb_t *lsdb)
+{
+    return cursor_open(lsdb, LSDB_CURSOR_CATALOG, 0);
+}
+
+/* keep the largest chunk for the next block */
+static void strs_reset(lsdb_cursor_t *cur)
+{
+    lsdb_str_chunk_t *k = cur->strs;
+
+    if (!k) {
+        return;
+    }
+
+    while (k->next) {
+        lsdb_str_chunk_t *next = k->next->next;
+        free(k->next);
+        k->next = next;
+    }
+    k->used = 0;
+}
+
+static bool strs_copy(lsdb_cursor_t *cur, sqlite3_stmt *stmt, int col,
+    const char **str)
+{
+    const unsigned char *s = sqlite3_column_text(stmt, col);
+    lsdb_str_chunk_t *k = cur->strs;
+    size_t len;
+
+    if (!s) {
+        *str = NULL;
+        return true;
+    }
+
+    len = strlen((const char *) s) + 1;
+    if (!k || k->used + len > k->size) {
+        size_t size = k ? 2*k->size:4096;
+        while (size < len) {
+            size *= 2;
+        }
+
+        k = malloc(sizeof(lsdb_str_chunk_t) + size);
+        if (!k) {
+            return false;
+        }
+        k->next   = cur->strs;
+        k->size   = size;
+        k->used   = 0;
+        cur->strs = k;
+    }
+
+    *str = memcpy(k->data + k->used, s, len);
+    k->used += len;
+
+    return true;
+}
+
+static bool fill_row(lsdb_cursor_t *cur, void *row)
+{
+    sqlite3_stmt *stmt = cur->stmt;
+
+    switch (cur->type) {
+    case LSDB_CURSOR_MODELS:
+        {
+            lsdb_model_t *m = row;
+            m->id = sqlite3_column_int(stmt, 0);
+            return strs_copy(cur, stmt, 1, &m->name) &&
+                   strs_copy(cur, stmt, 2, &m->descr);
+        }
+    case LSDB_CURSOR_ENVIRONMENTS:
+        {
+            lsdb_environment_t *e = row;
+            e->id = sqlite3_column_int(stmt, 0);
+            return strs_copy(cur, stmt, 1, &e->name) &&
+                   strs_copy(cur, stmt, 2, &e->descr);
+        }
+    case LSDB_CURSOR_RADIATORS:
+        {
+            lsdb_radiator_t *r = row;
+            r->id   = sqlite3_column_int   (stmt, 0);
+            r->anum = sqlite3_column_int   (stmt, 2);
+            r->mass = sqlite3_column_double(stmt, 3);
+            r->zsp  = sqlite3_column_int   (stmt, 4);
+            return strs_copy(cur, stmt, 1, &r->sym);
+        }
+    case LSDB_CURSOR_LINES:
+        {
+            lsdb_line_t *l = row;
+            l->id     = sqlite3_column_int   (stmt, 0);
+            l->energy = sqlite3_column_double(stmt, 2);
+            return strs_copy(cur, stmt, 1, &l->name);
+        }
+    case LSDB_CURSOR_LINE_PROPERTIES:
+        {
+            lsdb_line_property_t *p = row;
+            p->id = sqlite3_column_int(stmt, 0);
+            return strs_copy(cur, stmt, 1, &p->name) &&
+                   strs_copy(cur, stmt, 2, &p->value);
+        }
+    case LSDB_CURSOR_DATASETS:
+        {
+            lsdb_dataset_t *d = row;
+            d->id  = sqlite3_column_int   (stmt, 0);
+            d->mid = sqlite3_column_int   (stmt, 1);
+            d->eid = sqlite3_column_int   (stmt, 2);
+            d->n   = sqlite3_column_double(stmt, 3);
+            d->T   = sqlite3_column_double(stmt, 4);
+            return true;
+        }
+    case LSDB_CURSOR_CATALOG:
+        {
+            lsdb_catalog_entry_t *c = row;
+            unsigned long id = sqlite3_column_int(stmt, 3);
+
+            c->kind = sqlite3_column_int(stmt, 0);
+            c->rid  = sqlite3_column_int(stmt, 1);
+            c->lid  = sqlite3_column_int(stmt, 2);
+            switch (c->kind) {
+            case LSDB_CATALOG_RADIATOR:
+                c->u.r.id   = id;
+                c->u.r.anum = sqlite3_column_int   (stmt, 6);
+                c->u.r.zsp  = sqlite3_column_int   (stmt, 7);
+                c->u.r.mass = sqlite3_column_double(stmt, 8);
+                return strs_copy(cur, stmt, 4, &c->u.r.sym);
+            case LSDB_CATALOG_LINE:
+                c->u.l.id     = id;
+                c->u.l.energy = sqlite3_column_double(stmt, 8);
+                return strs_copy(cur, stmt, 4, &c->u.l.name);
+            case LSDB_CATALOG_LINE_PROPERTY:
+                c->u.p.id = id;
+                return strs_copy(cur, stmt, 4, &c->u.p.name) &&
+                       strs_copy(cur, stmt, 5, &c->u.p.value);
+            case LSDB_CATALOG_DATASET:
+                c->u.d.id  = id;
+                c->u.d.mid = sqlite3_column_int   (stmt, 6);
+                c->u.d.eid = sqlite3_column_int   (stmt, 7);
+                c->u.d.n   = sqlite3_column_double(stmt, 8);
+                c->u.d.T   = sqlite3_column_double(stmt, 9);
+                return true;
+            }
+            return false;
+        }
+    }
+
+    return false;
+}
+
+int lsdb_cursor_next(lsdb_cursor_t *cur, void *rows, size_t nrows)
+{
+    const lsdb_t *lsdb;
+    int n = 0;
+
+    if (!cur || !rows) {
+        return -1;
+    }
+    lsdb = cur->lsdb;
+
+    if (nrows > INT_MAX) {
+        nrows = INT_MAX;
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_cursor_next(cur, rows, nrows);
+    }
+
+    strs_reset(cur);
+
+    while (cur->stmt && (size_t) n < nrows) {
+        int rc = sqlite3_step(cur->stmt);
+
+        switch (rc) {
+        case SQLITE_ROW:
+            if (!fill_row(cur, (char *) rows + n*row_size[cur->type])) {
+                lsdb_errmsg(lsdb, "Memory allocation failed\n");
+                return -1;
+            }
+            n++;
+            break;
+        case SQLITE_DONE:
+            /* give the statement back as soon as possible */
+            lsdb_stmt_release(lsdb, cursor_stmt[cur->type], cur->stmt);
+            cur->stmt = NULL;
+            break;
+        default:
+            lsdb_errmsg(lsdb, "SQL error: %s\n",
+                sqlite3_errmsg(sqlite3_db_handle(cur->stmt)));
+            return -1;
+        }
+    }
+
+    return n;
+}
+
+void lsdb_cursor_close(lsdb_cursor_t *cur)
+{
+    if (!cur) {
+        return;
+    }
+
+    if (cur->stmt) {
+        lsdb_stmt_release(cur->lsdb, cursor_stmt[cur->type], cur->stmt);
+    }
+
+    strs_reset(cur);
+    free(cur->strs);
+    free(cur->catalog);
+    free(cur);
+}
@@ -33,7 +33,9 @@
 typedef enum {
     LSDB_ACCESS_RO,
     LSDB_ACCESS_RW,
-    LSDB_ACCESS_INIT
+    LSDB_ACCESS_INIT,
+    /* read-only, with the whole DB loaded into memory on opening */
+    LSDB_ACCESS_RO_MEMORY
 } lsdb_access_t;
 
 typedef enum {
@@ -44,9 +46,91 @@ typedef enum {
     LSDB_UNITS_CUSTOM = 99
 } lsdb_units_t;
 
+/* FFTW planner modes, from the fastest planning to the fastest transforms */
+typedef enum {
+    LSDB_FFT_ESTIMATE,
+    LSDB_FFT_MEASURE,
+    LSDB_FFT_PATIENT
+} lsdb_fft_planner_t;
+
 typedef struct _lsdb_t lsdb_t;
 
+typedef enum {
+    LSDB_TEMP_STORE_DEFAULT,
+    LSDB_TEMP_STORE_FILE,
+    LSDB_TEMP_STORE_MEMORY
+} lsdb_temp_store_t;
+
+typedef enum {
+    LSDB_SYNC_DEFAULT,
+    LSDB_SYNC_OFF,
+    LSDB_SYNC_NORMAL,
+    LSDB_SYNC_FULL
+} lsdb_sync_t;
+
+/* options of lsdb_open_ex(); zero-initialized means the defaults, in [] */
+typedef struct {
+    /*
+     * allow using the handle from several threads at once; each thread reads
+     * through a connection of its own, while writes are serialized [no]
+     */
+    bool threadsafe;
+    /*
+     * switch the DB to write-ahead logging, so that readers and a writer
+     * don't block each other; the mode persists in the file. Needs write
+     * access, ignored otherwise [no]
+     */
+    bool wal;
+    /* ms to wait for other connections' locks [fail at once; 5000 if thread-safe] */
+    int busy_timeout;
+    /* bytes of the file to access memory-mapped [none] */
+    long long mmap_size;
+    /* size of the page cache: pages if positive, KiB if negative [SQLite's] */
+    int cache_size;
+    /* where temporary tables and indices are kept [SQLite's] */
+    lsdb_temp_store_t temp_store;
+    /* how often the writer flushes to the disk [SQLite's, i.e., full] */
+    lsdb_sync_t synchronous;
+    /*
+     * skip SQLite's per-connection mutexes; the connections of a handle are
+     * never used by several threads at once anyway [no]
+     */
+    bool nomutex;
+    /*
+     * read-only access to a file nobody modifies, without any locking;
+     * e.g., for shared filesystems with broken locks [no]
+     */
+    bool immutable;
+    /*
+     * keep the radiators, lines and the (n, T) limits of the datasets in
+     * memory, for the lookups by lsdb_find_*(), lsdb_get_limits() and
+     * lsdb_get_doppler_sigma(); refreshed by the first call after any change
+     * of the DB [no]
+     */
+    bool catalog;
+} lsdb_open_opts_t;
+
 typedef struct _lsdb_interp_t lsdb_interp_t;
+typedef struct _lsdb_interp_ws_t lsdb_interp_ws_t;
+typedef struct _lsdb_line_model_t lsdb_line_model_t;
+
+/* search state of the re-entrant evaluations; zero-initialize before use */
+typedef struct {
+    size_t cache;
+} lsdb_interp_accel_t;
+
+/*
+ * The morph engine transports each dataset onto the next one, and caches the
+ * pair morphs; the quantile engine blends the datasets' quantile functions in
+ * one pass, much cheaper to prepare but limited at the nodes by the
+ * resolution of the quantiles
+ */
+typedef enum {
+    /* successive morphs along n and T */
+    LSDB_INTERP_MORPH,
+    /* bilinear blend of the quantile functions of the cell's datasets */
+    LSDB_INTERP_QUANTILE
+} lsdb_interp_engine_t;
 
 typedef struct {
     unsigned long id;
@@ -96,6 +180,64 @@ typedef struct {
     const char *value;
 } lsdb_line_property_t;
 
+/* input of lsdb_add_datasets_bulk(); did is set to the new ID or -1 */
+typedef struct {
+    unsigned int mid;
+    unsigned int eid;
+    unsigned int lid;
+    double n;
+    double T;
+    const double *x;
+    const double *y;
+    size_t len;
+    int did;
+} lsdb_dataset_desc_t;
+
+typedef struct {
+    unsigned long stmt_prepares;
+    unsigned long stmt_reuses;
+    unsigned long index_builds;
+    unsigned long catalog_builds;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    unsigned long cache_evictions;
+    size_t cache_bytes;
+    unsigned long morph_hits;
+    unsigned long morph_misses;
+    /* of LSDB_ACCESS_RO_MEMORY: seconds taken to load, and the bytes loaded */
+    double load_time;
+    size_t mem_bytes;
+    /* process-wide */
+    unsigned long conv_direct;
+    unsigned long conv_fft;
+    unsigned long conv_padded;
+} lsdb_stats_t;
+
+typedef enum {
+    LSDB_CATALOG_RADIATOR,
+    LSDB_CATALOG_LINE,
+    LSDB_CATALOG_LINE_PROPERTY,
+    LSDB_CATALOG_DATASET
+} lsdb_catalog_kind_t;
+
+/*
+ * row of the catalog dump: each radiator is followed by its lines, and each
+ * line by its properties and then its datasets; rid & lid are of the parents
+ */
+typedef struct {
+    lsdb_catalog_kind_t kind;
+    unsigned long rid;
+    unsigned long lid;
+    union {
+        lsdb_radiator_t      r;
+        lsdb_line_t          l;
+        lsdb_line_property_t p;
+        lsdb_dataset_t       d;
+    } u;
+} lsdb_catalog_entry_t;
+
+typedef struct _lsdb_cursor_t lsdb_cursor_t;
+
 typedef int (*lsdb_model_sink_t)(const lsdb_t *lsdb,
     const lsdb_model_t *m, void *udata);
 typedef int (*lsdb_environment_sink_t)(const lsdb_t *lsdb,
@@ -112,11 +254,31 @@ typedef int (*lsdb_line_property_sink_t)(const lsdb_t *lsdb,
 void lsdb_get_version_numbers(int *major, int *minor, int *nano);
 
 lsdb_t *lsdb_open(const char *fname, lsdb_access_t access);
+lsdb_t *lsdb_open_ex(const char *fname, lsdb_access_t access,
+    const lsdb_open_opts_t *opts);
 void lsdb_close(lsdb_t *lsdb);
 
+int lsdb_export_snapshot(const lsdb_t *lsdb, const char *fname);
+bool lsdb_is_snapshot(const lsdb_t *lsdb);
+
+int lsdb_get_format(const lsdb_t *lsdb);
+int lsdb_upgrade(lsdb_t *lsdb);
+/* store the quantile tables missing in a DB upgraded to format 4 */
+int lsdb_backfill_quantiles(lsdb_t *lsdb);
+
+int lsdb_begin(lsdb_t *lsdb);
+int lsdb_commit(lsdb_t *lsdb);
+int lsdb_rollback(lsdb_t *lsdb);
+
 int lsdb_set_units(lsdb_t *lsdb, lsdb_units_t units);
 lsdb_units_t lsdb_get_units(const lsdb_t *lsdb);
 
+int lsdb_get_stats(const lsdb_t *lsdb, lsdb_stats_t *stats);
+
+int lsdb_set_cache_budget(lsdb_t *lsdb, size_t nbytes);
+size_t lsdb_get_cache_budget(const lsdb_t *lsdb);
+int lsdb_set_morph_cache_size(lsdb_t *lsdb, size_t npairs);
+
 int lsdb_add_model(lsdb_t *lsdb, const char *name, const char *descr);
 int lsdb_get_models(const lsdb_t *lsdb,
     lsdb_model_sink_t sink, void *udata);
@@ -132,12 +294,16 @@ int lsdb_add_radiator(lsdb_t *lsdb,
 int lsdb_get_radiators(const lsdb_t *lsdb,
     lsdb_radiator_sink_t sink, void *udata);
 int lsdb_del_radiator(lsdb_t *lsdb, unsigned long id);
+/* the ID, or -1 if not found */
+int lsdb_find_radiator(const lsdb_t *lsdb, const char *symbol);
 
 int lsdb_add_line(lsdb_t *lsdb,
     unsigned int rid, const char *name, double energy);
 int lsdb_get_lines(const lsdb_t *lsdb, unsigned long rid,
     lsdb_line_sink_t sink, void *udata);
 int lsdb_del_line(lsdb_t *lsdb, unsigned long id);
+/* the ID, or -1 if not found */
+int lsdb_find_line(const lsdb_t *lsdb, unsigned long rid, const char *name);
 
 int lsdb_add_line_property(lsdb_t *lsdb,
     unsigned int lid, const char *name, const char *value);
@@ -149,11 +315,42 @@ int lsdb_add_dataset(lsdb_t *lsdb,
     unsigned int mid, unsigned int eid, unsigned int lid,
     double n, double T,
     const double *x, const double *y, size_t len);
+int lsdb_add_datasets_bulk(lsdb_t *lsdb,
+    lsdb_dataset_desc_t *dsets, size_t count);
 int lsdb_get_datasets(const lsdb_t *lsdb, unsigned long lid,
     lsdb_dataset_sink_t sink, void *udata);
 int lsdb_del_dataset(lsdb_t *lsdb, unsigned long id);
 
+/*
+ * pull-style counterparts of the lsdb_get_*() calls above; lsdb_cursor_next()
+ * fills up to nrows rows of the cursor's type (lsdb_model_t for models etc.)
+ * and returns their number, 0 at the end or -1 on error. Strings of the rows
+ * stay valid until the next call. A cursor must be used by the thread that
+ * opened it, and closed before the handle
+ */
+lsdb_cursor_t *lsdb_cursor_models(const lsdb_t *lsdb);
+lsdb_cursor_t *lsdb_cursor_environments(const lsdb_t *lsdb);
+lsdb_cursor_t *lsdb_cursor_radiators(const lsdb_t *lsdb);
+lsdb_cursor_t *lsdb_cursor_lines(const lsdb_t *lsdb, unsigned long rid);
+lsdb_cursor_t *lsdb_cursor_line_properties(const lsdb_t *lsdb,
+    unsigned long lid);
+lsdb_cursor_t *lsdb_cursor_datasets(const lsdb_t *lsdb, unsigned long lid);
+/* all radiators, lines, line properties & datasets in a single pass */
+lsdb_cursor_t *lsdb_cursor_catalog(const lsdb_t *lsdb);
+int lsdb_cursor_next(lsdb_cursor_t *cur, void *rows, size_t nrows);
+void lsdb_cursor_close(lsdb_cursor_t *cur);
+
+/*
+ * on a snapshot or with the dataset cache enabled, the returned data are
+ * shared and must not be modified
+ */
 lsdb_dataset_data_t *lsdb_get_dataset_data(const lsdb_t *lsdb, int did);
+/*
+ * the same, into x[i*stride] & y[i*stride] of at most maxlen points; returns
+ * the number of points, or -1. x and/or y may be NULL
+ */
+int lsdb_get_dataset_data_into(const lsdb_t *lsdb, int did,
+    double *x, double *y, size_t stride, size_t maxlen);
 void lsdb_dataset_data_free(lsdb_dataset_data_t *ds);
 
 lsdb_dataset_data_t *lsdb_dataset_data_new(double n, double T, size_t len);
@@ -168,9 +365,81 @@ lsdb_interp_t *lsdb_prepare_interpolation(const lsdb_t *lsdb,
 lsdb_dataset_data_t *lsdb_get_interpolation(const lsdb_t *lsdb,
     unsigned int mid, unsigned int eid, unsigned int lid,
     double n, double T, unsigned int len, double sigma, double gamma);
+/*
+ * the same, into x[i*stride] & y[i*stride]; returns len, or -1. The grid is
+ * uniform, from *xmin to *xmax; x, xmin and xmax may be NULL
+ */
+int lsdb_get_interpolation_into(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len, double sigma, double gamma,
+    double *x, double *y, size_t stride, double *xmin, double *xmax);
+int lsdb_get_interpolation_batch(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    const double *n, const double *T, size_t count, unsigned int len,
+    const double *sigma, const double *gamma, double *out);
 void lsdb_interp_free(lsdb_interp_t *interp);
+
+/* of the interpolations prepared with lsdb from now on [LSDB_INTERP_MORPH] */
+int lsdb_set_interp_engine(lsdb_t *lsdb, lsdb_interp_engine_t engine);
+lsdb_interp_engine_t lsdb_get_interp_engine(const lsdb_t *lsdb);
+
+/*
+ * the same, using memory kept in ws, which is only grown; the result belongs
+ * to ws and is valid until the next call with it
+ */
+lsdb_interp_ws_t *lsdb_interp_ws_new(void);
+void lsdb_interp_ws_free(lsdb_interp_ws_t *ws);
+const lsdb_interp_t *lsdb_prepare_interpolation_ws(const lsdb_t *lsdb,
+    lsdb_interp_ws_t *ws,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len);
+
+/*
+ * all datasets of a (mid, eid, lid) triple, loaded in memory at once, for
+ * interpolations without any DB access. A model is read-only once loaded, so
+ * it may be shared by threads, each with its own ws; it doesn't depend on the
+ * handle and isn't updated by later changes of the DB. The interpolation
+ * engine is that of the handle at the time of loading
+ */
+lsdb_line_model_t *lsdb_load_line_model(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid);
+void lsdb_line_model_free(lsdb_line_model_t *lm);
+size_t lsdb_line_model_get_npoints(const lsdb_line_model_t *lm);
+/* whether the (n, T) points form a full rectilinear grid */
+bool lsdb_line_model_is_grid(const lsdb_line_model_t *lm);
+void lsdb_line_model_get_limits(const lsdb_line_model_t *lm,
+    double *nmin, double *nmax, double *Tmin, double *Tmax);
+/* as lsdb_prepare_interpolation_ws(); allocates nothing once ws is warm */
+const lsdb_interp_t *lsdb_line_model_prepare(const lsdb_line_model_t *lm,
+    lsdb_interp_ws_t *ws, double n, double T, unsigned int len);
+/* as lsdb_get_interpolation(), into x & y of len points each */
+int lsdb_line_model_interpolate(const lsdb_line_model_t *lm,
+    lsdb_interp_ws_t *ws, double n, double T, unsigned int len,
+    double sigma, double gamma, double *x, double *y);
+
+lsdb_interp_engine_t lsdb_interp_get_engine(const lsdb_interp_t *interp);
 int lsdb_interp_get_domain(const lsdb_interp_t *interp, double *xmin, double *xmax);
 double lsdb_interp_eval(const lsdb_interp_t *interp, double x, bool normalize);
+void lsdb_interp_eval_array(const lsdb_interp_t *interp,
+    const double *x, double *y, size_t n, bool normalize);
+/*
+ * re-entrant: interp is only read, so it may be shared by threads, each
+ * with its own accelerator (or none, at the cost of a full search per point)
+ */
+double lsdb_interp_eval_r(const lsdb_interp_t *interp, double x,
+    bool normalize, lsdb_interp_accel_t *acc);
+void lsdb_interp_eval_array_r(const lsdb_interp_t *interp,
+    const double *x, double *y, size_t n, bool normalize,
+    lsdb_interp_accel_t *acc);
+
+/* process-wide; see also the LSDB_FFTW_PLANNER and LSDB_FFTW_WISDOM env. vars */
+int lsdb_set_fft_planner(lsdb_fft_planner_t planner);
+int lsdb_import_fft_wisdom(const char *fname);
+int lsdb_export_fft_wisdom(const char *fname);
+void lsdb_fft_cleanup(void);
+
+int lsdb_voigt_conv_batch(double *y, size_t stride, size_t count, size_t len,
+    const double *dx, const double *sigma, const double *gamma);
 
 double lsdb_get_doppler_sigma(const lsdb_t *lsdb, unsigned long lid, double T);
 
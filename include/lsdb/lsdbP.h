@@ -22,33 +22,406 @@
 #define LSDBP_H
 
 #include <stdio.h>
+#include <pthread.h>
 #include <sqlite3.h>
 
 #include <lsdb/lsdb.h>
 #include <lsdb/morph.h>
 
+/* format of newly initialized databases; older ones are still readable */
+#define LSDB_DB_FORMAT              4
+
+/* quantiles stored per dataset (format 4+), at the probabilities k/512 */
+#define LSDB_NQUANTILES             513
+
+/* of the x & y arrays of datasets allocated by the library */
+#define LSDB_DATA_ALIGN             64
+
+/* default number of dataset pairs with their morphs cached */
+#define LSDB_MORPH_CACHE_SIZE       16
+
+/* how long (in ms) connections of thread-safe handles wait for DB locks */
+#define LSDB_BUSY_TIMEOUT           5000
+
 #define LSDB_CONVERT_EV_TO_INV_CM   8065.54394
 #define LSDB_CONVERT_AU_TO_EV       27.2113862
 
+typedef enum {
+    LSDB_STMT_SET_UNITS,
+    LSDB_STMT_ADD_MODEL,
+    LSDB_STMT_GET_MODELS,
+    LSDB_STMT_DEL_MODEL,
+    LSDB_STMT_ADD_ENVIRONMENT,
+    LSDB_STMT_GET_ENVIRONMENTS,
+    LSDB_STMT_DEL_ENVIRONMENT,
+    LSDB_STMT_ADD_RADIATOR,
+    LSDB_STMT_GET_RADIATORS,
+    LSDB_STMT_DEL_RADIATOR,
+    LSDB_STMT_ADD_LINE,
+    LSDB_STMT_GET_LINES,
+    LSDB_STMT_DEL_LINE,
+    LSDB_STMT_ADD_LINE_PROPERTY,
+    LSDB_STMT_GET_LINE_PROPERTIES,
+    LSDB_STMT_DEL_LINE_PROPERTY,
+    LSDB_STMT_ADD_DATASET,
+    LSDB_STMT_ADD_DATA,
+    LSDB_STMT_GET_DATASETS,
+    LSDB_STMT_DEL_DATASET,
+    LSDB_STMT_GET_DATASET_INFO,
+    LSDB_STMT_GET_DATASET_DATA,
+    LSDB_STMT_ADD_DATASET_BLOB,
+    LSDB_STMT_GET_DATASET_BLOB,
+    LSDB_STMT_ADD_DATASET_BLOB_Q,
+    LSDB_STMT_GET_DATASET_BLOB_Q,
+    LSDB_STMT_GET_NO_QUANTILES,
+    LSDB_STMT_SET_QUANTILES,
+    LSDB_STMT_GET_CLOSEST_DIDS,
+    LSDB_STMT_GET_LIMITS,
+    LSDB_STMT_GET_LINE_EM,
+    LSDB_STMT_GET_GRID,
+    LSDB_STMT_DATA_VERSION,
+    LSDB_STMT_GET_CATALOG,
+    LSDB_STMT_FIND_RADIATOR,
+    LSDB_STMT_FIND_LINE,
+
+    LSDB_STMT_NUM
+} lsdb_stmt_id_t;
+
+/* lazily prepared statements, reset and rebound on each use */
+typedef struct {
+    sqlite3_stmt *stmts[LSDB_STMT_NUM];
+    bool          busy[LSDB_STMT_NUM];
+
+    unsigned long nprepared;
+    unsigned long nreused;
+} lsdb_stmt_cache_t;
+
+/*
+ * Per-thread state of thread-safe handles: each thread reads through its own
+ * read-only connection, opened on the first use. When the thread exits, the
+ * state is returned to the handle's pool, to be taken over by another thread.
+ */
+typedef struct _lsdb_thread_t lsdb_thread_t;
+typedef struct _lsdb_mt_t lsdb_mt_t;
+
+struct _lsdb_thread_t {
+    sqlite3           *db;
+    lsdb_stmt_cache_t  sc;
+    lsdb_interp_ws_t  *ws;
+
+    /* depth of the write lock held */
+    unsigned int       nwrite;
+    /* of db, as of the last lsdb_sync() */
+    long long          data_version;
+
+    lsdb_mt_t         *mt;
+    /* all of the pool, and the free ones */
+    lsdb_thread_t     *next, *next_free;
+};
+
+/*
+ * Writes go through the primary connection under wlock, which also makes the
+ * calling thread use that connection for reading until released. The index
+ * and the catalog are protected by slock, which their lookups only take for
+ * reading; the caches by clock, and the pool by plock. The locks may only be
+ * taken in this order
+ */
+struct _lsdb_mt_t {
+    /* to open further connections with */
+    char            *fname;
+    int              oflags;
+    lsdb_open_opts_t opts;
+
+    pthread_mutex_t  wlock;
+    pthread_rwlock_t slock;
+    pthread_mutex_t  clock;
+    pthread_mutex_t  plock;
+
+    pthread_key_t    key;
+    lsdb_thread_t   *threads, *free_threads;
+};
+
+/* read-only binary snapshot, see lsdbx.c */
+typedef struct _lsdbx_t lsdbx_t;
+
+/* state of the DB data as seen by a cached structure */
+typedef struct {
+    unsigned long gen;
+} lsdb_stamp_t;
+
+/* per-handle cache of decoded datasets, see cache.c */
+typedef struct _lsdb_cache_t lsdb_cache_t;
+
+/* per-handle cache of morphs between dataset pairs, see cache.c */
+typedef struct _lsdb_morph_cache_t lsdb_morph_cache_t;
+
+typedef struct {
+    morph_t *m;
+    double   nf, Tf;
+    double   ng, Tg;
+} lsdb_morph_pair_t;
+
+/* the datasets of a cell, as in lsdb_get_closest_dids(), by their quantiles */
+typedef struct {
+    const double *q[4];
+    double        norm[4];
+    double        n[4], T[4];
+} lsdb_qcell_t;
+
+/* per-handle catalog of the radiators, lines & dataset limits, see catalog.c */
+typedef struct _lsdb_catalog_t lsdb_catalog_t;
+
+/* per-handle spatial index of the (n, T) grids, see spindex.c */
+typedef struct _lsdb_spindex_t lsdb_spindex_t;
+
+typedef struct {
+    unsigned long id;
+    double n, T;
+} lsdb_grid_point_t;
+
+/* see cursor.c */
+typedef enum {
+    LSDB_CURSOR_MODELS,
+    LSDB_CURSOR_ENVIRONMENTS,
+    LSDB_CURSOR_RADIATORS,
+    LSDB_CURSOR_LINES,
+    LSDB_CURSOR_LINE_PROPERTIES,
+    LSDB_CURSOR_DATASETS,
+    LSDB_CURSOR_CATALOG
+} lsdb_cursor_type_t;
+
+typedef struct _lsdb_str_chunk_t lsdb_str_chunk_t;
+
+struct _lsdb_cursor_t {
+    const lsdb_t       *lsdb;
+    lsdb_cursor_type_t  type;
+    /* rid or lid of the rows, if any */
+    unsigned long       parent;
+
+    /* NULL once exhausted */
+    sqlite3_stmt       *stmt;
+    /* copies of the strings of the last block */
+    lsdb_str_chunk_t   *strs;
+
+    /* of a snapshot: the next row; the catalog is built on the first use */
+    size_t                pos;
+    lsdb_catalog_entry_t *catalog;
+    size_t                ncatalog;
+};
+
+/*
+ * lsdb_dataset_data_t wrapper; views don't own the x & y arrays, nor the
+ * LSDB_NQUANTILES quantiles that come along if stored
+ */
+typedef struct {
+    lsdb_dataset_data_t ds;
+    bool                owner;
+    /* the allocation x & y are aligned within, if owned */
+    void               *block;
+    unsigned int        refcount;
+    double             *q;
+    double              norm;
+} lsdb_dataset_data_priv_t;
+
 struct _lsdb_t {
     sqlite3     *db;
+    lsdbx_t     *snap;
     int          db_format;
     lsdb_units_t units;
+    lsdb_interp_engine_t engine;
+
+    lsdb_stmt_cache_t *sc;
+    lsdb_spindex_t    *si;
+    /* NULL unless enabled */
+    lsdb_catalog_t    *catalog;
+    lsdb_cache_t      *cache;
+    lsdb_morph_cache_t *mcache;
+    /* scratch memory of the interpolations */
+    lsdb_interp_ws_t   *ws;
+
+    /*
+     * bumped by each write that may change the datasets or the catalog, and
+     * by lsdb_sync() on the commits of other connections; written under
+     * both slock and clock, so that either suffices for reading
+     */
+    unsigned long gen;
+    /* of db, as of the last lsdb_sync() */
+    long long     data_version;
+
+    /* NULL unless thread-safe */
+    lsdb_mt_t *mt;
+
+    /* of LSDB_ACCESS_RO_MEMORY */
+    double load_time;
+    size_t mem_bytes;
 
     void *udata;
 };
 
 struct _lsdb_interp_t {
-    morph_t *morph;
-    double   t;
+    lsdb_interp_engine_t engine;
+    /* LSDB_INTERP_MORPH: the morph along T, at t */
+    morph_t    *morph;
+    double      t;
+    /* LSDB_INTERP_QUANTILE */
+    qprofile_t *qp;
+};
+
+struct _lsdb_interp_ws_t {
+    morph_workspace_t *mws;
+    /* for the two intermediate profiles */
+    double *work;
+    size_t  work_len;
+    /* the blended and the computed quantiles, (1 + 4)*LSDB_NQUANTILES */
+    double *qwork;
+    /* the result of lsdb_prepare_interpolation_ws() */
+    lsdb_interp_t interp;
+
+    /* pair morphs of the cell of a line model used last, see linemodel.c */
+    lsdb_morph_pair_t pairs[2];
+    unsigned long     pairs_serial;
+    size_t            pairs_cell[4];
 };
 
 void lsdb_errmsg(const lsdb_t *lsdb, const char *fmt, ...);
 
+void *lsdb_grow(void *p, size_t n, size_t *nalloc, size_t size);
+int lsdb_add_string(char **strings, size_t *size, size_t *nalloc,
+    const char *s, size_t *off);
+
+/*
+ * Make room for one more element of s->what[s->nwhat] of s->awhat allocated;
+ * returns LSDB_FAILURE from the calling function if out of memory
+ */
+#define LSDB_APPEND(s, what) do { \
+    void *p_ = lsdb_grow((s)->what, (s)->n##what, &(s)->a##what, \
+        sizeof(*(s)->what)); \
+    if (!p_) { \
+        return LSDB_FAILURE; \
+    } \
+    (s)->what = p_; \
+} while (0)
+
+int lsdb_write_lock(const lsdb_t *lsdb);
+void lsdb_write_unlock(const lsdb_t *lsdb);
+void lsdb_lock(const lsdb_t *lsdb);
+void lsdb_rdlock(const lsdb_t *lsdb);
+void lsdb_unlock(const lsdb_t *lsdb);
+void lsdb_cache_lock(const lsdb_t *lsdb);
+void lsdb_cache_unlock(const lsdb_t *lsdb);
+void lsdb_bump_gen(const lsdb_t *lsdb);
+void lsdb_sync(const lsdb_t *lsdb);
+sqlite3 *lsdb_db(const lsdb_t *lsdb);
+lsdb_interp_ws_t *lsdb_thread_ws(const lsdb_t *lsdb);
+
+sqlite3_stmt *lsdb_stmt_acquire(const lsdb_t *lsdb, lsdb_stmt_id_t sid);
+void lsdb_stmt_release(const lsdb_t *lsdb, lsdb_stmt_id_t sid,
+    sqlite3_stmt *stmt);
+
 int lsdb_get_closest_dids(const lsdb_t *lsdb,
     unsigned int mid, unsigned int eid, unsigned int lid,
     double n, double T,
     unsigned long *did1, unsigned long *did2,
     unsigned long *did3, unsigned long *did4);
+int lsdb_get_closest_dids_sql(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T,
+    unsigned long *did1, unsigned long *did2,
+    unsigned long *did3, unsigned long *did4);
+
+int lsdb_get_grid(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    lsdb_grid_point_t **pts, size_t *npts);
+lsdb_dataset_data_t *lsdb_fetch_dataset_data(const lsdb_t *lsdb, int did);
+int lsdb_get_data_version(const lsdb_t *lsdb, long long *data_version);
+bool lsdb_data_changed(const lsdb_t *lsdb, lsdb_stamp_t *stamp);
+bool lsdb_data_stale(const lsdb_t *lsdb, const lsdb_stamp_t *stamp);
+
+lsdb_cache_t *lsdb_cache_new(void);
+void lsdb_cache_free(lsdb_cache_t *c);
+lsdb_dataset_data_t *lsdb_cache_get(const lsdb_t *lsdb, int did);
+void lsdb_cache_put(const lsdb_t *lsdb, int did, lsdb_dataset_data_t *ds);
+void lsdb_cache_get_stats(const lsdb_t *lsdb, lsdb_stats_t *stats);
+
+lsdb_morph_cache_t *lsdb_morph_cache_new(size_t size);
+void lsdb_morph_cache_free(lsdb_morph_cache_t *mc);
+bool lsdb_morph_cache_get(const lsdb_t *lsdb,
+    unsigned long didf, unsigned long didg, size_t np, lsdb_morph_pair_t *p);
+bool lsdb_morph_cache_put(const lsdb_t *lsdb,
+    unsigned long didf, unsigned long didg, size_t np,
+    const lsdb_morph_pair_t *p);
+void lsdb_morph_cache_release(const lsdb_t *lsdb, const lsdb_morph_pair_t *p);
+void lsdb_morph_cache_get_stats(const lsdb_t *lsdb, lsdb_stats_t *stats);
+
+lsdb_catalog_t *lsdb_catalog_new(void);
+void lsdb_catalog_free(lsdb_catalog_t *cat);
+unsigned long lsdb_catalog_nbuilds(const lsdb_catalog_t *cat);
+int lsdb_catalog_refresh(const lsdb_t *lsdb);
+int lsdb_catalog_get_line_em(const lsdb_t *lsdb, unsigned long lid,
+    double *energy, double *mass);
+int lsdb_catalog_get_limits(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double *nmin, double *nmax, double *Tmin, double *Tmax);
+int lsdb_catalog_find_radiator(const lsdb_t *lsdb, const char *symbol);
+int lsdb_catalog_find_line(const lsdb_t *lsdb,
+    unsigned long rid, const char *name);
+
+lsdb_interp_t *lsdb_interp_ws_prepare(lsdb_interp_ws_t *ws,
+    lsdb_interp_engine_t engine, unsigned int len);
+bool lsdb_interp_from_pairs(const lsdb_t *lsdb, lsdb_interp_ws_t *ws,
+    const lsdb_morph_pair_t *p12, const lsdb_morph_pair_t *p43,
+    double n, double T, unsigned int len, lsdb_interp_t *interp);
+bool lsdb_interp_from_qcell(const lsdb_t *lsdb, lsdb_interp_ws_t *ws,
+    const lsdb_qcell_t *c, double n, double T, lsdb_interp_t *interp);
+int lsdb_fill_interpolation(const lsdb_t *lsdb, const lsdb_interp_t *interp,
+    unsigned int len, double sigma, double gamma, double *xi, double *yi);
+
+lsdb_spindex_t *lsdb_spindex_new(void);
+void lsdb_spindex_free(lsdb_spindex_t *si);
+unsigned long lsdb_spindex_nbuilds(const lsdb_spindex_t *si);
+int lsdb_spindex_get_closest_dids(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T,
+    unsigned long *did1, unsigned long *did2,
+    unsigned long *did3, unsigned long *did4);
+
+int lsdb_voigt_conv(double *y, size_t n, double dx, double sigma, double gamma);
+void lsdb_fft_save_wisdom(void);
+void lsdb_voigt_get_stats(lsdb_stats_t *stats);
+
+lsdb_dataset_data_t *lsdb_dataset_data_view(double n, double T, size_t len,
+    const double *x, const double *y);
+lsdb_dataset_data_t *lsdb_dataset_data_ref(lsdb_dataset_data_t *ds);
+const double *lsdb_dataset_data_quantiles(const lsdb_dataset_data_t *ds,
+    double *norm);
+
+bool lsdbx_probe(const char *fname);
+lsdbx_t *lsdbx_open(lsdb_t *lsdb, const char *fname, bool load);
+void lsdbx_close(lsdbx_t *x);
+
+int lsdbx_get_models(const lsdb_t *lsdb,
+    lsdb_model_sink_t sink, void *udata);
+int lsdbx_get_environments(const lsdb_t *lsdb,
+    lsdb_environment_sink_t sink, void *udata);
+int lsdbx_get_radiators(const lsdb_t *lsdb,
+    lsdb_radiator_sink_t sink, void *udata);
+int lsdbx_get_lines(const lsdb_t *lsdb, unsigned long rid,
+    lsdb_line_sink_t sink, void *udata);
+int lsdbx_get_line_properties(const lsdb_t *lsdb, unsigned long lid,
+    lsdb_line_property_sink_t sink, void *udata);
+int lsdbx_get_datasets(const lsdb_t *lsdb, unsigned long lid,
+    lsdb_dataset_sink_t sink, void *udata);
+lsdb_dataset_data_t *lsdbx_get_dataset_data(const lsdb_t *lsdb, int did);
+int lsdbx_cursor_next(lsdb_cursor_t *cur, void *rows, size_t nrows);
+int lsdbx_get_grid(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    lsdb_grid_point_t **pts, size_t *npts);
+int lsdbx_get_limits(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double *nmin, double *nmax, double *Tmin, double *Tmax);
+int lsdbx_get_line_em(const lsdb_t *lsdb, unsigned long lid,
+    double *energy, double *mass);
+int lsdbx_find_radiator(const lsdb_t *lsdb, const char *symbol);
+int lsdbx_find_line(const lsdb_t *lsdb, unsigned long rid, const char *name);
 
 #endif /* LSDBP_H */
@@ -21,9 +21,17 @@
 #ifndef MORPH_H
 #define MORPH_H
 
+#include <stddef.h>
 #include <stdbool.h>
 
 typedef struct _morph_t morph_t;
+typedef struct _morph_workspace_t morph_workspace_t;
+typedef struct _qprofile_t qprofile_t;
+
+/* search state of the evaluations; zero-initialize before use */
+typedef struct {
+    size_t cache;
+} morph_accel_t;
 
 morph_t *morph_new(size_t np);
 void morph_free(morph_t *m);
@@ -32,8 +40,47 @@ bool morph_init(morph_t *m,
     const double *xf, const double *yf, size_t lenf,
     const double *xg, const double *yg, size_t leng);
 
+/* the scratch memory of morph_init(), kept between calls */
+morph_workspace_t *morph_workspace_new(void);
+void morph_workspace_free(morph_workspace_t *ws);
+
+bool morph_init_ws(morph_t *m, morph_workspace_t *ws,
+    const double *xf, const double *yf, size_t lenf,
+    const double *xg, const double *yg, size_t leng);
+
+/* from the quantile functions of the profiles, see morph.c */
+bool morph_get_quantiles(morph_workspace_t *ws,
+    const double *x, const double *y, size_t len,
+    double *q, size_t nq, double *norm);
+bool morph_init_q_ws(morph_t *m, morph_workspace_t *ws,
+    const double *xf, const double *yf, size_t lenf,
+    const double *qf, double norm_f,
+    const double *qg, double norm_g, size_t nq);
+
+/* the profile of a quantile function, see morph.c */
+qprofile_t *qprofile_new(void);
+void qprofile_free(qprofile_t *qp);
+bool qprofile_init(qprofile_t *qp, const double *q, size_t nq, double norm);
+double qprofile_eval(const qprofile_t *qp, double x, bool normalize);
+void qprofile_eval_array(const qprofile_t *qp,
+    const double *x, double *y, size_t n, bool normalize);
+double qprofile_eval_r(const qprofile_t *qp, double x, bool normalize,
+    morph_accel_t *acc);
+void qprofile_eval_array_r(const qprofile_t *qp,
+    const double *x, double *y, size_t n, bool normalize, morph_accel_t *acc);
+bool qprofile_get_domain(const qprofile_t *qp, double *xmin, double *xmax);
+
 double morph_eval(const morph_t *m, double t, double x, bool normalize);
+void morph_eval_array(const morph_t *m, double t,
+    const double *x, double *y, size_t n, bool normalize);
+
+/* re-entrant; acc may be NULL */
+double morph_eval_r(const morph_t *m, double t, double x, bool normalize,
+    morph_accel_t *acc);
+void morph_eval_array_r(const morph_t *m, double t,
+    const double *x, double *y, size_t n, bool normalize, morph_accel_t *acc);
 
 bool morph_get_domain(const morph_t *m, double *xmin, double *xmax);
+size_t morph_get_size(const morph_t *m);
 
 #endif  /* MORPH_H */
@@ -22,26 +22,47 @@
 #define MORPHP_H
 
 #include <stddef.h>
-#include <gsl/gsl_spline.h>
+#include <gsl/gsl_interp.h>
 
 #include <lsdb/morph.h>
 
+/*
+ * Steffen's monotonic spline, same as gsl_interp_steffen, but with storage
+ * that is only grown, and with the coefficients at hand
+ */
+typedef struct {
+    size_t n, alloc;
+    double *x;
+    /* d, c, b, a of each interval: y = d + dx*(c + dx*(b + dx*a)) */
+    double *c;
+} steffen_t;
+
 struct _morph_t {
     size_t np;
-    gsl_spline *spline_f, *spline_M;
-    gsl_interp_accel *acc_f, *acc_M;
+    steffen_t f;
+    morph_accel_t *acc_f;
     double xmin, xmax;
     double norm_f, norm_g;
+    /* M on the uniform grid of np points */
+    steffen_t M;
+    double h_inv;
 };
 
-typedef struct {
-    gsl_spline *spline_g, *spline_f_inv;
-    gsl_interp_accel *acc_g, *acc_f_inv;
+/* the CDF through the quantiles, with the probabilities as scratch */
+struct _qprofile_t {
+    steffen_t F;
+    morph_accel_t *acc;
+    double norm;
+    double *p;
+    size_t p_alloc;
+};
+
+struct _morph_workspace_t {
+    size_t alloc;
     double *F, *G;
     double *x, *M;
-} morph_aux_t;
-
-morph_aux_t *morph_aux_new(size_t np);
-void morph_aux_free(morph_aux_t *m);
+    steffen_t g, f_inv;
+    morph_accel_t acc_g, acc_f_inv;
+};
 
 #endif  /* MORPHP_H */
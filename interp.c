@@ -19,8 +19,10 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
 #include <math.h>
-#include <fftw3.h>
 
 #include <lsdb/lsdbP.h>
 #include <lsdb/morph.h>
@@ -28,7 +30,6 @@
 double lsdb_get_doppler_sigma(const lsdb_t *lsdb, unsigned long lid, double T)
 {
     sqlite3_stmt *stmt;
-    const char *sql;
     int rc;
 
     double sigma = 0.0;
@@ -37,11 +38,22 @@ double lsdb_get_doppler_sigma(const lsdb_t *lsdb, unsigned long lid, double T)
         return 0.0;
     }
 
-    sql = "SELECT l.energy, r.mass " \
-          " FROM lines AS l INNER JOIN radiators AS r ON (r.id = l.rid)" \
-          " WHERE l.id = ?";
+    lsdb_sync(lsdb);
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    if (lsdb->catalog || lsdb->snap) {
+        double energy, mass;
+        if ((lsdb->catalog ?
+                lsdb_catalog_get_line_em(lsdb, lid, &energy, &mass):
+                lsdbx_get_line_em(lsdb, lid, &energy, &mass)) == LSDB_SUCCESS) {
+            sigma = 3.265e-5*energy*sqrt(T/mass);
+        }
+        return sigma;
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_LINE_EM);
+    if (!stmt) {
+        return 0.0;
+    }
 
     sqlite3_bind_int(stmt, 1, lid);
 
@@ -52,229 +64,924 @@ double lsdb_get_doppler_sigma(const lsdb_t *lsdb, unsigned long lid, double T)
 
         sigma = 3.265e-5*energy*sqrt(T/mass);
     } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
     }
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_LINE_EM, stmt);
 
     return sigma;
 }
 
-/* convolution with a Voigt function; original data are replaced! */
-static int voigt_conv(double *y, size_t n, double dx, double sigma, double gamma)
+/* with the stored quantiles of both datasets, if any */
+static bool morph_datasets(morph_t *m, morph_workspace_t *mws,
+    const lsdb_dataset_data_t *dsf, const lsdb_dataset_data_t *dsg)
 {
-    size_t i;
-    fftw_plan xplan, zplan;
-    double *yf;
+    const double *qf, *qg;
+    double norm_f, norm_g;
+
+    qf = lsdb_dataset_data_quantiles(dsf, &norm_f);
+    qg = lsdb_dataset_data_quantiles(dsg, &norm_g);
+    if (qf && qg) {
+        return morph_init_q_ws(m, mws, dsf->x, dsf->y, dsf->len,
+            qf, norm_f, qg, norm_g, LSDB_NQUANTILES);
+    } else {
+        return morph_init_ws(m, mws, dsf->x, dsf->y, dsf->len,
+                                     dsg->x, dsg->y, dsg->len);
+    }
+}
 
-    yf = malloc(sizeof(double)*n);
-    if (!yf) {
-        return LSDB_FAILURE;
+/*
+ * The morph between two datasets, from the cache if possible; if the morph
+ * couldn't be cached, owned is set. Either way, put_pair_morph() it after use
+ */
+static bool get_pair_morph(const lsdb_t *lsdb, morph_workspace_t *mws,
+    unsigned long didf, unsigned long didg, unsigned int len,
+    lsdb_morph_pair_t *p, bool *owned)
+{
+    lsdb_dataset_data_t *dsf, *dsg;
+    bool OK = false;
+
+    *owned = false;
+
+    if (lsdb_morph_cache_get(lsdb, didf, didg, len, p)) {
+        return true;
     }
 
-    xplan = fftw_plan_r2r_1d(n, y, yf, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftw_execute(xplan);
-    fftw_destroy_plan(xplan);
+    dsf = lsdb_fetch_dataset_data(lsdb, didf);
+    dsg = lsdb_fetch_dataset_data(lsdb, didg);
 
-    for (i = 0; i < n; i++) {
-        /* 2 due to symmetry - we use half-length FFT */
-        double t = 2*M_PI*i/(2*(n - 1)*dx);
-        yf[i] *= exp(-gamma*t - sigma*sigma*t*t/2)/(2*(n - 1));
+    if (dsf && dsg) {
+        p->m = morph_new(len);
+        if (p->m && morph_datasets(p->m, mws, dsf, dsg)) {
+            p->nf = dsf->n;
+            p->Tf = dsf->T;
+            p->ng = dsg->n;
+            p->Tg = dsg->T;
+
+            if (!lsdb_morph_cache_put(lsdb, didf, didg, len, p)) {
+                *owned = true;
+            }
+            OK = true;
+        } else {
+            lsdb_errmsg(lsdb, "Morphing failed\n");
+            morph_free(p->m);
+        }
+    } else {
+        lsdb_errmsg(lsdb, "Failed fetching dataset(s)\n");
     }
 
-    zplan = fftw_plan_r2r_1d(n, yf, y, FFTW_REDFT00, FFTW_ESTIMATE);
-    fftw_execute(zplan);
-    fftw_destroy_plan(zplan);
+    lsdb_dataset_data_free(dsf);
+    lsdb_dataset_data_free(dsg);
 
-    free(yf);
+    return OK;
+}
 
-    return LSDB_SUCCESS;
+static void put_pair_morph(const lsdb_t *lsdb, lsdb_morph_pair_t *p,
+    bool owned)
+{
+    if (owned) {
+        morph_free(p->m);
+    } else {
+        lsdb_morph_cache_release(lsdb, p);
+    }
 }
 
+/* evaluate the morph on a uniform grid over its domain */
+static void eval_on_grid(const morph_t *m, double t, unsigned int len,
+    double *xm, double *ym)
+{
+    /* the morph may be shared via the cache; leave it untouched */
+    morph_accel_t acc = {0};
+    double xmin, xmax;
 
-lsdb_interp_t *lsdb_prepare_interpolation(const lsdb_t *lsdb,
-    unsigned int mid, unsigned int eid, unsigned int lid,
-    double n, double T, unsigned int len)
+    morph_get_domain(m, &xmin, &xmax);
+
+    for (unsigned int i = 0; i < len; i++) {
+        double x = xmin + i*(xmax - xmin)/(len - 1);
+        /* safety check against rounding error */
+        if (x > xmax) {
+            x = xmax;
+        }
+
+        xm[i] = x;
+    }
+
+    morph_eval_array_r(m, t, xm, ym, len, false, &acc);
+}
+
+/* n-direction parameter of a pair of datasets and the corresponding T */
+static double path_t(double nf, double Tf, double ng, double Tg, double n,
+    double *Tm)
 {
-    long unsigned did1, did2, did3, did4;
-    int rc;
-    bool OK = true;
-    lsdb_interp_t *interp = NULL;
+    double t;
 
-    rc = lsdb_get_closest_dids(lsdb, mid, eid, lid, n, T, &did1, &did2, &did3, &did4);
-    if (rc == LSDB_SUCCESS) {
-        lsdb_dataset_data_t *ds1, *ds2, *ds3, *ds4;
+    if (nf == ng) {
+        t = 0.0;
+    } else {
+        t = sqrt(log(n/nf)/log(ng/nf));
+    }
+    *Tm = Tf*pow(Tg/Tf, t*t);
 
-        ds1 = lsdb_get_dataset_data(lsdb, did1);
-        ds2 = lsdb_get_dataset_data(lsdb, did2);
-        ds3 = lsdb_get_dataset_data(lsdb, did3);
-        ds4 = lsdb_get_dataset_data(lsdb, did4);
+    return t;
+}
 
-        if (ds1 && ds2 && ds3 && ds4) {
-            double n1 = ds1->n, n2 = ds2->n, n3 = ds3->n, n4 = ds4->n;
-            double T1 = ds1->T, T2 = ds2->T, T3 = ds3->T, T4 = ds4->T;
-            double xmin, xmax, t;
-            double Tm1, Tm2;
-            double *xm1, *xm2, *ym1, *ym2;
-            double x, r;
+static double pair_t(const lsdb_morph_pair_t *p, double n, double *Tm)
+{
+    return path_t(p->nf, p->Tf, p->ng, p->Tg, n, Tm);
+}
 
-            morph_t *m = morph_new(len);
+/* T-direction parameter between the two n-direction ones */
+static double cross_t(double Tm1, double Tm2, double T)
+{
+    if (Tm1 == Tm2) {
+        return 0.0;
+    } else {
+        return sqrt(log(T/Tm1)/log(Tm2/Tm1));
+    }
+}
 
-            xm1 = malloc(len*sizeof(double));
-            xm2 = malloc(len*sizeof(double));
-            ym1 = malloc(len*sizeof(double));
-            ym2 = malloc(len*sizeof(double));
+lsdb_interp_ws_t *lsdb_interp_ws_new(void)
+{
+    lsdb_interp_ws_t *ws = calloc(1, sizeof(lsdb_interp_ws_t));
+    if (!ws) {
+        return NULL;
+    }
 
-            morph_init(m, ds1->x, ds1->y, ds1->len,
-                ds2->x, ds2->y, ds2->len);
+    ws->mws = morph_workspace_new();
+    if (!ws->mws) {
+        free(ws);
+        return NULL;
+    }
 
-            morph_get_domain(m, &xmin, &xmax);
+    return ws;
+}
 
-            if (n1 == n2) {
-                t = 0.0;
-            } else {
-                t = sqrt(log(n/n1)/log(n2/n1));
-            }
-            Tm1 = T1*pow(T2/T1, t*t);
-
-            for (unsigned int i = 0; i < len; i++) {
-                x = xmin + i*(xmax - xmin)/(len - 1);
-                /* safety check against rounding error */
-                if (x > xmax) {
-                    x = xmax;
-                }
-                r = morph_eval(m, t, x, false);
-
-                xm1[i] = x;
-                ym1[i] = r;
-            }
+void lsdb_interp_ws_free(lsdb_interp_ws_t *ws)
+{
+    if (ws) {
+        morph_workspace_free(ws->mws);
+        morph_free(ws->interp.morph);
+        qprofile_free(ws->interp.qp);
+        morph_free(ws->pairs[0].m);
+        morph_free(ws->pairs[1].m);
+        free(ws->work);
+        free(ws->qwork);
+        free(ws);
+    }
+}
 
-            morph_init(m, ds4->x, ds4->y, ds4->len,
-                ds3->x, ds3->y, ds3->len);
+/* scratch for interpolations of len points */
+static bool ws_reserve(lsdb_interp_ws_t *ws, unsigned int len)
+{
+    if (4*len > ws->work_len) {
+        double *work = realloc(ws->work, 4*len*sizeof(double));
+        if (!work) {
+            return false;
+        }
+        ws->work     = work;
+        ws->work_len = 4*len;
+    }
 
-            morph_get_domain(m, &xmin, &xmax);
+    return true;
+}
 
-            if (n3 == n4) {
-                t = 0.0;
-            } else {
-                t = sqrt(log(n/n4)/log(n3/n4));
-            }
-            Tm2 = T4*pow(T3/T4, t*t);
-
-            for (unsigned int i = 0; i < len; i++) {
-                x = xmin + i*(xmax - xmin)/(len - 1);
-                /* safety check against rounding error */
-                if (x > xmax) {
-                    x = xmax;
-                }
-                r = morph_eval(m, t, x, false);
-
-                xm2[i] = x;
-                ym2[i] = r;
-            }
+/* scratch for the quantiles of a cell; of fixed size */
+static bool ws_reserve_q(lsdb_interp_ws_t *ws)
+{
+    if (!ws->qwork) {
+        ws->qwork = malloc((1 + 4)*LSDB_NQUANTILES*sizeof(double));
+    }
 
-            morph_init(m, xm1, ym1, len, xm2, ym2, len);
+    return ws->qwork != NULL;
+}
 
-            morph_get_domain(m, &xmin, &xmax);
+/*
+ * the result of the next ws-based preparation, with scratch for len points
+ * or for the quantiles, depending on the engine
+ */
+lsdb_interp_t *lsdb_interp_ws_prepare(lsdb_interp_ws_t *ws,
+    lsdb_interp_engine_t engine, unsigned int len)
+{
+    ws->interp.engine = engine;
 
-            if (Tm1 == Tm2) {
-                t = 0.0;
-            } else {
-                t = sqrt(log(T/Tm1)/log(Tm2/Tm1));
-            }
+    if (engine == LSDB_INTERP_QUANTILE) {
+        if (!ws->interp.qp) {
+            ws->interp.qp = qprofile_new();
+        }
+        if (!ws->interp.qp || !ws_reserve_q(ws)) {
+            return NULL;
+        }
 
-            interp = malloc(sizeof(lsdb_interp_t));
-            interp->morph = m;
-            interp->t     = t;
+        return &ws->interp;
+    }
 
-            free(xm1);
-            free(xm2);
-            free(ym1);
-            free(ym2);
-        } else {
+    if (ws->interp.morph && morph_get_size(ws->interp.morph) != len) {
+        morph_free(ws->interp.morph);
+        ws->interp.morph = NULL;
+    }
+    if (!ws->interp.morph) {
+        ws->interp.morph = morph_new(len);
+        if (!ws->interp.morph) {
+            return NULL;
+        }
+    }
+
+    if (!ws_reserve(ws, len)) {
+        return NULL;
+    }
+
+    return &ws->interp;
+}
+
+/*
+ * Morph along n at the lower (p12) and upper (p43) T of the cell, then along
+ * T between the two, into interp, the morph of which must be of len points
+ */
+bool lsdb_interp_from_pairs(const lsdb_t *lsdb, lsdb_interp_ws_t *ws,
+    const lsdb_morph_pair_t *p12, const lsdb_morph_pair_t *p43,
+    double n, double T, unsigned int len, lsdb_interp_t *interp)
+{
+    double *xm1 = ws->work, *ym1 = xm1 + len, *xm2 = ym1 + len, *ym2 = xm2 + len;
+    double t, Tm1, Tm2;
+
+    t = pair_t(p12, n, &Tm1);
+    eval_on_grid(p12->m, t, len, xm1, ym1);
+
+    t = pair_t(p43, n, &Tm2);
+    eval_on_grid(p43->m, t, len, xm2, ym2);
+
+    if (!morph_init_ws(interp->morph, ws->mws,
+            xm1, ym1, len, xm2, ym2, len)) {
+        lsdb_errmsg(lsdb, "Morphing failed\n");
+        return false;
+    }
+
+    interp->t = cross_t(Tm1, Tm2, T);
+
+    return true;
+}
+
+/* q = w[0]*q1 + ... + w[3]*q4, in a loop the compiler may vectorize */
+static void blend_quantiles(double *restrict q,
+    const double *restrict q1, const double *restrict q2,
+    const double *restrict q3, const double *restrict q4,
+    const double w[4], size_t nq)
+{
+    double w1 = w[0], w2 = w[1], w3 = w[2], w4 = w[3];
+
+    for (size_t k = 0; k < nq; k++) {
+        q[k] = w1*q1[k] + w2*q2[k] + w3*q3[k] + w4*q4[k];
+    }
+}
+
+/*
+ * The width of a quantile function of LSDB_NQUANTILES, as the range between
+ * its 1/16 and 15/16 quantiles. Unlike the interquartile range, it takes in
+ * much of the wings
+ */
+static double qwidth(const double *q)
+{
+    return q[15*(LSDB_NQUANTILES - 1)/16] - q[(LSDB_NQUANTILES - 1)/16];
+}
+
+/*
+ * The displacement parameter equivalent to the morph one t between profiles
+ * of widths w1 and w2: the morphs interpolate the inverse transport map, so
+ * for profiles differing in scale only, the inverse width is linear in t
+ */
+static double displacement_t(double t, double w1, double w2)
+{
+    if (!(w1 > 0) || !(w2 > 0)) {
+        return t;
+    }
+
+    return t/(t + (w2/w1)*(1 - t));
+}
+
+/*
+ * Displacement interpolation in 1-D is linear in the quantile functions, so
+ * the quantiles of the cell's datasets are blended at once, bilinearly in the
+ * n- and T-direction parameters of the morphs converted as above; as are the
+ * integrals. The widths are taken as qwidth()s. The profile is
+ * the derivative of the resulting CDF. Where the datasets are not on a
+ * rectilinear grid, the two n-direction parameters differ
+ */
+bool lsdb_interp_from_qcell(const lsdb_t *lsdb, lsdb_interp_ws_t *ws,
+    const lsdb_qcell_t *c, double n, double T, lsdb_interp_t *interp)
+{
+    double t12, t43, tT, Tm1, Tm2, w12, w43, w[4], norm = 0.0;
+    double w1 = qwidth(c->q[0]), w2 = qwidth(c->q[1]);
+    double w3 = qwidth(c->q[2]), w4 = qwidth(c->q[3]);
+
+    t12 = path_t(c->n[0], c->T[0], c->n[1], c->T[1], n, &Tm1);
+    t43 = path_t(c->n[3], c->T[3], c->n[2], c->T[2], n, &Tm2);
+    tT  = cross_t(Tm1, Tm2, T);
+
+    t12 = displacement_t(t12, w1, w2);
+    t43 = displacement_t(t43, w4, w3);
+    w12 = (1 - t12)*w1 + t12*w2;
+    w43 = (1 - t43)*w4 + t43*w3;
+    tT  = displacement_t(tT, w12, w43);
+
+    w[0] = (1 - tT)*(1 - t12);
+    w[1] = (1 - tT)*t12;
+    w[2] = tT*t43;
+    w[3] = tT*(1 - t43);
+
+    blend_quantiles(ws->qwork, c->q[0], c->q[1], c->q[2], c->q[3],
+        w, LSDB_NQUANTILES);
+    for (int k = 0; k < 4; k++) {
+        norm += w[k]*c->norm[k];
+    }
+
+    if (!qprofile_init(interp->qp, ws->qwork, LSDB_NQUANTILES, norm)) {
+        lsdb_errmsg(lsdb, "Quantile interpolation failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * The quantiles of the datasets did[4] into c, computed into the scratch of
+ * ws unless stored; put_qcell() the datasets after use
+ */
+static bool get_qcell(const lsdb_t *lsdb, lsdb_interp_ws_t *ws,
+    const unsigned long did[4], lsdb_qcell_t *c, lsdb_dataset_data_t *ds[4])
+{
+    for (int k = 0; k < 4; k++) {
+        ds[k] = NULL;
+    }
+
+    for (int k = 0; k < 4; k++) {
+        ds[k] = lsdb_fetch_dataset_data(lsdb, did[k]);
+        if (!ds[k]) {
             lsdb_errmsg(lsdb, "Failed fetching dataset(s)\n");
-            OK = false;
+            return false;
+        }
+        c->n[k] = ds[k]->n;
+        c->T[k] = ds[k]->T;
+
+        c->q[k] = lsdb_dataset_data_quantiles(ds[k], &c->norm[k]);
+        if (!c->q[k]) {
+            double *q = ws->qwork + (1 + k)*LSDB_NQUANTILES;
+
+            if (!morph_get_quantiles(ws->mws, ds[k]->x, ds[k]->y, ds[k]->len,
+                    q, LSDB_NQUANTILES, &c->norm[k])) {
+                lsdb_errmsg(lsdb, "Failed computing quantiles\n");
+                return false;
+            }
+            c->q[k] = q;
+        }
+    }
+
+    return true;
+}
+
+static void put_qcell(lsdb_dataset_data_t *ds[4])
+{
+    for (int k = 0; k < 4; k++) {
+        lsdb_dataset_data_free(ds[k]);
+    }
+}
+
+static bool prepare_interpolation(const lsdb_t *lsdb, lsdb_interp_ws_t *ws,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len, lsdb_interp_t *interp)
+{
+    long unsigned did[4];
+    lsdb_morph_pair_t p12, p43;
+    bool owned12 = false, owned43 = false;
+    bool OK = false;
+    int rc;
+
+    rc = lsdb_get_closest_dids(lsdb, mid, eid, lid, n, T,
+        &did[0], &did[1], &did[2], &did[3]);
+    if (rc != LSDB_SUCCESS) {
+        return false;
+    }
+
+    if (interp->engine == LSDB_INTERP_QUANTILE) {
+        lsdb_dataset_data_t *ds[4];
+        lsdb_qcell_t c;
+
+        if (!ws || !ws_reserve_q(ws)) {
+            lsdb_errmsg(lsdb, "Memory allocation failed\n");
+            return false;
         }
 
-        lsdb_dataset_data_free(ds1);
-        lsdb_dataset_data_free(ds2);
-        lsdb_dataset_data_free(ds3);
-        lsdb_dataset_data_free(ds4);
+        if (get_qcell(lsdb, ws, did, &c, ds)) {
+            OK = lsdb_interp_from_qcell(lsdb, ws, &c, n, T, interp);
+        }
+        put_qcell(ds);
+
+        return OK;
+    }
+
+    if (!ws || !ws_reserve(ws, len)) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return false;
+    }
+
+    if (get_pair_morph(lsdb, ws->mws, did[0], did[1], len, &p12, &owned12)) {
+        if (get_pair_morph(lsdb, ws->mws, did[3], did[2], len, &p43, &owned43)) {
+            OK = lsdb_interp_from_pairs(lsdb, ws, &p12, &p43, n, T, len,
+                interp);
+
+            put_pair_morph(lsdb, &p43, owned43);
+        }
+
+        put_pair_morph(lsdb, &p12, owned12);
+    }
+
+    return OK;
+}
+
+lsdb_interp_t *lsdb_prepare_interpolation(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len)
+{
+    lsdb_interp_t *interp;
+
+    if (!lsdb) {
+        return NULL;
+    }
+
+    interp = calloc(1, sizeof(lsdb_interp_t));
+    if (!interp) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return NULL;
+    }
+    interp->engine = lsdb->engine;
+    if (interp->engine == LSDB_INTERP_QUANTILE) {
+        interp->qp = qprofile_new();
     } else {
-        OK = false;
+        interp->morph = morph_new(len);
     }
 
-    return OK ? interp:NULL;
+    lsdb_sync(lsdb);
+
+    if ((!interp->morph && !interp->qp) ||
+        !prepare_interpolation(lsdb, lsdb_thread_ws(lsdb),
+            mid, eid, lid, n, T, len, interp)) {
+        lsdb_interp_free(interp);
+        return NULL;
+    }
+
+    return interp;
+}
+
+static const lsdb_interp_t *prepare_interpolation_ws(const lsdb_t *lsdb,
+    lsdb_interp_ws_t *ws,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len)
+{
+    lsdb_interp_t *interp;
+
+    interp = lsdb_interp_ws_prepare(ws, lsdb->engine, len);
+    if (!interp) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return NULL;
+    }
+
+    if (!prepare_interpolation(lsdb, ws, mid, eid, lid, n, T, len, interp)) {
+        return NULL;
+    }
+
+    return interp;
+}
+
+/* no memory is allocated once ws has served the same len */
+const lsdb_interp_t *lsdb_prepare_interpolation_ws(const lsdb_t *lsdb,
+    lsdb_interp_ws_t *ws,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len)
+{
+    if (!lsdb || !ws) {
+        return NULL;
+    }
+
+    lsdb_sync(lsdb);
+
+    return prepare_interpolation_ws(lsdb, ws, mid, eid, lid, n, T, len);
 }
 
 void lsdb_interp_free(lsdb_interp_t *interp)
 {
     if (interp) {
         morph_free(interp->morph);
+        qprofile_free(interp->qp);
         free(interp);
     }
 }
 
+int lsdb_set_interp_engine(lsdb_t *lsdb, lsdb_interp_engine_t engine)
+{
+    if (!lsdb || (engine != LSDB_INTERP_MORPH &&
+                  engine != LSDB_INTERP_QUANTILE)) {
+        return LSDB_FAILURE;
+    }
+
+    lsdb->engine = engine;
+
+    return LSDB_SUCCESS;
+}
+
+lsdb_interp_engine_t lsdb_get_interp_engine(const lsdb_t *lsdb)
+{
+    return lsdb->engine;
+}
+
+lsdb_interp_engine_t lsdb_interp_get_engine(const lsdb_interp_t *interp)
+{
+    return interp->engine;
+}
+
 int lsdb_interp_get_domain(const lsdb_interp_t *interp, double *xmin, double *xmax)
 {
-    if (interp && morph_get_domain(interp->morph, xmin, xmax)) {
-        return LSDB_SUCCESS;
-    } else {
+    bool OK;
+
+    if (!interp) {
         return LSDB_FAILURE;
     }
+
+    if (interp->engine == LSDB_INTERP_QUANTILE) {
+        OK = qprofile_get_domain(interp->qp, xmin, xmax);
+    } else {
+        OK = morph_get_domain(interp->morph, xmin, xmax);
+    }
+
+    return OK ? LSDB_SUCCESS:LSDB_FAILURE;
 }
 
 double lsdb_interp_eval(const lsdb_interp_t *interp, double x, bool normalize)
 {
-    return morph_eval(interp->morph, interp->t, x, normalize);
+    if (interp->engine == LSDB_INTERP_QUANTILE) {
+        return qprofile_eval(interp->qp, x, normalize);
+    } else {
+        return morph_eval(interp->morph, interp->t, x, normalize);
+    }
+}
+
+/* same as lsdb_interp_eval() at n points, preferably sorted */
+void lsdb_interp_eval_array(const lsdb_interp_t *interp,
+    const double *x, double *y, size_t n, bool normalize)
+{
+    if (interp->engine == LSDB_INTERP_QUANTILE) {
+        qprofile_eval_array(interp->qp, x, y, n, normalize);
+    } else {
+        morph_eval_array(interp->morph, interp->t, x, y, n, normalize);
+    }
+}
+
+double lsdb_interp_eval_r(const lsdb_interp_t *interp, double x,
+    bool normalize, lsdb_interp_accel_t *acc)
+{
+    morph_accel_t macc, *pacc = NULL;
+    double r;
+
+    if (acc) {
+        macc.cache = acc->cache;
+        pacc = &macc;
+    }
+
+    if (interp->engine == LSDB_INTERP_QUANTILE) {
+        r = qprofile_eval_r(interp->qp, x, normalize, pacc);
+    } else {
+        r = morph_eval_r(interp->morph, interp->t, x, normalize, pacc);
+    }
+
+    if (acc) {
+        acc->cache = macc.cache;
+    }
+
+    return r;
+}
+
+void lsdb_interp_eval_array_r(const lsdb_interp_t *interp,
+    const double *x, double *y, size_t n, bool normalize,
+    lsdb_interp_accel_t *acc)
+{
+    morph_accel_t macc, *pacc = NULL;
+
+    if (acc) {
+        macc.cache = acc->cache;
+        pacc = &macc;
+    }
+
+    if (interp->engine == LSDB_INTERP_QUANTILE) {
+        qprofile_eval_array_r(interp->qp, x, y, n, normalize, pacc);
+    } else {
+        morph_eval_array_r(interp->morph, interp->t, x, y, n, normalize, pacc);
+    }
+
+    if (acc) {
+        acc->cache = macc.cache;
+    }
+}
+
+/* evaluate the interpolation on a uniform grid and convolve */
+int lsdb_fill_interpolation(const lsdb_t *lsdb, const lsdb_interp_t *interp,
+    unsigned int len, double sigma, double gamma, double *xi, double *yi)
+{
+    double xmin, xmax, dx;
+
+    lsdb_interp_get_domain(interp, &xmin, &xmax);
+
+    dx = (xmax - xmin)/(len - 1);
+    for (unsigned int i = 0; i < len; i++) {
+        double x = xmin + i*dx;
+        /* safety check against rounding error */
+        if (x > xmax) {
+            x = xmax;
+        }
+
+        xi[i] = x;
+    }
+    lsdb_interp_eval_array(interp, xi, yi, len, false);
+
+    if (sigma > 0.0 || gamma > 0.0) {
+        if (lsdb_voigt_conv(yi, len, dx, sigma, gamma) != LSDB_SUCCESS) {
+            lsdb_errmsg(lsdb, "Convolution failed\n");
+            return LSDB_FAILURE;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static int get_interpolation_into(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len, double sigma, double gamma,
+    double *x, double *y, size_t stride, double *xmin, double *xmax)
+{
+    const lsdb_interp_t *interp;
+    lsdb_interp_ws_t *ws;
+    double *xi, *yi;
+
+    ws = lsdb_thread_ws(lsdb);
+    if (!ws) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return -1;
+    }
+
+    interp = prepare_interpolation_ws(lsdb, ws, mid, eid, lid, n, T, len);
+    if (!interp) {
+        return -1;
+    }
+
+    /* the intermediate profiles in the scratch are no longer needed */
+    if (!ws_reserve(ws, len)) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return -1;
+    }
+    xi = (x && stride == 1) ? x:ws->work;
+    yi = stride == 1 ? y:ws->work + len;
+
+    if (lsdb_fill_interpolation(lsdb, interp, len, sigma, gamma,
+            xi, yi) != LSDB_SUCCESS) {
+        return -1;
+    }
+
+    if (stride != 1) {
+        for (unsigned int i = 0; i < len; i++) {
+            if (x) {
+                x[i*stride] = xi[i];
+            }
+            y[i*stride] = yi[i];
+        }
+    }
+
+    if (xmin) {
+        *xmin = xi[0];
+    }
+    if (xmax) {
+        *xmax = xi[len - 1];
+    }
+
+    return len;
+}
+
+/*
+ * With the per-thread workspace, so nothing is allocated once it is warm. The
+ * grid is uniform; x may be NULL, its ends are in xmin & xmax if not NULL. A
+ * strided y is convolved in the scratch first
+ */
+int lsdb_get_interpolation_into(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T, unsigned int len, double sigma, double gamma,
+    double *x, double *y, size_t stride, double *xmin, double *xmax)
+{
+    if (!lsdb || !y || len < 2 || len > INT_MAX || stride == 0) {
+        return -1;
+    }
+
+    lsdb_sync(lsdb);
+
+    return get_interpolation_into(lsdb, mid, eid, lid, n, T, len, sigma, gamma,
+        x, y, stride, xmin, xmax);
 }
 
 lsdb_dataset_data_t *lsdb_get_interpolation(const lsdb_t *lsdb,
     unsigned int mid, unsigned int eid, unsigned int lid,
     double n, double T, unsigned int len, double sigma, double gamma)
 {
+    lsdb_dataset_data_t *dsi;
+
+    if (!lsdb || len < 2 || len > INT_MAX) {
+        return NULL;
+    }
+
+    dsi = lsdb_dataset_data_new(n, T, len);
+    if (!dsi) {
+        lsdb_errmsg(lsdb, "Failed allocating dataset\n");
+        return NULL;
+    }
+
+    lsdb_sync(lsdb);
+
+    if (get_interpolation_into(lsdb, mid, eid, lid, n, T, len,
+            sigma, gamma, dsi->x, dsi->y, 1, NULL, NULL) < 0) {
+        lsdb_dataset_data_free(dsi);
+        return NULL;
+    }
+
+    return dsi;
+}
+
+typedef struct {
+    size_t        idx;
+    unsigned long did[4];
+} batch_item_t;
+
+static int batch_item_cmp(const void *a, const void *b)
+{
+    const batch_item_t *ia = a, *ib = b;
+
+    for (int k = 0; k < 4; k++) {
+        if (ia->did[k] != ib->did[k]) {
+            return ia->did[k] < ib->did[k] ? -1:1;
+        }
+    }
+
+    return (ia->idx > ib->idx) - (ia->idx < ib->idx);
+}
+
+/*
+ * Interpolate for many (n, T) points at once. The points are processed grouped
+ * by their grid cells, so that each cell's datasets are fetched and morphed
+ * once. For the i-th point, x and y are written to out[2*i*len] and
+ * out[(2*i + 1)*len], respectively; out must hold 2*count*len doubles. sigma
+ * and gamma may be NULL. Points that fail are zeroed. The convolutions are
+ * done for all the points together at the end.
+ */
+int lsdb_get_interpolation_batch(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    const double *n, const double *T, size_t count, unsigned int len,
+    const double *sigma, const double *gamma, double *out)
+{
+    lsdb_interp_ws_t *ws;
+    batch_item_t *items;
+    lsdb_interp_t interp;
+    double *dx;
+    size_t i, j;
     bool OK = true;
-    lsdb_dataset_data_t *dsi = NULL;
-    lsdb_interp_t *interp;
 
-    interp = lsdb_prepare_interpolation(lsdb, mid, eid, lid, n, T, len);
-    if (interp != NULL) {
-        dsi = lsdb_dataset_data_new(n, T, len);
+    if (!lsdb || !n || !T || !out || len < 2) {
+        return LSDB_FAILURE;
+    }
+
+    /* out is of 2*count*len doubles */
+    if (count > SIZE_MAX/(2*len*sizeof(double)) ||
+        count > SIZE_MAX/sizeof(batch_item_t)) {
+        lsdb_errmsg(lsdb, "Too many points in a batch\n");
+        return LSDB_FAILURE;
+    }
+
+    ws    = lsdb_thread_ws(lsdb);
+    items = malloc((count ? count:1)*sizeof(batch_item_t));
+    dx    = calloc(count ? count:1, sizeof(double));
+    memset(&interp, 0, sizeof(lsdb_interp_t));
+    interp.engine = lsdb->engine;
+    if (interp.engine == LSDB_INTERP_QUANTILE) {
+        interp.qp = qprofile_new();
+    } else {
+        interp.morph = morph_new(len);
+    }
+    if (!ws || !items || !dx || (!interp.morph && !interp.qp) ||
+        !(interp.qp ? ws_reserve_q(ws):ws_reserve(ws, len))) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        free(items);
+        free(dx);
+        morph_free(interp.morph);
+        qprofile_free(interp.qp);
+        return LSDB_FAILURE;
+    }
+
+    lsdb_sync(lsdb);
 
-        if (dsi) {
-            double xmin, xmax;
-            double x, r;
+    memset(out, 0, 2*count*len*sizeof(double));
 
-            lsdb_interp_get_domain(interp, &xmin, &xmax);
+    for (i = 0; i < count; i++) {
+        batch_item_t *it = &items[i];
 
-            double dx = (xmax - xmin)/(len - 1);
-            for (unsigned int i = 0; i < len; i++) {
-                x = xmin + i*dx;
-                /* safety check against rounding error */
-                if (x > xmax) {
-                    x = xmax;
-                }
-                r = lsdb_interp_eval(interp, x, false);
+        it->idx = i;
+        if (lsdb_get_closest_dids(lsdb, mid, eid, lid, n[i], T[i],
+                &it->did[0], &it->did[1], &it->did[2], &it->did[3])
+            != LSDB_SUCCESS) {
+            it->did[0] = it->did[1] = it->did[2] = it->did[3] = 0;
+            OK = false;
+        }
+    }
+
+    qsort(items, count, sizeof(batch_item_t), batch_item_cmp);
+
+    for (i = 0; i < count; i = j) {
+        const unsigned long *did = items[i].did;
+        lsdb_morph_pair_t p12, p43;
+        bool owned12 = false, owned43 = false;
+        lsdb_dataset_data_t *ds[4];
+        lsdb_qcell_t c;
+        bool cell_OK = false;
+
+        /* the group of points sharing the cell */
+        for (j = i + 1; j < count &&
+            !memcmp(items[j].did, did, sizeof(items[j].did)); j++) {
+            ;
+        }
 
-                dsi->x[i] = x;
-                dsi->y[i] = r;
+        if (did[0] == 0) {
+            continue;
+        }
+
+        if (interp.engine == LSDB_INTERP_QUANTILE) {
+            if (get_qcell(lsdb, ws, did, &c, ds)) {
+                cell_OK = true;
+            } else {
+                put_qcell(ds);
             }
+        } else
+        if (get_pair_morph(lsdb, ws->mws,
+                did[0], did[1], len, &p12, &owned12)) {
+            if (get_pair_morph(lsdb, ws->mws,
+                    did[3], did[2], len, &p43, &owned43)) {
+                cell_OK = true;
+            } else {
+                put_pair_morph(lsdb, &p12, owned12);
+            }
+        }
+        if (!cell_OK) {
+            OK = false;
+            continue;
+        }
+
+        for (size_t k = i; k < j; k++) {
+            size_t idx = items[k].idx;
+            double *xi = out + 2*idx*len, *yi = xi + len;
+            bool point_OK;
 
-            if (OK && (sigma > 0.0 || gamma > 0.0)) {
-                if (voigt_conv(dsi->y, len, dx, sigma, gamma) != LSDB_SUCCESS) {
-                    lsdb_errmsg(lsdb, "Convolution failed\n");
-                    OK = false;
-                }
+            if (interp.engine == LSDB_INTERP_QUANTILE) {
+                point_OK = lsdb_interp_from_qcell(lsdb, ws, &c,
+                    n[idx], T[idx], &interp);
+            } else {
+                point_OK = lsdb_interp_from_pairs(lsdb, ws, &p12, &p43,
+                    n[idx], T[idx], len, &interp);
+            }
+            if (!point_OK) {
+                OK = false;
+                continue;
             }
+
+            if (lsdb_fill_interpolation(lsdb, &interp, len, 0.0, 0.0,
+                    xi, yi) == LSDB_SUCCESS) {
+                double xmin, xmax;
+                lsdb_interp_get_domain(&interp, &xmin, &xmax);
+                dx[idx] = (xmax - xmin)/(len - 1);
+            } else {
+                memset(xi, 0, 2*len*sizeof(double));
+                OK = false;
+            }
+        }
+
+        if (interp.engine == LSDB_INTERP_QUANTILE) {
+            put_qcell(ds);
         } else {
-            lsdb_errmsg(lsdb, "Failed allocating dataset\n");
-            OK = false;
+            put_pair_morph(lsdb, &p12, owned12);
+            put_pair_morph(lsdb, &p43, owned43);
         }
+    }
 
-        lsdb_interp_free(interp);
-    } else {
+    /* the zeroed spectra of failed points are not affected */
+    if ((sigma || gamma) && lsdb_voigt_conv_batch(out + len, 2*len, count, len,
+            dx, sigma, gamma) != LSDB_SUCCESS) {
+        lsdb_errmsg(lsdb, "Convolution failed\n");
         OK = false;
     }
 
-    return OK ? dsi:NULL;
+    free(items);
+    free(dx);
+    morph_free(interp.morph);
+    qprofile_free(interp.qp);
+
+    return OK ? LSDB_SUCCESS:LSDB_FAILURE;
 }
@@ -0,0 +1,546 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Line models: all datasets of a (mid, eid, lid) triple in a single block of
+ * memory. If the (n, T) points form a full rectilinear grid, the cell of a
+ * query is found by per-axis bucket tables in expected O(1) time; otherwise,
+ * by a scan doing the same quadrant search as lsdb_get_closest_dids(). The
+ * pair morphs of the last cell are kept in the interpolation workspace; with
+ * LSDB_INTERP_QUANTILE, the quantiles of all the datasets are in the model.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <lsdb/lsdbP.h>
+#include <lsdb/morph.h>
+
+typedef struct {
+    unsigned long did;
+    double        n, T;
+    size_t        len;
+    /*
+     * in the arena; q (LSDB_NQUANTILES) is NULL unless stored, or computed
+     * for LSDB_INTERP_QUANTILE
+     */
+    const double *x, *y, *q;
+    double        norm;
+} lm_point_t;
+
+/*
+ * distinct values, ascending; values in buckets below k, in the log scale,
+ * are in v[0, bucket[k])
+ */
+typedef struct {
+    double *v;
+    size_t  nv;
+
+    size_t *bucket;
+    size_t  nbuckets;
+    double  lmin, lscale;
+} lm_axis_t;
+
+struct _lsdb_line_model_t {
+    unsigned int mid, eid, lid;
+    lsdb_interp_engine_t engine;
+    /* tells models apart in the workspaces */
+    unsigned long serial;
+
+    lm_point_t *pts;
+    size_t      npts;
+    double     *arena;
+
+    double nmin, nmax;
+    double Tmin, Tmax;
+
+    /* of a full grid, the point at (n[i], T[j]) is pts[cell[j*an.nv + i]] */
+    bool      grid;
+    lm_axis_t an, aT;
+    size_t   *cell;
+};
+
+static unsigned long lm_serial;
+static pthread_mutex_t lm_serial_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int dbl_cmp(const void *a, const void *b)
+{
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return (da > db) - (da < db);
+}
+
+static size_t axis_bucket(const lm_axis_t *a, double x)
+{
+    double b = (log(x) - a->lmin)*a->lscale;
+
+    if (!(b > 0)) {
+        return 0;
+    } else
+    if (b >= a->nbuckets) {
+        return a->nbuckets - 1;
+    } else {
+        return (size_t) b;
+    }
+}
+
+static bool axis_build(lm_axis_t *a, const lm_point_t *pts, size_t npts,
+    bool along_n)
+{
+    size_t i, nv;
+
+    a->v = malloc(npts*sizeof(double));
+    if (!a->v) {
+        return false;
+    }
+    for (i = 0; i < npts; i++) {
+        a->v[i] = along_n ? pts[i].n:pts[i].T;
+    }
+    qsort(a->v, npts, sizeof(double), dbl_cmp);
+    for (i = 1, nv = 1; i < npts; i++) {
+        if (a->v[i] != a->v[nv - 1]) {
+            a->v[nv++] = a->v[i];
+        }
+    }
+    a->nv = nv;
+
+    /* the bucket search needs logs; the binary one does without */
+    if (!(a->v[0] > 0)) {
+        return true;
+    }
+
+    a->nbuckets = 2*nv;
+    a->bucket = calloc(a->nbuckets + 1, sizeof(size_t));
+    if (!a->bucket) {
+        return false;
+    }
+    a->lmin = log(a->v[0]);
+    if (nv > 1) {
+        a->lscale = a->nbuckets/(log(a->v[nv - 1]) - a->lmin);
+    }
+    for (i = 0; i < nv; i++) {
+        a->bucket[axis_bucket(a, a->v[i]) + 1]++;
+    }
+    for (i = 1; i <= a->nbuckets; i++) {
+        a->bucket[i] += a->bucket[i - 1];
+    }
+
+    return true;
+}
+
+/* indices of the largest value <= x and the smallest >= x */
+static bool axis_find(const lm_axis_t *a, double x, size_t *lo, size_t *hi)
+{
+    size_t i;
+
+    if (!(x >= a->v[0] && x <= a->v[a->nv - 1])) {
+        return false;
+    }
+
+    if (a->bucket) {
+        /* axis_bucket() is monotonic, so these are all below x */
+        i = a->bucket[axis_bucket(a, x)];
+        while (a->v[i] <= x && i < a->nv - 1) {
+            i++;
+        }
+    } else {
+        size_t l = 0, h = a->nv - 1;
+        while (h - l > 1) {
+            size_t m = l + (h - l)/2;
+            if (a->v[m] <= x) {
+                l = m;
+            } else {
+                h = m;
+            }
+        }
+        i = h;
+    }
+    /* v[i] is the first value above x, or the last one */
+    if (a->v[i] <= x) {
+        *lo = i;
+    } else {
+        *lo = i - 1;
+    }
+    *hi = a->v[*lo] == x ? *lo:*lo + 1;
+
+    return true;
+}
+
+static size_t axis_index(const lm_axis_t *a, double x)
+{
+    const double *p = bsearch(&x, a->v, a->nv, sizeof(double), dbl_cmp);
+
+    return p - a->v;
+}
+
+static bool grid_build(lsdb_line_model_t *lm)
+{
+    size_t i, ncells;
+
+    if (!axis_build(&lm->an, lm->pts, lm->npts, true) ||
+        !axis_build(&lm->aT, lm->pts, lm->npts, false)) {
+        return false;
+    }
+
+    ncells = lm->an.nv*lm->aT.nv;
+    if (ncells != lm->npts) {
+        return true;
+    }
+
+    lm->cell = malloc(ncells*sizeof(size_t));
+    if (!lm->cell) {
+        return false;
+    }
+    for (i = 0; i < ncells; i++) {
+        lm->cell[i] = lm->npts;
+    }
+    for (i = 0; i < lm->npts; i++) {
+        size_t k = axis_index(&lm->aT, lm->pts[i].T)*lm->an.nv +
+                   axis_index(&lm->an, lm->pts[i].n);
+        if (lm->cell[k] != lm->npts) {
+            /* duplicate points, hence a hole somewhere */
+            return true;
+        }
+        lm->cell[k] = i;
+    }
+    lm->grid = true;
+
+    return true;
+}
+
+void lsdb_line_model_free(lsdb_line_model_t *lm)
+{
+    if (lm) {
+        free(lm->pts);
+        free(lm->arena);
+        free(lm->an.v);
+        free(lm->an.bucket);
+        free(lm->aT.v);
+        free(lm->aT.bucket);
+        free(lm->cell);
+        free(lm);
+    }
+}
+
+lsdb_line_model_t *lsdb_load_line_model(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid)
+{
+    lsdb_line_model_t *lm;
+    lsdb_grid_point_t *gpts;
+    lsdb_dataset_data_t **dss;
+    size_t i, npts, total = 0;
+    double *p;
+
+    if (!lsdb) {
+        return NULL;
+    }
+
+    lsdb_sync(lsdb);
+
+    if (lsdb_get_grid(lsdb, mid, eid, lid, &gpts, &npts) != LSDB_SUCCESS) {
+        return NULL;
+    }
+    if (!npts) {
+        lsdb_errmsg(lsdb, "No datasets found\n");
+        free(gpts);
+        return NULL;
+    }
+
+    lm  = calloc(1, sizeof(lsdb_line_model_t));
+    dss = calloc(npts, sizeof(lsdb_dataset_data_t *));
+    if (!lm || !dss || !(lm->pts = calloc(npts, sizeof(lm_point_t)))) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        free(lm);
+        free(dss);
+        free(gpts);
+        return NULL;
+    }
+    lm->mid    = mid;
+    lm->eid    = eid;
+    lm->lid    = lid;
+    lm->engine = lsdb_get_interp_engine(lsdb);
+    lm->npts   = npts;
+
+    for (i = 0; i < npts; i++) {
+        dss[i] = lsdb_fetch_dataset_data(lsdb, gpts[i].id);
+        if (!dss[i]) {
+            lsdb_errmsg(lsdb, "Failed fetching dataset %lu\n", gpts[i].id);
+            break;
+        }
+        total += 2*dss[i]->len;
+        if (lm->engine == LSDB_INTERP_QUANTILE ||
+            lsdb_dataset_data_quantiles(dss[i], &lm->pts[i].norm)) {
+            total += LSDB_NQUANTILES;
+        }
+    }
+
+    if (i == npts) {
+        lm->arena = malloc((total ? total:1)*sizeof(double));
+        if (!lm->arena) {
+            lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        }
+    }
+
+    for (i = 0, p = lm->arena; i < npts; i++) {
+        lm_point_t *pt = &lm->pts[i];
+
+        if (lm->arena) {
+            const double *q = lsdb_dataset_data_quantiles(dss[i], &pt->norm);
+
+            pt->did = gpts[i].id;
+            pt->n   = gpts[i].n;
+            pt->T   = gpts[i].T;
+            pt->len = dss[i]->len;
+            pt->x   = memcpy(p, dss[i]->x, pt->len*sizeof(double));
+            p += pt->len;
+            pt->y   = memcpy(p, dss[i]->y, pt->len*sizeof(double));
+            p += pt->len;
+            if (q) {
+                pt->q = memcpy(p, q, LSDB_NQUANTILES*sizeof(double));
+                p += LSDB_NQUANTILES;
+            } else
+            if (lm->engine == LSDB_INTERP_QUANTILE) {
+                lsdb_interp_ws_t *ws = lsdb_thread_ws(lsdb);
+
+                if (ws && morph_get_quantiles(ws->mws,
+                        pt->x, pt->y, pt->len, p, LSDB_NQUANTILES,
+                        &pt->norm)) {
+                    pt->q = p;
+                    p += LSDB_NQUANTILES;
+                } else {
+                    lsdb_errmsg(lsdb, "Failed computing quantiles\n");
+                    free(lm->arena);
+                    lm->arena = NULL;
+                }
+            }
+        }
+        lsdb_dataset_data_free(dss[i]);
+    }
+    free(dss);
+    free(gpts);
+
+    if (!lm->arena) {
+        lsdb_line_model_free(lm);
+        return NULL;
+    }
+
+    lm->nmin = lm->nmax = lm->pts[0].n;
+    lm->Tmin = lm->Tmax = lm->pts[0].T;
+    for (i = 1; i < npts; i++) {
+        const lm_point_t *pt = &lm->pts[i];
+        if (pt->n < lm->nmin) lm->nmin = pt->n;
+        if (pt->n > lm->nmax) lm->nmax = pt->n;
+        if (pt->T < lm->Tmin) lm->Tmin = pt->T;
+        if (pt->T > lm->Tmax) lm->Tmax = pt->T;
+    }
+
+    if (!grid_build(lm)) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        lsdb_line_model_free(lm);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&lm_serial_mutex);
+    lm->serial = ++lm_serial;
+    pthread_mutex_unlock(&lm_serial_mutex);
+
+    return lm;
+}
+
+size_t lsdb_line_model_get_npoints(const lsdb_line_model_t *lm)
+{
+    return lm ? lm->npts:0;
+}
+
+bool lsdb_line_model_is_grid(const lsdb_line_model_t *lm)
+{
+    return lm ? lm->grid:false;
+}
+
+void lsdb_line_model_get_limits(const lsdb_line_model_t *lm,
+    double *nmin, double *nmax, double *Tmin, double *Tmax)
+{
+    *nmin = lm->nmin;
+    *nmax = lm->nmax;
+    *Tmin = lm->Tmin;
+    *Tmax = lm->Tmax;
+}
+
+/* the points of the did1...did4 of lsdb_get_closest_dids() */
+static bool find_cell(const lsdb_line_model_t *lm, double n, double T,
+    size_t cell[4])
+{
+    static const int signs[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+    double best[4];
+    size_t i;
+    int k;
+
+    if (lm->grid) {
+        size_t nlo, nhi, Tlo, Thi, nn = lm->an.nv;
+
+        if (!axis_find(&lm->an, n, &nlo, &nhi) ||
+            !axis_find(&lm->aT, T, &Tlo, &Thi)) {
+            return false;
+        }
+        cell[0] = lm->cell[Tlo*nn + nlo];
+        cell[1] = lm->cell[Tlo*nn + nhi];
+        cell[2] = lm->cell[Thi*nn + nhi];
+        cell[3] = lm->cell[Thi*nn + nlo];
+
+        return true;
+    }
+
+    for (k = 0; k < 4; k++) {
+        cell[k] = lm->npts;
+    }
+    for (i = 0; i < lm->npts; i++) {
+        /* same expressions as in the SQL query, to get identical quadrants */
+        double dn = (lm->pts[i].n - n)/n;
+        double dT = (lm->pts[i].T - T)/T;
+        double d  = dn*dn + dT*dT;
+
+        for (k = 0; k < 4; k++) {
+            if (signs[k][0]*dn >= 0 && signs[k][1]*dT >= 0 &&
+                (cell[k] == lm->npts || d < best[k] ||
+                 (d == best[k] && lm->pts[i].did < lm->pts[cell[k]].did))) {
+                best[k] = d;
+                cell[k] = i;
+            }
+        }
+    }
+
+    for (k = 0; k < 4; k++) {
+        if (cell[k] == lm->npts) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool init_pair(lsdb_interp_ws_t *ws, lsdb_morph_pair_t *p,
+    const lm_point_t *f, const lm_point_t *g, unsigned int len)
+{
+    if (p->m && morph_get_size(p->m) != len) {
+        morph_free(p->m);
+        p->m = NULL;
+    }
+    if (!p->m) {
+        p->m = morph_new(len);
+        if (!p->m) {
+            return false;
+        }
+    }
+
+    if (f->q && g->q) {
+        if (!morph_init_q_ws(p->m, ws->mws, f->x, f->y, f->len,
+                f->q, f->norm, g->q, g->norm, LSDB_NQUANTILES)) {
+            return false;
+        }
+    } else
+    if (!morph_init_ws(p->m, ws->mws, f->x, f->y, f->len, g->x, g->y, g->len)) {
+        return false;
+    }
+    p->nf = f->n;
+    p->Tf = f->T;
+    p->ng = g->n;
+    p->Tg = g->T;
+
+    return true;
+}
+
+const lsdb_interp_t *lsdb_line_model_prepare(const lsdb_line_model_t *lm,
+    lsdb_interp_ws_t *ws, double n, double T, unsigned int len)
+{
+    lsdb_interp_t *interp;
+    size_t cell[4];
+
+    if (!lm || !ws) {
+        return NULL;
+    }
+
+    if (!find_cell(lm, n, T, cell)) {
+        return NULL;
+    }
+
+    interp = lsdb_interp_ws_prepare(ws, lm->engine, len);
+    if (!interp) {
+        lsdb_errmsg(NULL, "Memory allocation failed\n");
+        return NULL;
+    }
+
+    if (lm->engine == LSDB_INTERP_QUANTILE) {
+        lsdb_qcell_t c;
+
+        for (int k = 0; k < 4; k++) {
+            const lm_point_t *pt = &lm->pts[cell[k]];
+
+            c.q[k]    = pt->q;
+            c.norm[k] = pt->norm;
+            c.n[k]    = pt->n;
+            c.T[k]    = pt->T;
+        }
+
+        if (!lsdb_interp_from_qcell(NULL, ws, &c, n, T, interp)) {
+            return NULL;
+        }
+
+        return interp;
+    }
+
+    if (ws->pairs_serial != lm->serial ||
+        memcmp(ws->pairs_cell, cell, sizeof(cell)) ||
+        morph_get_size(ws->pairs[0].m) != len) {
+        const lm_point_t *pts = lm->pts;
+
+        ws->pairs_serial = 0;
+        if (!init_pair(ws, &ws->pairs[0], &pts[cell[0]], &pts[cell[1]], len) ||
+            !init_pair(ws, &ws->pairs[1], &pts[cell[3]], &pts[cell[2]], len)) {
+            lsdb_errmsg(NULL, "Morphing failed\n");
+            return NULL;
+        }
+        ws->pairs_serial = lm->serial;
+        memcpy(ws->pairs_cell, cell, sizeof(cell));
+    }
+
+    if (!lsdb_interp_from_pairs(NULL, ws, &ws->pairs[0], &ws->pairs[1],
+            n, T, len, interp)) {
+        return NULL;
+    }
+
+    return interp;
+}
+
+int lsdb_line_model_interpolate(const lsdb_line_model_t *lm,
+    lsdb_interp_ws_t *ws, double n, double T, unsigned int len,
+    double sigma, double gamma, double *x, double *y)
+{
+    const lsdb_interp_t *interp;
+
+    interp = lsdb_line_model_prepare(lm, ws, n, T, len);
+    if (!interp) {
+        return LSDB_FAILURE;
+    }
+
+    return lsdb_fill_interpolation(NULL, interp, len, sigma, gamma, x, y);
+}
@@ -19,15 +19,162 @@
  */
 
 #include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <lsdb/lsdbP.h>
 
 #include "schema.i"
+#include "migrate1.i"
+#include "migrate2.i"
+#include "migrate3.i"
 
 #define SQLITE3_BIND_STR(stmt, id, txt) \
         sqlite3_bind_text(stmt, id, txt, -1, SQLITE_STATIC)
 
+static const char *stmt_sql[LSDB_STMT_NUM] = {
+    [LSDB_STMT_SET_UNITS] =
+        "UPDATE lsdb SET value=? WHERE property = 'units'",
+
+    [LSDB_STMT_ADD_MODEL] =
+        "INSERT INTO models (name, descr) VALUES (?, ?)",
+    [LSDB_STMT_GET_MODELS] =
+        "SELECT id, name, descr" \
+        " FROM models" \
+        " ORDER BY id",
+    [LSDB_STMT_DEL_MODEL] =
+        "DELETE FROM models WHERE id = ?",
+
+    [LSDB_STMT_ADD_ENVIRONMENT] =
+        "INSERT INTO environments (name, descr) VALUES (?, ?)",
+    [LSDB_STMT_GET_ENVIRONMENTS] =
+        "SELECT id, name, descr" \
+        " FROM environments" \
+        " ORDER BY id",
+    [LSDB_STMT_DEL_ENVIRONMENT] =
+        "DELETE FROM environments WHERE id = ?",
+
+    [LSDB_STMT_ADD_RADIATOR] =
+        "INSERT INTO radiators (symbol, anum, mass, zsp) VALUES (?, ?, ?, ?)",
+    [LSDB_STMT_GET_RADIATORS] =
+        "SELECT id, symbol, anum, mass, zsp" \
+        " FROM radiators" \
+        " ORDER BY id",
+    [LSDB_STMT_DEL_RADIATOR] =
+        "DELETE FROM radiators WHERE id = ?",
+
+    [LSDB_STMT_ADD_LINE] =
+        "INSERT INTO lines (rid, name, energy) VALUES (?, ?, ?)",
+    [LSDB_STMT_GET_LINES] =
+        "SELECT id, name, energy" \
+        " FROM lines" \
+        " WHERE rid = ?" \
+        " ORDER BY id",
+    [LSDB_STMT_DEL_LINE] =
+        "DELETE FROM lines WHERE id = ?",
+
+    [LSDB_STMT_ADD_LINE_PROPERTY] =
+        "INSERT INTO line_properties (lid, name, value) VALUES (?, ?, ?)",
+    [LSDB_STMT_GET_LINE_PROPERTIES] =
+        "SELECT id, name, value" \
+        " FROM line_properties" \
+        " WHERE lid = ?" \
+        " ORDER BY id",
+    [LSDB_STMT_DEL_LINE_PROPERTY] =
+        "DELETE FROM line_properties WHERE id = ?",
+
+    [LSDB_STMT_ADD_DATASET] =
+        "INSERT INTO datasets (mid, eid, lid, n, T) VALUES (?, ?, ?, ?, ?)",
+    [LSDB_STMT_ADD_DATA] =
+        "INSERT INTO data (did, x, y) VALUES (?, ?, ?)",
+    [LSDB_STMT_GET_DATASETS] =
+        "SELECT id, mid, eid, n, T" \
+        " FROM datasets" \
+        " WHERE lid = ?" \
+        " ORDER BY mid, eid, n, T",
+    [LSDB_STMT_DEL_DATASET] =
+        "DELETE FROM datasets WHERE id = ?",
+    [LSDB_STMT_GET_DATASET_INFO] =
+        "SELECT ds.n, ds.T, count(*)" \
+        " FROM datasets AS ds INNER JOIN data AS d ON (ds.id = d.did)" \
+        " WHERE ds.id = ?",
+    [LSDB_STMT_GET_DATASET_DATA] =
+        "SELECT x, y FROM data WHERE data.did = ? ORDER BY x",
+    [LSDB_STMT_ADD_DATASET_BLOB] =
+        "INSERT INTO datasets (mid, eid, lid, n, T, len, xmin, xmax, x, y)" \
+        " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    [LSDB_STMT_GET_DATASET_BLOB] =
+        "SELECT n, T, len, x, y FROM datasets WHERE id = ?",
+    [LSDB_STMT_ADD_DATASET_BLOB_Q] =
+        "INSERT INTO datasets" \
+        " (mid, eid, lid, n, T, len, xmin, xmax, x, y, norm, q)" \
+        " VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+    [LSDB_STMT_GET_DATASET_BLOB_Q] =
+        "SELECT n, T, len, x, y, norm, q FROM datasets WHERE id = ?",
+    [LSDB_STMT_GET_NO_QUANTILES] =
+        "SELECT id FROM datasets WHERE q IS NULL ORDER BY id",
+    [LSDB_STMT_SET_QUANTILES] =
+        "UPDATE datasets SET norm = ?, q = ? WHERE id = ?",
+
+    [LSDB_STMT_GET_CLOSEST_DIDS] =
+        "SELECT id, (n - ?)/? AS dn, (T - ?)/? AS dT" \
+        " FROM datasets WHERE mid = ? AND eid = ? AND lid = ?" \
+        " ORDER BY dn*dn + dT*dT, id",
+    [LSDB_STMT_GET_LIMITS] =
+        "SELECT MIN(n), MAX(n), MIN(T), MAX(T)" \
+        " FROM datasets WHERE mid = ? AND eid = ? AND lid = ?",
+    [LSDB_STMT_GET_LINE_EM] =
+        "SELECT l.energy, r.mass " \
+        " FROM lines AS l INNER JOIN radiators AS r ON (r.id = l.rid)" \
+        " WHERE l.id = ?",
+    [LSDB_STMT_GET_GRID] =
+        "SELECT id, n, T" \
+        " FROM datasets WHERE mid = ? AND eid = ? AND lid = ?",
+    [LSDB_STMT_DATA_VERSION] =
+        "PRAGMA data_version",
+    /* (kind, rid, lid, id, s1, s2, i1, i2, d1, d2), see cursor.c */
+    [LSDB_STMT_GET_CATALOG] =
+        "SELECT 0, id, 0, id, symbol, NULL, anum, zsp, mass, NULL" \
+        " FROM radiators" \
+        " UNION ALL" \
+        " SELECT 1, rid, id, id, name, NULL, NULL, NULL, energy, NULL" \
+        " FROM lines" \
+        " UNION ALL" \
+        " SELECT 2, l.rid, p.lid, p.id, p.name, p.value, NULL, NULL, NULL, NULL" \
+        " FROM line_properties AS p INNER JOIN lines AS l ON (l.id = p.lid)" \
+        " UNION ALL" \
+        " SELECT 3, l.rid, d.lid, d.id, NULL, NULL, d.mid, d.eid, d.n, d.T" \
+        " FROM datasets AS d INNER JOIN lines AS l ON (l.id = d.lid)" \
+        " ORDER BY 2, 3, 1, 7, 8, 9, 10, 4",
+    [LSDB_STMT_FIND_RADIATOR] =
+        "SELECT id FROM radiators WHERE symbol = ?",
+    [LSDB_STMT_FIND_LINE] =
+        "SELECT id FROM lines WHERE rid = ? AND name = ?"
+};
+
+/* statements needing the write lock */
+static const bool stmt_write[LSDB_STMT_NUM] = {
+    [LSDB_STMT_SET_UNITS]           = true,
+    [LSDB_STMT_ADD_MODEL]           = true,
+    [LSDB_STMT_DEL_MODEL]           = true,
+    [LSDB_STMT_ADD_ENVIRONMENT]     = true,
+    [LSDB_STMT_DEL_ENVIRONMENT]     = true,
+    [LSDB_STMT_ADD_RADIATOR]        = true,
+    [LSDB_STMT_DEL_RADIATOR]        = true,
+    [LSDB_STMT_ADD_LINE]            = true,
+    [LSDB_STMT_DEL_LINE]            = true,
+    [LSDB_STMT_ADD_LINE_PROPERTY]   = true,
+    [LSDB_STMT_DEL_LINE_PROPERTY]   = true,
+    [LSDB_STMT_ADD_DATASET]         = true,
+    [LSDB_STMT_ADD_DATA]            = true,
+    [LSDB_STMT_DEL_DATASET]         = true,
+    [LSDB_STMT_ADD_DATASET_BLOB]    = true,
+    [LSDB_STMT_ADD_DATASET_BLOB_Q]  = true,
+    [LSDB_STMT_SET_QUANTILES]       = true
+};
+
 void lsdb_get_version_numbers(int *major, int *minor, int *nano)
 {
     *major = LSDB_VERSION_MAJOR;
@@ -35,46 +182,208 @@ void lsdb_get_version_numbers(int *major, int *minor, int *nano)
     *nano  = LSDB_VERSION_NANO;
 }
 
+/* datasets may be shared by threads via the cache; refcounted atomically */
 void lsdb_dataset_data_free(lsdb_dataset_data_t *ds)
 {
-    if (ds) {
-        if (ds->x) {
-            free(ds->x);
-        }
-        if (ds->y) {
-            free(ds->y);
+    lsdb_dataset_data_priv_t *dsp = (lsdb_dataset_data_priv_t *) ds;
+    unsigned int refcount;
+
+    if (!ds) {
+        return;
+    }
+
+    /* the last release must see all the writes of the other holders */
+    refcount = __atomic_sub_fetch(&dsp->refcount, 1, __ATOMIC_ACQ_REL);
+
+    if (refcount == 0) {
+        if (dsp->owner) {
+            free(dsp->block);
+            free(dsp->q);
         }
 
-        free(ds);
+        free(dsp);
     }
 }
 
+/* x & y are zeroed, in one block, and both aligned to LSDB_DATA_ALIGN */
 lsdb_dataset_data_t *lsdb_dataset_data_new(double n, double T, size_t len)
 {
+    const size_t na = LSDB_DATA_ALIGN/sizeof(double);
+    lsdb_dataset_data_priv_t *dsp;
     lsdb_dataset_data_t *ds;
+    size_t yoff, nbytes;
+    uintptr_t addr;
+    void *block;
 
-    ds = malloc(sizeof(lsdb_dataset_data_t));
-    if (ds) {
-        ds->n = n;
-        ds->T = T;
+    if (len > SIZE_MAX/(2*sizeof(double)) - 2*na) {
+        return NULL;
+    }
+    yoff   = (len + na - 1)/na*na;
+    nbytes = (yoff + len)*sizeof(double);
 
-        ds->x = calloc(len, sizeof(double));
-        ds->y = calloc(len, sizeof(double));
-        if (!ds->x || !ds->y) {
-            lsdb_dataset_data_free(ds);
-            return NULL;
-        }
+    /* aligned within the block, there being no portable aligned calloc() */
+    block = calloc(1, nbytes + LSDB_DATA_ALIGN);
+    if (!block) {
+        return NULL;
+    }
+    addr = ((uintptr_t) block + LSDB_DATA_ALIGN - 1) &
+        ~(uintptr_t) (LSDB_DATA_ALIGN - 1);
+
+    dsp = malloc(sizeof(lsdb_dataset_data_priv_t));
+    if (!dsp) {
+        free(block);
+        return NULL;
+    }
+    dsp->owner    = true;
+    dsp->block    = block;
+    dsp->refcount = 1;
+    dsp->q        = NULL;
+    dsp->norm     = 0.0;
+
+    ds = &dsp->ds;
+    ds->n   = n;
+    ds->T   = T;
+    ds->len = len;
+    ds->x   = (double *) addr;
+    ds->y   = ds->x + yoff;
+
+    return ds;
+}
+
+lsdb_dataset_data_t *lsdb_dataset_data_ref(lsdb_dataset_data_t *ds)
+{
+    __atomic_add_fetch(&((lsdb_dataset_data_priv_t *) ds)->refcount, 1,
+        __ATOMIC_RELAXED);
+
+    return ds;
+}
+
+/* a dataset referring to external arrays, which must outlive it */
+lsdb_dataset_data_t *lsdb_dataset_data_view(double n, double T, size_t len,
+    const double *x, const double *y)
+{
+    lsdb_dataset_data_priv_t *dsp;
+    lsdb_dataset_data_t *ds;
 
-        ds->len = len;
+    dsp = malloc(sizeof(lsdb_dataset_data_priv_t));
+    if (!dsp) {
+        return NULL;
     }
+    dsp->owner    = false;
+    dsp->block    = NULL;
+    dsp->refcount = 1;
+    dsp->q        = NULL;
+    dsp->norm     = 0.0;
+
+    ds = &dsp->ds;
+    ds->n   = n;
+    ds->T   = T;
+    ds->len = len;
+    ds->x   = (double *) x;
+    ds->y   = (double *) y;
 
     return ds;
 }
 
+/* the stored quantiles of a dataset, or NULL */
+const double *lsdb_dataset_data_quantiles(const lsdb_dataset_data_t *ds,
+    double *norm)
+{
+    const lsdb_dataset_data_priv_t *dsp = (const lsdb_dataset_data_priv_t *) ds;
+
+    *norm = dsp->norm;
+
+    return dsp->q;
+}
+
+static void stmt_cache_clear(lsdb_stmt_cache_t *sc)
+{
+    for (unsigned int i = 0; i < LSDB_STMT_NUM; i++) {
+        sqlite3_finalize(sc->stmts[i]);
+    }
+}
+
+/* thread exit: return the thread's state to the pool */
+static void thread_release(void *p)
+{
+    lsdb_thread_t *t = p;
+    lsdb_mt_t *mt = t->mt;
+
+    pthread_mutex_lock(&mt->plock);
+    t->next_free = mt->free_threads;
+    mt->free_threads = t;
+    pthread_mutex_unlock(&mt->plock);
+}
+
+static lsdb_mt_t *mt_new(void)
+{
+    lsdb_mt_t *mt;
+
+    mt = calloc(1, sizeof(lsdb_mt_t));
+    if (!mt) {
+        return NULL;
+    }
+
+    if (pthread_key_create(&mt->key, thread_release) != 0) {
+        free(mt);
+        return NULL;
+    }
+
+    pthread_mutex_init(&mt->wlock, NULL);
+    pthread_rwlock_init(&mt->slock, NULL);
+    pthread_mutex_init(&mt->clock, NULL);
+    pthread_mutex_init(&mt->plock, NULL);
+
+    return mt;
+}
+
+/* no other threads may use the handle anymore */
+static void mt_free(lsdb_mt_t *mt)
+{
+    lsdb_thread_t *t, *next;
+
+    if (!mt) {
+        return;
+    }
+
+    pthread_key_delete(mt->key);
+
+    for (t = mt->threads; t; t = next) {
+        next = t->next;
+        stmt_cache_clear(&t->sc);
+        sqlite3_close(t->db);
+        lsdb_interp_ws_free(t->ws);
+        free(t);
+    }
+
+    pthread_mutex_destroy(&mt->wlock);
+    pthread_rwlock_destroy(&mt->slock);
+    pthread_mutex_destroy(&mt->clock);
+    pthread_mutex_destroy(&mt->plock);
+
+    free(mt->fname);
+    free(mt);
+}
+
 void lsdb_close(lsdb_t *lsdb)
 {
     if (lsdb) {
+        mt_free(lsdb->mt);
+
+        if (lsdb->sc) {
+            stmt_cache_clear(lsdb->sc);
+            free(lsdb->sc);
+        }
+        lsdb_spindex_free(lsdb->si);
+        lsdb_catalog_free(lsdb->catalog);
+        lsdb_cache_free(lsdb->cache);
+        lsdb_morph_cache_free(lsdb->mcache);
+        lsdb_interp_ws_free(lsdb->ws);
+
         sqlite3_close(lsdb->db);
+        lsdbx_close(lsdb->snap);
+
+        lsdb_fft_save_wisdom();
 
         free(lsdb);
     }
@@ -90,216 +399,1415 @@ void lsdb_errmsg(const lsdb_t *lsdb, const char *fmt, ...)
     va_end(args);
 }
 
-static int format_cb(void *udata,
-    int argc, char **argv, char **colNames)
+/*
+ * Make room for one more element of size bytes in an array of n elements
+ * allocated for *nalloc; *nalloc is only updated once the array has grown.
+ * Returns the array, possibly moved, or NULL (the old one left intact)
+ */
+void *lsdb_grow(void *p, size_t n, size_t *nalloc, size_t size)
 {
-    int *db_format = udata;
+    size_t nnew;
 
-    if (argc != 1 || !argv[0] || !colNames[0]) {
-        return -1;
+    if (n < *nalloc) {
+        return p;
     }
 
-    *db_format = atol(argv[0]);
+    nnew = *nalloc ? 2*(*nalloc):16;
+    if (nnew > SIZE_MAX/size) {
+        return NULL;
+    }
+    p = realloc(p, nnew*size);
+    if (p) {
+        *nalloc = nnew;
+    }
 
-    return 0;
+    return p;
 }
 
-lsdb_t *lsdb_open(const char *fname, lsdb_access_t access)
+/*
+ * Append s (NULL taken as "") with its terminator to a pool of strings of
+ * *size bytes allocated for *nalloc, and return its offset in *off
+ */
+int lsdb_add_string(char **strings, size_t *size, size_t *nalloc,
+    const char *s, size_t *off)
 {
-    lsdb_t *lsdb = NULL;
+    size_t len = strlen(s ? s:"") + 1;
 
-    const char *sql;
-    char *errmsg;
-    int rc;
-    int flags;
+    if (*size > SIZE_MAX/2 || len > SIZE_MAX/2 - *size) {
+        return LSDB_FAILURE;
+    }
 
-    lsdb = malloc(sizeof(lsdb_t));
-    if (!lsdb) {
-        return NULL;
+    if (*size + len > *nalloc) {
+        size_t nnew = *nalloc ? 2*(*nalloc):1024;
+        char *p;
+
+        while (nnew < *size + len) {
+            nnew *= 2;
+        }
+        p = realloc(*strings, nnew);
+        if (!p) {
+            return LSDB_FAILURE;
+        }
+        *strings = p;
+        *nalloc  = nnew;
     }
-    memset(lsdb, 0, sizeof(lsdb_t));
 
-    if (access == LSDB_ACCESS_RW) {
-        flags = SQLITE_OPEN_READWRITE;
-    } else
-    if (access == LSDB_ACCESS_INIT) {
-        flags = SQLITE_OPEN_CREATE|SQLITE_OPEN_READWRITE;
+    *off = *size;
+    memcpy(*strings + *size, s ? s:"", len);
+    *size += len;
+
+    return LSDB_SUCCESS;
+}
+
+/* the calling thread's state, taken from the pool on its first call */
+static lsdb_thread_t *thread_get(const lsdb_t *lsdb)
+{
+    lsdb_mt_t *mt = lsdb->mt;
+    lsdb_thread_t *t;
+
+    t = pthread_getspecific(mt->key);
+    if (t) {
+        return t;
+    }
+
+    pthread_mutex_lock(&mt->plock);
+    t = mt->free_threads;
+    if (t) {
+        mt->free_threads = t->next_free;
     } else {
-        flags = SQLITE_OPEN_READONLY;
+        t = calloc(1, sizeof(lsdb_thread_t));
+        if (t) {
+            t->ws = lsdb_interp_ws_new();
+            if (t->ws) {
+                t->mt = mt;
+                t->next = mt->threads;
+                mt->threads = t;
+            } else {
+                free(t);
+                t = NULL;
+            }
+        }
     }
+    pthread_mutex_unlock(&mt->plock);
 
-    rc = sqlite3_open_v2(fname, &lsdb->db, flags, NULL);
-    if (rc) {
-        lsdb_errmsg(lsdb, "Cannot open database \"%s\": %s\n",
-            fname, sqlite3_errmsg(lsdb->db));
-        lsdb_close(lsdb);
+    if (!t) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
         return NULL;
     }
 
-    rc = sqlite3_exec(lsdb->db, "PRAGMA foreign_keys = ON", NULL, NULL, &errmsg);
-    if (rc != SQLITE_OK) {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
-        sqlite3_free(errmsg);
-        lsdb_close(lsdb);
+    if (pthread_setspecific(mt->key, t) != 0) {
+        lsdb_errmsg(lsdb, "Failed setting up the thread state\n");
+        thread_release(t);
         return NULL;
     }
 
-    if (access == LSDB_ACCESS_INIT) {
-        int i = 0;
-        while ((sql = schema_str[i])) {
-            rc = sqlite3_exec(lsdb->db, sql, NULL, NULL, &errmsg);
-            if (rc != SQLITE_OK) {
-                lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
-                sqlite3_free(errmsg);
-                lsdb_close(lsdb);
-                return NULL;
-            }
-            i++;
-        }
-    } else {
-        /* verify the version/format is compatible */
-        sql = "SELECT value FROM lsdb WHERE property = 'format'";
+    return t;
+}
 
-        rc = sqlite3_exec(lsdb->db, sql, format_cb, &lsdb->db_format, &errmsg);
-        if (rc != SQLITE_OK) {
-            lsdb_errmsg(lsdb, "Wrong DB format\n");
-            lsdb_close(lsdb);
-            return NULL;
-        }
+/*
+ * Serialize writes of a thread-safe handle (otherwise, a no-op). The lock may
+ * be nested; until it is released, the thread uses the primary connection
+ * for everything, so it sees its own uncommitted changes
+ */
+int lsdb_write_lock(const lsdb_t *lsdb)
+{
+    lsdb_thread_t *t;
 
-        if (lsdb->db_format != 1) {
-            lsdb_errmsg(lsdb, "Unsupported DB format version %d\n", lsdb->db_format);
-            lsdb_close(lsdb);
-            return NULL;
-        }
+    if (!lsdb->mt) {
+        return LSDB_SUCCESS;
+    }
 
-        /* obtain units */
-        sql = "SELECT value FROM lsdb WHERE property = 'units'";
+    t = thread_get(lsdb);
+    if (!t) {
+        return LSDB_FAILURE;
+    }
 
-        rc = sqlite3_exec(lsdb->db, sql, format_cb, &lsdb->units, &errmsg);
-        if (rc != SQLITE_OK) {
-            lsdb_errmsg(lsdb, "Wrong DB format\n");
-            lsdb_close(lsdb);
-            return NULL;
-        }
+    if (t->nwrite++ == 0) {
+        pthread_mutex_lock(&lsdb->mt->wlock);
     }
 
-    return lsdb;
+    return LSDB_SUCCESS;
 }
 
-int lsdb_set_units(lsdb_t *lsdb, lsdb_units_t units)
+void lsdb_write_unlock(const lsdb_t *lsdb)
 {
-    sqlite3_stmt *stmt;
-    int rc;
-    char *sql = "UPDATE lsdb SET value=? WHERE property = 'units'";
+    lsdb_thread_t *t;
 
-    if (!lsdb) {
-        return LSDB_FAILURE;
+    if (!lsdb->mt) {
+        return;
     }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    t = pthread_getspecific(lsdb->mt->key);
+    if (t && t->nwrite && --t->nwrite == 0) {
+        pthread_mutex_unlock(&lsdb->mt->wlock);
+    }
+}
 
-    sqlite3_bind_int(stmt, 1, units);
+static bool write_locked(const lsdb_t *lsdb)
+{
+    lsdb_thread_t *t;
 
-    rc = sqlite3_step(stmt);
+    if (!lsdb->mt) {
+        return false;
+    }
 
-    sqlite3_finalize(stmt);
+    t = pthread_getspecific(lsdb->mt->key);
 
-    if (rc == SQLITE_DONE) {
-        if (sqlite3_changes(lsdb->db) == 1) {
-            lsdb->units = units;
-            return LSDB_SUCCESS;
-        } else {
-            return LSDB_FAILURE;
-        }
-    } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        return LSDB_FAILURE;
-    }
+    return t && t->nwrite;
 }
 
-lsdb_units_t lsdb_get_units(const lsdb_t *lsdb) {
-    return lsdb->units;
+/* the state shared by the threads: the index, the catalog, and gen */
+void lsdb_lock(const lsdb_t *lsdb)
+{
+    if (lsdb->mt) {
+        pthread_rwlock_wrlock(&lsdb->mt->slock);
+    }
 }
 
-static int lsdb_del_entity(lsdb_t *lsdb, const char *tname, unsigned long id)
+/* for the lookups that find everything in place */
+void lsdb_rdlock(const lsdb_t *lsdb)
 {
-    sqlite3_stmt *stmt;
-    char sql[64];
-    int rc;
+    if (lsdb->mt) {
+        pthread_rwlock_rdlock(&lsdb->mt->slock);
+    }
+}
 
-    if (!lsdb || id == 0) {
-        return LSDB_FAILURE;
+void lsdb_unlock(const lsdb_t *lsdb)
+{
+    if (lsdb->mt) {
+        pthread_rwlock_unlock(&lsdb->mt->slock);
     }
+}
 
-    sprintf(sql, "DELETE FROM %s WHERE id = ?", tname);
+/* the caches; a hit modifies their LRU lists */
+void lsdb_cache_lock(const lsdb_t *lsdb)
+{
+    if (lsdb->mt) {
+        pthread_mutex_lock(&lsdb->mt->clock);
+    }
+}
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+void lsdb_cache_unlock(const lsdb_t *lsdb)
+{
+    if (lsdb->mt) {
+        pthread_mutex_unlock(&lsdb->mt->clock);
+    }
+}
 
-    sqlite3_bind_int(stmt, 1, id);
+void lsdb_bump_gen(const lsdb_t *lsdb)
+{
+    lsdb_lock(lsdb);
+    lsdb_cache_lock(lsdb);
+    ((lsdb_t *) lsdb)->gen++;
+    lsdb_cache_unlock(lsdb);
+    lsdb_unlock(lsdb);
+}
 
-    rc = sqlite3_step(stmt);
+/*
+ * Invalidate the cached structures if another connection has committed to the
+ * DB since the calling thread's connection was last checked. Done once at the
+ * start of each public call that may use them; the own writes bump gen anyway
+ */
+void lsdb_sync(const lsdb_t *lsdb)
+{
+    long long data_version, *seen;
+    lsdb_thread_t *t;
 
-    sqlite3_finalize(stmt);
+    if (lsdb->snap || !lsdb->db) {
+        return;
+    }
 
-    if (rc == SQLITE_DONE) {
-        if (sqlite3_changes(lsdb->db) == 1) {
-            return LSDB_SUCCESS;
-        } else {
-            return LSDB_FAILURE;
+    if (lsdb->mt) {
+        t = thread_get(lsdb);
+        if (!t) {
+            lsdb_bump_gen(lsdb);
+            return;
         }
+        seen = t->nwrite ? &((lsdb_t *) lsdb)->data_version:&t->data_version;
     } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        return LSDB_FAILURE;
+        seen = &((lsdb_t *) lsdb)->data_version;
+    }
+
+    if (lsdb_get_data_version(lsdb, &data_version) != LSDB_SUCCESS) {
+        lsdb_bump_gen(lsdb);
+        return;
+    }
+
+    if (data_version != *seen) {
+        *seen = data_version;
+        lsdb_bump_gen(lsdb);
     }
 }
 
-int lsdb_add_model(lsdb_t *lsdb, const char *name, const char *descr)
+/* the connection the calling thread last used, for error messages */
+sqlite3 *lsdb_db(const lsdb_t *lsdb)
 {
-    const char *sql;
-    sqlite3_stmt *stmt;
-    int rc;
-    int rid;
+    lsdb_thread_t *t;
 
-    sql = "INSERT INTO models (name, descr) VALUES (?, ?)";
+    if (!lsdb->mt) {
+        return lsdb->db;
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    t = pthread_getspecific(lsdb->mt->key);
+    if (t && !t->nwrite && t->db) {
+        return t->db;
+    } else {
+        return lsdb->db;
+    }
+}
 
-    SQLITE3_BIND_STR(stmt, 1, name);
-    SQLITE3_BIND_STR(stmt, 2, descr);
+/* scratch memory of the calling thread's interpolations */
+lsdb_interp_ws_t *lsdb_thread_ws(const lsdb_t *lsdb)
+{
+    lsdb_thread_t *t;
 
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_DONE) {
-        rid = sqlite3_last_insert_rowid(lsdb->db);
-    } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        rid = -1;
+    if (!lsdb->mt) {
+        return lsdb->ws;
     }
 
-    sqlite3_finalize(stmt);
+    t = thread_get(lsdb);
 
-    return rid;
+    return t ? t->ws:NULL;
 }
 
-int lsdb_get_models(const lsdb_t *lsdb,
-    lsdb_model_sink_t sink, void *udata)
+/* run a statement from sqlite3_mprintf(), which is freed; NULL if it failed */
+static bool exec_pragma(const lsdb_t *lsdb, sqlite3 *db, char *sql)
 {
-    sqlite3_stmt *stmt;
-    const char *sql;
+    char *errmsg;
     int rc;
 
-    if (!lsdb) {
-        return LSDB_FAILURE;
+    if (!sql) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return false;
     }
 
-    sql = "SELECT id, name, descr" \
-          " FROM models" \
-          " ORDER BY id";
+    rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+    sqlite3_free(sql);
+    if (rc != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
+        sqlite3_free(errmsg);
+        return false;
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    return true;
+}
+
+/* the per-connection settings of opts */
+static bool set_conn_opts(const lsdb_t *lsdb, sqlite3 *db,
+    const lsdb_open_opts_t *opts)
+{
+    static const char *temp_stores[] = {NULL, "FILE", "MEMORY"};
+
+    if (opts->busy_timeout) {
+        sqlite3_busy_timeout(db, opts->busy_timeout);
+    }
+
+    if (opts->mmap_size && !exec_pragma(lsdb, db,
+            sqlite3_mprintf("PRAGMA mmap_size = %lld", opts->mmap_size))) {
+        return false;
+    }
+    if (opts->cache_size && !exec_pragma(lsdb, db,
+            sqlite3_mprintf("PRAGMA cache_size = %d", opts->cache_size))) {
+        return false;
+    }
+    if (temp_stores[opts->temp_store] && !exec_pragma(lsdb, db,
+            sqlite3_mprintf("PRAGMA temp_store = %s",
+                temp_stores[opts->temp_store]))) {
+        return false;
+    }
+
+    return true;
+}
+
+/* the settings of opts affecting the writer */
+static bool set_writer_opts(const lsdb_t *lsdb, const lsdb_open_opts_t *opts)
+{
+    static const char *syncs[] = {NULL, "OFF", "NORMAL", "FULL"};
+    sqlite3_stmt *stmt;
+    bool OK;
+
+    if (syncs[opts->synchronous] && !exec_pragma(lsdb, lsdb->db,
+            sqlite3_mprintf("PRAGMA synchronous = %s",
+                syncs[opts->synchronous]))) {
+        return false;
+    }
+
+    if (!opts->wal) {
+        return true;
+    }
+
+    /* the mode actually set is returned */
+    if (sqlite3_prepare_v2(lsdb->db, "PRAGMA journal_mode = WAL", -1,
+            &stmt, NULL) != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
+        return false;
+    }
+    OK = sqlite3_step(stmt) == SQLITE_ROW &&
+        !sqlite3_stricmp((const char *) sqlite3_column_text(stmt, 0), "wal");
+    sqlite3_finalize(stmt);
+
+    if (!OK) {
+        lsdb_errmsg(lsdb, "Failed switching to WAL mode\n");
+    }
+
+    return OK;
+}
+
+static bool thread_open_db(const lsdb_t *lsdb, lsdb_thread_t *t)
+{
+    lsdb_mt_t *mt = lsdb->mt;
+    int rc;
+
+    rc = sqlite3_open_v2(mt->fname, &t->db,
+        SQLITE_OPEN_READONLY|SQLITE_OPEN_NOMUTEX|mt->oflags, NULL);
+    if (rc || !set_conn_opts(lsdb, t->db, &mt->opts)) {
+        if (rc) {
+            lsdb_errmsg(lsdb, "Cannot open database \"%s\": %s\n",
+                mt->fname, sqlite3_errmsg(t->db));
+        }
+        sqlite3_close(t->db);
+        t->db = NULL;
+        return false;
+    }
+
+    /* unknown what the connection's first version follows */
+    t->data_version = LLONG_MIN;
+
+    return true;
+}
+
+/* the connection to be used by the calling thread, with its statements */
+static bool get_conn(const lsdb_t *lsdb, sqlite3 **db, lsdb_stmt_cache_t **sc)
+{
+    lsdb_thread_t *t;
+
+    if (!lsdb->mt) {
+        *db = lsdb->db;
+        *sc = lsdb->sc;
+        return true;
+    }
+
+    t = thread_get(lsdb);
+    if (!t) {
+        return false;
+    }
+
+    if (t->nwrite) {
+        *db = lsdb->db;
+        *sc = lsdb->sc;
+    } else {
+        if (!t->db && !thread_open_db(lsdb, t)) {
+            return false;
+        }
+        *db = t->db;
+        *sc = &t->sc;
+    }
+
+    return true;
+}
+
+/*
+ * Get the statement for one of the fixed queries. It is prepared on the first
+ * use and then kept; if it is still in use (e.g., by a caller up the stack
+ * whose sink re-enters the same API), a temporary one is prepared instead.
+ * Statements that write hold the write lock until released.
+ */
+sqlite3_stmt *lsdb_stmt_acquire(const lsdb_t *lsdb, lsdb_stmt_id_t sid)
+{
+    lsdb_stmt_cache_t *sc;
+    sqlite3_stmt *stmt;
+    sqlite3 *db;
+    int rc;
+
+    if (!lsdb->db) {
+        lsdb_errmsg(lsdb, "Operation not supported on a snapshot\n");
+        return NULL;
+    }
+
+    if (stmt_write[sid] && lsdb_write_lock(lsdb) != LSDB_SUCCESS) {
+        return NULL;
+    }
+
+    if (!get_conn(lsdb, &db, &sc)) {
+        if (stmt_write[sid]) {
+            lsdb_write_unlock(lsdb);
+        }
+        return NULL;
+    }
+
+    if (sc->stmts[sid] && !sc->busy[sid]) {
+        sc->busy[sid] = true;
+        sc->nreused++;
+        return sc->stmts[sid];
+    }
+
+    rc = sqlite3_prepare_v3(db, stmt_sql[sid], -1,
+        SQLITE_PREPARE_PERSISTENT, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(db));
+        if (stmt_write[sid]) {
+            lsdb_write_unlock(lsdb);
+        }
+        return NULL;
+    }
+    sc->nprepared++;
+
+    if (!sc->stmts[sid]) {
+        sc->stmts[sid] = stmt;
+        sc->busy[sid]  = true;
+    }
+
+    return stmt;
+}
+
+void lsdb_stmt_release(const lsdb_t *lsdb, lsdb_stmt_id_t sid,
+    sqlite3_stmt *stmt)
+{
+    lsdb_stmt_cache_t *sc = lsdb->sc;
+
+    if (!stmt) {
+        return;
+    }
+
+    /* the thread may have taken the write lock since the statement was got */
+    if (lsdb->mt && sqlite3_db_handle(stmt) != lsdb->db) {
+        lsdb_thread_t *t = pthread_getspecific(lsdb->mt->key);
+        sc = &t->sc;
+    }
+
+    if (stmt == sc->stmts[sid]) {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        sc->busy[sid] = false;
+    } else {
+        sqlite3_finalize(stmt);
+    }
+
+    if (stmt_write[sid]) {
+        lsdb_write_unlock(lsdb);
+    }
+}
+
+int lsdb_get_stats(const lsdb_t *lsdb, lsdb_stats_t *stats)
+{
+    if (!lsdb || !stats) {
+        return LSDB_FAILURE;
+    }
+
+    memset(stats, 0, sizeof(lsdb_stats_t));
+
+    lsdb_rdlock(lsdb);
+    lsdb_cache_lock(lsdb);
+
+    /* connections busy in other threads are counted as of a moment ago */
+    stats->stmt_prepares = lsdb->sc->nprepared;
+    stats->stmt_reuses   = lsdb->sc->nreused;
+    if (lsdb->mt) {
+        pthread_mutex_lock(&lsdb->mt->plock);
+        for (lsdb_thread_t *t = lsdb->mt->threads; t; t = t->next) {
+            stats->stmt_prepares += t->sc.nprepared;
+            stats->stmt_reuses   += t->sc.nreused;
+        }
+        pthread_mutex_unlock(&lsdb->mt->plock);
+    }
+    stats->index_builds  = lsdb_spindex_nbuilds(lsdb->si);
+    stats->catalog_builds = lsdb_catalog_nbuilds(lsdb->catalog);
+    lsdb_cache_get_stats(lsdb, stats);
+    lsdb_morph_cache_get_stats(lsdb, stats);
+
+    lsdb_cache_unlock(lsdb);
+    lsdb_unlock(lsdb);
+
+    stats->load_time = lsdb->load_time;
+    stats->mem_bytes = lsdb->mem_bytes;
+
+    lsdb_voigt_get_stats(stats);
+
+    return LSDB_SUCCESS;
+}
+
+static int format_cb(void *udata,
+    int argc, char **argv, char **colNames)
+{
+    int *db_format = udata;
+
+    if (argc != 1 || !argv[0] || !colNames[0]) {
+        return -1;
+    }
+
+    *db_format = atol(argv[0]);
+
+    return 0;
+}
+
+/* the name to open fname by: as is, or as a file: URI with query appended */
+static char *conn_name(const char *fname, const char *query)
+{
+    size_t len = strlen(fname);
+    char *name, *p;
+
+    if (!query) {
+        name = malloc(len + 1);
+        if (name) {
+            memcpy(name, fname, len + 1);
+        }
+        return name;
+    }
+
+    name = malloc(strlen("file:") + 3*len + 1 + strlen(query) + 1);
+    if (!name) {
+        return NULL;
+    }
+
+    p = name + sprintf(name, "file:");
+    for (; *fname; fname++) {
+        if (*fname == '%' || *fname == '?' || *fname == '#') {
+            p += sprintf(p, "%%%02X", (unsigned char) *fname);
+        } else {
+            *p++ = *fname;
+        }
+    }
+    sprintf(p, "?%s", query);
+
+    return name;
+}
+
+static sqlite3_int64 db_size(sqlite3 *db)
+{
+    int page_size = 0, page_count = 0;
+
+    sqlite3_exec(db, "PRAGMA page_size", format_cb, &page_size, NULL);
+    sqlite3_exec(db, "PRAGMA page_count", format_cb, &page_count, NULL);
+
+    return (sqlite3_int64) page_size*page_count;
+}
+
+/*
+ * Copy the DB into memory, as the primary connection; returns the name to
+ * open further connections to the copy by. The connections of a thread-safe
+ * handle share the copy via the memdb VFS
+ */
+static char *load_db(lsdb_t *lsdb, const char *name, int oflags,
+    const lsdb_open_opts_t *opts)
+{
+    struct timespec t0, t1;
+    sqlite3_backup *backup;
+    sqlite3 *src;
+    sqlite3_int64 size;
+    char *mname;
+    int rc;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    mname = malloc(64);
+    if (!mname) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        return NULL;
+    }
+    if (lsdb->mt) {
+        snprintf(mname, 64, "file:/lsdb-%p?vfs=memdb", (void *) lsdb);
+    } else {
+        snprintf(mname, 64, ":memory:");
+    }
+
+    rc = sqlite3_open_v2(name, &src, SQLITE_OPEN_READONLY|oflags, NULL);
+    if (rc) {
+        lsdb_errmsg(lsdb, "Cannot open database \"%s\": %s\n",
+            name, sqlite3_errmsg(src));
+        sqlite3_close(src);
+        free(mname);
+        return NULL;
+    }
+    if (opts->busy_timeout) {
+        sqlite3_busy_timeout(src, opts->busy_timeout);
+    }
+    size = db_size(src);
+
+    rc = sqlite3_open_v2(mname, &lsdb->db,
+        SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE|SQLITE_OPEN_URI|
+        (opts->nomutex ? SQLITE_OPEN_NOMUTEX:0), NULL);
+    if (rc == SQLITE_OK) {
+        /* memdb files are limited to 1 GiB by default */
+        if (lsdb->mt) {
+            sqlite3_file_control(lsdb->db, "main", SQLITE_FCNTL_SIZE_LIMIT,
+                &size);
+        }
+
+        backup = sqlite3_backup_init(lsdb->db, "main", src, "main");
+        if (backup) {
+            rc = sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        } else {
+            rc = SQLITE_ERROR;
+        }
+    }
+    sqlite3_close(src);
+
+    if (rc != SQLITE_DONE) {
+        lsdb_errmsg(lsdb, "Loading database \"%s\" failed: %s\n",
+            name, sqlite3_errmsg(lsdb->db));
+        free(mname);
+        return NULL;
+    }
+
+    /* the copy is read-only as well */
+    sqlite3_exec(lsdb->db, "PRAGMA query_only = ON", NULL, NULL, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    lsdb->load_time = (t1.tv_sec - t0.tv_sec) + 1e-9*(t1.tv_nsec - t0.tv_nsec);
+    lsdb->mem_bytes = db_size(lsdb->db);
+
+    return mname;
+}
+
+/* the last step of opening */
+static lsdb_t *open_catalog(lsdb_t *lsdb, const lsdb_open_opts_t *opts)
+{
+    if (opts->catalog) {
+        lsdb->catalog = lsdb_catalog_new();
+        if (!lsdb->catalog || lsdb_catalog_refresh(lsdb) != LSDB_SUCCESS) {
+            lsdb_close(lsdb);
+            return NULL;
+        }
+    }
+
+    return lsdb;
+}
+
+lsdb_t *lsdb_open(const char *fname, lsdb_access_t access)
+{
+    return lsdb_open_ex(fname, access, NULL);
+}
+
+lsdb_t *lsdb_open_ex(const char *fname, lsdb_access_t access,
+    const lsdb_open_opts_t *opts)
+{
+    lsdb_open_opts_t o = {0};
+    lsdb_t *lsdb = NULL;
+
+    const char *sql;
+    char *errmsg, *name;
+    int rc;
+    int flags, oflags = 0;
+
+    lsdb = malloc(sizeof(lsdb_t));
+    if (!lsdb) {
+        return NULL;
+    }
+    memset(lsdb, 0, sizeof(lsdb_t));
+
+    lsdb->sc = calloc(1, sizeof(lsdb_stmt_cache_t));
+    lsdb->si = lsdb_spindex_new();
+    lsdb->cache = lsdb_cache_new();
+    lsdb->mcache = lsdb_morph_cache_new(LSDB_MORPH_CACHE_SIZE);
+    lsdb->ws = lsdb_interp_ws_new();
+    if (!lsdb->sc || !lsdb->si || !lsdb->cache || !lsdb->mcache ||
+        !lsdb->ws) {
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    if (opts) {
+        o = *opts;
+    }
+
+    if ((unsigned int) o.temp_store > LSDB_TEMP_STORE_MEMORY ||
+        (unsigned int) o.synchronous > LSDB_SYNC_FULL ||
+        o.busy_timeout < 0 || o.mmap_size < 0) {
+        lsdb_errmsg(lsdb, "Invalid open options\n");
+        lsdb_close(lsdb);
+        return NULL;
+    }
+    if (o.immutable &&
+        access != LSDB_ACCESS_RO && access != LSDB_ACCESS_RO_MEMORY) {
+        lsdb_errmsg(lsdb, "Immutable DBs can only be opened read-only\n");
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    /* no disk I/O for sorting, either */
+    if (access == LSDB_ACCESS_RO_MEMORY &&
+        o.temp_store == LSDB_TEMP_STORE_DEFAULT) {
+        o.temp_store = LSDB_TEMP_STORE_MEMORY;
+    }
+
+    if (o.threadsafe) {
+        /* each connection to these would have a DB of its own */
+        if (!strcmp(fname, "") || !strcmp(fname, ":memory:")) {
+            lsdb_errmsg(lsdb, "Thread-safe access needs a DB file\n");
+            lsdb_close(lsdb);
+            return NULL;
+        }
+
+        if (!o.busy_timeout) {
+            o.busy_timeout = LSDB_BUSY_TIMEOUT;
+        }
+
+        lsdb->mt = mt_new();
+        if (!lsdb->mt) {
+            lsdb_errmsg(lsdb, "Memory allocation failed\n");
+            lsdb_close(lsdb);
+            return NULL;
+        }
+    }
+
+    if (access != LSDB_ACCESS_INIT && lsdbx_probe(fname)) {
+        bool load = access == LSDB_ACCESS_RO_MEMORY;
+        struct timespec t0, t1;
+
+        if (access != LSDB_ACCESS_RO && !load) {
+            lsdb_errmsg(lsdb, "Snapshot \"%s\" is read-only\n", fname);
+            lsdb_close(lsdb);
+            return NULL;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+
+        lsdb->snap = lsdbx_open(lsdb, fname, load);
+        if (!lsdb->snap) {
+            lsdb_close(lsdb);
+            return NULL;
+        }
+
+        if (load) {
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            lsdb->load_time = (t1.tv_sec - t0.tv_sec) +
+                1e-9*(t1.tv_nsec - t0.tv_nsec);
+        }
+
+        return open_catalog(lsdb, &o);
+    }
+
+    if (access == LSDB_ACCESS_RW) {
+        flags = SQLITE_OPEN_READWRITE;
+    } else
+    if (access == LSDB_ACCESS_INIT) {
+        flags = SQLITE_OPEN_CREATE|SQLITE_OPEN_READWRITE;
+    } else {
+        flags = SQLITE_OPEN_READONLY;
+    }
+
+    if (o.immutable) {
+        oflags |= SQLITE_OPEN_URI;
+    }
+    name = conn_name(fname, o.immutable ? "immutable=1":NULL);
+    if (!name) {
+        lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    if (access == LSDB_ACCESS_RO_MEMORY) {
+        char *mname = load_db(lsdb, name, oflags, &o);
+
+        free(name);
+        if (!mname) {
+            lsdb_close(lsdb);
+            return NULL;
+        }
+        name   = mname;
+        oflags = SQLITE_OPEN_URI;
+        rc     = SQLITE_OK;
+    } else {
+        rc = sqlite3_open_v2(name, &lsdb->db,
+            flags|oflags|(o.nomutex ? SQLITE_OPEN_NOMUTEX:0), NULL);
+    }
+    if (lsdb->mt) {
+        lsdb->mt->fname  = name;
+        lsdb->mt->oflags = oflags;
+        lsdb->mt->opts   = o;
+    } else {
+        free(name);
+    }
+    if (rc) {
+        lsdb_errmsg(lsdb, "Cannot open database \"%s\": %s\n",
+            fname, sqlite3_errmsg(lsdb->db));
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    if (!set_conn_opts(lsdb, lsdb->db, &o) ||
+        (flags != SQLITE_OPEN_READONLY && !set_writer_opts(lsdb, &o))) {
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    rc = sqlite3_exec(lsdb->db, "PRAGMA foreign_keys = ON", NULL, NULL, &errmsg);
+    if (rc != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
+        sqlite3_free(errmsg);
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    if (access == LSDB_ACCESS_INIT) {
+        int i = 0;
+        while ((sql = schema_str[i])) {
+            rc = sqlite3_exec(lsdb->db, sql, NULL, NULL, &errmsg);
+            if (rc != SQLITE_OK) {
+                lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
+                sqlite3_free(errmsg);
+                lsdb_close(lsdb);
+                return NULL;
+            }
+            i++;
+        }
+
+        lsdb->db_format = LSDB_DB_FORMAT;
+    } else {
+        /* verify the version/format is compatible */
+        sql = "SELECT value FROM lsdb WHERE property = 'format'";
+
+        rc = sqlite3_exec(lsdb->db, sql, format_cb, &lsdb->db_format, &errmsg);
+        if (rc != SQLITE_OK) {
+            lsdb_errmsg(lsdb, "Wrong DB format\n");
+            lsdb_close(lsdb);
+            return NULL;
+        }
+
+        if (lsdb->db_format < 1 || lsdb->db_format > LSDB_DB_FORMAT) {
+            lsdb_errmsg(lsdb, "Unsupported DB format version %d\n", lsdb->db_format);
+            lsdb_close(lsdb);
+            return NULL;
+        }
+
+        /* obtain units */
+        sql = "SELECT value FROM lsdb WHERE property = 'units'";
+
+        rc = sqlite3_exec(lsdb->db, sql, format_cb, &lsdb->units, &errmsg);
+        if (rc != SQLITE_OK) {
+            lsdb_errmsg(lsdb, "Wrong DB format\n");
+            lsdb_close(lsdb);
+            return NULL;
+        }
+    }
+
+    /* a thread-safe handle reads through other connections, see lsdb_sync() */
+    if (lsdb->mt) {
+        lsdb->data_version = LLONG_MIN;
+    } else
+    if (lsdb_get_data_version(lsdb, &lsdb->data_version) != LSDB_SUCCESS) {
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    return open_catalog(lsdb, &o);
+}
+
+int lsdb_get_format(const lsdb_t *lsdb)
+{
+    return lsdb->db_format;
+}
+
+bool lsdb_is_snapshot(const lsdb_t *lsdb)
+{
+    return lsdb->snap != NULL;
+}
+
+static int lsdb_exec(lsdb_t *lsdb, const char *sql)
+{
+    char *errmsg;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+    if (!lsdb->db) {
+        lsdb_errmsg(lsdb, "Operation not supported on a snapshot\n");
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb_write_lock(lsdb) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    if (sqlite3_exec(lsdb->db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
+        sqlite3_free(errmsg);
+        lsdb_write_unlock(lsdb);
+        return LSDB_FAILURE;
+    }
+
+    lsdb_write_unlock(lsdb);
+
+    return LSDB_SUCCESS;
+}
+
+/*
+ * Explicit transactions, to group lsdb_add_*() and lsdb_del_*() calls;
+ * the API calls themselves only use savepoints, so they can be nested.
+ * With a thread-safe handle, writes by other threads wait until the
+ * transaction is over
+ */
+int lsdb_begin(lsdb_t *lsdb)
+{
+    if (!lsdb || lsdb_write_lock(lsdb) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb_exec(lsdb, "BEGIN") != LSDB_SUCCESS) {
+        lsdb_write_unlock(lsdb);
+        return LSDB_FAILURE;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_commit(lsdb_t *lsdb)
+{
+    if (lsdb_exec(lsdb, "COMMIT") != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    /* the lock taken by lsdb_begin() */
+    if (write_locked(lsdb)) {
+        lsdb_write_unlock(lsdb);
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_rollback(lsdb_t *lsdb)
+{
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    lsdb_bump_gen(lsdb);
+
+    if (lsdb_exec(lsdb, "ROLLBACK") != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    if (write_locked(lsdb)) {
+        lsdb_write_unlock(lsdb);
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_set_units(lsdb_t *lsdb, lsdb_units_t units)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_SET_UNITS);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    sqlite3_bind_int(stmt, 1, units);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        rc = sqlite3_changes(lsdb->db) == 1 ? LSDB_SUCCESS:LSDB_FAILURE;
+        if (rc == LSDB_SUCCESS) {
+            lsdb->units = units;
+        }
+    } else {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        rc = LSDB_FAILURE;
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_SET_UNITS, stmt);
+
+    return rc;
+}
+
+lsdb_units_t lsdb_get_units(const lsdb_t *lsdb) {
+    return lsdb->units;
+}
+
+static int lsdb_del_entity(lsdb_t *lsdb, lsdb_stmt_id_t sid, unsigned long id)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!lsdb || id == 0) {
+        return LSDB_FAILURE;
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, sid);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    sqlite3_bind_int(stmt, 1, id);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        rc = sqlite3_changes(lsdb->db) == 1 ? LSDB_SUCCESS:LSDB_FAILURE;
+    } else {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        rc = LSDB_FAILURE;
+    }
+
+    lsdb_stmt_release(lsdb, sid, stmt);
+
+    /* deletions may cascade to datasets */
+    lsdb_bump_gen(lsdb);
+
+    return rc;
+}
+
+int lsdb_add_model(lsdb_t *lsdb, const char *name, const char *descr)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    int rid;
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_ADD_MODEL);
+    if (!stmt) {
+        return -1;
+    }
+
+    SQLITE3_BIND_STR(stmt, 1, name);
+    SQLITE3_BIND_STR(stmt, 2, descr);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        rid = sqlite3_last_insert_rowid(lsdb->db);
+    } else {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        rid = -1;
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_ADD_MODEL, stmt);
+
+    return rid;
+}
+
+int lsdb_get_models(const lsdb_t *lsdb,
+    lsdb_model_sink_t sink, void *udata)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_get_models(lsdb, sink, udata);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_MODELS);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    do {
+        lsdb_model_t m;
+
+        rc = sqlite3_step(stmt);
+        switch (rc) {
+        case SQLITE_DONE:
+        case SQLITE_OK:
+            break;
+        case SQLITE_ROW:
+            m.id    = sqlite3_column_int   (stmt, 0);
+            m.name  = (char *) sqlite3_column_text(stmt, 1);
+            m.descr = (char *) sqlite3_column_text(stmt, 2);
+
+            if (sink(lsdb, &m, udata) != LSDB_SUCCESS) {
+                lsdb_stmt_release(lsdb, LSDB_STMT_GET_MODELS, stmt);
+                return LSDB_FAILURE;
+            }
+
+            break;
+        default:
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_MODELS, stmt);
+            return LSDB_FAILURE;
+            break;
+        }
+    } while (rc == SQLITE_ROW);
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_MODELS, stmt);
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_del_model(lsdb_t *lsdb, unsigned long id)
+{
+    return lsdb_del_entity(lsdb, LSDB_STMT_DEL_MODEL, id);
+}
+
+int lsdb_add_environment(lsdb_t *lsdb, const char *name, const char *descr)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    int rid;
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_ADD_ENVIRONMENT);
+    if (!stmt) {
+        return -1;
+    }
+
+    SQLITE3_BIND_STR(stmt, 1, name);
+    SQLITE3_BIND_STR(stmt, 2, descr);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        rid = sqlite3_last_insert_rowid(lsdb->db);
+    } else {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        rid = -1;
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_ADD_ENVIRONMENT, stmt);
+
+    return rid;
+}
+
+int lsdb_get_environments(const lsdb_t *lsdb,
+    lsdb_environment_sink_t sink, void *udata)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_get_environments(lsdb, sink, udata);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_ENVIRONMENTS);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    do {
+        lsdb_environment_t e;
+
+        rc = sqlite3_step(stmt);
+        switch (rc) {
+        case SQLITE_DONE:
+        case SQLITE_OK:
+            break;
+        case SQLITE_ROW:
+            e.id    = sqlite3_column_int   (stmt, 0);
+            e.name  = (char *) sqlite3_column_text(stmt, 1);
+            e.descr = (char *) sqlite3_column_text(stmt, 2);
+
+            if (sink(lsdb, &e, udata) != LSDB_SUCCESS) {
+                lsdb_stmt_release(lsdb, LSDB_STMT_GET_ENVIRONMENTS, stmt);
+                return LSDB_FAILURE;
+            }
+
+            break;
+        default:
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_ENVIRONMENTS, stmt);
+            return LSDB_FAILURE;
+            break;
+        }
+    } while (rc == SQLITE_ROW);
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_ENVIRONMENTS, stmt);
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_del_environment(lsdb_t *lsdb, unsigned long id)
+{
+    return lsdb_del_entity(lsdb, LSDB_STMT_DEL_ENVIRONMENT, id);
+}
+
+int lsdb_add_radiator(lsdb_t *lsdb,
+    const char *symbol, int anum, double mass, int zsp)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    int rid;
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_ADD_RADIATOR);
+    if (!stmt) {
+        return -1;
+    }
+
+    SQLITE3_BIND_STR   (stmt, 1, symbol);
+    sqlite3_bind_int   (stmt, 2, anum);
+    sqlite3_bind_double(stmt, 3, mass);
+    sqlite3_bind_int   (stmt, 4, zsp);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        rid = sqlite3_last_insert_rowid(lsdb->db);
+    } else {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        rid = -1;
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_ADD_RADIATOR, stmt);
+
+    if (rid > 0) {
+        lsdb_bump_gen(lsdb);
+    }
+
+    return rid;
+}
+
+int lsdb_get_radiators(const lsdb_t *lsdb,
+    lsdb_radiator_sink_t sink, void *udata)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_get_radiators(lsdb, sink, udata);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_RADIATORS);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    do {
+        lsdb_radiator_t r;
+
+        rc = sqlite3_step(stmt);
+        switch (rc) {
+        case SQLITE_DONE:
+        case SQLITE_OK:
+            break;
+        case SQLITE_ROW:
+            r.id   = sqlite3_column_int   (stmt, 0);
+            r.sym  = (char *) sqlite3_column_text(stmt, 1);
+            r.anum = sqlite3_column_int   (stmt, 2);
+            r.mass = sqlite3_column_double(stmt, 3);
+            r.zsp  = sqlite3_column_int   (stmt, 4);
+
+            if (sink(lsdb, &r, udata) != LSDB_SUCCESS) {
+                lsdb_stmt_release(lsdb, LSDB_STMT_GET_RADIATORS, stmt);
+                return LSDB_FAILURE;
+            }
+
+            break;
+        default:
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_RADIATORS, stmt);
+            return LSDB_FAILURE;
+            break;
+        }
+    } while (rc == SQLITE_ROW);
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_RADIATORS, stmt);
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_del_radiator(lsdb_t *lsdb, unsigned long id)
+{
+    return lsdb_del_entity(lsdb, LSDB_STMT_DEL_RADIATOR, id);
+}
+
+int lsdb_find_radiator(const lsdb_t *lsdb, const char *symbol)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    int rid = -1;
+
+    if (!lsdb || !symbol) {
+        return -1;
+    }
+
+    lsdb_sync(lsdb);
+
+    if (lsdb->catalog) {
+        return lsdb_catalog_find_radiator(lsdb, symbol);
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_find_radiator(lsdb, symbol);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_FIND_RADIATOR);
+    if (!stmt) {
+        return -1;
+    }
+
+    SQLITE3_BIND_STR(stmt, 1, symbol);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        rid = sqlite3_column_int(stmt, 0);
+    } else
+    if (rc != SQLITE_DONE) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_FIND_RADIATOR, stmt);
+
+    return rid;
+}
+
+int lsdb_add_line(lsdb_t *lsdb,
+    unsigned int rid, const char *name, double energy)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    int lid;
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_ADD_LINE);
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_int   (stmt, 1, rid);
+    SQLITE3_BIND_STR   (stmt, 2, name);
+    sqlite3_bind_double(stmt, 3, energy);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        lid = sqlite3_last_insert_rowid(lsdb->db);
+    } else {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        lid = -1;
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_ADD_LINE, stmt);
+
+    if (lid > 0) {
+        lsdb_bump_gen(lsdb);
+    }
+
+    return lid;
+}
+
+int lsdb_get_lines(const lsdb_t *lsdb, unsigned long rid,
+    lsdb_line_sink_t sink, void *udata)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_get_lines(lsdb, rid, sink, udata);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_LINES);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    sqlite3_bind_int(stmt, 1, rid);
 
     do {
-        lsdb_model_t m;
+        lsdb_line_t l;
 
         rc = sqlite3_step(stmt);
         switch (rc) {
@@ -307,80 +1815,127 @@ int lsdb_get_models(const lsdb_t *lsdb,
         case SQLITE_OK:
             break;
         case SQLITE_ROW:
-            m.id    = sqlite3_column_int   (stmt, 0);
-            m.name  = (char *) sqlite3_column_text(stmt, 1);
-            m.descr = (char *) sqlite3_column_text(stmt, 2);
+            l.id     = sqlite3_column_int(stmt, 0);
+            l.name   = (char *) sqlite3_column_text(stmt, 1);
+            l.energy = sqlite3_column_double(stmt, 2);
 
-            if (sink(lsdb, &m, udata) != LSDB_SUCCESS) {
-                sqlite3_finalize(stmt);
+            if (sink(lsdb, &l, udata) != LSDB_SUCCESS) {
+                lsdb_stmt_release(lsdb, LSDB_STMT_GET_LINES, stmt);
                 return LSDB_FAILURE;
             }
 
             break;
         default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_LINES, stmt);
             return LSDB_FAILURE;
             break;
         }
     } while (rc == SQLITE_ROW);
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_LINES, stmt);
 
     return LSDB_SUCCESS;
 }
 
-int lsdb_del_model(lsdb_t *lsdb, unsigned long id)
+int lsdb_del_line(lsdb_t *lsdb, unsigned long id)
 {
-    return lsdb_del_entity(lsdb, "models", id);
+    return lsdb_del_entity(lsdb, LSDB_STMT_DEL_LINE, id);
 }
 
-int lsdb_add_environment(lsdb_t *lsdb, const char *name, const char *descr)
+int lsdb_find_line(const lsdb_t *lsdb, unsigned long rid, const char *name)
 {
-    const char *sql;
     sqlite3_stmt *stmt;
     int rc;
-    int rid;
+    int lid = -1;
 
-    sql = "INSERT INTO environments (name, descr) VALUES (?, ?)";
+    if (!lsdb || !name) {
+        return -1;
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    lsdb_sync(lsdb);
 
-    SQLITE3_BIND_STR(stmt, 1, name);
-    SQLITE3_BIND_STR(stmt, 2, descr);
+    if (lsdb->catalog) {
+        return lsdb_catalog_find_line(lsdb, rid, name);
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_find_line(lsdb, rid, name);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_FIND_LINE);
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, rid);
+    SQLITE3_BIND_STR(stmt, 2, name);
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        lid = sqlite3_column_int(stmt, 0);
+    } else
+    if (rc != SQLITE_DONE) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_FIND_LINE, stmt);
+
+    return lid;
+}
+
+int lsdb_add_line_property(lsdb_t *lsdb,
+    unsigned int lid, const char *name, const char *value)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+    int pid;
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_ADD_LINE_PROPERTY);
+    if (!stmt) {
+        return -1;
+    }
+
+    sqlite3_bind_int(stmt, 1, lid);
+    SQLITE3_BIND_STR(stmt, 2, name);
+    SQLITE3_BIND_STR(stmt, 3, value);
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_DONE) {
-        rid = sqlite3_last_insert_rowid(lsdb->db);
+        pid = sqlite3_last_insert_rowid(lsdb->db);
     } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        rid = -1;
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        pid = -1;
     }
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_ADD_LINE_PROPERTY, stmt);
 
-    return rid;
+    return pid;
 }
 
-int lsdb_get_environments(const lsdb_t *lsdb,
-    lsdb_environment_sink_t sink, void *udata)
+int lsdb_get_line_properties(const lsdb_t *lsdb, unsigned long lid,
+    lsdb_line_property_sink_t sink, void *udata)
 {
     sqlite3_stmt *stmt;
-    const char *sql;
     int rc;
 
     if (!lsdb) {
         return LSDB_FAILURE;
     }
 
-    sql = "SELECT id, name, descr" \
-          " FROM environments" \
-          " ORDER BY id";
+    if (lsdb->snap) {
+        return lsdbx_get_line_properties(lsdb, lid, sink, udata);
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_LINE_PROPERTIES);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    sqlite3_bind_int(stmt, 1, lid);
 
     do {
-        lsdb_environment_t e;
+        lsdb_line_property_t p;
 
         rc = sqlite3_step(stmt);
         switch (rc) {
@@ -388,83 +1943,375 @@ int lsdb_get_environments(const lsdb_t *lsdb,
         case SQLITE_OK:
             break;
         case SQLITE_ROW:
-            e.id    = sqlite3_column_int   (stmt, 0);
-            e.name  = (char *) sqlite3_column_text(stmt, 1);
-            e.descr = (char *) sqlite3_column_text(stmt, 2);
+            p.id    = sqlite3_column_int(stmt, 0);
+            p.name  = (char *) sqlite3_column_text(stmt, 1);
+            p.value = (char *) sqlite3_column_text(stmt, 2);
 
-            if (sink(lsdb, &e, udata) != LSDB_SUCCESS) {
-                sqlite3_finalize(stmt);
+            if (sink(lsdb, &p, udata) != LSDB_SUCCESS) {
+                lsdb_stmt_release(lsdb, LSDB_STMT_GET_LINE_PROPERTIES, stmt);
                 return LSDB_FAILURE;
             }
 
             break;
         default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_LINE_PROPERTIES, stmt);
             return LSDB_FAILURE;
             break;
         }
     } while (rc == SQLITE_ROW);
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_LINE_PROPERTIES, stmt);
 
     return LSDB_SUCCESS;
 }
 
-int lsdb_del_environment(lsdb_t *lsdb, unsigned long id)
+int lsdb_del_line_property(lsdb_t *lsdb, unsigned long id)
 {
-    return lsdb_del_entity(lsdb, "environments", id);
+    return lsdb_del_entity(lsdb, LSDB_STMT_DEL_LINE_PROPERTY, id);
 }
 
-int lsdb_add_radiator(lsdb_t *lsdb,
-    const char *symbol, int anum, double mass, int zsp)
+static int add_dataset_rows(lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T,
+    const double *x, const double *y, size_t len)
 {
-    const char *sql;
     sqlite3_stmt *stmt;
     int rc;
-    int rid;
+    unsigned int i;
+    int did;
 
-    sql = "INSERT INTO radiators (symbol, anum, mass, zsp) VALUES (?, ?, ?, ?)";
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_ADD_DATASET);
+    if (!stmt) {
+        return -1;
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    sqlite3_exec(lsdb->db, "SAVEPOINT add_dataset", 0, 0, 0);
 
-    SQLITE3_BIND_STR   (stmt, 1, symbol);
-    sqlite3_bind_int   (stmt, 2, anum);
-    sqlite3_bind_double(stmt, 3, mass);
-    sqlite3_bind_int   (stmt, 4, zsp);
+    sqlite3_bind_int   (stmt, 1, mid);
+    sqlite3_bind_int   (stmt, 2, eid);
+    sqlite3_bind_int   (stmt, 3, lid);
+    sqlite3_bind_double(stmt, 4, n);
+    sqlite3_bind_double(stmt, 5, T);
+
+    rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        lsdb_stmt_release(lsdb, LSDB_STMT_ADD_DATASET, stmt);
+        sqlite3_exec(lsdb->db,
+            "ROLLBACK TO add_dataset; RELEASE add_dataset", 0, 0, 0);
+        return -1;
+    } else {
+        did = sqlite3_last_insert_rowid(lsdb->db);
+
+        lsdb_stmt_release(lsdb, LSDB_STMT_ADD_DATASET, stmt);
+
+        stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_ADD_DATA);
+        if (!stmt) {
+            sqlite3_exec(lsdb->db,
+                "ROLLBACK TO add_dataset; RELEASE add_dataset", 0, 0, 0);
+            return -1;
+        }
+
+        sqlite3_bind_int(stmt, 1, did);
+        for (i = 0; i < len; i++) {
+            sqlite3_bind_double(stmt, 2, x[i]);
+            sqlite3_bind_double(stmt, 3, y[i]);
+
+            rc = sqlite3_step(stmt);
+            if (rc != SQLITE_DONE) {
+                lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+                lsdb_stmt_release(lsdb, LSDB_STMT_ADD_DATA, stmt);
+                sqlite3_exec(lsdb->db,
+                    "ROLLBACK TO add_dataset; RELEASE add_dataset", 0, 0, 0);
+                return -1;
+            }
+
+            sqlite3_reset(stmt);
+        }
+
+        lsdb_stmt_release(lsdb, LSDB_STMT_ADD_DATA, stmt);
+    }
+
+    sqlite3_exec(lsdb->db, "RELEASE add_dataset", 0, 0, 0);
+
+    return did;
+}
+
+/* BLOBs are stored as little-endian IEEE 754 doubles */
+static bool host_is_le(void)
+{
+    const union {
+        uint32_t      u;
+        unsigned char c[4];
+    } one = { 1 };
+
+    return one.c[0] == 1;
+}
+
+static void swap_doubles(double *dst, const void *src, size_t len)
+{
+    const unsigned char *s = src;
+
+    /* may be done in place */
+    for (size_t i = 0; i < len; i++) {
+        unsigned char d[sizeof(double)];
+        for (unsigned int k = 0; k < sizeof(double); k++) {
+            d[k] = s[i*sizeof(double) + sizeof(double) - 1 - k];
+        }
+        memcpy(&dst[i], d, sizeof(double));
+    }
+}
+
+typedef struct {
+    double x;
+    double y;
+} xy_pair_t;
+
+static int xy_pair_cmp(const void *a, const void *b)
+{
+    const xy_pair_t *p1 = a, *p2 = b;
+
+    if (p1->x < p2->x) {
+        return -1;
+    } else
+    if (p1->x > p2->x) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+/* in the byte order of BLOBs; false if the profile has no quantiles */
+static bool get_quantiles(const lsdb_t *lsdb,
+    const double *x, const double *y, size_t len, double *q, double *norm)
+{
+    lsdb_interp_ws_t *ws = lsdb_thread_ws(lsdb);
+
+    if (!ws || !morph_get_quantiles(ws->mws, x, y, len,
+            q, LSDB_NQUANTILES, norm)) {
+        return false;
+    }
+
+    if (!host_is_le()) {
+        swap_doubles(q, q, LSDB_NQUANTILES);
+    }
+
+    return true;
+}
+
+static int add_dataset_blob(lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T,
+    const double *x, const double *y, size_t len)
+{
+    lsdb_stmt_id_t sid = LSDB_STMT_ADD_DATASET_BLOB;
+    sqlite3_stmt *stmt;
+    double *buf = NULL, q[LSDB_NQUANTILES], norm;
+    double xmin, xmax;
+    bool sorted = true, has_q = false;
+    int rc;
+    int did;
+
+    for (size_t i = 1; i < len; i++) {
+        if (x[i] < x[i - 1]) {
+            sorted = false;
+            break;
+        }
+    }
+
+    /* format 1 sorted on reading; here the data are stored ready to use */
+    if (!sorted || !host_is_le()) {
+        buf = malloc(2*len*sizeof(double));
+        if (!buf) {
+            lsdb_errmsg(lsdb, "Memory allocation failed\n");
+            return -1;
+        }
+
+        if (!sorted) {
+            xy_pair_t *xy = malloc(len*sizeof(xy_pair_t));
+            if (!xy) {
+                lsdb_errmsg(lsdb, "Memory allocation failed\n");
+                free(buf);
+                return -1;
+            }
+            for (size_t i = 0; i < len; i++) {
+                xy[i].x = x[i];
+                xy[i].y = y[i];
+            }
+            qsort(xy, len, sizeof(xy_pair_t), xy_pair_cmp);
+            for (size_t i = 0; i < len; i++) {
+                buf[i]       = xy[i].x;
+                buf[len + i] = xy[i].y;
+            }
+            free(xy);
+        } else {
+            memcpy(buf, x, len*sizeof(double));
+            memcpy(buf + len, y, len*sizeof(double));
+        }
+
+        x = buf;
+        y = buf + len;
+    }
+
+    xmin = x[0];
+    xmax = x[len - 1];
+
+    /* datasets never change, so this is done once and for all */
+    if (lsdb->db_format >= 4) {
+        sid   = LSDB_STMT_ADD_DATASET_BLOB_Q;
+        has_q = get_quantiles(lsdb, x, y, len, q, &norm);
+    }
+
+    if (!host_is_le()) {
+        swap_doubles(buf, buf, 2*len);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, sid);
+    if (!stmt) {
+        free(buf);
+        return -1;
+    }
+
+    sqlite3_bind_int   (stmt,  1, mid);
+    sqlite3_bind_int   (stmt,  2, eid);
+    sqlite3_bind_int   (stmt,  3, lid);
+    sqlite3_bind_double(stmt,  4, n);
+    sqlite3_bind_double(stmt,  5, T);
+    sqlite3_bind_int64 (stmt,  6, len);
+    sqlite3_bind_double(stmt,  7, xmin);
+    sqlite3_bind_double(stmt,  8, xmax);
+    sqlite3_bind_blob  (stmt,  9, x, len*sizeof(double), SQLITE_STATIC);
+    sqlite3_bind_blob  (stmt, 10, y, len*sizeof(double), SQLITE_STATIC);
+    if (has_q) {
+        sqlite3_bind_double(stmt, 11, norm);
+        sqlite3_bind_blob  (stmt, 12, q, sizeof(q), SQLITE_STATIC);
+    } else
+    if (sid == LSDB_STMT_ADD_DATASET_BLOB_Q) {
+        sqlite3_bind_null(stmt, 11);
+        sqlite3_bind_null(stmt, 12);
+    }
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_DONE) {
-        rid = sqlite3_last_insert_rowid(lsdb->db);
+        did = sqlite3_last_insert_rowid(lsdb->db);
     } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        rid = -1;
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        did = -1;
     }
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, sid, stmt);
 
-    return rid;
+    free(buf);
+
+    return did;
 }
 
-int lsdb_get_radiators(const lsdb_t *lsdb,
-    lsdb_radiator_sink_t sink, void *udata)
+int lsdb_add_dataset(lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T,
+    const double *x, const double *y, size_t len)
+{
+    int did;
+
+    if (len < 2 || !x || !y) {
+        lsdb_errmsg(lsdb, "Adding empty dataset refused\n");
+        return -1;
+    }
+
+    if (lsdb->snap) {
+        lsdb_errmsg(lsdb, "Operation not supported on a snapshot\n");
+        return -1;
+    }
+
+    if (lsdb_write_lock(lsdb) != LSDB_SUCCESS) {
+        return -1;
+    }
+
+    lsdb_bump_gen(lsdb);
+
+    if (lsdb->db_format == 1) {
+        did = add_dataset_rows(lsdb, mid, eid, lid, n, T, x, y, len);
+    } else {
+        did = add_dataset_blob(lsdb, mid, eid, lid, n, T, x, y, len);
+    }
+
+    lsdb_write_unlock(lsdb);
+
+    return did;
+}
+
+/*
+ * Add many datasets in one transaction (or savepoint, if a transaction is
+ * already open). A failed item doesn't affect the others; the number of
+ * datasets added is returned, or -1 if the transaction itself failed.
+ */
+int lsdb_add_datasets_bulk(lsdb_t *lsdb,
+    lsdb_dataset_desc_t *dsets, size_t count)
+{
+    int nadded = 0;
+
+    if (!lsdb || (count && !dsets)) {
+        return -1;
+    }
+
+    if (lsdb_write_lock(lsdb) != LSDB_SUCCESS) {
+        return -1;
+    }
+
+    if (lsdb_exec(lsdb, "SAVEPOINT add_datasets_bulk") != LSDB_SUCCESS) {
+        lsdb_write_unlock(lsdb);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        lsdb_dataset_desc_t *d = &dsets[i];
+
+        d->did = lsdb_add_dataset(lsdb, d->mid, d->eid, d->lid, d->n, d->T,
+            d->x, d->y, d->len);
+        if (d->did > 0) {
+            nadded++;
+        }
+    }
+
+    if (lsdb_exec(lsdb, "RELEASE add_datasets_bulk") != LSDB_SUCCESS) {
+        lsdb_exec(lsdb, "ROLLBACK TO add_datasets_bulk");
+        lsdb_exec(lsdb, "RELEASE add_datasets_bulk");
+        for (size_t i = 0; i < count; i++) {
+            dsets[i].did = -1;
+        }
+        lsdb_write_unlock(lsdb);
+        return -1;
+    }
+
+    lsdb_write_unlock(lsdb);
+
+    return nadded;
+}
+
+int lsdb_get_datasets(const lsdb_t *lsdb, unsigned long lid,
+    lsdb_dataset_sink_t sink, void *udata)
 {
     sqlite3_stmt *stmt;
-    const char *sql;
     int rc;
 
     if (!lsdb) {
         return LSDB_FAILURE;
     }
 
-    sql = "SELECT id, symbol, anum, mass, zsp" \
-          " FROM radiators" \
-          " ORDER BY id";
+    if (lsdb->snap) {
+        return lsdbx_get_datasets(lsdb, lid, sink, udata);
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_DATASETS);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    sqlite3_bind_int(stmt, 1, lid);
 
     do {
-        lsdb_radiator_t r;
+        lsdb_dataset_t cbdata;
 
         rc = sqlite3_step(stmt);
         switch (rc) {
@@ -472,406 +2319,597 @@ int lsdb_get_radiators(const lsdb_t *lsdb,
         case SQLITE_OK:
             break;
         case SQLITE_ROW:
-            r.id   = sqlite3_column_int   (stmt, 0);
-            r.sym  = (char *) sqlite3_column_text(stmt, 1);
-            r.anum = sqlite3_column_int   (stmt, 2);
-            r.mass = sqlite3_column_double(stmt, 3);
-            r.zsp  = sqlite3_column_int   (stmt, 4);
+            cbdata.id  = sqlite3_column_int(stmt, 0);
+            cbdata.mid = sqlite3_column_int(stmt, 1);
+            cbdata.eid = sqlite3_column_int(stmt, 2);
+            cbdata.n   = sqlite3_column_double(stmt, 3);
+            cbdata.T   = sqlite3_column_double(stmt, 4);
 
-            if (sink(lsdb, &r, udata) != LSDB_SUCCESS) {
-                sqlite3_finalize(stmt);
+            if (sink(lsdb, &cbdata, udata) != LSDB_SUCCESS) {
+                lsdb_stmt_release(lsdb, LSDB_STMT_GET_DATASETS, stmt);
                 return LSDB_FAILURE;
             }
 
             break;
         default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_DATASETS, stmt);
             return LSDB_FAILURE;
             break;
         }
     } while (rc == SQLITE_ROW);
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_DATASETS, stmt);
 
     return LSDB_SUCCESS;
 }
 
-int lsdb_del_radiator(lsdb_t *lsdb, unsigned long id)
+int lsdb_del_dataset(lsdb_t *lsdb, unsigned long id)
 {
-    return lsdb_del_entity(lsdb, "radiators", id);
+    return lsdb_del_entity(lsdb, LSDB_STMT_DEL_DATASET, id);
 }
 
-int lsdb_add_line(lsdb_t *lsdb,
-    unsigned int rid, const char *name, double energy)
+static lsdb_dataset_data_t *get_dataset_data_rows(const lsdb_t *lsdb, int did)
 {
-    const char *sql;
+    lsdb_dataset_data_t *ds;
     sqlite3_stmt *stmt;
     int rc;
-    int lid;
+    unsigned int i;
 
-    sql = "INSERT INTO lines (rid, name, energy) VALUES (?, ?, ?)";
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_DATASET_INFO);
+    if (!stmt) {
+        return NULL;
+    }
+    sqlite3_bind_int(stmt, 1, did);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        double n, T;
+        size_t len;
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+        n   = sqlite3_column_double(stmt, 0);
+        T   = sqlite3_column_double(stmt, 1);
+        len = sqlite3_column_int64 (stmt, 2);
 
-    sqlite3_bind_int   (stmt, 1, rid);
-    SQLITE3_BIND_STR   (stmt, 2, name);
-    sqlite3_bind_double(stmt, 3, energy);
+        lsdb_stmt_release(lsdb, LSDB_STMT_GET_DATASET_INFO, stmt);
 
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_DONE) {
-        lid = sqlite3_last_insert_rowid(lsdb->db);
+        if (len == 0) {
+            lsdb_errmsg(lsdb, "Dataset %d not found\n", did);
+            return NULL;
+        }
+        ds = lsdb_dataset_data_new(n, T, len);
+        if (!ds) {
+            lsdb_errmsg(lsdb, "Dataset allocation failed\n");
+            return NULL;
+        }
     } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        lid = -1;
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        lsdb_stmt_release(lsdb, LSDB_STMT_GET_DATASET_INFO, stmt);
+        return NULL;
     }
 
-    sqlite3_finalize(stmt);
-
-    return lid;
-}
-
-int lsdb_get_lines(const lsdb_t *lsdb, unsigned long rid,
-    lsdb_line_sink_t sink, void *udata)
-{
-    sqlite3_stmt *stmt;
-    const char *sql;
-    int rc;
-
-    if (!lsdb) {
-        return LSDB_FAILURE;
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_DATASET_DATA);
+    if (!stmt) {
+        lsdb_dataset_data_free(ds);
+        return NULL;
     }
+    sqlite3_bind_int(stmt, 1, did);
 
-    sql = "SELECT id, name, energy" \
-          " FROM lines" \
-          " WHERE rid = ?" \
-          " ORDER BY id";
-
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
-
-    sqlite3_bind_int(stmt, 1, rid);
-
+    i = 0;
     do {
-        lsdb_line_t l;
-
         rc = sqlite3_step(stmt);
         switch (rc) {
         case SQLITE_DONE:
         case SQLITE_OK:
             break;
         case SQLITE_ROW:
-            l.id     = sqlite3_column_int(stmt, 0);
-            l.name   = (char *) sqlite3_column_text(stmt, 1);
-            l.energy = sqlite3_column_double(stmt, 2);
-
-            if (sink(lsdb, &l, udata) != LSDB_SUCCESS) {
-                sqlite3_finalize(stmt);
-                return LSDB_FAILURE;
-            }
-
+            ds->x[i] = sqlite3_column_double(stmt, 0);
+            ds->y[i] = sqlite3_column_double(stmt, 1);
+            i++;
             break;
         default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
-            return LSDB_FAILURE;
-            break;
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_DATASET_DATA, stmt);
+            lsdb_dataset_data_free(ds);
+            return NULL;
         }
-    } while (rc == SQLITE_ROW);
+    } while (rc == SQLITE_ROW && i < ds->len);
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_DATASET_DATA, stmt);
 
-    return LSDB_SUCCESS;
+    return ds;
 }
 
-int lsdb_del_line(lsdb_t *lsdb, unsigned long id)
+/* columns 5 & 6; missing or malformed quantiles are just left out */
+static void get_blob_quantiles(sqlite3_stmt *stmt,
+    lsdb_dataset_data_priv_t *dsp)
 {
-    return lsdb_del_entity(lsdb, "lines", id);
+    const void *qb = sqlite3_column_blob(stmt, 6);
+    size_t nbytes = LSDB_NQUANTILES*sizeof(double);
+
+    if (!qb || (size_t) sqlite3_column_bytes(stmt, 6) != nbytes) {
+        return;
+    }
+
+    dsp->q = malloc(nbytes);
+    if (!dsp->q) {
+        return;
+    }
+    if (host_is_le()) {
+        memcpy(dsp->q, qb, nbytes);
+    } else {
+        swap_doubles(dsp->q, qb, LSDB_NQUANTILES);
+    }
+    dsp->norm = sqlite3_column_double(stmt, 5);
 }
 
-int lsdb_add_line_property(lsdb_t *lsdb,
-    unsigned int lid, const char *name, const char *value)
+static lsdb_dataset_data_t *get_dataset_data_blob(const lsdb_t *lsdb, int did)
 {
-    const char *sql;
+    lsdb_stmt_id_t sid = lsdb->db_format >= 4 ?
+        LSDB_STMT_GET_DATASET_BLOB_Q:LSDB_STMT_GET_DATASET_BLOB;
+    lsdb_dataset_data_t *ds = NULL;
     sqlite3_stmt *stmt;
     int rc;
-    int pid;
 
-    sql = "INSERT INTO line_properties (lid, name, value) VALUES (?, ?, ?)";
+    stmt = lsdb_stmt_acquire(lsdb, sid);
+    if (!stmt) {
+        return NULL;
+    }
+    sqlite3_bind_int(stmt, 1, did);
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        double n, T;
+        size_t len, nbytes;
+        const void *xb, *yb;
 
-    sqlite3_bind_int(stmt, 1, lid);
-    SQLITE3_BIND_STR(stmt, 2, name);
-    SQLITE3_BIND_STR(stmt, 3, value);
+        n   = sqlite3_column_double(stmt, 0);
+        T   = sqlite3_column_double(stmt, 1);
+        len = sqlite3_column_int64 (stmt, 2);
+        xb  = sqlite3_column_blob  (stmt, 3);
+        yb  = sqlite3_column_blob  (stmt, 4);
+
+        nbytes = len*sizeof(double);
+        if (len == 0 || !xb || !yb ||
+            (size_t) sqlite3_column_bytes(stmt, 3) != nbytes ||
+            (size_t) sqlite3_column_bytes(stmt, 4) != nbytes) {
+            lsdb_errmsg(lsdb, "Dataset %d is corrupted\n", did);
+        } else {
+            ds = lsdb_dataset_data_new(n, T, len);
+            if (!ds) {
+                lsdb_errmsg(lsdb, "Dataset allocation failed\n");
+            } else
+            if (host_is_le()) {
+                memcpy(ds->x, xb, nbytes);
+                memcpy(ds->y, yb, nbytes);
+            } else {
+                swap_doubles(ds->x, xb, len);
+                swap_doubles(ds->y, yb, len);
+            }
+        }
 
-    rc = sqlite3_step(stmt);
+        if (ds && sid == LSDB_STMT_GET_DATASET_BLOB_Q) {
+            get_blob_quantiles(stmt, (lsdb_dataset_data_priv_t *) ds);
+        }
+    } else
     if (rc == SQLITE_DONE) {
-        pid = sqlite3_last_insert_rowid(lsdb->db);
+        lsdb_errmsg(lsdb, "Dataset %d not found\n", did);
     } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        pid = -1;
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
     }
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, sid, stmt);
 
-    return pid;
+    return ds;
 }
 
-int lsdb_get_line_properties(const lsdb_t *lsdb, unsigned long lid,
-    lsdb_line_property_sink_t sink, void *udata)
+/* without lsdb_sync(), for use within the public calls */
+lsdb_dataset_data_t *lsdb_fetch_dataset_data(const lsdb_t *lsdb, int did)
 {
-    sqlite3_stmt *stmt;
-    const char *sql;
-    int rc;
+    lsdb_dataset_data_t *ds;
 
-    if (!lsdb) {
-        return LSDB_FAILURE;
+    /* snapshot data are mapped anyway */
+    if (lsdb->snap) {
+        return lsdbx_get_dataset_data(lsdb, did);
     }
 
-    sql = "SELECT id, name, value" \
-          " FROM line_properties" \
-          " WHERE lid = ?" \
-          " ORDER BY id";
+    ds = lsdb_cache_get(lsdb, did);
+    if (ds) {
+        return ds;
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    if (lsdb->db_format == 1) {
+        ds = get_dataset_data_rows(lsdb, did);
+    } else {
+        ds = get_dataset_data_blob(lsdb, did);
+    }
 
-    sqlite3_bind_int(stmt, 1, lid);
+    if (ds) {
+        lsdb_cache_put(lsdb, did, ds);
+    }
 
-    do {
-        lsdb_line_property_t p;
+    return ds;
+}
 
-        rc = sqlite3_step(stmt);
-        switch (rc) {
-        case SQLITE_DONE:
-        case SQLITE_OK:
-            break;
-        case SQLITE_ROW:
-            p.id    = sqlite3_column_int(stmt, 0);
-            p.name  = (char *) sqlite3_column_text(stmt, 1);
-            p.value = (char *) sqlite3_column_text(stmt, 2);
+lsdb_dataset_data_t *lsdb_get_dataset_data(const lsdb_t *lsdb, int did)
+{
+    lsdb_sync(lsdb);
 
-            if (sink(lsdb, &p, udata) != LSDB_SUCCESS) {
-                sqlite3_finalize(stmt);
-                return LSDB_FAILURE;
-            }
+    return lsdb_fetch_dataset_data(lsdb, did);
+}
 
-            break;
-        default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
-            return LSDB_FAILURE;
-            break;
+/*
+ * Copy a dataset to x[i*stride] & y[i*stride], without allocating its arrays
+ * if cached or in a snapshot; either of x & y may be NULL. With both NULL,
+ * only the number of points is returned
+ */
+int lsdb_get_dataset_data_into(const lsdb_t *lsdb, int did,
+    double *x, double *y, size_t stride, size_t maxlen)
+{
+    lsdb_dataset_data_t *ds;
+    int len;
+
+    if (!lsdb || stride == 0) {
+        return -1;
+    }
+
+    ds = lsdb_get_dataset_data(lsdb, did);
+    if (!ds) {
+        return -1;
+    }
+
+    if (ds->len > INT_MAX) {
+        lsdb_errmsg(lsdb, "Dataset %d is too large\n", did);
+        lsdb_dataset_data_free(ds);
+        return -1;
+    }
+    len = ds->len;
+
+    if (x || y) {
+        if (ds->len > maxlen) {
+            lsdb_errmsg(lsdb, "Dataset %d has more than %zu points\n",
+                did, maxlen);
+            lsdb_dataset_data_free(ds);
+            return -1;
         }
-    } while (rc == SQLITE_ROW);
 
-    sqlite3_finalize(stmt);
+        if (stride == 1) {
+            if (x) {
+                memcpy(x, ds->x, ds->len*sizeof(double));
+            }
+            if (y) {
+                memcpy(y, ds->y, ds->len*sizeof(double));
+            }
+        } else {
+            for (size_t i = 0; i < ds->len; i++) {
+                if (x) {
+                    x[i*stride] = ds->x[i];
+                }
+                if (y) {
+                    y[i*stride] = ds->y[i];
+                }
+            }
+        }
+    }
 
-    return LSDB_SUCCESS;
-}
+    lsdb_dataset_data_free(ds);
 
-int lsdb_del_line_property(lsdb_t *lsdb, unsigned long id)
-{
-    return lsdb_del_entity(lsdb, "line_properties", id);
+    return len;
 }
 
-int lsdb_add_dataset(lsdb_t *lsdb,
-    unsigned int mid, unsigned int eid, unsigned int lid,
-    double n, double T,
-    const double *x, const double *y, size_t len)
+/* format 1 => 2: move the per-point rows into BLOBs */
+static int migrate1_hook(lsdb_t *lsdb)
 {
-    const char *sql;
     sqlite3_stmt *stmt;
+    const char *sql;
+    int *dids = NULL;
+    size_t ndids = 0, nalloc = 0;
     int rc;
-    unsigned int i;
-    int did;
-
-    if (len < 2 || !x || !y) {
-        lsdb_errmsg(lsdb, "Adding empty dataset refused\n");
-        return -1;
-    }
-
-    sqlite3_exec(lsdb->db, "BEGIN", 0, 0, 0);
-
-    sql = "INSERT INTO datasets (mid, eid, lid, n, T) VALUES (?, ?, ?, ?, ?)";
 
+    /* collect the IDs first, so that the table isn't modified while read */
+    sql = "SELECT id FROM datasets";
     sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (ndids >= nalloc) {
+            int *p = realloc(dids, sizeof(int)*(nalloc + 128));
+            if (!p) {
+                rc = SQLITE_NOMEM;
+                break;
+            }
+            dids = p;
+            nalloc += 128;
+        }
+        dids[ndids++] = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
 
-    sqlite3_bind_int   (stmt, 1, mid);
-    sqlite3_bind_int   (stmt, 2, eid);
-    sqlite3_bind_int   (stmt, 3, lid);
-    sqlite3_bind_double(stmt, 4, n);
-    sqlite3_bind_double(stmt, 5, T);
-
-    rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        sqlite3_finalize(stmt);
-        sqlite3_exec(lsdb->db, "ROLLBACK", 0, 0, 0);
-        return -1;
-    } else {
-        did = sqlite3_last_insert_rowid(lsdb->db);
+        lsdb_errmsg(lsdb, "Failed reading dataset IDs\n");
+        free(dids);
+        return LSDB_FAILURE;
+    }
 
-        /* reuse stmt */
-        sqlite3_finalize(stmt);
+    sql = "UPDATE datasets SET len = ?, xmin = ?, xmax = ?, x = ?, y = ?" \
+          " WHERE id = ?";
+    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
 
-        sql = "INSERT INTO data (did, x, y) VALUES (?, ?, ?)";
-        sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    for (size_t i = 0; i < ndids && rc == SQLITE_DONE; i++) {
+        lsdb_dataset_data_t *ds = get_dataset_data_rows(lsdb, dids[i]);
+        if (!ds) {
+            rc = SQLITE_ERROR;
+            break;
+        }
 
-        sqlite3_bind_int(stmt, 1, did);
-        for (i = 0; i < len; i++) {
-            sqlite3_bind_double(stmt, 2, x[i]);
-            sqlite3_bind_double(stmt, 3, y[i]);
+        sqlite3_bind_int64 (stmt, 1, ds->len);
+        sqlite3_bind_double(stmt, 2, ds->x[0]);
+        sqlite3_bind_double(stmt, 3, ds->x[ds->len - 1]);
 
-            rc = sqlite3_step(stmt);
-            if (rc != SQLITE_DONE) {
-                lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-                sqlite3_finalize(stmt);
-                sqlite3_exec(lsdb->db, "ROLLBACK", 0, 0, 0);
-                return -1;
-            }
+        if (!host_is_le()) {
+            swap_doubles(ds->x, ds->x, ds->len);
+            swap_doubles(ds->y, ds->y, ds->len);
+        }
+        sqlite3_bind_blob(stmt, 4, ds->x, ds->len*sizeof(double), SQLITE_STATIC);
+        sqlite3_bind_blob(stmt, 5, ds->y, ds->len*sizeof(double), SQLITE_STATIC);
+        sqlite3_bind_int (stmt, 6, dids[i]);
 
-            sqlite3_reset(stmt);
+        rc = sqlite3_step(stmt);
+        if (rc != SQLITE_DONE) {
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
         }
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+
+        lsdb_dataset_data_free(ds);
     }
 
-    sqlite3_exec(lsdb->db, "COMMIT", 0, 0, 0);
+    sqlite3_finalize(stmt);
+    free(dids);
 
-    return did;
+    if (rc != SQLITE_DONE) {
+        return LSDB_FAILURE;
+    }
+
+    rc = sqlite3_exec(lsdb->db, "DROP TABLE data", NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        return LSDB_FAILURE;
+    }
+
+    return LSDB_SUCCESS;
 }
 
-int lsdb_get_datasets(const lsdb_t *lsdb, unsigned long lid,
-    lsdb_dataset_sink_t sink, void *udata)
+/*
+ * Each migration upgrades format "from" to "from + 1": its SQL statements
+ * (from migrate<from>.sql) are executed first, followed by the hook, if any
+ */
+static const struct {
+    int           from;
+    const char  **sql;
+    int         (*hook)(lsdb_t *lsdb);
+} migrations[] = {
+    {1, migrate1_str, migrate1_hook},
+    {2, migrate2_str, NULL},
+    {3, migrate3_str, NULL}
+};
+
+static int upgrade(lsdb_t *lsdb)
 {
     sqlite3_stmt *stmt;
     const char *sql;
+    char *errmsg;
+    int format;
     int rc;
 
-    if (!lsdb) {
+    rc = sqlite3_exec(lsdb->db, "BEGIN IMMEDIATE", NULL, NULL, &errmsg);
+    if (rc != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
+        sqlite3_free(errmsg);
         return LSDB_FAILURE;
     }
 
-    sql = "SELECT id, mid, eid, n, T" \
-          " FROM datasets" \
-          " WHERE lid = ?" \
-          " ORDER BY mid, eid, n, T";
-
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
-
-    sqlite3_bind_int(stmt, 1, lid);
-
-    do {
-        lsdb_dataset_t cbdata;
+    format = lsdb->db_format;
+    for (unsigned int i = 0; i < sizeof(migrations)/sizeof(migrations[0]); i++) {
+        int j = 0;
 
-        rc = sqlite3_step(stmt);
-        switch (rc) {
-        case SQLITE_DONE:
-        case SQLITE_OK:
-            break;
-        case SQLITE_ROW:
-            cbdata.id  = sqlite3_column_int(stmt, 0);
-            cbdata.mid = sqlite3_column_int(stmt, 1);
-            cbdata.eid = sqlite3_column_int(stmt, 2);
-            cbdata.n   = sqlite3_column_double(stmt, 3);
-            cbdata.T   = sqlite3_column_double(stmt, 4);
+        if (migrations[i].from != format) {
+            continue;
+        }
 
-            if (sink(lsdb, &cbdata, udata) != LSDB_SUCCESS) {
-                sqlite3_finalize(stmt);
+        while ((sql = migrations[i].sql[j])) {
+            rc = sqlite3_exec(lsdb->db, sql, NULL, NULL, &errmsg);
+            if (rc != SQLITE_OK) {
+                lsdb_errmsg(lsdb, "SQL error: %s\n", errmsg);
+                sqlite3_free(errmsg);
+                sqlite3_exec(lsdb->db, "ROLLBACK", NULL, NULL, NULL);
                 return LSDB_FAILURE;
             }
+            j++;
+        }
 
-            break;
-        default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
+        if (migrations[i].hook && migrations[i].hook(lsdb) != LSDB_SUCCESS) {
+            lsdb_errmsg(lsdb, "Upgrade from format %d failed\n", format);
+            sqlite3_exec(lsdb->db, "ROLLBACK", NULL, NULL, NULL);
             return LSDB_FAILURE;
-            break;
         }
-    } while (rc == SQLITE_ROW);
 
+        format++;
+    }
+
+    if (format != LSDB_DB_FORMAT) {
+        lsdb_errmsg(lsdb, "No upgrade path from DB format %d\n", format);
+        sqlite3_exec(lsdb->db, "ROLLBACK", NULL, NULL, NULL);
+        return LSDB_FAILURE;
+    }
+
+    sql = "UPDATE lsdb SET value = ? WHERE property = 'format'";
+    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    sqlite3_bind_int(stmt, 1, format);
+    rc = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
 
+    if (rc != SQLITE_DONE ||
+        sqlite3_exec(lsdb->db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        sqlite3_exec(lsdb->db, "ROLLBACK", NULL, NULL, NULL);
+        return LSDB_FAILURE;
+    }
+
+    lsdb->db_format = format;
+    lsdb_bump_gen(lsdb);
+
     return LSDB_SUCCESS;
 }
 
-int lsdb_del_dataset(lsdb_t *lsdb, unsigned long id)
+int lsdb_upgrade(lsdb_t *lsdb)
 {
-    return lsdb_del_entity(lsdb, "datasets", id);
+    int rc;
+
+    if (!lsdb) {
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb->snap) {
+        lsdb_errmsg(lsdb, "Operation not supported on a snapshot\n");
+        return LSDB_FAILURE;
+    }
+
+    if (lsdb->db_format == LSDB_DB_FORMAT) {
+        return LSDB_SUCCESS;
+    }
+
+    if (lsdb_write_lock(lsdb) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    rc = upgrade(lsdb);
+
+    lsdb_write_unlock(lsdb);
+
+    return rc;
 }
 
-lsdb_dataset_data_t *lsdb_get_dataset_data(const lsdb_t *lsdb, int did)
+/*
+ * Store the quantiles of the datasets lacking them, e.g., those added before
+ * format 4. Returns the number of datasets updated, or -1 on error
+ */
+int lsdb_backfill_quantiles(lsdb_t *lsdb)
 {
-    lsdb_dataset_data_t *ds;
-    const char *sql;
     sqlite3_stmt *stmt;
+    int *dids = NULL;
+    size_t ndids = 0, nalloc = 0;
+    int nupdated = 0;
     int rc;
-    unsigned int i;
 
-    sql = "SELECT ds.n, ds.T, count(*)" \
-          " FROM datasets AS ds INNER JOIN data AS d ON (ds.id = d.did)" \
-          " WHERE ds.id = ?";
+    if (!lsdb) {
+        return -1;
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
-    sqlite3_bind_int(stmt, 1, did);
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
-        double n, T;
-        size_t len;
+    if (lsdb->snap) {
+        lsdb_errmsg(lsdb, "Operation not supported on a snapshot\n");
+        return -1;
+    }
 
-        n   = sqlite3_column_double(stmt, 0);
-        T   = sqlite3_column_double(stmt, 1);
-        len = sqlite3_column_int64 (stmt, 2);
+    if (lsdb->db_format < 4) {
+        lsdb_errmsg(lsdb, "DB format %d has no quantiles; upgrade it first\n",
+            lsdb->db_format);
+        return -1;
+    }
 
-        sqlite3_finalize(stmt);
+    if (lsdb_write_lock(lsdb) != LSDB_SUCCESS) {
+        return -1;
+    }
 
-        if (len == 0) {
-            lsdb_errmsg(lsdb, "Dataset %d not found\n", did);
-            return NULL;
-        }
-        ds = lsdb_dataset_data_new(n, T, len);
-        if (!ds) {
-            lsdb_errmsg(lsdb, "Dataset allocation failed\n");
-            return NULL;
+    /* collect the IDs first, so that the table isn't modified while read */
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_NO_QUANTILES);
+    if (!stmt) {
+        lsdb_write_unlock(lsdb);
+        return -1;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (ndids >= nalloc) {
+            int *p = realloc(dids, sizeof(int)*(nalloc + 128));
+            if (!p) {
+                break;
+            }
+            dids = p;
+            nalloc += 128;
         }
-    } else {
-        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-        sqlite3_finalize(stmt);
-        return NULL;
+        dids[ndids++] = sqlite3_column_int(stmt, 0);
     }
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_NO_QUANTILES, stmt);
 
-    sql = "SELECT x, y FROM data WHERE data.did = ? ORDER BY x";
+    if (rc != SQLITE_DONE) {
+        lsdb_errmsg(lsdb, "Failed reading dataset IDs\n");
+        free(dids);
+        lsdb_write_unlock(lsdb);
+        return -1;
+    }
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
-    sqlite3_bind_int(stmt, 1, did);
+    if (lsdb_exec(lsdb, "SAVEPOINT backfill_quantiles") != LSDB_SUCCESS) {
+        free(dids);
+        lsdb_write_unlock(lsdb);
+        return -1;
+    }
 
-    i = 0;
-    do {
-        rc = sqlite3_step(stmt);
-        switch (rc) {
-        case SQLITE_DONE:
-        case SQLITE_OK:
-            break;
-        case SQLITE_ROW:
-            ds->x[i] = sqlite3_column_double(stmt, 0);
-            ds->y[i] = sqlite3_column_double(stmt, 1);
-            i++;
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_SET_QUANTILES);
+    rc = stmt ? SQLITE_DONE:SQLITE_ERROR;
+
+    for (size_t i = 0; i < ndids && rc == SQLITE_DONE; i++) {
+        lsdb_dataset_data_t *ds = get_dataset_data_blob(lsdb, dids[i]);
+        double q[LSDB_NQUANTILES], norm;
+
+        if (!ds) {
+            rc = SQLITE_ERROR;
             break;
-        default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
-            lsdb_dataset_data_free(ds);
-            return NULL;
         }
-    } while (rc == SQLITE_ROW && i < ds->len);
 
-    sqlite3_finalize(stmt);
+        /* e.g., all-zero profiles have none; they are left as they are */
+        if (get_quantiles(lsdb, ds->x, ds->y, ds->len, q, &norm)) {
+            sqlite3_bind_double(stmt, 1, norm);
+            sqlite3_bind_blob  (stmt, 2, q, sizeof(q), SQLITE_STATIC);
+            sqlite3_bind_int   (stmt, 3, dids[i]);
 
-    return ds;
+            rc = sqlite3_step(stmt);
+            if (rc == SQLITE_DONE) {
+                nupdated++;
+            } else {
+                lsdb_errmsg(lsdb, "SQL error: %s\n",
+                    sqlite3_errmsg(lsdb_db(lsdb)));
+            }
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+
+        lsdb_dataset_data_free(ds);
+    }
+
+    if (stmt) {
+        lsdb_stmt_release(lsdb, LSDB_STMT_SET_QUANTILES, stmt);
+    }
+    free(dids);
+
+    if (rc != SQLITE_DONE ||
+        lsdb_exec(lsdb, "RELEASE backfill_quantiles") != LSDB_SUCCESS) {
+        lsdb_exec(lsdb, "ROLLBACK TO backfill_quantiles");
+        lsdb_exec(lsdb, "RELEASE backfill_quantiles");
+        lsdb_write_unlock(lsdb);
+        return -1;
+    }
+
+    /* cached datasets and morphs are without the quantiles */
+    if (nupdated) {
+        lsdb_bump_gen(lsdb);
+    }
+
+    lsdb_write_unlock(lsdb);
+
+    return nupdated;
 }
 
 /*
  * Find nearest four datasets (the list can be partly or fully degenerate)
  * In the (n, T) plane, did1...did4 correspond to the bottom-left, bottom-right,
- * top-right, and top-left, respectively
+ * top-right, and top-left, respectively. Of equally distant datasets, the one
+ * with the smallest ID is taken
  */
 int lsdb_get_closest_dids(const lsdb_t *lsdb,
     unsigned int mid, unsigned int eid, unsigned int lid,
@@ -879,9 +2917,6 @@ int lsdb_get_closest_dids(const lsdb_t *lsdb,
     unsigned long *did1, unsigned long *did2,
     unsigned long *did3, unsigned long *did4)
 {
-    const char *sql;
-    sqlite3_stmt *stmt;
-    bool found = false;
     int rc;
 
     *did1 = *did2 = *did3 = *did4 = 0;
@@ -890,11 +2925,38 @@ int lsdb_get_closest_dids(const lsdb_t *lsdb,
         return LSDB_FAILURE;
     }
 
-    sql = "SELECT id, (n - ?)/? AS dn, (T - ?)/? AS dT" \
-          " FROM datasets WHERE mid = ? AND eid = ? AND lid = ?" \
-          " ORDER BY dn*dn + dT*dT";
+    rc = lsdb_spindex_get_closest_dids(lsdb, mid, eid, lid, n, T,
+        did1, did2, did3, did4);
+    if (rc >= 0 || lsdb->snap) {
+        return rc == LSDB_SUCCESS ? LSDB_SUCCESS:LSDB_FAILURE;
+    }
+
+    /* fall back to the SQL search */
+    return lsdb_get_closest_dids_sql(lsdb, mid, eid, lid, n, T,
+        did1, did2, did3, did4);
+}
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+/* the same, bypassing the spatial index */
+int lsdb_get_closest_dids_sql(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T,
+    unsigned long *did1, unsigned long *did2,
+    unsigned long *did3, unsigned long *did4)
+{
+    sqlite3_stmt *stmt;
+    bool found = false;
+    int rc;
+
+    *did1 = *did2 = *did3 = *did4 = 0;
+
+    if (n <= 0 || T <= 0 || lsdb->snap) {
+        return LSDB_FAILURE;
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_CLOSEST_DIDS);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
 
     sqlite3_bind_double(stmt, 1, n);
     sqlite3_bind_double(stmt, 2, n);
@@ -937,12 +2999,12 @@ int lsdb_get_closest_dids(const lsdb_t *lsdb,
 
             break;
         default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
             break;
         }
     } while (rc == SQLITE_ROW && !found);
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_CLOSEST_DIDS, stmt);
 
     if (found) {
         return LSDB_SUCCESS;
@@ -951,18 +3013,135 @@ int lsdb_get_closest_dids(const lsdb_t *lsdb,
     }
 }
 
+/* all datasets of the triple, in no particular order */
+int lsdb_get_grid(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    lsdb_grid_point_t **pts, size_t *npts)
+{
+    sqlite3_stmt *stmt;
+    size_t nalloc = 0;
+    int rc;
+
+    *pts  = NULL;
+    *npts = 0;
+
+    if (lsdb->snap) {
+        return lsdbx_get_grid(lsdb, mid, eid, lid, pts, npts);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_GRID);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    sqlite3_bind_int(stmt, 1, mid);
+    sqlite3_bind_int(stmt, 2, eid);
+    sqlite3_bind_int(stmt, 3, lid);
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        lsdb_grid_point_t *p;
+
+        if (*npts >= nalloc) {
+            nalloc = nalloc ? 2*nalloc:64;
+            p = realloc(*pts, nalloc*sizeof(lsdb_grid_point_t));
+            if (!p) {
+                break;
+            }
+            *pts = p;
+        }
+
+        p = &(*pts)[(*npts)++];
+        p->id = sqlite3_column_int64 (stmt, 0);
+        p->n  = sqlite3_column_double(stmt, 1);
+        p->T  = sqlite3_column_double(stmt, 2);
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_GRID, stmt);
+
+    if (rc != SQLITE_DONE) {
+        if (rc == SQLITE_ROW) {
+            lsdb_errmsg(lsdb, "Memory allocation failed\n");
+        } else {
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+        }
+        free(*pts);
+        *pts  = NULL;
+        *npts = 0;
+        return LSDB_FAILURE;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+/*
+ * Changes whenever another connection commits to the DB; of the connection
+ * the calling thread reads through. The commits of the writer of a
+ * thread-safe handle count for the other connections
+ */
+int lsdb_get_data_version(const lsdb_t *lsdb, long long *data_version)
+{
+    sqlite3_stmt *stmt;
+    int rc;
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_DATA_VERSION);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
+
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        *data_version = sqlite3_column_int64(stmt, 0);
+    } else {
+        lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+    }
+
+    lsdb_stmt_release(lsdb, LSDB_STMT_DATA_VERSION, stmt);
+
+    return rc == SQLITE_ROW ? LSDB_SUCCESS:LSDB_FAILURE;
+}
+
+/*
+ * Check whether the data could have changed since the stamp was taken, by us
+ * or, as of the last lsdb_sync(), by another connection; the stamp is
+ * updated. Called under lsdb_lock() or lsdb_cache_lock()
+ */
+bool lsdb_data_changed(const lsdb_t *lsdb, lsdb_stamp_t *stamp)
+{
+    bool changed = stamp->gen != lsdb->gen;
+
+    stamp->gen = lsdb->gen;
+
+    return changed;
+}
+
+/* the same, without updating the stamp; called under lsdb_rdlock() */
+bool lsdb_data_stale(const lsdb_t *lsdb, const lsdb_stamp_t *stamp)
+{
+    return stamp->gen != lsdb->gen;
+}
+
 int lsdb_get_limits(const lsdb_t *lsdb,
     unsigned int mid, unsigned int eid, unsigned int lid,
     double *nmin, double *nmax, double *Tmin, double *Tmax)
 {
-    const char *sql;
     sqlite3_stmt *stmt;
     int rc;
 
-    sql = "SELECT MIN(n), MAX(n), MIN(T), MAX(T)" \
-          " FROM datasets WHERE mid = ? AND eid = ? AND lid = ?";
+    lsdb_sync(lsdb);
 
-    sqlite3_prepare_v2(lsdb->db, sql, -1, &stmt, NULL);
+    if (lsdb->catalog) {
+        return lsdb_catalog_get_limits(lsdb, mid, eid, lid,
+            nmin, nmax, Tmin, Tmax);
+    }
+
+    if (lsdb->snap) {
+        return lsdbx_get_limits(lsdb, mid, eid, lid, nmin, nmax, Tmin, Tmax);
+    }
+
+    stmt = lsdb_stmt_acquire(lsdb, LSDB_STMT_GET_LIMITS);
+    if (!stmt) {
+        return LSDB_FAILURE;
+    }
 
     sqlite3_bind_int(stmt, 1, mid);
     sqlite3_bind_int(stmt, 2, eid);
@@ -982,14 +3161,14 @@ int lsdb_get_limits(const lsdb_t *lsdb,
 
             break;
         default:
-            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb->db));
-            sqlite3_finalize(stmt);
+            lsdb_errmsg(lsdb, "SQL error: %s\n", sqlite3_errmsg(lsdb_db(lsdb)));
+            lsdb_stmt_release(lsdb, LSDB_STMT_GET_LIMITS, stmt);
             return LSDB_FAILURE;
             break;
         }
     } while (rc == SQLITE_ROW);
 
-    sqlite3_finalize(stmt);
+    lsdb_stmt_release(lsdb, LSDB_STMT_GET_LIMITS, stmt);
     return LSDB_SUCCESS;
 }
 
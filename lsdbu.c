@@ -32,6 +32,9 @@ enum {
     LSDBU_ACTION_NONE,
     LSDBU_ACTION_INFO,
     LSDBU_ACTION_INIT,
+    LSDBU_ACTION_UPGRADE,
+    LSDBU_ACTION_BACKFILL,
+    LSDBU_ACTION_EXPORT,
     LSDBU_ACTION_SET_UNITS,
     LSDBU_ACTION_ADD_MODEL,
     LSDBU_ACTION_ADD_ENV,
@@ -109,48 +112,37 @@ static int read_in(FILE *fp, double **xap, double **yap, size_t *lenp)
     return LSDB_SUCCESS;
 }
 
-static int line_property_sink(const lsdb_t *lsdb,
-    const lsdb_line_property_t *p, void *udata)
+static void print_line_property(lsdbu_t *lsdbu,
+    const lsdb_line_property_t *p)
 {
-    lsdbu_t *lsdbu = udata;
-    (void)(lsdb);
-
     fprintf(lsdbu->fp_out,
         "      id = %lu: \"%s\" => \"%s\"\n",
         p->id, p->name, p->value);
-
-    return LSDB_SUCCESS;
 }
 
-static int dataset_sink(const lsdb_t *lsdb,
-    const lsdb_dataset_t *ds, void *udata)
+static void print_dataset(lsdbu_t *lsdbu, const lsdb_dataset_t *ds)
 {
-    lsdbu_t *lsdbu = udata;
-    (void)(lsdb);
-
     if ((lsdbu->eid != 0 && ds->eid != lsdbu->eid) ||
         (lsdbu->mid != 0 && ds->mid != lsdbu->mid) ||
         (lsdbu->n   >  0 && ds->n   != lsdbu->n)   ||
         (lsdbu->T   >  0 && ds->T   != lsdbu->T)) {
-        return LSDB_SUCCESS;
+        return;
     }
 
     fprintf(lsdbu->fp_out,
         "      id = %lu: (mid = %lu, eid = %lu, n_e = %g cm^-3, T = %g eV)\n",
         ds->id, ds->mid, ds->eid, ds->n, ds->T);
-
-    return LSDB_SUCCESS;
 }
 
-static int line_sink(const lsdb_t *lsdb,
-    const lsdb_line_t *l, void *udata)
+/* returns false if filtered out */
+static bool print_line(lsdbu_t *lsdbu, const lsdb_t *lsdb,
+    const lsdb_line_t *l)
 {
-    lsdbu_t *lsdbu = udata;
     lsdb_units_t units = lsdb_get_units(lsdb);
     double w_cm, e_eV;
 
     if (lsdbu->lid != 0 && l->id != lsdbu->lid) {
-        return LSDB_SUCCESS;
+        return false;
     }
 
     w_cm = l->energy*lsdb_convert_units(units, LSDB_UNITS_INV_CM);
@@ -173,24 +165,14 @@ static int line_sink(const lsdb_t *lsdb,
         fprintf(lsdbu->fp_out, "      T: (%g - %g) eV\n", T_min, T_max);
     }
 
-    if (lsdbu->verbose) {
-        fprintf(lsdbu->fp_out, "    Properties:\n");
-        lsdb_get_line_properties(lsdb, l->id, line_property_sink, lsdbu);
-
-        fprintf(lsdbu->fp_out, "    Datasets:\n");
-        lsdb_get_datasets(lsdb, l->id, dataset_sink, lsdbu);
-    }
-
-    return LSDB_SUCCESS;
+    return true;
 }
 
-static int radiator_sink(const lsdb_t *lsdb,
-    const lsdb_radiator_t *r, void *udata)
+/* returns false if filtered out */
+static bool print_radiator(lsdbu_t *lsdbu, const lsdb_radiator_t *r)
 {
-    lsdbu_t *lsdbu = udata;
-
     if (lsdbu->rid != 0 && r->id != lsdbu->rid) {
-        return LSDB_SUCCESS;
+        return false;
     }
 
     fprintf(lsdbu->fp_out, "  id = %lu: \"%s\"", r->id, r->sym);
@@ -203,11 +185,89 @@ static int radiator_sink(const lsdb_t *lsdb,
     }
 
     fprintf(lsdbu->fp_out, "  Lines:\n");
-    lsdb_get_lines(lsdb, r->id, line_sink, lsdbu);
+
+    return true;
+}
+
+static int line_sink(const lsdb_t *lsdb,
+    const lsdb_line_t *l, void *udata)
+{
+    print_line(udata, lsdb, l);
+
+    return LSDB_SUCCESS;
+}
+
+static int radiator_sink(const lsdb_t *lsdb,
+    const lsdb_radiator_t *r, void *udata)
+{
+    lsdbu_t *lsdbu = udata;
+
+    if (print_radiator(lsdbu, r)) {
+        lsdb_get_lines(lsdb, r->id, line_sink, lsdbu);
+    }
 
     return LSDB_SUCCESS;
 }
 
+/* the same as the radiator_sink() chain, with all the details, in one pass */
+static int print_catalog(const lsdb_t *lsdb, lsdbu_t *lsdbu)
+{
+    lsdb_catalog_entry_t rows[256];
+    lsdb_cursor_t *cur;
+    bool rshown = false, lshown = false, dpending = false;
+    int n;
+
+    cur = lsdb_cursor_catalog(lsdb);
+    if (!cur) {
+        return LSDB_FAILURE;
+    }
+
+    while ((n = lsdb_cursor_next(cur, rows, 256)) > 0) {
+        for (int i = 0; i < n; i++) {
+            const lsdb_catalog_entry_t *c = &rows[i];
+
+            /* the datasets header is due even if there are none */
+            if (dpending && (c->kind == LSDB_CATALOG_RADIATOR ||
+                             c->kind == LSDB_CATALOG_LINE ||
+                             c->kind == LSDB_CATALOG_DATASET)) {
+                fprintf(lsdbu->fp_out, "    Datasets:\n");
+                dpending = false;
+            }
+
+            switch (c->kind) {
+            case LSDB_CATALOG_RADIATOR:
+                rshown = print_radiator(lsdbu, &c->u.r);
+                lshown = false;
+                break;
+            case LSDB_CATALOG_LINE:
+                lshown = rshown && print_line(lsdbu, lsdb, &c->u.l);
+                if (lshown) {
+                    fprintf(lsdbu->fp_out, "    Properties:\n");
+                    dpending = true;
+                }
+                break;
+            case LSDB_CATALOG_LINE_PROPERTY:
+                if (lshown) {
+                    print_line_property(lsdbu, &c->u.p);
+                }
+                break;
+            case LSDB_CATALOG_DATASET:
+                if (lshown) {
+                    print_dataset(lsdbu, &c->u.d);
+                }
+                break;
+            }
+        }
+    }
+    if (dpending) {
+        fprintf(lsdbu->fp_out, "    Datasets:\n");
+    }
+
+    lsdb_cursor_close(cur);
+
+    return n < 0 ? LSDB_FAILURE:LSDB_SUCCESS;
+}
+
 static int environment_sink(const lsdb_t *lsdb,
     const lsdb_environment_t *e, void *udata)
 {
@@ -248,6 +308,61 @@ static int model_sink(const lsdb_t *lsdb,
     return LSDB_SUCCESS;
 }
 
+/* comma-separated list of name[=value] */
+static bool parse_open_opts(char *str, lsdb_open_opts_t *opts)
+{
+    char *token, *value;
+
+    for (token = strtok(str, ","); token; token = strtok(NULL, ",")) {
+        value = strchr(token, '=');
+        if (value) {
+            *value++ = '\0';
+        }
+
+        if (!strcmp(token, "wal") && !value) {
+            opts->wal = true;
+        } else
+        if (!strcmp(token, "nomutex") && !value) {
+            opts->nomutex = true;
+        } else
+        if (!strcmp(token, "immutable") && !value) {
+            opts->immutable = true;
+        } else
+        if (!strcmp(token, "catalog") && !value) {
+            opts->catalog = true;
+        } else
+        if (!strcmp(token, "busy") && value) {
+            opts->busy_timeout = atoi(value);
+        } else
+        if (!strcmp(token, "mmap") && value) {
+            opts->mmap_size = atoll(value);
+        } else
+        if (!strcmp(token, "cache") && value) {
+            opts->cache_size = atoi(value);
+        } else
+        if (!strcmp(token, "temp") && value && !strcmp(value, "file")) {
+            opts->temp_store = LSDB_TEMP_STORE_FILE;
+        } else
+        if (!strcmp(token, "temp") && value && !strcmp(value, "memory")) {
+            opts->temp_store = LSDB_TEMP_STORE_MEMORY;
+        } else
+        if (!strcmp(token, "sync") && value && !strcmp(value, "off")) {
+            opts->synchronous = LSDB_SYNC_OFF;
+        } else
+        if (!strcmp(token, "sync") && value && !strcmp(value, "normal")) {
+            opts->synchronous = LSDB_SYNC_NORMAL;
+        } else
+        if (!strcmp(token, "sync") && value && !strcmp(value, "full")) {
+            opts->synchronous = LSDB_SYNC_FULL;
+        } else {
+            fprintf(stderr, "Unrecognized DB option %s\n", token);
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static void usage(const char *arg0, FILE *out)
 {
     fprintf(out, "Usage: %s [options] <database>\n", arg0);
@@ -264,7 +379,11 @@ static void usage(const char *arg0, FILE *out)
     fprintf(out, "  -T <T>                set temperature to T eV [0]\n");
     fprintf(out, "  -p                    print interpolated lineshape\n");
     fprintf(out, "  -c                    convolve with the Doppler broadening\n");
+    fprintf(out, "  -q                    interpolate in the quantile space\n");
     fprintf(out, "  -I                    initialize the DB\n");
+    fprintf(out, "  -u                    upgrade the DB to the current format\n");
+    fprintf(out, "  -Q                    store missing quantile tables of datasets\n");
+    fprintf(out, "  -x <filename>         export a read-only snapshot of the DB\n");
     fprintf(out, "  -U <units>            set units (1/cm|eV|au|custom) [none]\n");
     fprintf(out, "  -M <name[,descr]>     add a model\n");
     fprintf(out, "  -E <name[,descr]>     add an environment\n");
@@ -273,6 +392,10 @@ static void usage(const char *arg0, FILE *out)
     fprintf(out, "  -D <filename>         add a dataset\n");
     fprintf(out, "  -P <name,value>       add a line property\n");
     fprintf(out, "  -X                    delete an entity by its ID\n");
+    fprintf(out, "  -O <opt[,opt...]>     DB open options: wal, busy=<ms>, mmap=<bytes>,\n");
+    fprintf(out, "                        cache=<pages|-KiB>, temp=<file|memory>,\n");
+    fprintf(out, "                        sync=<off|normal|full>, nomutex, immutable,\n");
+    fprintf(out, "                        catalog\n");
     fprintf(out, "  -v                    be more verbose (together with \"-i\")\n");
     fprintf(out, "  -V                    print version info and exit\n");
     fprintf(out, "  -h                    print this help and exit\n");
@@ -295,6 +418,7 @@ int main(int argc, char **argv)
 
     int action = LSDBU_ACTION_NONE;
     char *dbfile;
+    const char *xfile = NULL;
     int db_access = LSDB_ACCESS_RO;
     lsdb_t *lsdb;
     bool OK = true;
@@ -309,16 +433,19 @@ int main(int argc, char **argv)
     double mass = 0, w0 = 0, *x = NULL, *y = NULL;
     size_t len;
     bool doppler = false;
+    lsdb_interp_engine_t engine = LSDB_INTERP_MORPH;
     lsdb_units_t units = LSDB_UNITS_NONE;
+    lsdb_open_opts_t open_opts;
 
     int opt;
 
     memset(lsdbu, 0, sizeof(lsdbu_t));
+    memset(&open_opts, 0, sizeof(lsdb_open_opts_t));
     lsdbu->fp_out = stdout;
     lsdbu->verbose = false;
 
     while ((opt = getopt(argc, argv,
-        "id:o:m:e:r:l:t:n:T:pcIU:M:E:R:L:D:P:XvVh")) != -1) {
+        "id:o:m:e:r:l:t:n:T:pcqIuQx:U:M:E:R:L:D:P:XO:vVh")) != -1) {
         switch (opt) {
         case 'i':
             action = LSDBU_ACTION_INFO;
@@ -399,9 +526,22 @@ int main(int argc, char **argv)
         case 'c':
             doppler = true;
             break;
+        case 'q':
+            engine = LSDB_INTERP_QUANTILE;
+            break;
         case 'I':
             action = LSDBU_ACTION_INIT;
             break;
+        case 'u':
+            action = LSDBU_ACTION_UPGRADE;
+            break;
+        case 'Q':
+            action = LSDBU_ACTION_BACKFILL;
+            break;
+        case 'x':
+            action = LSDBU_ACTION_EXPORT;
+            xfile = optarg;
+            break;
         case 'U':
             action = LSDBU_ACTION_SET_UNITS;
             if (!strcmp(optarg, "1/cm")) {
@@ -537,6 +677,11 @@ int main(int argc, char **argv)
         case 'X':
             action = LSDBU_ACTION_DEL_ENTITY;
             break;
+        case 'O':
+            if (!parse_open_opts(optarg, &open_opts)) {
+                exit(1);
+            }
+            break;
         case 'v':
             lsdbu->verbose = true;
             break;
@@ -564,6 +709,7 @@ int main(int argc, char **argv)
 
     switch (action) {
     case LSDBU_ACTION_INFO:
+    case LSDBU_ACTION_EXPORT:
     case LSDBU_ACTION_GET_DATA:
     case LSDBU_ACTION_INTERPOLATE:
         db_access = LSDB_ACCESS_RO;
@@ -571,6 +717,8 @@ int main(int argc, char **argv)
     case LSDBU_ACTION_INIT:
         db_access = LSDB_ACCESS_INIT;
         break;
+    case LSDBU_ACTION_UPGRADE:
+    case LSDBU_ACTION_BACKFILL:
     case LSDBU_ACTION_SET_UNITS:
     case LSDBU_ACTION_ADD_MODEL:
     case LSDBU_ACTION_ADD_ENV:
@@ -588,7 +736,7 @@ int main(int argc, char **argv)
         break;
     }
 
-    lsdb = lsdb_open(dbfile, db_access);
+    lsdb = lsdb_open_ex(dbfile, db_access, &open_opts);
     if (!lsdb) {
         fprintf(stderr, "DB initialization failed\n");
         exit(1);
@@ -597,6 +745,31 @@ int main(int argc, char **argv)
     if (action == LSDBU_ACTION_INIT) {
         ;
     } else
+    if (action == LSDBU_ACTION_UPGRADE) {
+        int format = lsdb_get_format(lsdb);
+        if (lsdb_upgrade(lsdb) == LSDB_SUCCESS) {
+            fprintf(lsdbu->fp_out, "OK: format %d => %d\n",
+                format, lsdb_get_format(lsdb));
+        } else {
+            fprintf(stderr, "Upgrade failed\n");
+            OK = false;
+        }
+    } else
+    if (action == LSDBU_ACTION_BACKFILL) {
+        int nupdated = lsdb_backfill_quantiles(lsdb);
+        if (nupdated >= 0) {
+            fprintf(lsdbu->fp_out, "OK: %d dataset(s) updated\n", nupdated);
+        } else {
+            fprintf(stderr, "Backfilling quantiles failed\n");
+            OK = false;
+        }
+    } else
+    if (action == LSDBU_ACTION_EXPORT) {
+        if (lsdb_export_snapshot(lsdb, xfile) != LSDB_SUCCESS) {
+            fprintf(stderr, "Export failed\n");
+            OK = false;
+        }
+    } else
     if (action == LSDBU_ACTION_SET_UNITS) {
         id = lsdb_set_units(lsdb, units);
         if (lsdb_set_units(lsdb, units) != LSDB_SUCCESS) {
@@ -747,6 +920,8 @@ int main(int argc, char **argv)
             break;
         }
         if (lsdbu->verbose) {
+            fprintf(lsdbu->fp_out, "Format: %d%s\n", lsdb_get_format(lsdb),
+                lsdb_is_snapshot(lsdb) ? " (snapshot)":"");
             fprintf(lsdbu->fp_out, "Units: %s\n", ustr);
         }
         fprintf(lsdbu->fp_out, "Models:\n");
@@ -754,7 +929,13 @@ int main(int argc, char **argv)
         fprintf(lsdbu->fp_out, "Environments:\n");
         lsdb_get_environments(lsdb, environment_sink, lsdbu);
         fprintf(lsdbu->fp_out, "Radiators:\n");
-        lsdb_get_radiators(lsdb, radiator_sink, lsdbu);
+        if (lsdbu->verbose) {
+            if (print_catalog(lsdb, lsdbu) != LSDB_SUCCESS) {
+                OK = false;
+            }
+        } else {
+            lsdb_get_radiators(lsdb, radiator_sink, lsdbu);
+        }
     } else
     if (action == LSDBU_ACTION_GET_DATA) {
         lsdb_dataset_data_t *ds = lsdb_get_dataset_data(lsdb, did);
@@ -783,6 +964,7 @@ int main(int argc, char **argv)
             OK = false;
         } else {
             double sigma = 0.0;
+            lsdb_set_interp_engine(lsdb, engine);
             if (doppler) {
                 sigma = lsdb_get_doppler_sigma(lsdb, lsdbu->lid, lsdbu->T);
             }
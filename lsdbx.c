@@ -0,0 +1,1334 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Read-only binary snapshots (.lsdbx). The file is a fixed header followed by
+ * the x/y arrays of all datasets and then the catalog tables and a string
+ * pool, all in the host byte order. Opened snapshots are mmap'ed, and all
+ * lookups are done directly on the mapped tables.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+# define LSDBX_NO_MMAP
+#else
+# include <sys/mman.h>
+#endif
+
+#include <lsdb/lsdbP.h>
+
+#define LSDBX_MAGIC     "LSDBX\r\n\032"
+#define LSDBX_VERSION   1
+#define LSDBX_BOM       0x01020304
+
+#define LSDBX_DATA_ALIGN    64
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t bom;
+    int32_t  db_format;
+    int32_t  units;
+    uint64_t size;
+
+    uint64_t nmodels, models_off;
+    uint64_t nenvironments, environments_off;
+    uint64_t nradiators, radiators_off;
+    uint64_t nlines, lines_off;
+    uint64_t nproperties, properties_off;
+    uint64_t ndatasets, datasets_off, dids_off;
+    uint64_t strings_size, strings_off;
+    uint64_t data_size, data_off;
+} lsdbx_header_t;
+
+/* string members are offsets in the string pool */
+typedef struct {
+    uint64_t id;
+    uint64_t name;
+    uint64_t descr;
+} lsdbx_model_t;
+
+typedef lsdbx_model_t lsdbx_environment_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t sym;
+    uint32_t anum;
+    uint32_t zsp;
+    double   mass;
+} lsdbx_radiator_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t rid;
+    uint64_t name;
+    double   energy;
+} lsdbx_line_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t lid;
+    uint64_t name;
+    uint64_t value;
+} lsdbx_property_t;
+
+/*
+ * x[len] followed by y[len] start at data[off]; if nq isn't zero, then come
+ * the norm and the nq quantiles (0 in snapshots of format 3 DBs or older)
+ */
+typedef struct {
+    uint64_t id;
+    uint32_t mid, eid, lid, nq;
+    double   n, T;
+    uint64_t len;
+    uint64_t off;
+    double   xmin, xmax;
+} lsdbx_dataset_t;
+
+struct _lsdbx_t {
+    void  *base;
+    size_t size;
+    /* or read in */
+    bool   mapped;
+
+    const lsdbx_header_t      *hdr;
+    const lsdbx_model_t       *models;
+    const lsdbx_environment_t *environments;
+    const lsdbx_radiator_t    *radiators;
+    const lsdbx_line_t        *lines;
+    const lsdbx_property_t    *properties;
+    /* sorted by (mid, eid, lid, n, T) */
+    const lsdbx_dataset_t     *datasets;
+    /* indices of datasets sorted by ID */
+    const uint32_t            *dids;
+    const char                *strings;
+    const double              *data;
+};
+
+bool lsdbx_probe(const char *fname)
+{
+    char magic[8];
+    bool found = false;
+    FILE *fp;
+
+    fp = fopen(fname, "rb");
+    if (fp) {
+        if (fread(magic, 1, 8, fp) == 8 && !memcmp(magic, LSDBX_MAGIC, 8)) {
+            found = true;
+        }
+        fclose(fp);
+    }
+
+    return found;
+}
+
+static bool section_ok(const lsdbx_t *x,
+    uint64_t off, uint64_t n, size_t size)
+{
+    if (off % 8 || off > x->size) {
+        return false;
+    }
+    if (n > (x->size - off)/size) {
+        return false;
+    }
+
+    return true;
+}
+
+static int lsdbx_validate(const lsdb_t *lsdb, lsdbx_t *x)
+{
+    const lsdbx_header_t *hdr = x->hdr;
+    uint64_t i;
+
+    if (x->size < sizeof(lsdbx_header_t) ||
+        memcmp(hdr->magic, LSDBX_MAGIC, 8) || hdr->size != x->size) {
+        lsdb_errmsg(lsdb, "Not a valid snapshot\n");
+        return LSDB_FAILURE;
+    }
+    if (hdr->version != LSDBX_VERSION) {
+        lsdb_errmsg(lsdb, "Unsupported snapshot version %u\n", hdr->version);
+        return LSDB_FAILURE;
+    }
+    if (hdr->bom != LSDBX_BOM) {
+        lsdb_errmsg(lsdb, "Snapshot was created on a host of different endianness\n");
+        return LSDB_FAILURE;
+    }
+
+    if (!section_ok(x, hdr->models_off, hdr->nmodels, sizeof(lsdbx_model_t)) ||
+        !section_ok(x, hdr->environments_off, hdr->nenvironments,
+            sizeof(lsdbx_environment_t)) ||
+        !section_ok(x, hdr->radiators_off, hdr->nradiators,
+            sizeof(lsdbx_radiator_t)) ||
+        !section_ok(x, hdr->lines_off, hdr->nlines, sizeof(lsdbx_line_t)) ||
+        !section_ok(x, hdr->properties_off, hdr->nproperties,
+            sizeof(lsdbx_property_t)) ||
+        !section_ok(x, hdr->datasets_off, hdr->ndatasets,
+            sizeof(lsdbx_dataset_t)) ||
+        !section_ok(x, hdr->dids_off, hdr->ndatasets, sizeof(uint32_t)) ||
+        !section_ok(x, hdr->strings_off, hdr->strings_size, 1) ||
+        !section_ok(x, hdr->data_off, hdr->data_size, sizeof(double)) ||
+        hdr->strings_size == 0 || hdr->ndatasets > UINT32_MAX) {
+        lsdb_errmsg(lsdb, "Snapshot is corrupted\n");
+        return LSDB_FAILURE;
+    }
+
+    x->models       = (const void *) ((const char *) x->base + hdr->models_off);
+    x->environments = (const void *) ((const char *) x->base + hdr->environments_off);
+    x->radiators    = (const void *) ((const char *) x->base + hdr->radiators_off);
+    x->lines        = (const void *) ((const char *) x->base + hdr->lines_off);
+    x->properties   = (const void *) ((const char *) x->base + hdr->properties_off);
+    x->datasets     = (const void *) ((const char *) x->base + hdr->datasets_off);
+    x->dids         = (const void *) ((const char *) x->base + hdr->dids_off);
+    x->strings      = (const char *) x->base + hdr->strings_off;
+    x->data         = (const void *) ((const char *) x->base + hdr->data_off);
+
+    /* all string references must point inside the (NUL-terminated) pool */
+    if (x->strings[hdr->strings_size - 1] != '\0') {
+        lsdb_errmsg(lsdb, "Snapshot is corrupted\n");
+        return LSDB_FAILURE;
+    }
+#define STR_OK(s) ((s) < hdr->strings_size)
+    for (i = 0; i < hdr->nmodels; i++) {
+        if (!STR_OK(x->models[i].name) || !STR_OK(x->models[i].descr)) {
+            goto corrupted;
+        }
+    }
+    for (i = 0; i < hdr->nenvironments; i++) {
+        if (!STR_OK(x->environments[i].name) ||
+            !STR_OK(x->environments[i].descr)) {
+            goto corrupted;
+        }
+    }
+    for (i = 0; i < hdr->nradiators; i++) {
+        if (!STR_OK(x->radiators[i].sym)) {
+            goto corrupted;
+        }
+    }
+    for (i = 0; i < hdr->nlines; i++) {
+        if (!STR_OK(x->lines[i].name)) {
+            goto corrupted;
+        }
+    }
+    for (i = 0; i < hdr->nproperties; i++) {
+        if (!STR_OK(x->properties[i].name) || !STR_OK(x->properties[i].value)) {
+            goto corrupted;
+        }
+    }
+#undef STR_OK
+    for (i = 0; i < hdr->ndatasets; i++) {
+        const lsdbx_dataset_t *d = &x->datasets[i];
+        if (d->len < 2 || d->off > hdr->data_size ||
+            d->len > (hdr->data_size - d->off)/2 ||
+            (d->nq && (d->nq != LSDB_NQUANTILES ||
+                 d->nq + 1 > hdr->data_size - d->off - 2*d->len)) ||
+            x->dids[i] >= hdr->ndatasets) {
+            goto corrupted;
+        }
+    }
+
+    return LSDB_SUCCESS;
+
+corrupted:
+    lsdb_errmsg(lsdb, "Snapshot is corrupted\n");
+    return LSDB_FAILURE;
+}
+
+/* the file is mapped, unless loaded into memory up front */
+lsdbx_t *lsdbx_open(lsdb_t *lsdb, const char *fname, bool load)
+{
+    lsdbx_t *x;
+    FILE *fp;
+    long size;
+
+    x = calloc(1, sizeof(lsdbx_t));
+    if (!x) {
+        return NULL;
+    }
+
+    fp = fopen(fname, "rb");
+    if (!fp) {
+        lsdb_errmsg(lsdb, "Cannot open snapshot \"%s\"\n", fname);
+        free(x);
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0) {
+        lsdb_errmsg(lsdb, "Cannot read snapshot \"%s\"\n", fname);
+        fclose(fp);
+        free(x);
+        return NULL;
+    }
+    x->size = size;
+    if (x->size < sizeof(lsdbx_header_t)) {
+        lsdb_errmsg(lsdb, "Not a valid snapshot\n");
+        fclose(fp);
+        free(x);
+        return NULL;
+    }
+
+#ifndef LSDBX_NO_MMAP
+    if (!load) {
+        x->base = mmap(NULL, x->size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+        if (x->base == MAP_FAILED) {
+            x->base = NULL;
+        } else {
+            x->mapped = true;
+        }
+    } else
+#endif
+    {
+        x->base = malloc(x->size);
+        if (x->base) {
+            rewind(fp);
+            if (fread(x->base, 1, x->size, fp) != x->size) {
+                free(x->base);
+                x->base = NULL;
+            }
+        }
+    }
+    fclose(fp);
+
+    if (!x->base) {
+        lsdb_errmsg(lsdb, "Cannot map snapshot \"%s\"\n", fname);
+        free(x);
+        return NULL;
+    }
+
+    x->hdr = x->base;
+    if (lsdbx_validate(lsdb, x) != LSDB_SUCCESS) {
+        lsdbx_close(x);
+        return NULL;
+    }
+
+    lsdb->db_format = x->hdr->db_format;
+    lsdb->units     = x->hdr->units;
+
+    if (load) {
+        lsdb->mem_bytes = x->size;
+    }
+
+    return x;
+}
+
+void lsdbx_close(lsdbx_t *x)
+{
+    if (x) {
+#ifndef LSDBX_NO_MMAP
+        if (x->mapped) {
+            munmap(x->base, x->size);
+        } else
+#endif
+        {
+            free(x->base);
+        }
+        free(x);
+    }
+}
+
+int lsdbx_get_models(const lsdb_t *lsdb,
+    lsdb_model_sink_t sink, void *udata)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->nmodels; i++) {
+        lsdb_model_t m;
+
+        m.id    = x->models[i].id;
+        m.name  = x->strings + x->models[i].name;
+        m.descr = x->strings + x->models[i].descr;
+
+        if (sink(lsdb, &m, udata) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_get_environments(const lsdb_t *lsdb,
+    lsdb_environment_sink_t sink, void *udata)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->nenvironments; i++) {
+        lsdb_environment_t e;
+
+        e.id    = x->environments[i].id;
+        e.name  = x->strings + x->environments[i].name;
+        e.descr = x->strings + x->environments[i].descr;
+
+        if (sink(lsdb, &e, udata) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_get_radiators(const lsdb_t *lsdb,
+    lsdb_radiator_sink_t sink, void *udata)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->nradiators; i++) {
+        lsdb_radiator_t r;
+
+        r.id   = x->radiators[i].id;
+        r.sym  = x->strings + x->radiators[i].sym;
+        r.anum = x->radiators[i].anum;
+        r.mass = x->radiators[i].mass;
+        r.zsp  = x->radiators[i].zsp;
+
+        if (sink(lsdb, &r, udata) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_get_lines(const lsdb_t *lsdb, unsigned long rid,
+    lsdb_line_sink_t sink, void *udata)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->nlines; i++) {
+        lsdb_line_t l;
+
+        if (x->lines[i].rid != rid) {
+            continue;
+        }
+
+        l.id     = x->lines[i].id;
+        l.name   = x->strings + x->lines[i].name;
+        l.energy = x->lines[i].energy;
+
+        if (sink(lsdb, &l, udata) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_get_line_properties(const lsdb_t *lsdb, unsigned long lid,
+    lsdb_line_property_sink_t sink, void *udata)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->nproperties; i++) {
+        lsdb_line_property_t p;
+
+        if (x->properties[i].lid != lid) {
+            continue;
+        }
+
+        p.id    = x->properties[i].id;
+        p.name  = x->strings + x->properties[i].name;
+        p.value = x->strings + x->properties[i].value;
+
+        if (sink(lsdb, &p, udata) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_get_datasets(const lsdb_t *lsdb, unsigned long lid,
+    lsdb_dataset_sink_t sink, void *udata)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->ndatasets; i++) {
+        const lsdbx_dataset_t *d = &x->datasets[i];
+        lsdb_dataset_t cbdata;
+
+        if (d->lid != lid) {
+            continue;
+        }
+
+        cbdata.id  = d->id;
+        cbdata.mid = d->mid;
+        cbdata.eid = d->eid;
+        cbdata.n   = d->n;
+        cbdata.T   = d->T;
+
+        if (sink(lsdb, &cbdata, udata) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static const lsdbx_dataset_t *find_dataset(const lsdbx_t *x, uint64_t did)
+{
+    size_t lo = 0, hi = x->hdr->ndatasets;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        const lsdbx_dataset_t *d = &x->datasets[x->dids[mid]];
+
+        if (d->id == did) {
+            return d;
+        } else
+        if (d->id < did) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/* returned arrays point to the mapping and must not be modified */
+lsdb_dataset_data_t *lsdbx_get_dataset_data(const lsdb_t *lsdb, int did)
+{
+    const lsdbx_t *x = lsdb->snap;
+    const lsdbx_dataset_t *d;
+    lsdb_dataset_data_t *ds;
+
+    d = find_dataset(x, did);
+    if (!d) {
+        lsdb_errmsg(lsdb, "Dataset %d not found\n", did);
+        return NULL;
+    }
+
+    ds = lsdb_dataset_data_view(d->n, d->T, d->len,
+        x->data + d->off, x->data + d->off + d->len);
+    if (!ds) {
+        lsdb_errmsg(lsdb, "Dataset allocation failed\n");
+    } else
+    if (d->nq) {
+        lsdb_dataset_data_priv_t *dsp = (lsdb_dataset_data_priv_t *) ds;
+        const double *p = x->data + d->off + 2*d->len;
+
+        dsp->norm = p[0];
+        dsp->q    = (double *) (p + 1);
+    }
+
+    return ds;
+}
+
+static int key_cmp(const lsdbx_dataset_t *d,
+    unsigned int mid, unsigned int eid, unsigned int lid)
+{
+    if (d->mid != mid) {
+        return d->mid < mid ? -1:1;
+    }
+    if (d->eid != eid) {
+        return d->eid < eid ? -1:1;
+    }
+    if (d->lid != lid) {
+        return d->lid < lid ? -1:1;
+    }
+    return 0;
+}
+
+/* the [first, last) range of datasets of the given (mid, eid, lid) */
+static void find_range(const lsdbx_t *x,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    size_t *first, size_t *last)
+{
+    size_t lo, hi;
+
+    lo = 0;
+    hi = x->hdr->ndatasets;
+    while (lo < hi) {
+        size_t m = lo + (hi - lo)/2;
+        if (key_cmp(&x->datasets[m], mid, eid, lid) < 0) {
+            lo = m + 1;
+        } else {
+            hi = m;
+        }
+    }
+    *first = lo;
+
+    hi = x->hdr->ndatasets;
+    while (lo < hi) {
+        size_t m = lo + (hi - lo)/2;
+        if (key_cmp(&x->datasets[m], mid, eid, lid) <= 0) {
+            lo = m + 1;
+        } else {
+            hi = m;
+        }
+    }
+    *last = lo;
+}
+
+int lsdbx_get_grid(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    lsdb_grid_point_t **pts, size_t *npts)
+{
+    const lsdbx_t *x = lsdb->snap;
+    size_t first, last;
+
+    find_range(x, mid, eid, lid, &first, &last);
+
+    *npts = last - first;
+    *pts  = malloc((*npts ? *npts:1)*sizeof(lsdb_grid_point_t));
+    if (!*pts) {
+        return LSDB_FAILURE;
+    }
+
+    for (size_t i = first; i < last; i++) {
+        (*pts)[i - first].id = x->datasets[i].id;
+        (*pts)[i - first].n  = x->datasets[i].n;
+        (*pts)[i - first].T  = x->datasets[i].T;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_get_limits(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double *nmin, double *nmax, double *Tmin, double *Tmax)
+{
+    const lsdbx_t *x = lsdb->snap;
+    size_t first, last;
+
+    *nmin = *nmax = *Tmin = *Tmax = 0.0;
+
+    find_range(x, mid, eid, lid, &first, &last);
+
+    for (size_t i = first; i < last; i++) {
+        const lsdbx_dataset_t *d = &x->datasets[i];
+
+        if (i == first || d->n < *nmin) {
+            *nmin = d->n;
+        }
+        if (i == first || d->n > *nmax) {
+            *nmax = d->n;
+        }
+        if (i == first || d->T < *Tmin) {
+            *Tmin = d->T;
+        }
+        if (i == first || d->T > *Tmax) {
+            *Tmax = d->T;
+        }
+    }
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_get_line_em(const lsdb_t *lsdb, unsigned long lid,
+    double *energy, double *mass)
+{
+    const lsdbx_t *x = lsdb->snap;
+    uint64_t i, j;
+
+    for (i = 0; i < x->hdr->nlines; i++) {
+        if (x->lines[i].id == lid) {
+            break;
+        }
+    }
+    if (i == x->hdr->nlines) {
+        lsdb_errmsg(lsdb, "Line %lu not found\n", lid);
+        return LSDB_FAILURE;
+    }
+
+    for (j = 0; j < x->hdr->nradiators; j++) {
+        if (x->radiators[j].id == x->lines[i].rid) {
+            break;
+        }
+    }
+    if (j == x->hdr->nradiators) {
+        lsdb_errmsg(lsdb, "Radiator %lu not found\n",
+            (unsigned long) x->lines[i].rid);
+        return LSDB_FAILURE;
+    }
+
+    *energy = x->lines[i].energy;
+    *mass   = x->radiators[j].mass;
+
+    return LSDB_SUCCESS;
+}
+
+int lsdbx_find_radiator(const lsdb_t *lsdb, const char *symbol)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->nradiators; i++) {
+        if (!strcmp(x->strings + x->radiators[i].sym, symbol)) {
+            return x->radiators[i].id;
+        }
+    }
+
+    return -1;
+}
+
+int lsdbx_find_line(const lsdb_t *lsdb, unsigned long rid, const char *name)
+{
+    const lsdbx_t *x = lsdb->snap;
+
+    for (uint64_t i = 0; i < x->hdr->nlines; i++) {
+        if (x->lines[i].rid == rid &&
+            !strcmp(x->strings + x->lines[i].name, name)) {
+            return x->lines[i].id;
+        }
+    }
+
+    return -1;
+}
+
+/* --- export --- */
+
+typedef struct {
+    lsdbx_model_t       *models;
+    size_t               nmodels, amodels;
+    lsdbx_environment_t *environments;
+    size_t               nenvironments, aenvironments;
+    lsdbx_radiator_t    *radiators;
+    size_t               nradiators, aradiators;
+    lsdbx_line_t        *lines;
+    size_t               nlines, alines;
+    lsdbx_property_t    *properties;
+    size_t               nproperties, aproperties;
+    lsdbx_dataset_t     *datasets;
+    size_t               ndatasets, adatasets;
+
+    char                *strings;
+    size_t               strings_size, astrings;
+
+    /* the line being processed */
+    unsigned long        lid;
+} lsdbx_builder_t;
+
+static int add_string(lsdbx_builder_t *b, const char *s, uint64_t *off)
+{
+    size_t pos;
+
+    if (lsdb_add_string(&b->strings, &b->strings_size, &b->astrings,
+            s, &pos) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+    *off = pos;
+
+    return LSDB_SUCCESS;
+}
+
+static int model_sink(const lsdb_t *lsdb,
+    const lsdb_model_t *m, void *udata)
+{
+    lsdbx_builder_t *b = udata;
+    lsdbx_model_t *xm;
+    (void) lsdb;
+
+    LSDB_APPEND(b, models);
+    xm = &b->models[b->nmodels++];
+    xm->id = m->id;
+
+    if (add_string(b, m->name, &xm->name) != LSDB_SUCCESS ||
+        add_string(b, m->descr, &xm->descr) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static int environment_sink(const lsdb_t *lsdb,
+    const lsdb_environment_t *e, void *udata)
+{
+    lsdbx_builder_t *b = udata;
+    lsdbx_environment_t *xe;
+    (void) lsdb;
+
+    LSDB_APPEND(b, environments);
+    xe = &b->environments[b->nenvironments++];
+    xe->id = e->id;
+
+    if (add_string(b, e->name, &xe->name) != LSDB_SUCCESS ||
+        add_string(b, e->descr, &xe->descr) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static int radiator_sink(const lsdb_t *lsdb,
+    const lsdb_radiator_t *r, void *udata)
+{
+    lsdbx_builder_t *b = udata;
+    lsdbx_radiator_t *xr;
+    (void) lsdb;
+
+    LSDB_APPEND(b, radiators);
+    xr = &b->radiators[b->nradiators++];
+    memset(xr, 0, sizeof(lsdbx_radiator_t));
+    xr->id   = r->id;
+    xr->anum = r->anum;
+    xr->zsp  = r->zsp;
+    xr->mass = r->mass;
+
+    return add_string(b, r->sym, &xr->sym);
+}
+
+static int property_sink(const lsdb_t *lsdb,
+    const lsdb_line_property_t *p, void *udata)
+{
+    lsdbx_builder_t *b = udata;
+    lsdbx_property_t *xp;
+    (void) lsdb;
+
+    LSDB_APPEND(b, properties);
+    xp = &b->properties[b->nproperties++];
+    xp->id  = p->id;
+    xp->lid = b->lid;
+
+    if (add_string(b, p->name, &xp->name) != LSDB_SUCCESS ||
+        add_string(b, p->value, &xp->value) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static int dataset_sink(const lsdb_t *lsdb,
+    const lsdb_dataset_t *d, void *udata)
+{
+    lsdbx_builder_t *b = udata;
+    lsdbx_dataset_t *xd;
+    (void) lsdb;
+
+    LSDB_APPEND(b, datasets);
+    xd = &b->datasets[b->ndatasets++];
+    memset(xd, 0, sizeof(lsdbx_dataset_t));
+    xd->id  = d->id;
+    xd->mid = d->mid;
+    xd->eid = d->eid;
+    xd->lid = b->lid;
+    xd->n   = d->n;
+    xd->T   = d->T;
+
+    return LSDB_SUCCESS;
+}
+
+static int line_sink(const lsdb_t *lsdb,
+    const lsdb_line_t *l, void *udata)
+{
+    lsdbx_builder_t *b = udata;
+    lsdbx_line_t *xl;
+
+    LSDB_APPEND(b, lines);
+    xl = &b->lines[b->nlines++];
+    xl->id     = l->id;
+    xl->energy = l->energy;
+
+    if (add_string(b, l->name, &xl->name) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    b->lid = l->id;
+    if (lsdb_get_line_properties(lsdb, l->id, property_sink, b) != LSDB_SUCCESS ||
+        lsdb_get_datasets(lsdb, l->id, dataset_sink, b) != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static int id_cmp(uint64_t a, uint64_t b)
+{
+    return a < b ? -1:(a > b);
+}
+
+static int line_cmp(const void *a, const void *b)
+{
+    return id_cmp(((const lsdbx_line_t *) a)->id,
+                  ((const lsdbx_line_t *) b)->id);
+}
+
+static int property_cmp(const void *a, const void *b)
+{
+    return id_cmp(((const lsdbx_property_t *) a)->id,
+                  ((const lsdbx_property_t *) b)->id);
+}
+
+static int dataset_cmp(const void *a, const void *b)
+{
+    const lsdbx_dataset_t *da = a, *db = b;
+    int rc;
+
+    rc = key_cmp(da, db->mid, db->eid, db->lid);
+    if (rc) {
+        return rc;
+    }
+    if (da->n != db->n) {
+        return da->n < db->n ? -1:1;
+    }
+    if (da->T != db->T) {
+        return da->T < db->T ? -1:1;
+    }
+    return id_cmp(da->id, db->id);
+}
+
+typedef struct {
+    uint64_t id;
+    uint32_t idx;
+} did_index_t;
+
+static int did_cmp(const void *a, const void *b)
+{
+    return id_cmp(((const did_index_t *) a)->id,
+                  ((const did_index_t *) b)->id);
+}
+
+static void builder_free(lsdbx_builder_t *b)
+{
+    free(b->models);
+    free(b->environments);
+    free(b->radiators);
+    free(b->lines);
+    free(b->properties);
+    free(b->datasets);
+    free(b->strings);
+}
+
+static int write_section(FILE *fp, uint64_t *pos, uint64_t *off,
+    const void *p, size_t n, size_t size)
+{
+    static const char zeros[LSDBX_DATA_ALIGN];
+    size_t pad = (8 - *pos % 8) % 8;
+
+    if (pad && fwrite(zeros, 1, pad, fp) != pad) {
+        return LSDB_FAILURE;
+    }
+    *pos += pad;
+    *off = *pos;
+
+    if (n && fwrite(p, size, n, fp) != n) {
+        return LSDB_FAILURE;
+    }
+    *pos += n*size;
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_export_snapshot(const lsdb_t *lsdb, const char *fname)
+{
+    lsdbx_builder_t B, *b = &B;
+    lsdbx_header_t hdr;
+    did_index_t *index = NULL;
+    uint32_t *dids = NULL;
+    FILE *fp = NULL;
+    uint64_t pos, data_size;
+    size_t i;
+
+    if (!lsdb || !fname) {
+        return LSDB_FAILURE;
+    }
+
+    lsdb_sync(lsdb);
+
+    memset(b, 0, sizeof(lsdbx_builder_t));
+
+    /* the pool starts with an empty string */
+    if (add_string(b, "", &pos) != LSDB_SUCCESS ||
+        lsdb_get_models(lsdb, model_sink, b) != LSDB_SUCCESS ||
+        lsdb_get_environments(lsdb, environment_sink, b) != LSDB_SUCCESS ||
+        lsdb_get_radiators(lsdb, radiator_sink, b) != LSDB_SUCCESS) {
+        goto fail;
+    }
+    for (i = 0; i < b->nradiators; i++) {
+        size_t nlines = b->nlines;
+        if (lsdb_get_lines(lsdb, b->radiators[i].id, line_sink, b)
+            != LSDB_SUCCESS) {
+            goto fail;
+        }
+        for (; nlines < b->nlines; nlines++) {
+            b->lines[nlines].rid = b->radiators[i].id;
+        }
+    }
+    if (b->ndatasets > UINT32_MAX) {
+        lsdb_errmsg(lsdb, "Too many datasets for a snapshot\n");
+        goto fail;
+    }
+
+    qsort(b->lines, b->nlines, sizeof(lsdbx_line_t), line_cmp);
+    qsort(b->properties, b->nproperties, sizeof(lsdbx_property_t),
+        property_cmp);
+    qsort(b->datasets, b->ndatasets, sizeof(lsdbx_dataset_t), dataset_cmp);
+
+    index = malloc((b->ndatasets ? b->ndatasets:1)*sizeof(did_index_t));
+    dids  = malloc((b->ndatasets ? b->ndatasets:1)*sizeof(uint32_t));
+    if (!index || !dids) {
+        goto fail;
+    }
+    for (i = 0; i < b->ndatasets; i++) {
+        index[i].id  = b->datasets[i].id;
+        index[i].idx = i;
+    }
+    qsort(index, b->ndatasets, sizeof(did_index_t), did_cmp);
+    for (i = 0; i < b->ndatasets; i++) {
+        dids[i] = index[i].idx;
+    }
+
+    fp = fopen(fname, "wb");
+    if (!fp) {
+        lsdb_errmsg(lsdb, "Cannot open \"%s\" for writing\n", fname);
+        goto fail;
+    }
+
+    /* the header is rewritten once all offsets are known */
+    memset(&hdr, 0, sizeof(lsdbx_header_t));
+    pos = (sizeof(lsdbx_header_t) + LSDBX_DATA_ALIGN - 1)/LSDBX_DATA_ALIGN*
+        LSDBX_DATA_ALIGN;
+    hdr.data_off = pos;
+    for (uint64_t k = 0; k < pos; k++) {
+        fputc(0, fp);
+    }
+
+    data_size = 0;
+    for (i = 0; i < b->ndatasets; i++) {
+        lsdbx_dataset_t *xd = &b->datasets[i];
+        lsdb_dataset_data_t *ds = lsdb_fetch_dataset_data(lsdb, xd->id);
+        const double *q;
+        double norm;
+        bool written;
+
+        if (!ds) {
+            goto fail;
+        }
+
+        xd->len  = ds->len;
+        xd->off  = data_size;
+        xd->xmin = ds->x[0];
+        xd->xmax = ds->x[ds->len - 1];
+
+        written = fwrite(ds->x, sizeof(double), ds->len, fp) == ds->len &&
+                  fwrite(ds->y, sizeof(double), ds->len, fp) == ds->len;
+        q = lsdb_dataset_data_quantiles(ds, &norm);
+        if (written && q) {
+            xd->nq  = LSDB_NQUANTILES;
+            written = fwrite(&norm, sizeof(double), 1, fp) == 1 &&
+                      fwrite(q, sizeof(double), xd->nq, fp) == xd->nq;
+        }
+        lsdb_dataset_data_free(ds);
+        if (!written) {
+            lsdb_errmsg(lsdb, "Failed writing \"%s\"\n", fname);
+            goto fail;
+        }
+
+        data_size += 2*xd->len + (xd->nq ? xd->nq + 1:0);
+    }
+    pos += data_size*sizeof(double);
+
+    if (write_section(fp, &pos, &hdr.models_off,
+            b->models, b->nmodels, sizeof(lsdbx_model_t)) ||
+        write_section(fp, &pos, &hdr.environments_off,
+            b->environments, b->nenvironments, sizeof(lsdbx_environment_t)) ||
+        write_section(fp, &pos, &hdr.radiators_off,
+            b->radiators, b->nradiators, sizeof(lsdbx_radiator_t)) ||
+        write_section(fp, &pos, &hdr.lines_off,
+            b->lines, b->nlines, sizeof(lsdbx_line_t)) ||
+        write_section(fp, &pos, &hdr.properties_off,
+            b->properties, b->nproperties, sizeof(lsdbx_property_t)) ||
+        write_section(fp, &pos, &hdr.datasets_off,
+            b->datasets, b->ndatasets, sizeof(lsdbx_dataset_t)) ||
+        write_section(fp, &pos, &hdr.dids_off,
+            dids, b->ndatasets, sizeof(uint32_t)) ||
+        write_section(fp, &pos, &hdr.strings_off,
+            b->strings, b->strings_size, 1)) {
+        lsdb_errmsg(lsdb, "Failed writing \"%s\"\n", fname);
+        goto fail;
+    }
+
+    memcpy(hdr.magic, LSDBX_MAGIC, 8);
+    hdr.version          = LSDBX_VERSION;
+    hdr.bom              = LSDBX_BOM;
+    hdr.db_format        = lsdb->db_format;
+    hdr.units            = lsdb->units;
+    hdr.size             = pos;
+    hdr.nmodels          = b->nmodels;
+    hdr.nenvironments    = b->nenvironments;
+    hdr.nradiators       = b->nradiators;
+    hdr.nlines           = b->nlines;
+    hdr.nproperties      = b->nproperties;
+    hdr.ndatasets        = b->ndatasets;
+    hdr.strings_size     = b->strings_size;
+    hdr.data_size        = data_size;
+
+    rewind(fp);
+    if (fwrite(&hdr, sizeof(lsdbx_header_t), 1, fp) != 1 || fclose(fp)) {
+        fp = NULL;
+        lsdb_errmsg(lsdb, "Failed writing \"%s\"\n", fname);
+        goto fail;
+    }
+
+    free(index);
+    free(dids);
+    builder_free(b);
+
+    return LSDB_SUCCESS;
+
+fail:
+    if (fp) {
+        fclose(fp);
+    }
+    free(index);
+    free(dids);
+    builder_free(b);
+
+    return LSDB_FAILURE;
+}
+
+/* --- cursors --- */
+
+static int line_rid_cmp(const void *a, const void *b)
+{
+    const lsdbx_line_t *la = *(const lsdbx_line_t * const *) a;
+    const lsdbx_line_t *lb = *(const lsdbx_line_t * const *) b;
+
+    if (la->rid != lb->rid) {
+        return id_cmp(la->rid, lb->rid);
+    }
+    return id_cmp(la->id, lb->id);
+}
+
+static int property_lid_cmp(const void *a, const void *b)
+{
+    const lsdbx_property_t *pa = *(const lsdbx_property_t * const *) a;
+    const lsdbx_property_t *pb = *(const lsdbx_property_t * const *) b;
+
+    if (pa->lid != pb->lid) {
+        return id_cmp(pa->lid, pb->lid);
+    }
+    return id_cmp(pa->id, pb->id);
+}
+
+/* by (lid, mid, eid, n, T), as the datasets of each line are listed */
+static int dataset_lid_cmp(const void *a, const void *b)
+{
+    const lsdbx_dataset_t *da = *(const lsdbx_dataset_t * const *) a;
+    const lsdbx_dataset_t *db = *(const lsdbx_dataset_t * const *) b;
+
+    if (da->lid != db->lid) {
+        return da->lid < db->lid ? -1:1;
+    }
+    return dataset_cmp(da, db);
+}
+
+/* walk the tables sorted by the parents, rather than scanning per parent */
+static int build_catalog(lsdb_cursor_t *cur)
+{
+    const lsdbx_t *x = cur->lsdb->snap;
+    const lsdbx_header_t *h = x->hdr;
+    const lsdbx_line_t **lines;
+    const lsdbx_property_t **props;
+    const lsdbx_dataset_t **dsets;
+    lsdb_catalog_entry_t *c;
+    size_t i, il = 0, ip = 0, id = 0, n = 0;
+
+    lines = malloc((h->nlines ? h->nlines:1)*sizeof(*lines));
+    props = malloc((h->nproperties ? h->nproperties:1)*sizeof(*props));
+    dsets = malloc((h->ndatasets ? h->ndatasets:1)*sizeof(*dsets));
+    cur->catalog = malloc((h->nradiators + h->nlines + h->nproperties +
+        h->ndatasets + 1)*sizeof(lsdb_catalog_entry_t));
+    if (!lines || !props || !dsets || !cur->catalog) {
+        free(lines);
+        free(props);
+        free(dsets);
+        return LSDB_FAILURE;
+    }
+
+    for (i = 0; i < h->nlines; i++) {
+        lines[i] = &x->lines[i];
+    }
+    for (i = 0; i < h->nproperties; i++) {
+        props[i] = &x->properties[i];
+    }
+    for (i = 0; i < h->ndatasets; i++) {
+        dsets[i] = &x->datasets[i];
+    }
+    qsort(lines, h->nlines, sizeof(*lines), line_rid_cmp);
+    qsort(props, h->nproperties, sizeof(*props), property_lid_cmp);
+    qsort(dsets, h->ndatasets, sizeof(*dsets), dataset_lid_cmp);
+
+    for (i = 0; i < h->nradiators; i++) {
+        const lsdbx_radiator_t *r = &x->radiators[i];
+
+        c = &cur->catalog[n++];
+        c->kind = LSDB_CATALOG_RADIATOR;
+        c->rid  = r->id;
+        c->lid  = 0;
+        c->u.r.id   = r->id;
+        c->u.r.sym  = x->strings + r->sym;
+        c->u.r.anum = r->anum;
+        c->u.r.mass = r->mass;
+        c->u.r.zsp  = r->zsp;
+
+        while (il < h->nlines && lines[il]->rid < r->id) {
+            il++;
+        }
+        for (; il < h->nlines && lines[il]->rid == r->id; il++) {
+            const lsdbx_line_t *l = lines[il];
+            size_t lo, hi;
+
+            c = &cur->catalog[n++];
+            c->kind = LSDB_CATALOG_LINE;
+            c->rid  = r->id;
+            c->lid  = l->id;
+            c->u.l.id     = l->id;
+            c->u.l.name   = x->strings + l->name;
+            c->u.l.energy = l->energy;
+
+            /* line IDs aren't ordered by radiator, hence the searches */
+            for (lo = 0, hi = h->nproperties; lo < hi;) {
+                size_t m = lo + (hi - lo)/2;
+                if (props[m]->lid < l->id) {
+                    lo = m + 1;
+                } else {
+                    hi = m;
+                }
+            }
+            for (ip = lo; ip < h->nproperties && props[ip]->lid == l->id;
+                ip++) {
+                c = &cur->catalog[n++];
+                c->kind = LSDB_CATALOG_LINE_PROPERTY;
+                c->rid  = r->id;
+                c->lid  = l->id;
+                c->u.p.id    = props[ip]->id;
+                c->u.p.name  = x->strings + props[ip]->name;
+                c->u.p.value = x->strings + props[ip]->value;
+            }
+
+            for (lo = 0, hi = h->ndatasets; lo < hi;) {
+                size_t m = lo + (hi - lo)/2;
+                if (dsets[m]->lid < l->id) {
+                    lo = m + 1;
+                } else {
+                    hi = m;
+                }
+            }
+            for (id = lo; id < h->ndatasets && dsets[id]->lid == l->id; id++) {
+                c = &cur->catalog[n++];
+                c->kind = LSDB_CATALOG_DATASET;
+                c->rid  = r->id;
+                c->lid  = l->id;
+                c->u.d.id  = dsets[id]->id;
+                c->u.d.mid = dsets[id]->mid;
+                c->u.d.eid = dsets[id]->eid;
+                c->u.d.n   = dsets[id]->n;
+                c->u.d.T   = dsets[id]->T;
+            }
+        }
+    }
+    cur->ncatalog = n;
+
+    free(lines);
+    free(props);
+    free(dsets);
+
+    return LSDB_SUCCESS;
+}
+
+/* strings of the rows point to the mapping */
+int lsdbx_cursor_next(lsdb_cursor_t *cur, void *rows, size_t nrows)
+{
+    const lsdbx_t *x = cur->lsdb->snap;
+    const lsdbx_header_t *h = x->hdr;
+    size_t n = 0;
+
+    switch (cur->type) {
+    case LSDB_CURSOR_MODELS:
+        for (; n < nrows && cur->pos < h->nmodels; cur->pos++) {
+            lsdb_model_t *m = (lsdb_model_t *) rows + n++;
+            m->id    = x->models[cur->pos].id;
+            m->name  = x->strings + x->models[cur->pos].name;
+            m->descr = x->strings + x->models[cur->pos].descr;
+        }
+        break;
+    case LSDB_CURSOR_ENVIRONMENTS:
+        for (; n < nrows && cur->pos < h->nenvironments; cur->pos++) {
+            lsdb_environment_t *e = (lsdb_environment_t *) rows + n++;
+            e->id    = x->environments[cur->pos].id;
+            e->name  = x->strings + x->environments[cur->pos].name;
+            e->descr = x->strings + x->environments[cur->pos].descr;
+        }
+        break;
+    case LSDB_CURSOR_RADIATORS:
+        for (; n < nrows && cur->pos < h->nradiators; cur->pos++) {
+            lsdb_radiator_t *r = (lsdb_radiator_t *) rows + n++;
+            r->id   = x->radiators[cur->pos].id;
+            r->sym  = x->strings + x->radiators[cur->pos].sym;
+            r->anum = x->radiators[cur->pos].anum;
+            r->mass = x->radiators[cur->pos].mass;
+            r->zsp  = x->radiators[cur->pos].zsp;
+        }
+        break;
+    case LSDB_CURSOR_LINES:
+        for (; n < nrows && cur->pos < h->nlines; cur->pos++) {
+            lsdb_line_t *l = (lsdb_line_t *) rows + n;
+            if (x->lines[cur->pos].rid != cur->parent) {
+                continue;
+            }
+            l->id     = x->lines[cur->pos].id;
+            l->name   = x->strings + x->lines[cur->pos].name;
+            l->energy = x->lines[cur->pos].energy;
+            n++;
+        }
+        break;
+    case LSDB_CURSOR_LINE_PROPERTIES:
+        for (; n < nrows && cur->pos < h->nproperties; cur->pos++) {
+            lsdb_line_property_t *p = (lsdb_line_property_t *) rows + n;
+            if (x->properties[cur->pos].lid != cur->parent) {
+                continue;
+            }
+            p->id    = x->properties[cur->pos].id;
+            p->name  = x->strings + x->properties[cur->pos].name;
+            p->value = x->strings + x->properties[cur->pos].value;
+            n++;
+        }
+        break;
+    case LSDB_CURSOR_DATASETS:
+        for (; n < nrows && cur->pos < h->ndatasets; cur->pos++) {
+            const lsdbx_dataset_t *xd = &x->datasets[cur->pos];
+            lsdb_dataset_t *d = (lsdb_dataset_t *) rows + n;
+            if (xd->lid != cur->parent) {
+                continue;
+            }
+            d->id  = xd->id;
+            d->mid = xd->mid;
+            d->eid = xd->eid;
+            d->n   = xd->n;
+            d->T   = xd->T;
+            n++;
+        }
+        break;
+    case LSDB_CURSOR_CATALOG:
+        if (!cur->catalog && build_catalog(cur) != LSDB_SUCCESS) {
+            lsdb_errmsg(cur->lsdb, "Memory allocation failed\n");
+            return -1;
+        }
+        n = cur->ncatalog - cur->pos;
+        if (n > nrows) {
+            n = nrows;
+        }
+        memcpy(rows, cur->catalog + cur->pos, n*sizeof(lsdb_catalog_entry_t));
+        cur->pos += n;
+        break;
+    }
+
+    return n;
+}
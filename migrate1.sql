@@ -0,0 +1,7 @@
+CREATE INDEX IF NOT EXISTS data_did ON data (did);
+
+ALTER TABLE datasets ADD COLUMN len  INTEGER NOT NULL DEFAULT 0;
+ALTER TABLE datasets ADD COLUMN xmin REAL NOT NULL DEFAULT 0;
+ALTER TABLE datasets ADD COLUMN xmax REAL NOT NULL DEFAULT 0;
+ALTER TABLE datasets ADD COLUMN x    BLOB;
+ALTER TABLE datasets ADD COLUMN y    BLOB;
@@ -0,0 +1 @@
+CREATE INDEX datasets_meln ON datasets (mid, eid, lid, n, T);
@@ -0,0 +1,2 @@
+ALTER TABLE datasets ADD COLUMN norm REAL;
+ALTER TABLE datasets ADD COLUMN q    BLOB;
@@ -18,32 +18,197 @@
  * The license text can be found in the LGPL-3.0.txt file.
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
-#include <gsl/gsl_errno.h>
-
 #include <lsdb/morphP.h>
 
 #define MAX2(a,b) ((a) > (b) ? (a):(b))
 #define MIN2(a,b) ((a) < (b) ? (a):(b))
 
+#define MORPH_BLOCK 256
+
+static void steffen_free(steffen_t *s)
+{
+    free(s->x);
+    free(s->c);
+}
+
+static bool steffen_reserve(steffen_t *s, size_t n)
+{
+    double *x, *c;
+
+    if (n <= s->alloc) {
+        return true;
+    }
+
+    x = realloc(s->x, n*sizeof(double));
+    if (!x) {
+        return false;
+    }
+    s->x = x;
+
+    c = realloc(s->c, 4*n*sizeof(double));
+    if (!c) {
+        return false;
+    }
+    s->c = c;
+
+    s->alloc = n;
+
+    return true;
+}
+
+/* the sign convention of GSL */
+static double steffen_copysign(double x, double y)
+{
+    if ((x < 0 && y > 0) || (x > 0 && y < 0)) {
+        return -x;
+    } else {
+        return x;
+    }
+}
+
+/*
+ * Steffen's monotonic spline (M. Steffen, Astron. Astrophys. 239, 443 (1990)),
+ * the same expressions as in gsl_interp_steffen; fails if x is not strictly
+ * increasing
+ */
+static bool steffen_init(steffen_t *s, const double *x, const double *y,
+    size_t n)
+{
+    double *c, yp_last;
+    size_t i;
+
+    if (n < 3 || !steffen_reserve(s, n)) {
+        return false;
+    }
+    for (i = 0; i < n - 1; i++) {
+        if (!(x[i] < x[i + 1])) {
+            return false;
+        }
+    }
+
+    s->n = n;
+    if (s->x != x) {
+        memcpy(s->x, x, n*sizeof(double));
+    }
+    c = s->c;
+
+    /* the slopes go to the c coefficients first */
+    c[1] = (y[1] - y[0])/(x[1] - x[0]);
+    for (i = 1; i < n - 1; i++) {
+        double hi   = x[i + 1] - x[i];
+        double him1 = x[i] - x[i - 1];
+        double si   = (y[i + 1] - y[i])/hi;
+        double sim1 = (y[i] - y[i - 1])/him1;
+        double pi   = (sim1*hi + si*him1)/(him1 + hi);
+
+        c[4*i + 1] = (steffen_copysign(1.0, sim1) + steffen_copysign(1.0, si))*
+            MIN2(fabs(sim1), MIN2(fabs(si), 0.5*fabs(pi)));
+    }
+    yp_last = (y[n - 1] - y[n - 2])/(x[n - 1] - x[n - 2]);
+
+    for (i = 0; i < n - 1; i++) {
+        double hi = x[i + 1] - x[i];
+        double si = (y[i + 1] - y[i])/hi;
+        double yp = c[4*i + 1];
+        double yp_next = i < n - 2 ? c[4*(i + 1) + 1]:yp_last;
+
+        c[4*i + 0] = y[i];
+        c[4*i + 2] = (3*si - 2*yp - yp_next)/hi;
+        c[4*i + 3] = (yp + yp_next - 2*si)/hi/hi;
+    }
+
+    return true;
+}
+
+/*
+ * The interval containing x; as in gsl_interp_accel_find(), the accelerator
+ * only saves the search. The result doesn't depend on it, and the same one
+ * may be used with different splines
+ */
+static inline size_t steffen_find(const steffen_t *s, double x,
+    morph_accel_t *acc)
+{
+    size_t i;
+
+    if (!acc) {
+        return gsl_interp_bsearch(s->x, x, 0, s->n - 1);
+    }
+
+    i = acc->cache;
+    if (i >= s->n - 1) {
+        i = 0;
+    }
+    if (x < s->x[i]) {
+        i = gsl_interp_bsearch(s->x, x, 0, i);
+    } else
+    if (x >= s->x[i + 1]) {
+        i = gsl_interp_bsearch(s->x, x, i, s->n - 1);
+    }
+    acc->cache = i;
+
+    return i;
+}
+
+static double steffen_eval(const steffen_t *s, double x, morph_accel_t *acc)
+{
+    const double *c;
+    double dx;
+    size_t i;
+
+    if (x < s->x[0] || x > s->x[s->n - 1]) {
+        return NAN;
+    }
+
+    i  = steffen_find(s, x, acc);
+    c  = &s->c[4*i];
+    dx = x - s->x[i];
+
+    return c[0] + dx*(c[1] + dx*(c[2] + dx*c[3]));
+}
+
+/* the integral from a to b */
+static double steffen_integ(const steffen_t *s, double a, double b,
+    morph_accel_t *acc)
+{
+    size_t i, ia, ib;
+    double r = 0.0;
+
+    if (a > b || a < s->x[0] || b > s->x[s->n - 1]) {
+        return NAN;
+    } else
+    if (a == b) {
+        return 0.0;
+    }
+
+    ia = steffen_find(s, a, acc);
+    ib = steffen_find(s, b, acc);
+
+    for (i = ia; i <= ib; i++) {
+        const double *c = &s->c[4*i];
+        double x_lo = s->x[i];
+        double x1 = (i == ia) ? a - x_lo:0.0;
+        double x2 = (i == ib) ? b - x_lo:s->x[i + 1] - x_lo;
+
+        r += (1.0/4.0)*c[3]*(x2*x2*x2*x2 - x1*x1*x1*x1)
+           + (1.0/3.0)*c[2]*(x2*x2*x2 - x1*x1*x1)
+           + (1.0/2.0)*c[1]*(x2*x2 - x1*x1)
+           + c[0]*(x2 - x1);
+    }
+
+    return r;
+}
+
 void morph_free(morph_t *m)
 {
     if (m) {
-        if (m->acc_f) {
-            gsl_interp_accel_free(m->acc_f);
-        }
-        if (m->acc_M) {
-            gsl_interp_accel_free(m->acc_M);
-        }
+        free(m->acc_f);
 
-        if (m->spline_f) {
-            gsl_spline_free(m->spline_f);
-        }
-        if (m->spline_M) {
-            gsl_spline_free(m->spline_M);
-        }
+        steffen_free(&m->f);
+        steffen_free(&m->M);
 
         free(m);
     }
@@ -59,20 +224,13 @@ morph_t *morph_new(size_t np)
 
     m->np = np;
 
-    m->spline_f = gsl_spline_alloc(gsl_interp_steffen, np);
-    if (!m->spline_f) {
-        morph_free(m);
-        return NULL;
-    }
-    m->spline_M = gsl_spline_alloc(gsl_interp_steffen, np);
-    if (!m->spline_M) {
+    if (!steffen_reserve(&m->M, np)) {
         morph_free(m);
         return NULL;
     }
 
-    m->acc_f = gsl_interp_accel_alloc();
-    m->acc_M = gsl_interp_accel_alloc();
-    if (!m->acc_f || !m->acc_M) {
+    m->acc_f = calloc(1, sizeof(morph_accel_t));
+    if (!m->acc_f) {
         morph_free(m);
         return NULL;
     }
@@ -80,100 +238,98 @@ morph_t *morph_new(size_t np)
     return m;
 }
 
-void morph_aux_free(morph_aux_t *m)
+void morph_workspace_free(morph_workspace_t *ws)
 {
-    if (m) {
-        if (m->x) {
-            free(m->x);
-        }
-        if (m->M) {
-            free(m->M);
-        }
-        if (m->F) {
-            free(m->F);
-        }
-        if (m->G) {
-            free(m->G);
-        }
+    if (ws) {
+        free(ws->x);
+        free(ws->M);
+        free(ws->F);
+        free(ws->G);
 
-        if (m->acc_g) {
-            gsl_interp_accel_free(m->acc_g);
-        }
-        if (m->acc_f_inv) {
-            gsl_interp_accel_free(m->acc_f_inv);
-        }
-
-        if (m->spline_g) {
-            gsl_spline_free(m->spline_g);
-        }
-        if (m->spline_f_inv) {
-            gsl_spline_free(m->spline_f_inv);
-        }
+        steffen_free(&ws->g);
+        steffen_free(&ws->f_inv);
 
-        free(m);
+        free(ws);
     }
 }
 
-morph_aux_t *morph_aux_new(size_t np)
+morph_workspace_t *morph_workspace_new(void)
 {
-    morph_aux_t *ma = malloc(sizeof(morph_aux_t));
-    if (!ma) {
+    morph_workspace_t *ws = malloc(sizeof(morph_workspace_t));
+    if (!ws) {
         return NULL;
     }
-    memset(ma, 0, sizeof(morph_aux_t));
+    memset(ws, 0, sizeof(morph_workspace_t));
 
-    ma->F = calloc(np, sizeof(double));
-    ma->G = calloc(np, sizeof(double));
+    return ws;
+}
 
-    ma->x = malloc(np*sizeof(double));
-    ma->M = malloc(np*sizeof(double));
-    if (!ma->x || !ma->M || !ma->F || !ma->G) {
-        morph_aux_free(ma);
-        return NULL;
+static bool workspace_reserve(morph_workspace_t *ws, size_t np)
+{
+    double **arrays[4] = {&ws->x, &ws->M, &ws->F, &ws->G};
+
+    if (np <= ws->alloc) {
+        return true;
     }
 
-    ma->spline_f_inv = gsl_spline_alloc(gsl_interp_steffen, np);
-    if (!ma->spline_f_inv) {
-        morph_aux_free(ma);
-        return NULL;
+    for (int k = 0; k < 4; k++) {
+        double *p = realloc(*arrays[k], np*sizeof(double));
+        if (!p) {
+            return false;
+        }
+        *arrays[k] = p;
     }
+    ws->alloc = np;
 
-    ma->acc_g     = gsl_interp_accel_alloc();
-    ma->acc_f_inv = gsl_interp_accel_alloc();
-    if (!ma->acc_g || !ma->acc_f_inv) {
-        morph_aux_free(ma);
-        return NULL;
+    return true;
+}
+
+/* the interval of the uniform M grid containing x, without any search */
+static inline size_t M_index(const morph_t *m, double x)
+{
+    double r = (x - m->xmin)*m->h_inv;
+    size_t i, imax = m->np - 2;
+    const double *Mx = m->M.x;
+
+    if (r <= 0) {
+        i = 0;
+    } else {
+        i = (size_t) r;
+        if (i > imax) {
+            i = imax;
+        }
+    }
+
+    /* correct for rounding, to agree with a bisection over the grid */
+    if (i > 0 && x < Mx[i]) {
+        i--;
+    } else
+    if (i < imax && x >= Mx[i + 1]) {
+        i++;
     }
 
-    return ma;
+    return i;
 }
 
-bool morph_init(morph_t *m,
+/* once the workspace has grown enough, no memory is allocated */
+bool morph_init_ws(morph_t *m, morph_workspace_t *ws,
     const double *xf, const double *yf, size_t lenf,
     const double *xg, const double *yg, size_t leng)
 {
     double xf_min, xf_max, xg_min, xg_max;
 
-    morph_aux_t *ma = morph_aux_new(m->np);
-    if (!ma) {
+    if (!workspace_reserve(ws, m->np)) {
         return false;
     }
-    ma->spline_g = gsl_spline_alloc(gsl_interp_steffen, leng);
-    if (!ma->spline_g) {
-        morph_aux_free(ma);
-        return false;
-    }
-    gsl_spline_init(ma->spline_g, xg, yg, leng);
 
-    if (m->spline_f) {
-        gsl_spline_free(m->spline_f);
-    }
-    m->spline_f = gsl_spline_alloc(gsl_interp_steffen, lenf);
-    if (!m->spline_f) {
-        morph_aux_free(ma);
+    m->acc_f->cache      = 0;
+    ws->acc_g.cache     = 0;
+    ws->acc_f_inv.cache = 0;
+
+    if (!steffen_init(&ws->g, xg, yg, leng) ||
+        !steffen_init(&m->f, xf, yf, lenf)) {
         return false;
     }
-    gsl_spline_init(m->spline_f, xf, yf, lenf);
 
     xf_min = xf[0];
     xf_max = xf[lenf - 1];
@@ -189,43 +345,310 @@ bool morph_init(morph_t *m,
         }
 
         /* store the grid */
-        ma->x[i] = x;
-
-        /* calculate CDFs */
-        ma->F[i] = gsl_spline_eval_integ(m->spline_f, m->xmin, x, m->acc_f);
-        ma->G[i] = gsl_spline_eval_integ(ma->spline_g, m->xmin, x, ma->acc_g);
+        ws->x[i] = x;
+
+        /* calculate CDFs, accumulating the integrals between grid points */
+        if (i == 0) {
+            ws->F[i] = 0.0;
+            ws->G[i] = 0.0;
+        } else {
+            double xp = ws->x[i - 1];
+            ws->F[i] = ws->F[i - 1] + steffen_integ(&m->f, xp, x, m->acc_f);
+            ws->G[i] = ws->G[i - 1] + steffen_integ(&ws->g, xp, x, &ws->acc_g);
+        }
     }
 
     /* normalize CDFs to unity */
-    m->norm_f = ma->F[m->np - 1];
-    m->norm_g = ma->G[m->np - 1];
+    m->norm_f = ws->F[m->np - 1];
+    m->norm_g = ws->G[m->np - 1];
     for (unsigned int i = 0; i < m->np; i++) {
-        ma->F[i] /= m->norm_f;
-        ma->G[i] /= m->norm_g;
+        ws->F[i] /= m->norm_f;
+        ws->G[i] /= m->norm_g;
     }
 
     /* prepare spline for the quantile of F */
-    gsl_spline_init(ma->spline_f_inv, ma->F, ma->x, m->np);
+    if (!steffen_init(&ws->f_inv, ws->F, ws->x, m->np)) {
+        return false;
+    }
 
     /* calculate M on the grid */
     for (unsigned int i = 0; i < m->np; i++) {
-        ma->M[i] = gsl_spline_eval(ma->spline_f_inv, ma->G[i], ma->acc_f_inv);
+        ws->M[i] = steffen_eval(&ws->f_inv, ws->G[i], &ws->acc_f_inv);
     }
 
     /* prepare spline for M */
-    gsl_spline_init(m->spline_M, ma->x, ma->M, m->np);
+    if (!steffen_init(&m->M, ws->x, ws->M, m->np)) {
+        return false;
+    }
+    m->h_inv = (m->np - 1)/(m->xmax - m->xmin);
 
-    morph_aux_free(ma);
+    m->acc_f->cache = 0;
 
     return true;
 }
 
-double morph_eval(const morph_t *m, double t, double x, bool normalize)
+bool morph_init(morph_t *m,
+    const double *xf, const double *yf, size_t lenf,
+    const double *xg, const double *yg, size_t leng)
+{
+    morph_workspace_t *ws = morph_workspace_new();
+    bool rc;
+
+    if (!ws) {
+        return false;
+    }
+
+    rc = morph_init_ws(m, ws, xf, yf, lenf, xg, yg, leng);
+
+    morph_workspace_free(ws);
+
+    return rc;
+}
+
+/*
+ * The quantile function of the profile (x, y), normalized to unity, at the
+ * nq probabilities k/(nq - 1), and the profile's integral. As in morph_init(),
+ * the CDF is integrated over a uniform grid, here of 4*(nq - 1) intervals;
+ * where it is flat, the smallest x is used
+ */
+bool morph_get_quantiles(morph_workspace_t *ws,
+    const double *x, const double *y, size_t len,
+    double *q, size_t nq, double *norm)
+{
+    size_t i, nk, ng = 4*(nq - 1) + 1;
+    double *F, *xk, xmin = x[0], xmax = x[len - 1];
+
+    if (nq < 2 || !workspace_reserve(ws, ng)) {
+        return false;
+    }
+    F  = ws->F;
+    xk = ws->x;
+
+    ws->acc_g.cache     = 0;
+    ws->acc_f_inv.cache = 0;
+
+    if (!steffen_init(&ws->g, x, y, len)) {
+        return false;
+    }
+
+    xk[0] = xmin;
+    F[0]  = 0.0;
+    for (i = 1; i < ng; i++) {
+        xk[i] = xmin + i*(xmax - xmin)/(ng - 1);
+        if (xk[i] > xmax) {
+            xk[i] = xmax;
+        }
+        F[i] = F[i - 1] + steffen_integ(&ws->g, xk[i - 1], xk[i], &ws->acc_g);
+    }
+    *norm = F[ng - 1];
+    if (!(*norm > 0)) {
+        return false;
+    }
+
+    /* the strictly increasing part of the CDF */
+    for (i = 1, nk = 1; i < ng; i++) {
+        double Fi = F[i]/(*norm);
+        if (Fi > F[nk - 1]) {
+            xk[nk] = xk[i];
+            F[nk]  = Fi;
+            nk++;
+        }
+    }
+
+    if (!steffen_init(&ws->f_inv, F, xk, nk)) {
+        return false;
+    }
+
+    for (size_t k = 0; k < nq; k++) {
+        double p = (double) k/(nq - 1);
+
+        if (p >= F[nk - 1]) {
+            q[k] = xk[nk - 1];
+        } else {
+            q[k] = steffen_eval(&ws->f_inv, p, &ws->acc_f_inv);
+        }
+    }
+
+    return true;
+}
+
+/*
+ * The CDF at x of a profile with the nq quantiles q, interpolating linearly
+ * between them
+ */
+static double quantile_cdf(const double *q, size_t nq, double x)
+{
+    size_t lo = 0, hi = nq;
+
+    /* the first quantile above x */
+    while (lo < hi) {
+        size_t mid = (lo + hi)/2;
+        if (q[mid] > x) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    if (lo == 0) {
+        return 0.0;
+    } else
+    if (lo == nq) {
+        return 1.0;
+    } else {
+        return (lo - 1 + (x - q[lo - 1])/(q[lo] - q[lo - 1]))/(nq - 1);
+    }
+}
+
+/*
+ * The map knots of morph_init_q_ws() into ws->F & ws->G where the domain
+ * [m->xmin, m->xmax] clips f or g: the quantile functions of both are
+ * restricted to it and renormalized, as the CDFs of morph_init_ws() are, so
+ * that M stays inside. The norms are scaled to the domain, too. Returns the
+ * number of knots, 0 on failure
+ */
+static size_t clip_knots(morph_t *m, morph_workspace_t *ws,
+    const double *qf, const double *qg, size_t nq)
+{
+    double *xk = ws->F, *Mk = ws->G, *p = ws->x;
+    double pfa, pfb, pga, pgb;
+    size_t k, nk;
+
+    pfa = quantile_cdf(qf, nq, m->xmin);
+    pfb = quantile_cdf(qf, nq, m->xmax);
+    pga = quantile_cdf(qg, nq, m->xmin);
+    pgb = quantile_cdf(qg, nq, m->xmax);
+    if (!(pfa < pfb && pga < pgb)) {
+        return 0;
+    }
+
+    /* the quantile function of f */
+    for (k = 0; k < nq; k++) {
+        p[k] = (double) k/(nq - 1);
+    }
+    if (!steffen_init(&ws->g, p, qf, nq)) {
+        return 0;
+    }
+    ws->acc_g.cache = 0;
+
+    /* the quantiles of g inside, at the probabilities of f they map to */
+    xk[0] = m->xmin;
+    Mk[0] = pfa;
+    for (k = 0, nk = 1; k < nq; k++) {
+        if (qg[k] > xk[nk - 1] && qg[k] < m->xmax) {
+            xk[nk] = qg[k];
+            Mk[nk] = pfa + (p[k] - pga)/(pgb - pga)*(pfb - pfa);
+            nk++;
+        }
+    }
+    xk[nk] = m->xmax;
+    Mk[nk] = pfb;
+    nk++;
+
+    for (k = 0; k < nk; k++) {
+        double M = steffen_eval(&ws->g, MIN2(MAX2(Mk[k], 0.0), 1.0),
+            &ws->acc_g);
+        Mk[k] = MIN2(MAX2(M, m->xmin), m->xmax);
+    }
+
+    m->norm_f *= pfb - pfa;
+    m->norm_g *= pgb - pga;
+
+    return nk;
+}
+
+/*
+ * Same as morph_init_ws(), with the quantile functions of f and g from
+ * morph_get_quantiles(): the transport map goes through the pairs of their
+ * values, which needs neither integrals nor inversions. Where f and g are not
+ * defined over the same range, the quantile functions are taken over the
+ * common one, see clip_knots()
+ */
+bool morph_init_q_ws(morph_t *m, morph_workspace_t *ws,
+    const double *xf, const double *yf, size_t lenf,
+    const double *qf, double norm_f,
+    const double *qg, double norm_g, size_t nq)
+{
+    double *xk, *Mk;
+    size_t k, nk;
+
+    if (!workspace_reserve(ws, MAX2(m->np, nq))) {
+        return false;
+    }
+
+    m->acc_f->cache     = 0;
+    ws->acc_f_inv.cache = 0;
+
+    if (nq < 3 || !steffen_init(&m->f, xf, yf, lenf)) {
+        return false;
+    }
+
+    m->xmin = MAX2(xf[0], qg[0]);
+    m->xmax = MIN2(xf[lenf - 1], qg[nq - 1]);
+    if (!(m->xmin < m->xmax)) {
+        return false;
+    }
+
+    m->norm_f = norm_f;
+    m->norm_g = norm_g;
+
+    /* the map knots, merging the quantiles; steps of g are skipped */
+    xk = ws->F;
+    Mk = ws->G;
+    if (m->xmin > MIN2(qf[0], qg[0]) ||
+        m->xmax < MAX2(qf[nq - 1], qg[nq - 1])) {
+        nk = clip_knots(m, ws, qf, qg, nq);
+        if (!nk) {
+            return false;
+        }
+    } else {
+        xk[0] = qg[0];
+        Mk[0] = qf[0];
+        for (k = 1, nk = 1; k < nq; k++) {
+            if (qg[k] > xk[nk - 1]) {
+                xk[nk] = qg[k];
+                Mk[nk] = qf[k];
+                nk++;
+            }
+        }
+    }
+    if (!steffen_init(&ws->f_inv, xk, Mk, nk)) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < m->np; i++) {
+        double x = m->xmin + i*(m->xmax - m->xmin)/(m->np - 1);
+        if (x > m->xmax) {
+            x = m->xmax;
+        }
+
+        ws->x[i] = x;
+        ws->M[i] = steffen_eval(&ws->f_inv, x, &ws->acc_f_inv);
+    }
+
+    if (!steffen_init(&m->M, ws->x, ws->M, m->np)) {
+        return false;
+    }
+    m->h_inv = (m->np - 1)/(m->xmax - m->xmin);
+
+    return true;
+}
+
+/*
+ * The evaluation only reads m; acc (or none, at the cost of a bisection in
+ * each lookup) keeps the search state, so one morph may be evaluated by many
+ * threads at once, each with its own accelerator
+ */
+double morph_eval_r(const morph_t *m, double t, double x, bool normalize,
+    morph_accel_t *acc)
 {
     double nfactor, T, M, dM_dx, dT_dx, r;
+    size_t i = M_index(m, x);
+    const double *c = &m->M.c[4*i];
+    double dx = x - m->M.x[i];
 
-    M     = gsl_spline_eval(m->spline_M, x, m->acc_M);
-    dM_dx = gsl_spline_eval_deriv(m->spline_M, x, m->acc_M);
+    M     = c[0] + dx*(c[1] + dx*(c[2] + dx*c[3]));
+    dM_dx = c[1] + dx*(2*c[2] + dx*3*c[3]);
 
     T     = (1 - t)*x + t*M;
     dT_dx = (1 - t)   + t*dM_dx;
@@ -238,7 +661,7 @@ double morph_eval(const morph_t *m, double t, double x, bool normalize)
     }
 
     if (T >= m->xmin && T <= m->xmax) {
-        r = nfactor*fabs(dT_dx)*gsl_spline_eval(m->spline_f, T, m->acc_f);
+        r = nfactor*fabs(dT_dx)*steffen_eval(&m->f, T, acc);
     } else {
         r = 0.0;
     }
@@ -246,6 +669,63 @@ double morph_eval(const morph_t *m, double t, double x, bool normalize)
     return r;
 }
 
+/*
+ * Evaluate at n points at once; M is computed for a block of points in a
+ * simple loop first. For sorted x, the transported points are sorted too,
+ * so the accelerated lookups in f advance by at most a few intervals
+ */
+void morph_eval_array_r(const morph_t *m, double t,
+    const double *x, double *y, size_t n, bool normalize, morph_accel_t *acc)
+{
+    double dT_dx[MORPH_BLOCK];
+    double nfactor;
+
+    if (normalize) {
+        nfactor = 1/m->norm_f;
+    } else {
+        nfactor = (1 - t) + t*m->norm_g/m->norm_f;
+    }
+
+    for (size_t j0 = 0; j0 < n; j0 += MORPH_BLOCK) {
+        size_t nb = MIN2(MORPH_BLOCK, n - j0);
+        const double *xb = x + j0;
+        double *Tb = y + j0;
+
+        for (size_t j = 0; j < nb; j++) {
+            size_t i = M_index(m, xb[j]);
+            const double *c = &m->M.c[4*i];
+            double dx = xb[j] - m->M.x[i];
+            double M     = c[0] + dx*(c[1] + dx*(c[2] + dx*c[3]));
+            double dM_dx = c[1] + dx*(2*c[2] + dx*3*c[3]);
+
+            Tb[j]    = (1 - t)*xb[j] + t*M;
+            dT_dx[j] = (1 - t)      + t*dM_dx;
+        }
+
+        for (size_t j = 0; j < nb; j++) {
+            double T = Tb[j];
+
+            if (T >= m->xmin && T <= m->xmax) {
+                Tb[j] = nfactor*fabs(dT_dx[j])*steffen_eval(&m->f, T, acc);
+            } else {
+                Tb[j] = 0.0;
+            }
+        }
+    }
+}
+
+/* the same with the morph's own accelerator; not for concurrent use */
+double morph_eval(const morph_t *m, double t, double x, bool normalize)
+{
+    return morph_eval_r(m, t, x, normalize, m->acc_f);
+}
+
+void morph_eval_array(const morph_t *m, double t,
+    const double *x, double *y, size_t n, bool normalize)
+{
+    morph_eval_array_r(m, t, x, y, n, normalize, m->acc_f);
+}
+
 bool morph_get_domain(const morph_t *m, double *xmin, double *xmax)
 {
     if (m) {
@@ -257,3 +737,134 @@ bool morph_get_domain(const morph_t *m, double *xmin, double *xmax)
         return false;
     }
 }
+
+size_t morph_get_size(const morph_t *m)
+{
+    return m ? m->np:0;
+}
+
+void qprofile_free(qprofile_t *qp)
+{
+    if (qp) {
+        free(qp->acc);
+        free(qp->p);
+
+        steffen_free(&qp->F);
+
+        free(qp);
+    }
+}
+
+qprofile_t *qprofile_new(void)
+{
+    qprofile_t *qp = calloc(1, sizeof(qprofile_t));
+    if (!qp) {
+        return NULL;
+    }
+
+    qp->acc = calloc(1, sizeof(morph_accel_t));
+    if (!qp->acc) {
+        qprofile_free(qp);
+        return NULL;
+    }
+
+    return qp;
+}
+
+/*
+ * The profile whose quantile function, at the nq probabilities k/(nq - 1), is
+ * q, and integral is norm. Its density is the derivative of the CDF, a Steffen
+ * spline through the points (q[k], k/(nq - 1)), so it is continuous and never
+ * negative. Of a run of equal quantiles, the first one is used
+ */
+bool qprofile_init(qprofile_t *qp, const double *q, size_t nq, double norm)
+{
+    double *x, *p;
+    size_t k, nk;
+
+    if (nq < 3 || !steffen_reserve(&qp->F, nq)) {
+        return false;
+    }
+    if (nq > qp->p_alloc) {
+        p = realloc(qp->p, nq*sizeof(double));
+        if (!p) {
+            return false;
+        }
+        qp->p       = p;
+        qp->p_alloc = nq;
+    }
+
+    /* the knots go to the spline's own storage directly */
+    x = qp->F.x;
+    p = qp->p;
+    x[0] = q[0];
+    p[0] = 0.0;
+    for (k = 1, nk = 1; k < nq; k++) {
+        if (q[k] > x[nk - 1]) {
+            x[nk] = q[k];
+            p[nk] = (double) k/(nq - 1);
+            nk++;
+        }
+    }
+    p[nk - 1] = 1.0;
+
+    if (!steffen_init(&qp->F, x, p, nk)) {
+        return false;
+    }
+    qp->norm = norm;
+
+    qp->acc->cache = 0;
+
+    return true;
+}
+
+double qprofile_eval_r(const qprofile_t *qp, double x, bool normalize,
+    morph_accel_t *acc)
+{
+    const steffen_t *F = &qp->F;
+    const double *c;
+    double dx;
+    size_t i;
+
+    if (x < F->x[0] || x > F->x[F->n - 1]) {
+        return 0.0;
+    }
+
+    i  = steffen_find(F, x, acc);
+    c  = &F->c[4*i];
+    dx = x - F->x[i];
+
+    return (normalize ? 1.0:qp->norm)*(c[1] + dx*(2*c[2] + dx*3*c[3]));
+}
+
+void qprofile_eval_array_r(const qprofile_t *qp,
+    const double *x, double *y, size_t n, bool normalize, morph_accel_t *acc)
+{
+    for (size_t j = 0; j < n; j++) {
+        y[j] = qprofile_eval_r(qp, x[j], normalize, acc);
+    }
+}
+
+/* the same with the profile's own accelerator; not for concurrent use */
+double qprofile_eval(const qprofile_t *qp, double x, bool normalize)
+{
+    return qprofile_eval_r(qp, x, normalize, qp->acc);
+}
+
+void qprofile_eval_array(const qprofile_t *qp,
+    const double *x, double *y, size_t n, bool normalize)
+{
+    qprofile_eval_array_r(qp, x, y, n, normalize, qp->acc);
+}
+
+bool qprofile_get_domain(const qprofile_t *qp, double *xmin, double *xmax)
+{
+    if (qp && qp->F.n) {
+        *xmin = qp->F.x[0];
+        *xmax = qp->F.x[qp->F.n - 1];
+
+        return true;
+    } else {
+        return false;
+    }
+}
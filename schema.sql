@@ -47,14 +47,17 @@ CREATE TABLE datasets (
     mid INTEGER NOT NULL REFERENCES models(id) ON DELETE CASCADE,
     n   REAL NOT NULL,
     T   REAL NOT NULL,
+    len  INTEGER NOT NULL DEFAULT 0,
+    xmin REAL NOT NULL DEFAULT 0,
+    xmax REAL NOT NULL DEFAULT 0,
+    x    BLOB,
+    y    BLOB,
+    norm REAL,
+    q    BLOB,
     UNIQUE (lid, eid, mid, n, T)
 );
 
-CREATE TABLE data (
-    did INTEGER NOT NULL REFERENCES datasets(id) ON DELETE CASCADE,
-    x   REAL NOT NULL,
-    y   REAL NOT NULL
-);
+CREATE INDEX datasets_meln ON datasets (mid, eid, lid, n, T);
 
-INSERT INTO lsdb (property, value) VALUES ('format', 1);
+INSERT INTO lsdb (property, value) VALUES ('format', 4);
 INSERT INTO lsdb (property, value) VALUES ('units', 0);
@@ -0,0 +1,345 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * In-memory kd-trees over the (n, T) grids of (mid, eid, lid) triples, used
+ * for the quadrant search of lsdb_get_closest_dids(). The trees are built on
+ * the first use and dropped whenever the data may have changed. Thread-safe
+ * handles share the trees; searches take lsdb_rdlock() only, and lsdb_lock()
+ * if a tree has to be built first.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <lsdb/lsdbP.h>
+
+typedef struct {
+    double nmin, nmax;
+    double Tmin, Tmax;
+} bbox_t;
+
+/* implicit tree: the node of the [lo, hi) range is at lo + (hi - lo)/2 */
+typedef struct {
+    unsigned int mid, eid, lid;
+
+    size_t             npts;
+    lsdb_grid_point_t *pts;
+    bbox_t            *boxes;
+} kdtree_t;
+
+struct _lsdb_spindex_t {
+    lsdb_stamp_t stamp;
+
+    kdtree_t *trees;
+    size_t    ntrees, atrees;
+
+    unsigned long nbuilds;
+};
+
+typedef struct {
+    double n, T;
+    /* quadrant: -1 for "not above", +1 for "not below" the query */
+    int sn, sT;
+
+    double        best;
+    unsigned long id;
+} kdquery_t;
+
+lsdb_spindex_t *lsdb_spindex_new(void)
+{
+    return calloc(1, sizeof(lsdb_spindex_t));
+}
+
+static void spindex_flush(lsdb_spindex_t *si)
+{
+    for (size_t i = 0; i < si->ntrees; i++) {
+        free(si->trees[i].pts);
+        free(si->trees[i].boxes);
+    }
+    si->ntrees = 0;
+}
+
+void lsdb_spindex_free(lsdb_spindex_t *si)
+{
+    if (si) {
+        spindex_flush(si);
+        free(si->trees);
+        free(si);
+    }
+}
+
+unsigned long lsdb_spindex_nbuilds(const lsdb_spindex_t *si)
+{
+    return si->nbuilds;
+}
+
+static int n_cmp(const void *a, const void *b)
+{
+    double na = ((const lsdb_grid_point_t *) a)->n;
+    double nb = ((const lsdb_grid_point_t *) b)->n;
+
+    return (na > nb) - (na < nb);
+}
+
+static int T_cmp(const void *a, const void *b)
+{
+    double Ta = ((const lsdb_grid_point_t *) a)->T;
+    double Tb = ((const lsdb_grid_point_t *) b)->T;
+
+    return (Ta > Tb) - (Ta < Tb);
+}
+
+static double log_span(double vmin, double vmax)
+{
+    if (vmin > 0) {
+        return log(vmax/vmin);
+    } else {
+        return HUGE_VAL;
+    }
+}
+
+static void kd_build(kdtree_t *t, size_t lo, size_t hi)
+{
+    bbox_t *box;
+    size_t i, mid;
+
+    if (lo >= hi) {
+        return;
+    }
+
+    mid = lo + (hi - lo)/2;
+    box = &t->boxes[mid];
+
+    box->nmin = box->nmax = t->pts[lo].n;
+    box->Tmin = box->Tmax = t->pts[lo].T;
+    for (i = lo + 1; i < hi; i++) {
+        const lsdb_grid_point_t *p = &t->pts[i];
+        if (p->n < box->nmin) box->nmin = p->n;
+        if (p->n > box->nmax) box->nmax = p->n;
+        if (p->T < box->Tmin) box->Tmin = p->T;
+        if (p->T > box->Tmax) box->Tmax = p->T;
+    }
+
+    /* grids are typically logarithmic, so split along the wider one */
+    if (log_span(box->nmin, box->nmax) >= log_span(box->Tmin, box->Tmax)) {
+        qsort(&t->pts[lo], hi - lo, sizeof(lsdb_grid_point_t), n_cmp);
+    } else {
+        qsort(&t->pts[lo], hi - lo, sizeof(lsdb_grid_point_t), T_cmp);
+    }
+
+    kd_build(t, lo, mid);
+    kd_build(t, mid + 1, hi);
+}
+
+/* the squared distance of the query from the part of box in the quadrant */
+static bool box_dist(const bbox_t *box, const kdquery_t *q, double *d)
+{
+    double nlo = box->nmin, nhi = box->nmax, Tlo = box->Tmin, Thi = box->Tmax;
+    double dn = 0, dT = 0;
+
+    if (q->sn < 0) {
+        nhi = fmin(nhi, q->n);
+    } else {
+        nlo = fmax(nlo, q->n);
+    }
+    if (q->sT < 0) {
+        Thi = fmin(Thi, q->T);
+    } else {
+        Tlo = fmax(Tlo, q->T);
+    }
+    if (nlo > nhi || Tlo > Thi) {
+        return false;
+    }
+
+    if (q->n < nlo) {
+        dn = (nlo - q->n)/q->n;
+    } else
+    if (q->n > nhi) {
+        dn = (nhi - q->n)/q->n;
+    }
+    if (q->T < Tlo) {
+        dT = (Tlo - q->T)/q->T;
+    } else
+    if (q->T > Thi) {
+        dT = (Thi - q->T)/q->T;
+    }
+
+    *d = dn*dn + dT*dT;
+
+    return true;
+}
+
+/* the box distance of a subtree; HUGE_VAL if none of it is in the quadrant */
+static double kd_dist(const kdtree_t *t, size_t lo, size_t hi,
+    const kdquery_t *q)
+{
+    double d;
+
+    if (lo >= hi || !box_dist(&t->boxes[lo + (hi - lo)/2], q, &d)) {
+        return HUGE_VAL;
+    }
+
+    return d;
+}
+
+static void kd_search(const kdtree_t *t, size_t lo, size_t hi, kdquery_t *q)
+{
+    const lsdb_grid_point_t *p;
+    size_t mid;
+    double d, dn, dT;
+
+    if (lo >= hi) {
+        return;
+    }
+
+    mid = lo + (hi - lo)/2;
+    /* a box at the best distance may still hold a smaller ID */
+    if (!box_dist(&t->boxes[mid], q, &d) || (q->id && d > q->best)) {
+        return;
+    }
+
+    /* same expressions as in the SQL query, to get identical quadrants */
+    p  = &t->pts[mid];
+    dn = (p->n - q->n)/q->n;
+    dT = (p->T - q->T)/q->T;
+    if (q->sn*dn >= 0 && q->sT*dT >= 0) {
+        d = dn*dn + dT*dT;
+        if (!q->id || d < q->best || (d == q->best && p->id < q->id)) {
+            q->best = d;
+            q->id   = p->id;
+        }
+    }
+
+    /* the nearer subtree first, for the earlier pruning of the other one */
+    if (kd_dist(t, lo, mid, q) <= kd_dist(t, mid + 1, hi, q)) {
+        kd_search(t, lo, mid, q);
+        kd_search(t, mid + 1, hi, q);
+    } else {
+        kd_search(t, mid + 1, hi, q);
+        kd_search(t, lo, mid, q);
+    }
+}
+
+static kdtree_t *spindex_find(const lsdb_spindex_t *si,
+    unsigned int mid, unsigned int eid, unsigned int lid)
+{
+    for (size_t i = 0; i < si->ntrees; i++) {
+        kdtree_t *t = &si->trees[i];
+        if (t->mid == mid && t->eid == eid && t->lid == lid) {
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+/* call under lsdb_lock() */
+static kdtree_t *spindex_get(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid)
+{
+    lsdb_spindex_t *si = lsdb->si;
+    kdtree_t *t;
+
+    if (lsdb_data_changed(lsdb, &si->stamp)) {
+        spindex_flush(si);
+    }
+
+    t = spindex_find(si, mid, eid, lid);
+    if (t) {
+        return t;
+    }
+
+    if (si->ntrees >= si->atrees) {
+        size_t nalloc = si->atrees ? 2*si->atrees:8;
+        void *p = realloc(si->trees, nalloc*sizeof(kdtree_t));
+        if (!p) {
+            return NULL;
+        }
+        si->trees  = p;
+        si->atrees = nalloc;
+    }
+
+    t = &si->trees[si->ntrees];
+    memset(t, 0, sizeof(kdtree_t));
+    t->mid = mid;
+    t->eid = eid;
+    t->lid = lid;
+
+    if (lsdb_get_grid(lsdb, mid, eid, lid, &t->pts, &t->npts) != LSDB_SUCCESS) {
+        return NULL;
+    }
+    t->boxes = malloc((t->npts ? t->npts:1)*sizeof(bbox_t));
+    if (!t->boxes) {
+        free(t->pts);
+        return NULL;
+    }
+    kd_build(t, 0, t->npts);
+
+    si->ntrees++;
+    si->nbuilds++;
+
+    return t;
+}
+
+/*
+ * Same as the SQL search: in each quadrant, the dataset with the smallest
+ * normalized distance, then ID; returns -1 if the index couldn't be built
+ */
+int lsdb_spindex_get_closest_dids(const lsdb_t *lsdb,
+    unsigned int mid, unsigned int eid, unsigned int lid,
+    double n, double T,
+    unsigned long *did1, unsigned long *did2,
+    unsigned long *did3, unsigned long *did4)
+{
+    static const int signs[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+    unsigned long *dids[4] = {did1, did2, did3, did4};
+    const kdtree_t *t = NULL;
+
+    lsdb_rdlock(lsdb);
+    if (!lsdb_data_stale(lsdb, &lsdb->si->stamp)) {
+        t = spindex_find(lsdb->si, mid, eid, lid);
+    }
+    if (!t) {
+        lsdb_unlock(lsdb);
+        lsdb_lock(lsdb);
+        t = spindex_get(lsdb, mid, eid, lid);
+        if (!t) {
+            lsdb_unlock(lsdb);
+            return -1;
+        }
+    }
+
+    for (int k = 0; k < 4; k++) {
+        kdquery_t q = {n, T, signs[k][0], signs[k][1], 0.0, 0};
+
+        kd_search(t, 0, t->npts, &q);
+        *dids[k] = q.id;
+    }
+
+    lsdb_unlock(lsdb);
+
+    if (*did1 != 0 && *did2 != 0 && *did3 != 0 && *did4 != 0) {
+        return LSDB_SUCCESS;
+    } else {
+        return LSDB_FAILURE;
+    }
+}
@@ -1,11 +1,15 @@
 #!/bin/sh
 
-echo "static const char *schema_str[] = {"
+# usage: sql2cstr.sh [array_name] < file.sql > file.i
+
+name=${1:-schema_str}
+
+echo "static const char *${name}[] = {"
 tr -d \\n\\r | tr \; \\n |
 sed '
 s/\ \ */\ /g
 s/^/"/
 s/$/",/
-' "$@"
+'
 
 echo "NULL};"
@@ -0,0 +1,219 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+#define MAX_TMPFILES 16
+
+static int nfailed;
+
+static char  *tmpfiles[MAX_TMPFILES];
+static size_t ntmpfiles;
+
+void test_fail(const char *file, int line, const char *expr)
+{
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    nfailed++;
+}
+
+int test_result(const char *name)
+{
+    test_cleanup();
+
+    if (nfailed) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, nfailed);
+        return EXIT_FAILURE;
+    } else {
+        printf("%s: OK\n", name);
+        return EXIT_SUCCESS;
+    }
+}
+
+double test_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+const char *test_tmpname(const char *tag)
+{
+    const char *dir = getenv("TMPDIR");
+    char *fname;
+    size_t len;
+
+    if (ntmpfiles >= MAX_TMPFILES) {
+        return NULL;
+    }
+    if (!dir) {
+        dir = "/tmp";
+    }
+
+    len = strlen(dir) + strlen(tag) + 32;
+    fname = malloc(len);
+    if (!fname) {
+        return NULL;
+    }
+    snprintf(fname, len, "%s/lsdb-%s-%ld.db", dir, tag, (long) getpid());
+    unlink(fname);
+
+    tmpfiles[ntmpfiles++] = fname;
+
+    return fname;
+}
+
+void test_cleanup(void)
+{
+    while (ntmpfiles) {
+        char *fname = tmpfiles[--ntmpfiles];
+        unlink(fname);
+        free(fname);
+    }
+}
+
+double test_profile_at(double n, double T, double x)
+{
+    double g = 0.05*pow(n/1e16, 0.7), s = 0.03*sqrt(T), c = 0.1*log10(n/1e16);
+    double u = x - c;
+
+    return g/M_PI/(u*u + g*g) + exp(-u*u/(2*s*s))/(sqrt(2*M_PI)*s);
+}
+
+void test_profile(double n, double T, double *x, double *y, size_t len)
+{
+    double g = 0.05*pow(n/1e16, 0.7), s = 0.03*sqrt(T), c = 0.1*log10(n/1e16);
+    double xmin = c - 30*(g + s), xmax = c + 30*(g + s);
+
+    for (size_t i = 0; i < len; i++) {
+        x[i] = xmin + (xmax - xmin)*i/(len - 1);
+        y[i] = test_profile_at(n, T, x[i]);
+    }
+}
+
+lsdb_t *test_create_db(const char *fname)
+{
+    lsdb_t *lsdb;
+
+    if (!fname) {
+        return NULL;
+    }
+
+    lsdb = lsdb_open(fname, LSDB_ACCESS_INIT);
+    if (!lsdb) {
+        return NULL;
+    }
+
+    if (lsdb_add_model(lsdb, "test", "synthetic profiles") != TEST_MID ||
+        lsdb_add_environment(lsdb, "plasma", "") != TEST_EID ||
+        lsdb_add_radiator(lsdb, "H", 1, 1.008, 1) < 0 ||
+        lsdb_add_line(lsdb, 1, "Ly-alpha", 82259.0) != TEST_LID) {
+        lsdb_close(lsdb);
+        return NULL;
+    }
+
+    return lsdb;
+}
+
+int test_add_points(lsdb_t *lsdb, const double *n, const double *T,
+    size_t count, size_t len)
+{
+    lsdb_dataset_desc_t *dsets;
+    double *buf;
+    int rc;
+
+    dsets = calloc(count ? count:1, sizeof(lsdb_dataset_desc_t));
+    buf   = malloc((count ? count:1)*2*len*sizeof(double));
+    if (!dsets || !buf) {
+        free(dsets);
+        free(buf);
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        double *x = buf + 2*i*len, *y = x + len;
+
+        test_profile(n[i], T[i], x, y, len);
+
+        dsets[i].mid = TEST_MID;
+        dsets[i].eid = TEST_EID;
+        dsets[i].lid = TEST_LID;
+        dsets[i].n   = n[i];
+        dsets[i].T   = T[i];
+        dsets[i].x   = x;
+        dsets[i].y   = y;
+        dsets[i].len = len;
+    }
+
+    rc = lsdb_add_datasets_bulk(lsdb, dsets, count);
+
+    free(dsets);
+    free(buf);
+
+    return rc;
+}
+
+int test_add_grid(lsdb_t *lsdb, const double *n, size_t nn,
+    const double *T, size_t nT, size_t len)
+{
+    size_t count = nn*nT;
+    double *pn, *pT;
+    int rc;
+
+    pn = malloc((count ? count:1)*sizeof(double));
+    pT = malloc((count ? count:1)*sizeof(double));
+    if (!pn || !pT) {
+        free(pn);
+        free(pT);
+        return -1;
+    }
+
+    for (size_t j = 0; j < nT; j++) {
+        for (size_t i = 0; i < nn; i++) {
+            pn[j*nn + i] = n[i];
+            pT[j*nn + i] = T[j];
+        }
+    }
+
+    rc = test_add_points(lsdb, pn, pT, count, len);
+
+    free(pn);
+    free(pT);
+
+    return rc;
+}
+
+double test_rel_diff(const double *y1, const double *y2, size_t len)
+{
+    double dmax = 0.0, ymax = 0.0;
+
+    for (size_t i = 0; i < len; i++) {
+        dmax = fmax(dmax, fabs(y1[i] - y2[i]));
+        ymax = fmax(ymax, fabs(y2[i]));
+    }
+
+    return ymax > 0.0 ? dmax/ymax:dmax;
+}
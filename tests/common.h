@@ -0,0 +1,73 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Helpers shared by the test and benchmark programs: building scratch DBs of
+ * synthetic line profiles, checks and timing.
+ */
+
+#ifndef TESTS_COMMON_H
+#define TESTS_COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <lsdb/lsdbP.h>
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            test_fail(__FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+/* the IDs test_create_db() gives the model, environment and line */
+#define TEST_MID 1
+#define TEST_EID 1
+#define TEST_LID 1
+
+void test_fail(const char *file, int line, const char *expr);
+/* prints the summary; returns the exit status */
+int test_result(const char *name);
+
+double test_time(void);
+/* a scratch file name; removed by test_cleanup() */
+const char *test_tmpname(const char *tag);
+void test_cleanup(void);
+
+/* Lorentzian + Gaussian, both widening & shifting with n and T */
+void test_profile(double n, double T, double *x, double *y, size_t len);
+/* the same at any x, unbounded */
+double test_profile_at(double n, double T, double x);
+
+/* a fresh DB with a model, an environment, a radiator and a line */
+lsdb_t *test_create_db(const char *fname);
+/* test_profile()s at all (n[i], T[j]); returns the number added, or -1 */
+int test_add_grid(lsdb_t *lsdb, const double *n, size_t nn,
+    const double *T, size_t nT, size_t len);
+/* the same, at count arbitrary points */
+int test_add_points(lsdb_t *lsdb, const double *n, const double *T,
+    size_t count, size_t len);
+
+/* the peak of |y1 - y2| relative to the peak of y2 */
+double test_rel_diff(const double *y1, const double *y2, size_t len);
+
+#endif /* TESTS_COMMON_H */
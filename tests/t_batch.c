@@ -0,0 +1,162 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * lsdb_get_interpolation_batch() against lsdb_get_interpolation() point by
+ * point, with both engines: several points per cell in scrambled order, each
+ * with its own Voigt widths (none, Gaussian through either convolution
+ * method, Lorentzian, both), and points outside the limits, whose spectra
+ * must come out zeroed. A count whose output could not be addressed is
+ * refused.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+
+#define DSLEN  401
+#define LEN    201
+#define NCELL  4
+#define NPOINT 14
+#define NWIDTH 5
+
+static double out[NPOINT][2][LEN];
+
+static bool zeroed(const double *a, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != 0.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* the single-point calls; the convolved y to a rounding error */
+static void check_point(const lsdb_t *lsdb, size_t k,
+    double n, double T, double sigma, double gamma)
+{
+    lsdb_dataset_data_t *ds;
+
+    ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, LEN, sigma, gamma);
+    CHECK(ds != NULL);
+    if (!ds) {
+        return;
+    }
+
+    CHECK(!memcmp(out[k][0], ds->x, LEN*sizeof(double)));
+    if (sigma == 0.0 && gamma == 0.0) {
+        CHECK(!memcmp(out[k][1], ds->y, LEN*sizeof(double)));
+    } else {
+        CHECK(test_rel_diff(out[k][1], ds->y, LEN) < 1e-12);
+    }
+
+    lsdb_dataset_data_free(ds);
+}
+
+static void check_batch(const lsdb_t *lsdb)
+{
+    /* the centers of the four cells of the 3x3 grid */
+    static const double cn[NCELL] = {1.4e16, 2.8e16, 1.4e16, 2.8e16};
+    static const double cT[NCELL] = {1.4, 1.4, 2.8, 2.8};
+    /* sigma 0.1 is over a grid step, so that it is convolved directly */
+    static const double ws[NWIDTH][2] = {
+        {0.0, 0.0}, {0.02, 0.0}, {0.1, 0.0}, {0.0, 0.01}, {0.02, 0.01}
+    };
+    double n[NPOINT], T[NPOINT], sigma[NPOINT], gamma[NPOINT];
+    bool outside[NPOINT];
+    lsdb_stats_t st0, st1;
+    size_t k;
+
+    for (k = 0; k < NPOINT; k++) {
+        size_t c = k % NCELL;
+
+        /* three points in each cell, the cells interleaved */
+        n[k] = cn[c]*(1 + 0.08*(k/NCELL));
+        T[k] = cT[c]*(1 + 0.08*(k/NCELL));
+        sigma[k] = ws[k % NWIDTH][0];
+        gamma[k] = ws[k % NWIDTH][1];
+        outside[k] = k == 5 || k == 12;
+        if (outside[k]) {
+            n[k] = k == 5 ? 1e18:2e16;
+            T[k] = k == 5 ? 2:100;
+        }
+    }
+
+    memset(out, 0xff, sizeof(out));
+    CHECK(lsdb_get_stats(lsdb, &st0) == LSDB_SUCCESS);
+    CHECK(lsdb_get_interpolation_batch(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, NPOINT, LEN, sigma, gamma, &out[0][0][0]) == LSDB_FAILURE);
+    CHECK(lsdb_get_stats(lsdb, &st1) == LSDB_SUCCESS);
+    CHECK(st1.conv_direct > st0.conv_direct && st1.conv_fft > st0.conv_fft);
+
+    for (k = 0; k < NPOINT; k++) {
+        if (outside[k]) {
+            CHECK(zeroed(out[k][0], 2*LEN));
+        } else {
+            check_point(lsdb, k, n[k], T[k], sigma[k], gamma[k]);
+        }
+    }
+
+    /* without the outside points; no widths at all */
+    memset(out, 0xff, sizeof(out));
+    CHECK(lsdb_get_interpolation_batch(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, 5, LEN, NULL, NULL, &out[0][0][0]) == LSDB_SUCCESS);
+    for (k = 0; k < 5; k++) {
+        check_point(lsdb, k, n[k], T[k], 0.0, 0.0);
+    }
+    CHECK(lsdb_get_interpolation_batch(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, 0, LEN, NULL, NULL, &out[0][0][0]) == LSDB_SUCCESS);
+}
+
+int main(void)
+{
+    static const lsdb_interp_engine_t engines[2] = {
+        LSDB_INTERP_MORPH, LSDB_INTERP_QUANTILE
+    };
+    const double n[3] = {1e16, 2e16, 4e16}, T[3] = {1, 2, 4};
+    double n1 = 2e16, T1 = 2;
+    lsdb_t *lsdb;
+
+    lsdb = test_create_db(test_tmpname("batch"));
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return test_result("t_batch");
+    }
+    CHECK(test_add_grid(lsdb, n, 3, T, 3, DSLEN) == 9);
+
+    for (int e = 0; e < 2; e++) {
+        CHECK(lsdb_set_interp_engine(lsdb, engines[e]) == LSDB_SUCCESS);
+        check_batch(lsdb);
+    }
+
+    /* out of 2*count*LEN doubles, more than can be addressed */
+    CHECK(lsdb_get_interpolation_batch(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        &n1, &T1, SIZE_MAX/(2*LEN*sizeof(double)) + 1, LEN, NULL, NULL,
+        &out[0][0][0]) == LSDB_FAILURE);
+
+    lsdb_close(lsdb);
+
+    return test_result("t_batch");
+}
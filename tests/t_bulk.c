@@ -0,0 +1,227 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * lsdb_add_datasets_bulk() and lsdb_begin()/lsdb_commit()/lsdb_rollback():
+ * each item gets its own status, and a bad one (a duplicate, too short, no
+ * data, of an unknown line or model) doesn't stop the rest; inside an
+ * explicit transaction the items are committed or rolled back with it, and
+ * the limits and the cached datasets follow. With and without a thread-safe
+ * handle & catalog.
+ */
+
+#include <string.h>
+
+#include "common.h"
+
+#define LEN    101
+#define NITEM  9
+#define NGOOD  4
+#define NGRID  9
+
+static double xs[NITEM][LEN], ys[NITEM][LEN];
+
+static int count_sink(const lsdb_t *lsdb, const lsdb_dataset_t *d,
+    void *udata)
+{
+    (void) lsdb;
+    (void) d;
+    (*(int *) udata)++;
+    return LSDB_SUCCESS;
+}
+
+static int count_datasets(const lsdb_t *lsdb)
+{
+    int count = 0;
+
+    if (lsdb_get_datasets(lsdb, TEST_LID, count_sink, &count)
+        != LSDB_SUCCESS) {
+        return -1;
+    }
+
+    return count;
+}
+
+/* the item stored, to the bit */
+static bool stored(const lsdb_t *lsdb, const lsdb_dataset_desc_t *d)
+{
+    lsdb_dataset_data_t *ds = lsdb_get_dataset_data(lsdb, d->did);
+    bool OK;
+
+    OK = ds && ds->n == d->n && ds->T == d->T && ds->len == d->len &&
+        !memcmp(ds->x, d->x, d->len*sizeof(double)) &&
+        !memcmp(ds->y, d->y, d->len*sizeof(double));
+    lsdb_dataset_data_free(ds);
+
+    return OK;
+}
+
+static void set_item(lsdb_dataset_desc_t *d, int k, double n, double T)
+{
+    test_profile(n, T, xs[k], ys[k], LEN);
+
+    d->mid = TEST_MID;
+    d->eid = TEST_EID;
+    d->lid = TEST_LID;
+    d->n   = n;
+    d->T   = T;
+    d->x   = xs[k];
+    d->y   = ys[k];
+    d->len = LEN;
+    d->did = 0;
+}
+
+/* NGOOD good items beyond n of the grid, and the bad ones in between */
+static void set_items(lsdb_dataset_desc_t *dsets, double T)
+{
+    for (int k = 0; k < NITEM; k++) {
+        set_item(&dsets[k], k, 8e16, T + k);
+    }
+
+    /* a duplicate of the one before */
+    dsets[1].T = dsets[0].T;
+    dsets[1].x = dsets[0].x;
+    dsets[1].y = dsets[0].y;
+    /* too short, and no data */
+    dsets[3].len = 1;
+    dsets[4].y   = NULL;
+    /* of a line and of a model that don't exist */
+    dsets[6].lid = 99;
+    dsets[7].mid = 99;
+}
+
+static bool good_item(int k)
+{
+    return k == 0 || k == 2 || k == 5 || k == 8;
+}
+
+static void check_status(const lsdb_t *lsdb, const lsdb_dataset_desc_t *dsets)
+{
+    int prev = 0;
+
+    for (int k = 0; k < NITEM; k++) {
+        if (good_item(k)) {
+            CHECK(dsets[k].did > prev);
+            CHECK(stored(lsdb, &dsets[k]));
+            prev = dsets[k].did;
+        } else {
+            CHECK(dsets[k].did == -1);
+        }
+    }
+}
+
+static void check_limits(const lsdb_t *lsdb, double nmax, double Tmax)
+{
+    double n0, n1, T0, T1;
+
+    CHECK(lsdb_get_limits(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        &n0, &n1, &T0, &T1) == LSDB_SUCCESS);
+    CHECK(n0 == 1e16 && n1 == nmax && T0 == 1 && T1 == Tmax);
+}
+
+static void check_mode(bool threadsafe, bool catalog)
+{
+    const double n[3] = {1e16, 2e16, 4e16}, T[3] = {1, 2, 4};
+    const char *fname = test_tmpname(threadsafe ? "bulk-mt":"bulk");
+    lsdb_dataset_desc_t dsets[NITEM];
+    double x[LEN], y[LEN];
+    lsdb_open_opts_t opts;
+    lsdb_t *lsdb;
+
+    lsdb = test_create_db(fname);
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return;
+    }
+    CHECK(test_add_grid(lsdb, n, 3, T, 3, LEN) == NGRID);
+    lsdb_close(lsdb);
+
+    memset(&opts, 0, sizeof(lsdb_open_opts_t));
+    opts.threadsafe = threadsafe;
+    opts.catalog    = catalog;
+    lsdb = lsdb_open_ex(fname, LSDB_ACCESS_RW, &opts);
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return;
+    }
+    CHECK(lsdb_set_cache_budget(lsdb, 1 << 24) == LSDB_SUCCESS);
+
+    /* on its own */
+    CHECK(lsdb_add_datasets_bulk(lsdb, NULL, 0) == 0);
+    CHECK(lsdb_add_datasets_bulk(lsdb, NULL, 1) == -1);
+    CHECK(lsdb_add_datasets_bulk(NULL, dsets, 1) == -1);
+
+    check_limits(lsdb, 4e16, 4);
+    set_items(dsets, 1);
+    CHECK(lsdb_add_datasets_bulk(lsdb, dsets, NITEM) == NGOOD);
+    check_status(lsdb, dsets);
+    CHECK(count_datasets(lsdb) == NGRID + NGOOD);
+    check_limits(lsdb, 8e16, 9);
+
+    /* rolled back with the transaction, also out of the dataset cache */
+    CHECK(lsdb_begin(lsdb) == LSDB_SUCCESS);
+    set_items(dsets, 11);
+    CHECK(lsdb_add_datasets_bulk(lsdb, dsets, NITEM) == NGOOD);
+    check_status(lsdb, dsets);
+    CHECK(count_datasets(lsdb) == NGRID + 2*NGOOD);
+    check_limits(lsdb, 8e16, 19);
+    CHECK(lsdb_rollback(lsdb) == LSDB_SUCCESS);
+
+    CHECK(count_datasets(lsdb) == NGRID + NGOOD);
+    check_limits(lsdb, 8e16, 9);
+    for (int k = 0; k < NITEM; k++) {
+        if (good_item(k)) {
+            CHECK(lsdb_get_dataset_data(lsdb, dsets[k].did) == NULL);
+        }
+    }
+
+    /* committed with it, together with a single add after the bad items */
+    CHECK(lsdb_begin(lsdb) == LSDB_SUCCESS);
+    set_items(dsets, 21);
+    CHECK(lsdb_add_datasets_bulk(lsdb, dsets, NITEM) == NGOOD);
+    check_status(lsdb, dsets);
+    test_profile(8e16, 30, x, y, LEN);
+    CHECK(lsdb_add_dataset(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        8e16, 30, x, y, LEN) > dsets[NITEM - 1].did);
+    CHECK(lsdb_commit(lsdb) == LSDB_SUCCESS);
+    CHECK(count_datasets(lsdb) == NGRID + 2*NGOOD + 1);
+    check_limits(lsdb, 8e16, 30);
+    lsdb_close(lsdb);
+
+    lsdb = lsdb_open(fname, LSDB_ACCESS_RO);
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        CHECK(count_datasets(lsdb) == NGRID + 2*NGOOD + 1);
+        for (int k = 0; k < NITEM; k++) {
+            if (good_item(k)) {
+                CHECK(stored(lsdb, &dsets[k]));
+            }
+        }
+        lsdb_close(lsdb);
+    }
+}
+
+int main(void)
+{
+    check_mode(false, false);
+    check_mode(true, true);
+
+    return test_result("t_bulk");
+}
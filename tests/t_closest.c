@@ -0,0 +1,99 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * The kd-tree quadrant search against the SQL one. The points are random
+ * subsets of an integer lattice, and the queries lie on and between the
+ * lattice lines, so that points on the query axes and equally distant points
+ * are common.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+
+#define LATTICE 12
+#define NSEEDS  4
+#define LEN     16
+
+static void check_seed(unsigned int seed, double fill)
+{
+    double n[LATTICE*LATTICE], T[LATTICE*LATTICE];
+    size_t count = 0;
+    lsdb_t *lsdb;
+
+    srand(seed);
+    for (int i = 1; i <= LATTICE; i++) {
+        for (int j = 1; j <= LATTICE; j++) {
+            if (rand() < fill*RAND_MAX) {
+                n[count] = 1e16*i;
+                T[count] = j;
+                count++;
+            }
+        }
+    }
+
+    lsdb = test_create_db(test_tmpname("closest"));
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return;
+    }
+    CHECK(test_add_points(lsdb, n, T, count, LEN) == (int) count);
+
+    for (int i = 0; i <= 2*LATTICE + 2; i++) {
+        for (int j = 0; j <= 2*LATTICE + 2; j++) {
+            double qn = 1e16*0.5*i, qT = 0.5*j;
+            unsigned long kd[4], sql[4];
+            int rc_kd, rc_sql;
+
+            if (qn <= 0 || qT <= 0) {
+                continue;
+            }
+
+            rc_kd  = lsdb_spindex_get_closest_dids(lsdb,
+                TEST_MID, TEST_EID, TEST_LID, qn, qT,
+                &kd[0], &kd[1], &kd[2], &kd[3]);
+            rc_sql = lsdb_get_closest_dids_sql(lsdb,
+                TEST_MID, TEST_EID, TEST_LID, qn, qT,
+                &sql[0], &sql[1], &sql[2], &sql[3]);
+
+            CHECK(rc_kd == rc_sql);
+            for (int k = 0; k < 4; k++) {
+                if (rc_sql == LSDB_SUCCESS && kd[k] != sql[k]) {
+                    fprintf(stderr, "seed %u, (%g, %g), quadrant %d: "
+                        "%lu != %lu\n", seed, qn, qT, k + 1, kd[k], sql[k]);
+                    CHECK(kd[k] == sql[k]);
+                }
+            }
+        }
+    }
+
+    lsdb_close(lsdb);
+}
+
+int main(void)
+{
+    for (unsigned int seed = 1; seed <= NSEEDS; seed++) {
+        check_seed(seed, seed == NSEEDS ? 1.0:0.5);
+    }
+
+    return test_result("t_closest");
+}
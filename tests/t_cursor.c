@@ -0,0 +1,560 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * The cursors against the lsdb_get_*() sinks, drained a row at a time and in
+ * blocks of NROWS: the same rows in the same order, on a DB and on its
+ * snapshot; the catalog against a walk of the sinks, radiator by radiator
+ * and line by line. The lines of one radiator and the datasets of one line
+ * outnumber a block, and their strings the first chunk. A cursor closed
+ * early must give its statement back to the cache.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "common.h"
+
+#define NROWS 256
+#define NHE   300
+#define NPT   300
+#define LEN   11
+
+/* the rows, printed while their strings are valid */
+typedef struct {
+    char **s;
+    size_t n, nalloc;
+} rows_t;
+
+typedef struct {
+    rows_t *rows;
+    unsigned long rid;
+    unsigned long lid;
+} walk_t;
+
+static lsdb_catalog_entry_t buf[NROWS];
+
+static void rows_add(rows_t *l, const char *s)
+{
+    if (l->n == l->nalloc) {
+        size_t nalloc = l->nalloc ? 2*l->nalloc:64;
+        char **p = realloc(l->s, nalloc*sizeof(char *));
+        CHECK(p != NULL);
+        if (!p) {
+            return;
+        }
+        l->s = p;
+        l->nalloc = nalloc;
+    }
+
+    l->s[l->n] = malloc(strlen(s) + 1);
+    CHECK(l->s[l->n] != NULL);
+    if (l->s[l->n]) {
+        strcpy(l->s[l->n++], s);
+    }
+}
+
+static void rows_free(rows_t *l)
+{
+    for (size_t i = 0; i < l->n; i++) {
+        free(l->s[i]);
+    }
+    free(l->s);
+    memset(l, 0, sizeof(rows_t));
+}
+
+static bool rows_equal(const rows_t *a, const rows_t *b)
+{
+    if (a->n != b->n) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a->n; i++) {
+        if (strcmp(a->s[i], b->s[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static size_t row_size(lsdb_cursor_type_t type)
+{
+    switch (type) {
+    case LSDB_CURSOR_MODELS:
+        return sizeof(lsdb_model_t);
+    case LSDB_CURSOR_ENVIRONMENTS:
+        return sizeof(lsdb_environment_t);
+    case LSDB_CURSOR_RADIATORS:
+        return sizeof(lsdb_radiator_t);
+    case LSDB_CURSOR_LINES:
+        return sizeof(lsdb_line_t);
+    case LSDB_CURSOR_LINE_PROPERTIES:
+        return sizeof(lsdb_line_property_t);
+    case LSDB_CURSOR_DATASETS:
+        return sizeof(lsdb_dataset_t);
+    case LSDB_CURSOR_CATALOG:
+        return sizeof(lsdb_catalog_entry_t);
+    }
+
+    return 0;
+}
+
+static void put_row(rows_t *l, lsdb_cursor_type_t type, const void *row)
+{
+    char s[512];
+
+    switch (type) {
+    case LSDB_CURSOR_MODELS:
+        {
+            const lsdb_model_t *m = row;
+            snprintf(s, sizeof(s), "model %lu %s|%s", m->id, m->name, m->descr);
+            break;
+        }
+    case LSDB_CURSOR_ENVIRONMENTS:
+        {
+            const lsdb_environment_t *e = row;
+            snprintf(s, sizeof(s), "env %lu %s|%s", e->id, e->name, e->descr);
+            break;
+        }
+    case LSDB_CURSOR_RADIATORS:
+        {
+            const lsdb_radiator_t *r = row;
+            snprintf(s, sizeof(s), "radiator %lu %s %u %.17g %u",
+                r->id, r->sym, r->anum, r->mass, r->zsp);
+            break;
+        }
+    case LSDB_CURSOR_LINES:
+        {
+            const lsdb_line_t *ln = row;
+            snprintf(s, sizeof(s), "line %lu %s|%.17g",
+                ln->id, ln->name, ln->energy);
+            break;
+        }
+    case LSDB_CURSOR_LINE_PROPERTIES:
+        {
+            const lsdb_line_property_t *p = row;
+            snprintf(s, sizeof(s), "property %lu %s|%s",
+                p->id, p->name, p->value);
+            break;
+        }
+    case LSDB_CURSOR_DATASETS:
+        {
+            const lsdb_dataset_t *d = row;
+            snprintf(s, sizeof(s), "dataset %lu %lu %lu %.17g %.17g",
+                d->id, d->mid, d->eid, d->n, d->T);
+            break;
+        }
+    case LSDB_CURSOR_CATALOG:
+        {
+            /* the parents, then the entry as its own cursor prints it */
+            const lsdb_catalog_entry_t *c = row;
+            static const lsdb_cursor_type_t types[] = {
+                [LSDB_CATALOG_RADIATOR]      = LSDB_CURSOR_RADIATORS,
+                [LSDB_CATALOG_LINE]          = LSDB_CURSOR_LINES,
+                [LSDB_CATALOG_LINE_PROPERTY] = LSDB_CURSOR_LINE_PROPERTIES,
+                [LSDB_CATALOG_DATASET]       = LSDB_CURSOR_DATASETS
+            };
+            rows_t one = {NULL, 0, 0};
+
+            put_row(&one, types[c->kind], &c->u);
+            snprintf(s, sizeof(s), "%lu %lu %s",
+                c->rid, c->lid, one.n ? one.s[0]:"");
+            rows_free(&one);
+            break;
+        }
+    }
+
+    rows_add(l, s);
+}
+
+static int model_sink(const lsdb_t *lsdb, const lsdb_model_t *m, void *udata)
+{
+    (void) lsdb;
+    put_row(udata, LSDB_CURSOR_MODELS, m);
+    return LSDB_SUCCESS;
+}
+
+static int environment_sink(const lsdb_t *lsdb,
+    const lsdb_environment_t *e, void *udata)
+{
+    (void) lsdb;
+    put_row(udata, LSDB_CURSOR_ENVIRONMENTS, e);
+    return LSDB_SUCCESS;
+}
+
+static int radiator_sink(const lsdb_t *lsdb,
+    const lsdb_radiator_t *r, void *udata)
+{
+    (void) lsdb;
+    put_row(udata, LSDB_CURSOR_RADIATORS, r);
+    return LSDB_SUCCESS;
+}
+
+static int line_sink(const lsdb_t *lsdb, const lsdb_line_t *l, void *udata)
+{
+    (void) lsdb;
+    put_row(udata, LSDB_CURSOR_LINES, l);
+    return LSDB_SUCCESS;
+}
+
+static int property_sink(const lsdb_t *lsdb,
+    const lsdb_line_property_t *p, void *udata)
+{
+    (void) lsdb;
+    put_row(udata, LSDB_CURSOR_LINE_PROPERTIES, p);
+    return LSDB_SUCCESS;
+}
+
+static int dataset_sink(const lsdb_t *lsdb, const lsdb_dataset_t *d,
+    void *udata)
+{
+    (void) lsdb;
+    put_row(udata, LSDB_CURSOR_DATASETS, d);
+    return LSDB_SUCCESS;
+}
+
+/* the catalog, walked by the sinks */
+static int walk_property_sink(const lsdb_t *lsdb,
+    const lsdb_line_property_t *p, void *udata)
+{
+    walk_t *w = udata;
+    lsdb_catalog_entry_t c;
+
+    (void) lsdb;
+    c.kind = LSDB_CATALOG_LINE_PROPERTY;
+    c.rid  = w->rid;
+    c.lid  = w->lid;
+    c.u.p  = *p;
+    put_row(w->rows, LSDB_CURSOR_CATALOG, &c);
+
+    return LSDB_SUCCESS;
+}
+
+static int walk_dataset_sink(const lsdb_t *lsdb, const lsdb_dataset_t *d,
+    void *udata)
+{
+    walk_t *w = udata;
+    lsdb_catalog_entry_t c;
+
+    (void) lsdb;
+    c.kind = LSDB_CATALOG_DATASET;
+    c.rid  = w->rid;
+    c.lid  = w->lid;
+    c.u.d  = *d;
+    put_row(w->rows, LSDB_CURSOR_CATALOG, &c);
+
+    return LSDB_SUCCESS;
+}
+
+static int walk_line_sink(const lsdb_t *lsdb, const lsdb_line_t *l,
+    void *udata)
+{
+    walk_t *w = udata;
+    lsdb_catalog_entry_t c;
+
+    c.kind = LSDB_CATALOG_LINE;
+    c.rid  = w->rid;
+    c.lid  = l->id;
+    c.u.l  = *l;
+    put_row(w->rows, LSDB_CURSOR_CATALOG, &c);
+
+    w->lid = l->id;
+    if (lsdb_get_line_properties(lsdb, l->id, walk_property_sink, w)
+        != LSDB_SUCCESS) {
+        return LSDB_FAILURE;
+    }
+    return lsdb_get_datasets(lsdb, l->id, walk_dataset_sink, w);
+}
+
+static int walk_radiator_sink(const lsdb_t *lsdb, const lsdb_radiator_t *r,
+    void *udata)
+{
+    walk_t *w = udata;
+    lsdb_catalog_entry_t c;
+
+    c.kind = LSDB_CATALOG_RADIATOR;
+    c.rid  = r->id;
+    c.lid  = 0;
+    c.u.r  = *r;
+    put_row(w->rows, LSDB_CURSOR_CATALOG, &c);
+
+    w->rid = r->id;
+    return lsdb_get_lines(lsdb, r->id, walk_line_sink, w);
+}
+
+static int get_rows(const lsdb_t *lsdb, lsdb_cursor_type_t type,
+    unsigned long parent, rows_t *l)
+{
+    walk_t w = {l, 0, 0};
+
+    switch (type) {
+    case LSDB_CURSOR_MODELS:
+        return lsdb_get_models(lsdb, model_sink, l);
+    case LSDB_CURSOR_ENVIRONMENTS:
+        return lsdb_get_environments(lsdb, environment_sink, l);
+    case LSDB_CURSOR_RADIATORS:
+        return lsdb_get_radiators(lsdb, radiator_sink, l);
+    case LSDB_CURSOR_LINES:
+        return lsdb_get_lines(lsdb, parent, line_sink, l);
+    case LSDB_CURSOR_LINE_PROPERTIES:
+        return lsdb_get_line_properties(lsdb, parent, property_sink, l);
+    case LSDB_CURSOR_DATASETS:
+        return lsdb_get_datasets(lsdb, parent, dataset_sink, l);
+    case LSDB_CURSOR_CATALOG:
+        return lsdb_get_radiators(lsdb, walk_radiator_sink, &w);
+    }
+
+    return LSDB_FAILURE;
+}
+
+static lsdb_cursor_t *open_cursor(const lsdb_t *lsdb,
+    lsdb_cursor_type_t type, unsigned long parent)
+{
+    switch (type) {
+    case LSDB_CURSOR_MODELS:
+        return lsdb_cursor_models(lsdb);
+    case LSDB_CURSOR_ENVIRONMENTS:
+        return lsdb_cursor_environments(lsdb);
+    case LSDB_CURSOR_RADIATORS:
+        return lsdb_cursor_radiators(lsdb);
+    case LSDB_CURSOR_LINES:
+        return lsdb_cursor_lines(lsdb, parent);
+    case LSDB_CURSOR_LINE_PROPERTIES:
+        return lsdb_cursor_line_properties(lsdb, parent);
+    case LSDB_CURSOR_DATASETS:
+        return lsdb_cursor_datasets(lsdb, parent);
+    case LSDB_CURSOR_CATALOG:
+        return lsdb_cursor_catalog(lsdb);
+    }
+
+    return NULL;
+}
+
+/* the rest of the rows, nrows at a time; closes the cursor */
+static void drain(lsdb_cursor_t *cur, lsdb_cursor_type_t type, size_t nrows,
+    rows_t *l)
+{
+    int n;
+
+    CHECK(cur != NULL);
+    if (!cur) {
+        return;
+    }
+
+    while ((n = lsdb_cursor_next(cur, buf, nrows)) > 0) {
+        CHECK((size_t) n <= nrows);
+        for (int i = 0; i < n; i++) {
+            put_row(l, type, (char *) buf + i*row_size(type));
+        }
+    }
+    CHECK(n == 0);
+    /* and stays exhausted */
+    CHECK(lsdb_cursor_next(cur, buf, nrows) == 0);
+
+    lsdb_cursor_close(cur);
+}
+
+/* the number of rows */
+static size_t check_cursor(const lsdb_t *lsdb, lsdb_cursor_type_t type,
+    unsigned long parent)
+{
+    static const size_t nrows[2] = {1, NROWS};
+    rows_t ref = {NULL, 0, 0};
+    size_t count;
+
+    CHECK(get_rows(lsdb, type, parent, &ref) == LSDB_SUCCESS);
+
+    for (int k = 0; k < 2; k++) {
+        rows_t got = {NULL, 0, 0};
+
+        drain(open_cursor(lsdb, type, parent), type, nrows[k], &got);
+        CHECK(rows_equal(&got, &ref));
+        rows_free(&got);
+    }
+
+    count = ref.n;
+    rows_free(&ref);
+
+    return count;
+}
+
+static void check_cursors(const lsdb_t *lsdb, rows_t *catalog)
+{
+    lsdb_cursor_t *cur;
+    rows_t got = {NULL, 0, 0};
+
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_MODELS, 0) == 3);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_ENVIRONMENTS, 0) == 2);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_RADIATORS, 0) == 3);
+
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINES, 1) == 2);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINES, 2) == NHE);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINES, 3) == 0);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINES, 99) == 0);
+
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINE_PROPERTIES, 1) == 2);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINE_PROPERTIES, 2) == 1);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINE_PROPERTIES, 3) == 1);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_LINE_PROPERTIES, 4) == 0);
+
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_DATASETS, 1) == NPT);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_DATASETS, 2) == 3);
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_DATASETS, 3) == 0);
+
+    CHECK(check_cursor(lsdb, LSDB_CURSOR_CATALOG, 0) == 3 + 2 + NHE + 4 +
+        NPT + 3);
+    CHECK(get_rows(lsdb, LSDB_CURSOR_CATALOG, 0, catalog) == LSDB_SUCCESS);
+
+    /* stopped halfway, the rows so far stay put */
+    cur = lsdb_cursor_catalog(lsdb);
+    CHECK(cur != NULL);
+    CHECK(lsdb_cursor_next(cur, buf, 1) == 1);
+    put_row(&got, LSDB_CURSOR_CATALOG, buf);
+    CHECK(got.n == 1 && catalog->n > 0 && !strcmp(got.s[0], catalog->s[0]));
+    lsdb_cursor_close(cur);
+    rows_free(&got);
+
+    CHECK(lsdb_cursor_next(NULL, buf, 1) == -1);
+    cur = lsdb_cursor_models(lsdb);
+    CHECK(lsdb_cursor_next(cur, NULL, 1) == -1);
+    lsdb_cursor_close(cur);
+    lsdb_cursor_close(NULL);
+}
+
+/* a cursor closed before the end gives its statement back */
+static void check_early_close(const lsdb_t *lsdb)
+{
+    lsdb_cursor_t *cur1, *cur2;
+    lsdb_stats_t st0, st1, st2, st3;
+    rows_t ref = {NULL, 0, 0}, got = {NULL, 0, 0};
+
+    CHECK(get_rows(lsdb, LSDB_CURSOR_LINES, 2, &ref) == LSDB_SUCCESS);
+
+    cur1 = lsdb_cursor_lines(lsdb, 2);
+    CHECK(cur1 != NULL);
+    CHECK(lsdb_cursor_next(cur1, buf, 1) == 1);
+
+    /* the cached statement is busy: a second one is prepared */
+    CHECK(lsdb_get_stats(lsdb, &st0) == LSDB_SUCCESS);
+    cur2 = lsdb_cursor_lines(lsdb, 2);
+    CHECK(cur2 != NULL);
+    CHECK(lsdb_get_stats(lsdb, &st1) == LSDB_SUCCESS);
+    CHECK(st1.stmt_prepares == st0.stmt_prepares + 1);
+    drain(cur2, LSDB_CURSOR_LINES, NROWS, &got);
+    CHECK(rows_equal(&got, &ref));
+    rows_free(&got);
+
+    lsdb_cursor_close(cur1);
+
+    /* reused, from the first row on */
+    CHECK(lsdb_get_stats(lsdb, &st2) == LSDB_SUCCESS);
+    drain(lsdb_cursor_lines(lsdb, 2), LSDB_CURSOR_LINES, NROWS, &got);
+    CHECK(lsdb_get_stats(lsdb, &st3) == LSDB_SUCCESS);
+    CHECK(st3.stmt_prepares == st2.stmt_prepares);
+    CHECK(st3.stmt_reuses == st2.stmt_reuses + 1);
+    CHECK(rows_equal(&got, &ref));
+    rows_free(&got);
+
+    /* and so to the sinks */
+    rows_free(&ref);
+    CHECK(get_rows(lsdb, LSDB_CURSOR_LINES, 2, &ref) == LSDB_SUCCESS);
+    CHECK(lsdb_get_stats(lsdb, &st0) == LSDB_SUCCESS);
+    CHECK(st0.stmt_prepares == st3.stmt_prepares);
+    CHECK(ref.n == NHE);
+    rows_free(&ref);
+}
+
+static bool fill_db(lsdb_t *lsdb)
+{
+    double n[NPT], T[NPT], x[LEN], y[LEN];
+    bool OK;
+
+    OK = lsdb_add_model(lsdb, "stark", "computed, with the ion dynamics and"
+            " the quadrupole interactions included") == 2 &&
+        lsdb_add_model(lsdb, "bare", "") == 3 &&
+        lsdb_add_environment(lsdb, "gas", "neutral perturbers") == 2 &&
+        lsdb_add_radiator(lsdb, "He", 2, 4.0026, 1) == 2 &&
+        lsdb_add_radiator(lsdb, "Li", 3, 6.94, 1) == 3 &&
+        lsdb_add_line(lsdb, 1, "Ly-beta", 97492.3) == 2;
+
+    /* more than a block, and more than the first chunk of names */
+    for (int i = 0; OK && i < NHE; i++) {
+        char name[64];
+
+        snprintf(name, sizeof(name), "He I 1s2-1s%dp, a line of the series",
+            i + 2);
+        OK = lsdb_add_line(lsdb, 2, name, 171134.9 + i) == i + 3;
+    }
+
+    OK = OK &&
+        lsdb_add_line_property(lsdb, 1, "source", "synthetic") > 0 &&
+        lsdb_add_line_property(lsdb, 1, "note", "") > 0 &&
+        lsdb_add_line_property(lsdb, 2, "upper", "n = 3") > 0 &&
+        lsdb_add_line_property(lsdb, 3, "upper", "1s2p 1P") > 0;
+
+    for (int i = 0; i < NPT; i++) {
+        n[i] = 1e16*(1 + 0.01*(i % 100));
+        T[i] = 1 + i/100;
+    }
+    OK = OK && test_add_points(lsdb, n, T, NPT, LEN) == NPT;
+
+    /* and of another model and environment */
+    for (int i = 0; OK && i < 3; i++) {
+        test_profile(2e16, 1 + i, x, y, LEN);
+        OK = lsdb_add_dataset(lsdb, 2, 2, 2, 2e16, 1 + i, x, y, LEN) > 0;
+    }
+
+    return OK;
+}
+
+int main(void)
+{
+    const char *snapname = test_tmpname("cursor-snap");
+    rows_t catalog = {NULL, 0, 0}, snap_catalog = {NULL, 0, 0};
+    lsdb_t *lsdb;
+
+    lsdb = test_create_db(test_tmpname("cursor"));
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return test_result("t_cursor");
+    }
+    CHECK(fill_db(lsdb));
+
+    check_cursors(lsdb, &catalog);
+    check_early_close(lsdb);
+
+    CHECK(lsdb_export_snapshot(lsdb, snapname) == LSDB_SUCCESS);
+    lsdb_close(lsdb);
+
+    lsdb = lsdb_open(snapname, LSDB_ACCESS_RO);
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        CHECK(lsdb_is_snapshot(lsdb));
+        check_cursors(lsdb, &snap_catalog);
+        CHECK(rows_equal(&snap_catalog, &catalog));
+        lsdb_close(lsdb);
+    }
+
+    rows_free(&catalog);
+    rows_free(&snap_catalog);
+
+    return test_result("t_cursor");
+}
@@ -0,0 +1,189 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * The accuracy of the interpolation engines against the profiles they stand
+ * for, test_profile_at(), and against each other: at the nodes of 3x3 grids,
+ * and on a lattice of points between them. The grids are of widths changing
+ * by about 1.5x from node to node, and by 5x.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+
+#define DSLEN  4001
+#define LEN    401
+#define NEVAL  2000
+#define NSTEP  8
+
+typedef struct {
+    double node;    /* the largest error at the nodes */
+    double max;     /* ... between them */
+    double l1;      /* the mean L1 error between them */
+} stats_t;
+
+/*
+ * The largest errors of the engines at (n, T) relative to the peak of the
+ * profile, into err[2], and the difference between them; their L1 errors
+ * into l1[2]. Both are evaluated over the common domain
+ */
+static int check_point(lsdb_t *lsdb, lsdb_interp_ws_t *ws[2],
+    double n, double T, double err[2], double l1[2], double *diff)
+{
+    static const lsdb_interp_engine_t engines[2] = {
+        LSDB_INTERP_MORPH, LSDB_INTERP_QUANTILE
+    };
+    const lsdb_interp_t *interp[2];
+    double x[NEVAL], y[2][NEVAL], yt[NEVAL];
+    double xmin = -HUGE_VAL, xmax = HUGE_VAL, peak = 0.0, dx;
+
+    for (int e = 0; e < 2; e++) {
+        double a, b;
+
+        lsdb_set_interp_engine(lsdb, engines[e]);
+        interp[e] = lsdb_prepare_interpolation_ws(lsdb, ws[e],
+            TEST_MID, TEST_EID, TEST_LID, n, T, LEN);
+        if (!interp[e] ||
+            lsdb_interp_get_domain(interp[e], &a, &b) != LSDB_SUCCESS) {
+            return LSDB_FAILURE;
+        }
+        xmin = fmax(xmin, a);
+        xmax = fmin(xmax, b);
+    }
+
+    dx = (xmax - xmin)/NEVAL;
+    for (int i = 0; i < NEVAL; i++) {
+        x[i]  = xmin + (i + 0.5)*dx;
+        yt[i] = test_profile_at(n, T, x[i]);
+        peak  = fmax(peak, yt[i]);
+    }
+
+    *diff = 0.0;
+    for (int e = 0; e < 2; e++) {
+        lsdb_interp_eval_array(interp[e], x, y[e], NEVAL, false);
+        err[e] = l1[e] = 0.0;
+        for (int i = 0; i < NEVAL; i++) {
+            double d = fabs(y[e][i] - yt[i]);
+            err[e] = fmax(err[e], d);
+            l1[e] += d*dx;
+        }
+        err[e] /= peak;
+    }
+    for (int i = 0; i < NEVAL; i++) {
+        *diff = fmax(*diff, fabs(y[1][i] - y[0][i]));
+    }
+    *diff /= peak;
+
+    return LSDB_SUCCESS;
+}
+
+static void check_grid(const char *name, const double n[3], const double T[3],
+    stats_t s[2], double *diff)
+{
+    lsdb_interp_ws_t *ws[2] = {lsdb_interp_ws_new(), lsdb_interp_ws_new()};
+    lsdb_t *lsdb;
+    int count = 0;
+
+    memset(s, 0, 2*sizeof(stats_t));
+    *diff = 0.0;
+
+    lsdb = test_create_db(test_tmpname(name));
+    CHECK(lsdb != NULL && ws[0] && ws[1]);
+    if (!lsdb || !ws[0] || !ws[1]) {
+        return;
+    }
+    /* finely sampled, for the nodes to be the profiles themselves */
+    CHECK(test_add_grid(lsdb, n, 3, T, 3, DSLEN) == 9);
+
+    /* log-uniform in both n and T, the nodes at every (NSTEP/2)th point */
+    for (int i = 0; i <= NSTEP; i++) {
+        for (int j = 0; j <= NSTEP; j++) {
+            double qn = n[0]*pow(n[2]/n[0], (double) i/NSTEP);
+            double qT = T[0]*pow(T[2]/T[0], (double) j/NSTEP);
+            bool node = i % (NSTEP/2) == 0 && j % (NSTEP/2) == 0;
+            double err[2], l1[2], d;
+
+            if (check_point(lsdb, ws, qn, qT, err, l1, &d) != LSDB_SUCCESS) {
+                fprintf(stderr, "%s: (%g, %g) failed\n", name, qn, qT);
+                CHECK(!"interpolation");
+                continue;
+            }
+            for (int e = 0; e < 2; e++) {
+                if (node) {
+                    s[e].node = fmax(s[e].node, err[e]);
+                } else {
+                    s[e].max = fmax(s[e].max, err[e]);
+                    s[e].l1 += l1[e];
+                }
+            }
+            if (!node) {
+                *diff = fmax(*diff, d);
+                count++;
+            }
+        }
+    }
+    for (int e = 0; e < 2; e++) {
+        s[e].l1 /= count;
+    }
+
+    printf("%-6s %-9s %8.1e %8.3f %8.3f\n", name, "morph",
+        s[0].node, s[0].max, s[0].l1);
+    printf("%-6s %-9s %8.1e %8.3f %8.3f %8.3f\n", name, "quantile",
+        s[1].node, s[1].max, s[1].l1, *diff);
+
+    lsdb_close(lsdb);
+    lsdb_interp_ws_free(ws[0]);
+    lsdb_interp_ws_free(ws[1]);
+}
+
+int main(void)
+{
+    static const double n1[3] = {1e16, 2e16, 4e16}, T1[3] = {1, 2, 4};
+    static const double n2[3] = {1e16, 1e17, 1e18}, T2[3] = {1, 4, 16};
+    stats_t s[2];
+    double diff;
+
+    printf("# largest errors relative to the peak, mean L1 errors\n");
+    printf("# %-4s %-9s %8s %8s %8s %8s\n", "grid", "engine",
+        "nodes", "between", "L1", "vs morph");
+
+    /*
+     * The quantile engine reproduces the nodes to the resolution of the
+     * quantiles; the morphs are clipped to common ranges and resampled. In
+     * between, the errors are those of the displacement interpolation
+     */
+    check_grid("fine", n1, T1, s, &diff);
+    CHECK(s[0].node < 2e-2);
+    CHECK(s[1].node < 3e-3);
+    CHECK(s[1].max < 0.12);
+    CHECK(s[1].max < s[0].max);
+    CHECK(s[1].l1 < s[0].l1);
+    CHECK(diff < 0.1);
+
+    check_grid("coarse", n2, T2, s, &diff);
+    CHECK(s[1].node < 5e-2);
+    CHECK(s[1].max < 0.5);
+    CHECK(s[1].max < s[0].max);
+    CHECK(s[1].l1 < s[0].l1);
+
+    return test_result("t_engines");
+}
@@ -0,0 +1,240 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * lsdb_get_interpolation_into() and lsdb_get_dataset_data_into() against
+ * the allocating calls: the same bytes, contiguous or strided, the elements
+ * in between left alone; the size query, and the errors, which write nothing.
+ * The arrays of the allocated datasets are aligned to LSDB_DATA_ALIGN.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <lsdb/lsdbP.h>
+
+#include "common.h"
+
+#define LEN       201
+#define STRIDE    3
+#define UNTOUCHED 1e300
+
+static double xs[STRIDE*LEN], ys[STRIDE*LEN];
+
+static void fill(double *a, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        a[i] = UNTOUCHED;
+    }
+}
+
+static bool untouched(const double *a, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != UNTOUCHED) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* a[i*stride] == ref[i], bitwise, and everything else untouched */
+static bool strided_equal(const double *a, const double *ref, size_t len,
+    size_t stride)
+{
+    for (size_t i = 0; i < len*stride; i++) {
+        if (i % stride == 0) {
+            if (memcmp(&a[i], &ref[i/stride], sizeof(double))) {
+                return false;
+            }
+        } else
+        if (a[i] != UNTOUCHED) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void check_interpolation(const lsdb_t *lsdb,
+    double n, double T, double sigma, double gamma)
+{
+    lsdb_dataset_data_t *ds;
+    double xmin, xmax;
+
+    ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, LEN, sigma, gamma);
+    CHECK(ds != NULL);
+    if (!ds) {
+        return;
+    }
+
+    /* contiguous */
+    fill(xs, STRIDE*LEN);
+    fill(ys, STRIDE*LEN);
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, LEN, sigma, gamma, xs, ys, 1, &xmin, &xmax) == LEN);
+    CHECK(strided_equal(xs, ds->x, LEN, 1));
+    CHECK(strided_equal(ys, ds->y, LEN, 1));
+    CHECK(xmin == ds->x[0] && xmax == ds->x[LEN - 1]);
+
+    /* the uniform grid */
+    for (int i = 0; i < LEN; i++) {
+        double xi = xmin + (xmax - xmin)*i/(LEN - 1);
+        CHECK(fabs(xs[i] - xi) <= 1e-12*(xmax - xmin));
+    }
+
+    /* strided, with and without x */
+    fill(xs, STRIDE*LEN);
+    fill(ys, STRIDE*LEN);
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, LEN, sigma, gamma, xs, ys, STRIDE, NULL, NULL) == LEN);
+    CHECK(strided_equal(xs, ds->x, LEN, STRIDE));
+    CHECK(strided_equal(ys, ds->y, LEN, STRIDE));
+
+    fill(ys, STRIDE*LEN);
+    xmin = xmax = UNTOUCHED;
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, LEN, sigma, gamma, NULL, ys, STRIDE, &xmin, &xmax) == LEN);
+    CHECK(strided_equal(ys, ds->y, LEN, STRIDE));
+    CHECK(xmin == ds->x[0] && xmax == ds->x[LEN - 1]);
+
+    fill(ys, STRIDE*LEN);
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, LEN, sigma, gamma, NULL, ys, 1, NULL, NULL) == LEN);
+    CHECK(strided_equal(ys, ds->y, LEN, 1));
+
+    lsdb_dataset_data_free(ds);
+}
+
+static void check_interpolation_errors(lsdb_t *lsdb)
+{
+    fill(xs, STRIDE*LEN);
+    fill(ys, STRIDE*LEN);
+
+    CHECK(lsdb_get_interpolation_into(NULL, TEST_MID, TEST_EID, TEST_LID,
+        2e16, 2, LEN, 0.0, 0.0, xs, ys, 1, NULL, NULL) == -1);
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        2e16, 2, LEN, 0.0, 0.0, xs, NULL, 1, NULL, NULL) == -1);
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        2e16, 2, 1, 0.0, 0.0, xs, ys, 1, NULL, NULL) == -1);
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        2e16, 2, LEN, 0.0, 0.0, xs, ys, 0, NULL, NULL) == -1);
+    /* outside the limits, and of a line without data */
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        1e18, 2, LEN, 0.0, 0.0, xs, ys, 1, NULL, NULL) == -1);
+    CHECK(lsdb_get_interpolation_into(lsdb, TEST_MID, TEST_EID, TEST_LID + 1,
+        2e16, 2, LEN, 0.0, 0.0, xs, ys, 1, NULL, NULL) == -1);
+
+    CHECK(untouched(xs, STRIDE*LEN) && untouched(ys, STRIDE*LEN));
+}
+
+static void check_dataset(const lsdb_t *lsdb, int did)
+{
+    lsdb_dataset_data_t *ds = lsdb_get_dataset_data(lsdb, did);
+    int len;
+
+    CHECK(ds != NULL);
+    if (!ds) {
+        return;
+    }
+    len = ds->len;
+
+    /* both arrays of a decoded dataset are aligned */
+    CHECK((uintptr_t) ds->x % LSDB_DATA_ALIGN == 0);
+    CHECK((uintptr_t) ds->y % LSDB_DATA_ALIGN == 0);
+
+    /* the size query */
+    CHECK(lsdb_get_dataset_data_into(lsdb, did, NULL, NULL, 1, 0) == len);
+
+    fill(xs, STRIDE*LEN);
+    fill(ys, STRIDE*LEN);
+    CHECK(lsdb_get_dataset_data_into(lsdb, did, xs, ys, 1, len) == len);
+    CHECK(strided_equal(xs, ds->x, len, 1));
+    CHECK(strided_equal(ys, ds->y, len, 1));
+    CHECK(xs[len] == UNTOUCHED && ys[len] == UNTOUCHED);
+
+    fill(xs, STRIDE*LEN);
+    fill(ys, STRIDE*LEN);
+    CHECK(lsdb_get_dataset_data_into(lsdb, did, xs, ys, STRIDE, LEN) == len);
+    CHECK(strided_equal(xs, ds->x, len, STRIDE));
+    CHECK(strided_equal(ys, ds->y, len, STRIDE));
+
+    fill(xs, STRIDE*LEN);
+    fill(ys, STRIDE*LEN);
+    CHECK(lsdb_get_dataset_data_into(lsdb, did, NULL, ys, STRIDE, LEN) == len);
+    CHECK(strided_equal(ys, ds->y, len, STRIDE));
+    CHECK(lsdb_get_dataset_data_into(lsdb, did, xs, NULL, 1, LEN) == len);
+    CHECK(strided_equal(xs, ds->x, len, 1));
+
+    /* too small a buffer, no stride, no such dataset: nothing is written */
+    fill(xs, STRIDE*LEN);
+    fill(ys, STRIDE*LEN);
+    CHECK(lsdb_get_dataset_data_into(lsdb, did, xs, ys, 1, len - 1) == -1);
+    CHECK(lsdb_get_dataset_data_into(lsdb, did, xs, ys, 0, len) == -1);
+    CHECK(lsdb_get_dataset_data_into(lsdb, did + 1000, xs, ys, 1, len) == -1);
+    CHECK(lsdb_get_dataset_data_into(NULL, did, xs, ys, 1, len) == -1);
+    CHECK(untouched(xs, STRIDE*LEN) && untouched(ys, STRIDE*LEN));
+
+    lsdb_dataset_data_free(ds);
+}
+
+int main(void)
+{
+    static const lsdb_interp_engine_t engines[2] = {
+        LSDB_INTERP_MORPH, LSDB_INTERP_QUANTILE
+    };
+    const double n[3] = {1e16, 2e16, 4e16}, T[3] = {1, 2, 4};
+    lsdb_t *lsdb;
+
+    lsdb = test_create_db(test_tmpname("into"));
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return test_result("t_into");
+    }
+    CHECK(test_add_grid(lsdb, n, 3, T, 3, LEN) == 9);
+
+    /* without and with the dataset cache, whose data are shared */
+    for (int cached = 0; cached <= 1; cached++) {
+        if (cached) {
+            CHECK(lsdb_set_cache_budget(lsdb, 1 << 24) == LSDB_SUCCESS);
+        }
+
+        for (int e = 0; e < 2; e++) {
+            CHECK(lsdb_set_interp_engine(lsdb, engines[e]) == LSDB_SUCCESS);
+            check_interpolation(lsdb, 1.5e16, 1.5, 0.0, 0.0);
+            check_interpolation(lsdb, 3e16, 3.5, 0.0, 0.0);
+            check_interpolation(lsdb, 2e16, 2, 0.0, 0.0);
+            check_interpolation(lsdb, 1.2e16, 3, 0.01, 0.0);
+            check_interpolation(lsdb, 3.5e16, 1.2, 0.01, 0.005);
+            check_interpolation_errors(lsdb);
+        }
+
+        for (int did = 1; did <= 9; did++) {
+            check_dataset(lsdb, did);
+        }
+    }
+
+    lsdb_close(lsdb);
+
+    return test_result("t_into");
+}
@@ -0,0 +1,150 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Line models against lsdb_get_interpolation(), with both engines, on a full
+ * grid (bucket lookup) and on scattered points (quadrant scan): the same
+ * queries must succeed or fail alike, with bitwise identical profiles. The
+ * queries include the grid nodes and lines, and points outside the limits.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+
+#define LEN      201
+#define NSCATTER 40
+#define NQUERY   200
+
+static const double ngrid[4] = {1e16, 1.5e16, 3e16, 8e16};
+static const double Tgrid[3] = {1, 2.5, 4};
+
+static double urand(double a, double b)
+{
+    return a + (b - a)*rand()/RAND_MAX;
+}
+
+static void check_query(const lsdb_t *lsdb, const lsdb_line_model_t *lm,
+    lsdb_interp_ws_t *ws, double n, double T, double sigma, double gamma)
+{
+    double x[LEN], y[LEN];
+    lsdb_dataset_data_t *ds;
+    int rc;
+
+    ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        n, T, LEN, sigma, gamma);
+    rc = lsdb_line_model_interpolate(lm, ws, n, T, LEN, sigma, gamma, x, y);
+
+    CHECK((ds != NULL) == (rc == LSDB_SUCCESS));
+    if (ds && rc == LSDB_SUCCESS &&
+        (memcmp(x, ds->x, sizeof(x)) || memcmp(y, ds->y, sizeof(y)))) {
+        fprintf(stderr, "(%g, %g): rel. diff. %.1e\n",
+            n, T, test_rel_diff(y, ds->y, LEN));
+        CHECK(!"identical profiles");
+    }
+
+    lsdb_dataset_data_free(ds);
+}
+
+static void check_db(lsdb_t *lsdb, bool grid)
+{
+    static const lsdb_interp_engine_t engines[2] = {
+        LSDB_INTERP_MORPH, LSDB_INTERP_QUANTILE
+    };
+    double nmin, nmax, Tmin, Tmax;
+    lsdb_interp_ws_t *ws;
+
+    ws = lsdb_interp_ws_new();
+    CHECK(ws != NULL);
+    if (!ws) {
+        return;
+    }
+
+    for (int e = 0; e < 2; e++) {
+        lsdb_line_model_t *lm;
+
+        CHECK(lsdb_set_interp_engine(lsdb, engines[e]) == LSDB_SUCCESS);
+        lm = lsdb_load_line_model(lsdb, TEST_MID, TEST_EID, TEST_LID);
+        CHECK(lm != NULL);
+        if (!lm) {
+            continue;
+        }
+        CHECK(lsdb_line_model_is_grid(lm) == grid);
+        CHECK(lsdb_line_model_get_npoints(lm) == (grid ? 12:NSCATTER));
+        lsdb_line_model_get_limits(lm, &nmin, &nmax, &Tmin, &Tmax);
+
+        /* the nodes, the midpoints, and the grid lines between them */
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 3; j++) {
+                check_query(lsdb, lm, ws, ngrid[i], Tgrid[j], 0.0, 0.0);
+                if (i < 3 && j < 2) {
+                    double n = 0.5*(ngrid[i] + ngrid[i + 1]);
+                    double T = 0.5*(Tgrid[j] + Tgrid[j + 1]);
+                    check_query(lsdb, lm, ws, n, T, 0.0, 0.0);
+                    check_query(lsdb, lm, ws, n, Tgrid[j], 0.0, 0.0);
+                    check_query(lsdb, lm, ws, ngrid[i], T, 0.0, 0.0);
+                }
+            }
+        }
+
+        /* random points, mostly in another cell than the previous one */
+        for (int k = 0; k < NQUERY; k++) {
+            double n = exp(urand(log(0.8*nmin), log(1.1*nmax)));
+            double T = urand(0.8*Tmin, 1.1*Tmax);
+            check_query(lsdb, lm, ws, n, T,
+                k % 4 ? 0.0:0.01, k % 8 ? 0.0:0.005);
+        }
+
+        lsdb_line_model_free(lm);
+    }
+
+    lsdb_interp_ws_free(ws);
+}
+
+int main(void)
+{
+    double n[NSCATTER], T[NSCATTER];
+    lsdb_t *lsdb;
+
+    srand(1);
+
+    lsdb = test_create_db(test_tmpname("linemodel"));
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        CHECK(test_add_grid(lsdb, ngrid, 4, Tgrid, 3, LEN) == 12);
+        check_db(lsdb, true);
+        lsdb_close(lsdb);
+    }
+
+    lsdb = test_create_db(test_tmpname("linemodel-scatter"));
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        for (int i = 0; i < NSCATTER; i++) {
+            n[i] = exp(urand(log(ngrid[0]), log(ngrid[3])));
+            T[i] = urand(Tgrid[0], Tgrid[2]);
+        }
+        CHECK(test_add_points(lsdb, n, T, NSCATTER, LEN) == NSCATTER);
+        check_db(lsdb, false);
+        lsdb_close(lsdb);
+    }
+
+    return test_result("t_linemodel");
+}
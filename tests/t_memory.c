@@ -0,0 +1,158 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * LSDB_ACCESS_RO_MEMORY: once opened, the handle doesn't need the file. The
+ * file is removed right after opening, and the interpolations must still be
+ * the same, bit for bit, as those of a handle reading the file, including
+ * from threads whose connections are opened only afterwards.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+
+#define LEN     201
+#define NPOINTS 4
+
+static const double qn[NPOINTS] = {1.5e16, 3e16, 1.2e16, 3.9e16};
+static const double qT[NPOINTS] = {1.5, 3, 3.5, 1.1};
+
+typedef struct {
+    const lsdb_t *lsdb;
+    const double *ref;
+    int           nbad;
+} job_t;
+
+/* the interpolations at all the query points into y[NPOINTS*LEN] */
+static int interpolate(const lsdb_t *lsdb, double *y)
+{
+    for (int i = 0; i < NPOINTS; i++) {
+        lsdb_dataset_data_t *ds = lsdb_get_interpolation(lsdb,
+            TEST_MID, TEST_EID, TEST_LID, qn[i], qT[i], LEN, 0.0, 0.0);
+        if (!ds) {
+            return LSDB_FAILURE;
+        }
+        memcpy(y + i*LEN, ds->y, LEN*sizeof(double));
+        lsdb_dataset_data_free(ds);
+    }
+
+    return LSDB_SUCCESS;
+}
+
+static void *worker(void *arg)
+{
+    job_t *job = arg;
+    double y[NPOINTS*LEN];
+
+    if (interpolate(job->lsdb, y) != LSDB_SUCCESS ||
+        memcmp(y, job->ref, sizeof(y))) {
+        job->nbad++;
+    }
+
+    return NULL;
+}
+
+static void check_file(const char *fname, bool threadsafe,
+    const double *ref)
+{
+    lsdb_open_opts_t opts;
+    lsdb_stats_t stats;
+    double y[NPOINTS*LEN];
+    lsdb_t *lsdb;
+
+    memset(&opts, 0, sizeof(lsdb_open_opts_t));
+    opts.threadsafe = threadsafe;
+    opts.catalog    = true;
+    lsdb = lsdb_open_ex(fname, LSDB_ACCESS_RO_MEMORY, &opts);
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return;
+    }
+    CHECK(unlink(fname) == 0);
+
+    CHECK(lsdb_get_stats(lsdb, &stats) == LSDB_SUCCESS);
+    CHECK(stats.load_time >= 0.0);
+    CHECK(stats.mem_bytes > 0);
+
+    CHECK(lsdb_find_radiator(lsdb, "H") > 0);
+    CHECK(lsdb_get_doppler_sigma(lsdb, TEST_LID, 1.0) > 0.0);
+    CHECK(interpolate(lsdb, y) == LSDB_SUCCESS);
+    CHECK(!memcmp(y, ref, sizeof(y)));
+
+    if (threadsafe) {
+        job_t job = {lsdb, ref, 0};
+        pthread_t tid;
+
+        CHECK(pthread_create(&tid, NULL, worker, &job) == 0);
+        pthread_join(tid, NULL);
+        CHECK(job.nbad == 0);
+    }
+
+    lsdb_close(lsdb);
+}
+
+int main(void)
+{
+    const double n[3] = {1e16, 2e16, 4e16}, T[3] = {1, 2, 4};
+    const char *fname = test_tmpname("memory");
+    const char *xname = test_tmpname("memory-x");
+    double ref[NPOINTS*LEN];
+    lsdb_t *lsdb;
+
+    lsdb = test_create_db(fname);
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return test_result("t_memory");
+    }
+    CHECK(test_add_grid(lsdb, n, 3, T, 3, LEN) == 9);
+    CHECK(interpolate(lsdb, ref) == LSDB_SUCCESS);
+    CHECK(lsdb_export_snapshot(lsdb, xname) == LSDB_SUCCESS);
+    lsdb_close(lsdb);
+
+    for (int mt = 0; mt <= 1; mt++) {
+        FILE *src, *dst;
+        const char *copy = test_tmpname(mt ? "memory-mt":"memory-st");
+        char buf[4096];
+        size_t nread;
+
+        /* each pass removes the file it opens */
+        src = fopen(fname, "rb");
+        dst = fopen(copy, "wb");
+        CHECK(src && dst);
+        if (!src || !dst) {
+            break;
+        }
+        while ((nread = fread(buf, 1, sizeof(buf), src)) > 0) {
+            fwrite(buf, 1, nread, dst);
+        }
+        fclose(src);
+        fclose(dst);
+
+        check_file(copy, mt, ref);
+    }
+
+    /* a snapshot is loaded into memory as well */
+    check_file(xname, false, ref);
+
+    return test_result("t_memory");
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * The CDFs morph_init_ws() accumulates between the grid points against the
+ * integrals of GSL's Steffen spline from the start of the domain.
+ */
+
+#include <math.h>
+#include <float.h>
+#include <gsl/gsl_spline.h>
+
+#include <lsdb/morphP.h>
+
+#include "common.h"
+
+#define LEN 2001
+
+/* max |C[i] - direct CDF at x[i]| */
+static double cdf_diff(const double *xs, const double *ys, size_t len,
+    const double *x, const double *C, size_t np)
+{
+    gsl_spline *s = gsl_spline_alloc(gsl_interp_steffen, len);
+    gsl_interp_accel *acc = gsl_interp_accel_alloc();
+    double norm, d = 0.0;
+
+    gsl_spline_init(s, xs, ys, len);
+    norm = gsl_spline_eval_integ(s, x[0], x[np - 1], acc);
+    for (size_t i = 0; i < np; i++) {
+        double Ci = gsl_spline_eval_integ(s, x[0], x[i], acc)/norm;
+        d = fmax(d, fabs(C[i] - Ci));
+    }
+
+    gsl_interp_accel_free(acc);
+    gsl_spline_free(s);
+
+    return d;
+}
+
+static void check_pair(double nf, double Tf, double ng, double Tg, size_t np)
+{
+    double xf[LEN], yf[LEN], xg[LEN], yg[LEN], dF, dG;
+    morph_workspace_t *ws = morph_workspace_new();
+    morph_t *m = morph_new(np);
+
+    test_profile(nf, Tf, xf, yf, LEN);
+    test_profile(ng, Tg, xg, yg, LEN);
+
+    CHECK(ws && m && morph_init_ws(m, ws, xf, yf, LEN, xg, yg, LEN));
+    if (ws && m) {
+        dF = cdf_diff(xf, yf, LEN, ws->x, ws->F, np);
+        dG = cdf_diff(xg, yg, LEN, ws->x, ws->G, np);
+        printf("np %5lu: F %.1e, G %.1e\n", (unsigned long) np, dF, dG);
+        CHECK(dF < np*DBL_EPSILON && dG < np*DBL_EPSILON);
+    }
+
+    morph_free(m);
+    morph_workspace_free(ws);
+}
+
+int main(void)
+{
+    check_pair(1e16, 1.0, 1e17, 4.0, 101);
+    check_pair(1e16, 1.0, 1e17, 4.0, 2001);
+    check_pair(3e16, 2.0, 3e16, 8.0, 2001);
+    check_pair(1e17, 1.0, 1e18, 1.0, 8001);
+
+    return test_result("t_morph");
+}
@@ -0,0 +1,199 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * morph_init_q_ws() against morph_init_ws() on profiles defined over
+ * different x ranges, and the interpolations of DBs with stored quantiles
+ * whose datasets all have ranges of their own, on a grid and on scattered
+ * points: the morphed profiles must not vanish inside the common range, so
+ * that the second morph of the interpolation succeeds.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include <lsdb/morph.h>
+#include <lsdb/lsdbP.h>
+
+#include "common.h"
+
+#define LEN      401
+#define NP       401
+#define NREF     8001
+#define NT       5
+#define NEVAL    1000
+#define NQUERY   16
+#define NSCATTER 20
+
+/*
+ * The largest deviations, relative to the peak, of the morphs of the profiles
+ * at (n, T) by morph_init_ws() and by morph_init_q_ws() from that of a
+ * twenty times finer grid
+ */
+static void check_pair(double nf, double Tf, double ng, double Tg,
+    double *err_ws, double *err_q)
+{
+    double xf[LEN], yf[LEN], xg[LEN], yg[LEN];
+    double qf[LSDB_NQUANTILES], qg[LSDB_NQUANTILES], norm_f, norm_g;
+    double xmin, xmax, xmin_q, xmax_q;
+    morph_workspace_t *ws = morph_workspace_new();
+    morph_t *ref = morph_new(NREF), *m = morph_new(NP), *mq = morph_new(NP);
+
+    *err_ws = *err_q = 0.0;
+
+    test_profile(nf, Tf, xf, yf, LEN);
+    test_profile(ng, Tg, xg, yg, LEN);
+
+    CHECK(ws && ref && m && mq);
+    CHECK(morph_get_quantiles(ws, xf, yf, LEN, qf, LSDB_NQUANTILES, &norm_f));
+    CHECK(morph_get_quantiles(ws, xg, yg, LEN, qg, LSDB_NQUANTILES, &norm_g));
+    CHECK(morph_init_ws(ref, ws, xf, yf, LEN, xg, yg, LEN));
+    CHECK(morph_init_ws(m, ws, xf, yf, LEN, xg, yg, LEN));
+    CHECK(morph_init_q_ws(mq, ws, xf, yf, LEN,
+        qf, norm_f, qg, norm_g, LSDB_NQUANTILES));
+
+    CHECK(morph_get_domain(m, &xmin, &xmax));
+    CHECK(morph_get_domain(mq, &xmin_q, &xmax_q));
+    CHECK(xmin == xmin_q && xmax == xmax_q);
+
+    for (int k = 0; k < NT; k++) {
+        double t = (double) k/(NT - 1), peak = 0.0, dws = 0.0, dq = 0.0;
+        double x[NEVAL], y0[NEVAL], y[NEVAL], yq[NEVAL];
+
+        for (int i = 0; i < NEVAL; i++) {
+            x[i] = xmin + (xmax - xmin)*(i + 0.5)/NEVAL;
+        }
+        morph_eval_array(ref, t, x, y0, NEVAL, false);
+        morph_eval_array(m, t, x, y, NEVAL, false);
+        morph_eval_array(mq, t, x, yq, NEVAL, false);
+
+        for (int i = 0; i < NEVAL; i++) {
+            peak = fmax(peak, y0[i]);
+            dws  = fmax(dws, fabs(y[i] - y0[i]));
+            dq   = fmax(dq, fabs(yq[i] - y0[i]));
+        }
+        /* no gaps inside; the profiles' tails are far from zero */
+        for (int i = 0; i < NEVAL; i++) {
+            if (!(yq[i] > 0)) {
+                fprintf(stderr, "(%g, %g) -> (%g, %g), t = %g: "
+                    "zero at %g\n", nf, Tf, ng, Tg, t, x[i]);
+                CHECK(yq[i] > 0);
+                break;
+            }
+        }
+        *err_ws = fmax(*err_ws, dws/peak);
+        *err_q  = fmax(*err_q, dq/peak);
+    }
+
+    morph_free(ref);
+    morph_free(m);
+    morph_free(mq);
+    morph_workspace_free(ws);
+}
+
+static double urand(double a, double b)
+{
+    return a + (b - a)*rand()/RAND_MAX;
+}
+
+/* the interpolations over [1e16, 4e16] x [1, 4] */
+static void check_db(lsdb_t *lsdb)
+{
+    for (int i = 0; i <= NQUERY; i++) {
+        for (int j = 0; j <= NQUERY; j++) {
+            double n = 1e16*pow(4.0, (double) i/NQUERY);
+            double T = 1 + 3.0*j/NQUERY;
+            lsdb_dataset_data_t *ds;
+            double area = 0.0;
+
+            ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+                n, T, LEN, 0.0, 0.0);
+            if (!ds) {
+                fprintf(stderr, "(%g, %g) failed\n", n, T);
+                CHECK(ds != NULL);
+                continue;
+            }
+            for (size_t k = 1; k < ds->len; k++) {
+                area += 0.5*(ds->y[k] + ds->y[k - 1])*(ds->x[k] - ds->x[k - 1]);
+            }
+            /* a Lorentzian and a Gaussian, less the tails of the former */
+            CHECK(area > 1.95 && area < 2.01);
+            lsdb_dataset_data_free(ds);
+        }
+    }
+}
+
+int main(void)
+{
+    static const double pairs[][4] = {
+        {1e16, 1, 1e16, 1},
+        {1e16, 1, 2e16, 1},
+        {2e16, 1, 1e16, 1},
+        {1e16, 1, 1e16, 4},
+        {1e16, 4, 1e16, 1},
+        {1e16, 1, 4e16, 4},
+        {4e16, 4, 1e16, 1},
+        {2e16, 2, 4e16, 1}
+    };
+    const double ngrid[3] = {1e16, 2e16, 4e16}, Tgrid[3] = {1, 2, 4};
+    double n[NSCATTER], T[NSCATTER];
+    lsdb_t *lsdb;
+
+    for (size_t k = 0; k < sizeof(pairs)/sizeof(pairs[0]); k++) {
+        const double *p = pairs[k];
+        double err_ws, err_q;
+
+        check_pair(p[0], p[1], p[2], p[3], &err_ws, &err_q);
+        printf("(%g, %g) -> (%g, %g): %.1e, %.1e of the peak\n",
+            p[0], p[1], p[2], p[3], err_ws, err_q);
+        /* as close to the fine grid as morph_init_ws() is, within 2% */
+        CHECK(err_q <= err_ws + 1e-3);
+        CHECK(err_q < 2e-2);
+    }
+
+    lsdb = test_create_db(test_tmpname("qmorph"));
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        CHECK(lsdb_get_format(lsdb) >= 4);
+        CHECK(test_add_grid(lsdb, ngrid, 3, Tgrid, 3, LEN) == 9);
+        check_db(lsdb);
+        lsdb_close(lsdb);
+    }
+
+    /* the corners, and random points; with the pairs of their cells */
+    srand(1);
+    for (int i = 0; i < NSCATTER; i++) {
+        n[i] = (i & 1) ? 4e16:1e16;
+        T[i] = (i & 2) ? 4:1;
+        if (i >= 4) {
+            n[i] = exp(urand(log(1e16), log(4e16)));
+            T[i] = urand(1, 4);
+        }
+    }
+    lsdb = test_create_db(test_tmpname("qmorph-scatter"));
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        CHECK(test_add_points(lsdb, n, T, NSCATTER, LEN) == NSCATTER);
+        check_db(lsdb);
+        lsdb_close(lsdb);
+    }
+
+    return test_result("t_qmorph");
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * The catalog, the index and the caches against the writes of another
+ * connection and of the handle itself: a lookup after a commit must see it,
+ * while repeated lookups without commits in between rebuild nothing.
+ */
+
+#include <string.h>
+
+#include "common.h"
+
+#define LEN     101
+#define NLOOKUP 100
+
+static void check_mode(bool threadsafe, bool catalog)
+{
+    const double n[3] = {1e16, 2e16, 4e16}, T[3] = {1, 2, 4};
+    lsdb_open_opts_t opts;
+    lsdb_stats_t s0, s1;
+    lsdb_dataset_data_t *ds;
+    lsdb_t *w, *r;
+    const char *fname = test_tmpname(threadsafe ? "sync-mt":"sync");
+
+    w = test_create_db(fname);
+    CHECK(w != NULL);
+    if (!w) {
+        return;
+    }
+    CHECK(test_add_grid(w, n, 3, T, 3, LEN) == 9);
+
+    memset(&opts, 0, sizeof(lsdb_open_opts_t));
+    opts.threadsafe = threadsafe;
+    opts.catalog    = catalog;
+    r = lsdb_open_ex(fname, LSDB_ACCESS_RW, &opts);
+    CHECK(r != NULL);
+    if (!r) {
+        lsdb_close(w);
+        return;
+    }
+    CHECK(lsdb_set_cache_budget(r, 1 << 24) == LSDB_SUCCESS);
+
+    /* warm up, then nothing is rebuilt */
+    ds = lsdb_get_interpolation(r, TEST_MID, TEST_EID, TEST_LID,
+        3e16, 3, LEN, 0.0, 0.0);
+    CHECK(ds != NULL);
+    lsdb_dataset_data_free(ds);
+    lsdb_dataset_data_free(lsdb_get_dataset_data(r, 1));
+    CHECK(lsdb_find_radiator(r, "H") > 0);
+    CHECK(lsdb_get_stats(r, &s0) == LSDB_SUCCESS);
+    for (int i = 0; i < NLOOKUP; i++) {
+        CHECK(lsdb_find_radiator(r, "H") > 0);
+        ds = lsdb_get_interpolation(r, TEST_MID, TEST_EID, TEST_LID,
+            3e16, 3, LEN, 0.0, 0.0);
+        CHECK(ds != NULL);
+        lsdb_dataset_data_free(ds);
+    }
+    CHECK(lsdb_get_stats(r, &s1) == LSDB_SUCCESS);
+    CHECK(s1.catalog_builds == s0.catalog_builds);
+    CHECK(s1.index_builds == s0.index_builds);
+
+    /* commits of another connection */
+    CHECK(lsdb_find_radiator(r, "He") < 0);
+    CHECK(lsdb_add_radiator(w, "He", 2, 4.003, 1) > 0);
+    CHECK(lsdb_find_radiator(r, "He") > 0);
+
+    CHECK(lsdb_del_dataset(w, 1) == LSDB_SUCCESS);
+    ds = lsdb_get_dataset_data(r, 1);
+    CHECK(ds == NULL);
+    lsdb_dataset_data_free(ds);
+    ds = lsdb_get_interpolation(r, TEST_MID, TEST_EID, TEST_LID,
+        1.5e16, 1.5, LEN, 0.0, 0.0);
+    CHECK(ds == NULL);
+    lsdb_dataset_data_free(ds);
+
+    /* own commits */
+    CHECK(lsdb_find_radiator(r, "Li") < 0);
+    CHECK(lsdb_add_radiator(r, "Li", 3, 6.94, 1) > 0);
+    CHECK(lsdb_find_radiator(r, "Li") > 0);
+
+    lsdb_close(r);
+    lsdb_close(w);
+}
+
+int main(void)
+{
+    check_mode(false, false);
+    check_mode(false, true);
+    check_mode(true, false);
+    check_mode(true, true);
+
+    return test_result("t_sync");
+}
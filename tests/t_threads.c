@@ -0,0 +1,166 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * 32 threads evaluating the same morph and interpolants at once, with their
+ * own accelerators, none, and in scrambled order; every value must be
+ * bitwise identical to the single-threaded one.
+ */
+
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "common.h"
+
+#define NTHREADS 32
+#define NITER    40
+#define NX       1009
+#define LEN      501
+
+typedef struct {
+    const morph_t       *m;
+    const lsdb_interp_t *interp[2];
+
+    double x[NX];
+    /* references: point by point, and by the array evaluation */
+    double ym[NX], yma[NX];
+    double yi[2][NX], yia[2][NX];
+} shared_t;
+
+typedef struct {
+    const shared_t *sh;
+    unsigned int seed;
+    int nbad;
+} job_t;
+
+static bool same(double a, double b)
+{
+    return !memcmp(&a, &b, sizeof(double));
+}
+
+static void *worker(void *arg)
+{
+    job_t *job = arg;
+    const shared_t *sh = job->sh;
+    double y[NX];
+
+    for (int it = 0; it < NITER; it++) {
+        morph_accel_t macc = {0};
+        lsdb_interp_accel_t iacc = {0};
+        /* NX is a prime, so any stride below it visits all the points */
+        size_t step = 1 + 2*(rand_r(&job->seed) % 100), i, k;
+        int e;
+
+        morph_eval_array_r(sh->m, 0.3, sh->x, y, NX, true, &macc);
+        job->nbad += memcmp(y, sh->yma, sizeof(y)) != 0;
+
+        for (i = 0, k = 0; i < NX; i++, k = (k + step) % NX) {
+            job->nbad += !same(morph_eval_r(sh->m, 0.3, sh->x[k], true,
+                it % 2 ? &macc:NULL), sh->ym[k]);
+        }
+
+        for (e = 0; e < 2; e++) {
+            lsdb_interp_eval_array_r(sh->interp[e], sh->x, y, NX, false, &iacc);
+            job->nbad += memcmp(y, sh->yia[e], sizeof(y)) != 0;
+
+            for (i = 0, k = 0; i < NX; i++, k = (k + step) % NX) {
+                job->nbad += !same(lsdb_interp_eval_r(sh->interp[e], sh->x[k],
+                    false, it % 2 ? &iacc:NULL), sh->yi[e][k]);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    static const double n[3] = {1e16, 1e17, 1e18}, T[3] = {1.0, 3.0, 10.0};
+    static shared_t sh;
+    static job_t jobs[NTHREADS];
+    pthread_t tids[NTHREADS];
+    double xf[LEN], yf[LEN], xg[LEN], yg[LEN], xmin, xmax;
+    lsdb_interp_t *interp[2] = {NULL, NULL};
+    morph_t *m = morph_new(LEN);
+    lsdb_t *lsdb;
+    int i, e, nbad = 0;
+
+    test_profile(1e16, 1.0, xf, yf, LEN);
+    test_profile(1e17, 4.0, xg, yg, LEN);
+    CHECK(m && morph_init(m, xf, yf, LEN, xg, yg, LEN));
+
+    lsdb = test_create_db(test_tmpname("threads"));
+    CHECK(lsdb && test_add_grid(lsdb, n, 3, T, 3, LEN) == 9);
+    if (!lsdb) {
+        return test_result("t_threads");
+    }
+    for (e = 0; e < 2; e++) {
+        lsdb_set_interp_engine(lsdb,
+            e ? LSDB_INTERP_QUANTILE:LSDB_INTERP_MORPH);
+        interp[e] = lsdb_prepare_interpolation(lsdb,
+            TEST_MID, TEST_EID, TEST_LID, 4e16, 2.0, LEN);
+        CHECK(interp[e] != NULL);
+    }
+    if (!m || !interp[0] || !interp[1]) {
+        return test_result("t_threads");
+    }
+
+    /* cover the domain with some margin, so that zeros are checked too */
+    morph_get_domain(m, &xmin, &xmax);
+    for (i = 0; i < NX; i++) {
+        sh.x[i] = xmin - 0.1*(xmax - xmin) + 1.2*(xmax - xmin)*i/(NX - 1);
+    }
+
+    sh.m = m;
+    morph_eval_array_r(m, 0.3, sh.x, sh.yma, NX, true, NULL);
+    for (i = 0; i < NX; i++) {
+        sh.ym[i] = morph_eval_r(m, 0.3, sh.x[i], true, NULL);
+    }
+    for (e = 0; e < 2; e++) {
+        sh.interp[e] = interp[e];
+        lsdb_interp_eval_array_r(interp[e], sh.x, sh.yia[e], NX, false, NULL);
+        for (i = 0; i < NX; i++) {
+            sh.yi[e][i] = lsdb_interp_eval_r(interp[e], sh.x[i], false, NULL);
+        }
+    }
+
+    for (i = 0; i < NTHREADS; i++) {
+        jobs[i].sh   = &sh;
+        jobs[i].seed = i + 1;
+        CHECK(pthread_create(&tids[i], NULL, worker, &jobs[i]) == 0);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        pthread_join(tids[i], NULL);
+        nbad += jobs[i].nbad;
+    }
+    if (nbad) {
+        fprintf(stderr, "%d evaluations differ\n", nbad);
+    }
+    CHECK(nbad == 0);
+
+    for (e = 0; e < 2; e++) {
+        lsdb_interp_free(interp[e]);
+    }
+    lsdb_close(lsdb);
+    morph_free(m);
+
+    return test_result("t_threads");
+}
@@ -0,0 +1,272 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * lsdb_upgrade() of a format-1 DB, with the datasets as per-point rows of the
+ * data table: every dataset must read the same, to the bit, before and after,
+ * also when reopened; the BLOB columns and the datasets_meln index must be
+ * there and the data table gone. A DB whose migration hook fails, due to a
+ * dataset without any points, must be left at format 1 as it was.
+ */
+
+#include <string.h>
+
+#include "common.h"
+
+#define LEN 101
+#define NDS 9
+
+/* schema.sql of format 1 */
+static const char *schema_v1 =
+    "CREATE TABLE lsdb (property TEXT UNIQUE NOT NULL,"
+    " value INTEGER NOT NULL);"
+    "CREATE TABLE models (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+    " name TEXT UNIQUE NOT NULL, descr TEXT NOT NULL DEFAULT '');"
+    "CREATE TABLE environments (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+    " name TEXT UNIQUE NOT NULL, descr TEXT NOT NULL DEFAULT '');"
+    "CREATE TABLE radiators (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+    " symbol TEXT UNIQUE NOT NULL, anum INTEGER NOT NULL,"
+    " mass REAL NOT NULL, zsp INTEGER NOT NULL, UNIQUE (anum, mass, zsp));"
+    "CREATE TABLE lines (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+    " rid INTEGER NOT NULL REFERENCES radiators(id) ON DELETE CASCADE,"
+    " name TEXT NOT NULL, energy REAL NOT NULL, UNIQUE (rid, name));"
+    "CREATE TABLE line_properties ("
+    " id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+    " lid INTEGER NOT NULL REFERENCES lines(id) ON DELETE CASCADE,"
+    " name TEXT NOT NULL, value TEXT NOT NULL, UNIQUE (lid, name));"
+    "CREATE TABLE datasets (id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,"
+    " lid INTEGER NOT NULL REFERENCES lines(id) ON DELETE CASCADE,"
+    " eid INTEGER NOT NULL REFERENCES environments(id) ON DELETE CASCADE,"
+    " mid INTEGER NOT NULL REFERENCES models(id) ON DELETE CASCADE,"
+    " n REAL NOT NULL, T REAL NOT NULL, UNIQUE (lid, eid, mid, n, T));"
+    "CREATE TABLE data ("
+    " did INTEGER NOT NULL REFERENCES datasets(id) ON DELETE CASCADE,"
+    " x REAL NOT NULL, y REAL NOT NULL);"
+    "INSERT INTO lsdb (property, value) VALUES ('format', 1);"
+    "INSERT INTO lsdb (property, value) VALUES ('units', 0);"
+    "INSERT INTO models (name, descr) VALUES ('test', 'synthetic profiles');"
+    "INSERT INTO environments (name, descr) VALUES ('plasma', '');"
+    "INSERT INTO radiators (symbol, anum, mass, zsp) VALUES ('H', 1, 1.008, 1);"
+    "INSERT INTO lines (rid, name, energy) VALUES (1, 'Ly-alpha', 82259.0);";
+
+/*
+ * A format-1 DB of the 3x3 grid of test_profile()s, the points of each
+ * stored in descending x; with empty, one more dataset without any points
+ */
+static bool create_v1(const char *fname, bool empty)
+{
+    const double n[3] = {1e16, 2e16, 4e16}, T[3] = {1, 2, 4};
+    sqlite3 *db;
+    sqlite3_stmt *ds_stmt = NULL, *data_stmt = NULL;
+    double x[LEN], y[LEN];
+    bool OK;
+
+    if (sqlite3_open(fname, &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        return false;
+    }
+
+    OK = sqlite3_exec(db, schema_v1, NULL, NULL, NULL) == SQLITE_OK &&
+        sqlite3_exec(db, "BEGIN", NULL, NULL, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, "INSERT INTO datasets (mid, eid, lid, n, T)"
+            " VALUES (1, 1, 1, ?, ?)", -1, &ds_stmt, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, "INSERT INTO data (did, x, y)"
+            " VALUES (?, ?, ?)", -1, &data_stmt, NULL) == SQLITE_OK;
+
+    for (int i = 0; OK && i < NDS + empty; i++) {
+        double ni = i < NDS ? n[i/3]:3e16, Ti = i < NDS ? T[i%3]:3;
+        sqlite3_int64 did;
+
+        sqlite3_bind_double(ds_stmt, 1, ni);
+        sqlite3_bind_double(ds_stmt, 2, Ti);
+        OK = sqlite3_step(ds_stmt) == SQLITE_DONE;
+        sqlite3_reset(ds_stmt);
+        did = sqlite3_last_insert_rowid(db);
+
+        if (i == NDS) {
+            break;
+        }
+
+        test_profile(ni, Ti, x, y, LEN);
+        for (int k = LEN - 1; OK && k >= 0; k--) {
+            sqlite3_bind_int64(data_stmt, 1, did);
+            sqlite3_bind_double(data_stmt, 2, x[k]);
+            sqlite3_bind_double(data_stmt, 3, y[k]);
+            OK = sqlite3_step(data_stmt) == SQLITE_DONE;
+            sqlite3_reset(data_stmt);
+        }
+    }
+
+    sqlite3_finalize(ds_stmt);
+    sqlite3_finalize(data_stmt);
+    OK = OK && sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) == SQLITE_OK;
+    sqlite3_close(db);
+
+    return OK;
+}
+
+/* the first column of the first row of sql, or -1 */
+static int query_int(const char *fname, const char *sql)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    int v = -1;
+
+    if (sqlite3_open_v2(fname, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            v = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+
+    return v;
+}
+
+static bool same_dataset(const lsdb_dataset_data_t *a,
+    const lsdb_dataset_data_t *b)
+{
+    return a && b && a->len == b->len && a->n == b->n && a->T == b->T &&
+        !memcmp(a->x, b->x, a->len*sizeof(double)) &&
+        !memcmp(a->y, b->y, a->len*sizeof(double));
+}
+
+static void check_datasets(const lsdb_t *lsdb, lsdb_dataset_data_t *ref[NDS])
+{
+    for (int i = 0; i < NDS; i++) {
+        lsdb_dataset_data_t *ds = lsdb_get_dataset_data(lsdb, i + 1);
+
+        CHECK(same_dataset(ds, ref[i]));
+        lsdb_dataset_data_free(ds);
+    }
+}
+
+static void check_upgrade(void)
+{
+    const char *fname = test_tmpname("upgrade");
+    lsdb_dataset_data_t *ref[NDS];
+    lsdb_dataset_data_t *ds;
+    lsdb_t *lsdb;
+
+    CHECK(create_v1(fname, false));
+    lsdb = lsdb_open(fname, LSDB_ACCESS_RW);
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return;
+    }
+    CHECK(lsdb_get_format(lsdb) == 1);
+
+    /* as stored, in ascending x */
+    for (int i = 0; i < NDS; i++) {
+        ref[i] = lsdb_get_dataset_data(lsdb, i + 1);
+        CHECK(ref[i] != NULL && ref[i]->len == LEN);
+        CHECK(ref[i] && ref[i]->x[0] < ref[i]->x[LEN - 1]);
+    }
+
+    CHECK(lsdb_upgrade(lsdb) == LSDB_SUCCESS);
+    CHECK(lsdb_get_format(lsdb) == 4);
+    check_datasets(lsdb, ref);
+
+    /* the interpolation over the upgraded datasets */
+    ds = lsdb_get_interpolation(lsdb, TEST_MID, TEST_EID, TEST_LID,
+        1.5e16, 1.5, LEN, 0.0, 0.0);
+    CHECK(ds != NULL);
+    lsdb_dataset_data_free(ds);
+
+    /* idempotent */
+    CHECK(lsdb_upgrade(lsdb) == LSDB_SUCCESS);
+    lsdb_close(lsdb);
+
+    lsdb = lsdb_open(fname, LSDB_ACCESS_RO);
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        CHECK(lsdb_get_format(lsdb) == 4);
+        check_datasets(lsdb, ref);
+        lsdb_close(lsdb);
+    }
+
+    CHECK(query_int(fname,
+        "SELECT value FROM lsdb WHERE property = 'format'") == 4);
+    CHECK(query_int(fname, "SELECT count(*) FROM sqlite_master"
+        " WHERE type = 'table' AND name = 'data'") == 0);
+    CHECK(query_int(fname, "SELECT count(*) FROM datasets"
+        " WHERE len = 101 AND length(x) = 808 AND length(y) = 808") == NDS);
+    CHECK(query_int(fname, "SELECT group_concat(name, ',') = 'mid,eid,lid,n,T'"
+        " FROM pragma_index_info('datasets_meln')") == 1);
+
+    for (int i = 0; i < NDS; i++) {
+        lsdb_dataset_data_free(ref[i]);
+    }
+}
+
+static void check_failed_upgrade(void)
+{
+    const char *fname = test_tmpname("upgrade-fail");
+    lsdb_dataset_data_t *ref[NDS];
+    lsdb_t *lsdb;
+
+    CHECK(create_v1(fname, true));
+    lsdb = lsdb_open(fname, LSDB_ACCESS_RW);
+    CHECK(lsdb != NULL);
+    if (!lsdb) {
+        return;
+    }
+
+    for (int i = 0; i < NDS; i++) {
+        ref[i] = lsdb_get_dataset_data(lsdb, i + 1);
+        CHECK(ref[i] != NULL);
+    }
+
+    CHECK(lsdb_upgrade(lsdb) == LSDB_FAILURE);
+    CHECK(lsdb_get_format(lsdb) == 1);
+    check_datasets(lsdb, ref);
+    lsdb_close(lsdb);
+
+    /* nothing of the migration left behind */
+    CHECK(query_int(fname,
+        "SELECT value FROM lsdb WHERE property = 'format'") == 1);
+    CHECK(query_int(fname, "SELECT count(*) FROM data") == NDS*LEN);
+    CHECK(query_int(fname, "SELECT count(*) FROM pragma_table_info('datasets')"
+        " WHERE name IN ('len', 'xmin', 'xmax', 'x', 'y')") == 0);
+    CHECK(query_int(fname, "SELECT count(*) FROM sqlite_master"
+        " WHERE type = 'index' AND name IN ('data_did', 'datasets_meln')")
+        == 0);
+
+    lsdb = lsdb_open(fname, LSDB_ACCESS_RO);
+    CHECK(lsdb != NULL);
+    if (lsdb) {
+        CHECK(lsdb_get_format(lsdb) == 1);
+        check_datasets(lsdb, ref);
+        lsdb_close(lsdb);
+    }
+
+    for (int i = 0; i < NDS; i++) {
+        lsdb_dataset_data_free(ref[i]);
+    }
+}
+
+int main(void)
+{
+    check_upgrade();
+    check_failed_upgrade();
+
+    return test_result("t_upgrade");
+}
@@ -0,0 +1,154 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * The Voigt convolution paths against a plain O(n^2) evaluation of the
+ * unpadded type-I DCT: the DCT itself, the truncated direct kernel used for
+ * narrow Gaussians, and the DCT of the mirror-padded data.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+
+#define LEN 2001
+
+/* y <- DCT-I(y); c[] is cos(pi*k/(n - 1)) for k < 2(n - 1) */
+static void dct1(double *y, size_t n, const double *c, double *work)
+{
+    size_t N = 2*(n - 1);
+
+    for (size_t k = 0; k < n; k++) {
+        double s = y[0] + (k % 2 ? -y[n - 1]:y[n - 1]);
+        for (size_t j = 1; j < n - 1; j++) {
+            s += 2*y[j]*c[(j*k) % N];
+        }
+        work[k] = s;
+    }
+    memcpy(y, work, n*sizeof(double));
+}
+
+static void ref_conv(double *y, size_t n, double dx, double sigma, double gamma)
+{
+    size_t N = 2*(n - 1);
+    double *c = malloc(N*sizeof(double)), *work = malloc(n*sizeof(double));
+
+    for (size_t k = 0; k < N; k++) {
+        c[k] = cos(M_PI*k/(n - 1));
+    }
+
+    dct1(y, n, c, work);
+    for (size_t i = 0; i < n; i++) {
+        double t = M_PI*i/((n - 1)*dx);
+        y[i] *= exp(-gamma*t - sigma*sigma*t*t/2)/N;
+    }
+    dct1(y, n, c, work);
+
+    free(c);
+    free(work);
+}
+
+static double max_diff(const double *y1, const double *y2, size_t len)
+{
+    double d = 0.0;
+
+    for (size_t i = 0; i < len; i++) {
+        d = fmax(d, fabs(y1[i] - (y2 ? y2[i]:0.0)));
+    }
+
+    return d;
+}
+
+/*
+ * the deviation from the reference relative to its peak, over the whole
+ * profile and over its first half; and the method counts
+ */
+static double conv_diff(size_t len, double sigma, double gamma,
+    lsdb_stats_t *stats, double *dhalf)
+{
+    double *x = malloc(len*sizeof(double));
+    double *y = malloc(len*sizeof(double)), *ref = malloc(len*sizeof(double));
+    double dx, diff;
+    lsdb_stats_t s0;
+
+    test_profile(3e16, 2.0, x, y, len);
+    memcpy(ref, y, len*sizeof(double));
+    dx = x[1] - x[0];
+
+    lsdb_voigt_get_stats(&s0);
+    CHECK(lsdb_voigt_conv(y, len, dx, sigma*dx, gamma*dx) == LSDB_SUCCESS);
+    lsdb_voigt_get_stats(stats);
+    stats->conv_direct -= s0.conv_direct;
+    stats->conv_fft    -= s0.conv_fft;
+    stats->conv_padded -= s0.conv_padded;
+
+    ref_conv(ref, len, dx, sigma*dx, gamma*dx);
+    diff = test_rel_diff(y, ref, len);
+    *dhalf = max_diff(y, ref, len/2)/max_diff(ref, NULL, len);
+
+    free(x);
+    free(y);
+    free(ref);
+
+    return diff;
+}
+
+int main(void)
+{
+    /* widths in grid steps */
+    static const double sigmas[] = {1.0, 1.5, 2.5, 4.0};
+    static const double voigts[][2] = {{0.5, 0.5}, {3.0, 1.0}, {20.0, 5.0}};
+    lsdb_stats_t st;
+    double d, dh;
+
+    /* the DCT path proper */
+    for (size_t i = 0; i < sizeof(voigts)/sizeof(voigts[0]); i++) {
+        d = conv_diff(LEN, voigts[i][0], voigts[i][1], &st, &dh);
+        printf("dct     sigma %4.1f gamma %4.1f: %.1e\n",
+            voigts[i][0], voigts[i][1], d);
+        CHECK(st.conv_fft == 1 && st.conv_padded == 0);
+        CHECK(d < 1e-12);
+    }
+
+    /* the direct kernel, truncated at 6 sigma */
+    for (size_t i = 0; i < sizeof(sigmas)/sizeof(sigmas[0]); i++) {
+        d = conv_diff(LEN, sigmas[i], 0.0, &st, &dh);
+        printf("direct  sigma %4.1f           : %.1e\n", sigmas[i], d);
+        CHECK(st.conv_direct == 1);
+        CHECK(d < 1e-8);
+    }
+
+    /*
+     * 1999 is a prime, so 2000 points are padded. The padding is felt where
+     * the kernel reaches past the last point, so mostly at the far end
+     */
+    for (size_t i = 0; i < sizeof(voigts)/sizeof(voigts[0]); i++) {
+        d = conv_diff(LEN - 1, voigts[i][0], voigts[i][1], &st, &dh);
+        printf("padded  sigma %4.1f gamma %4.1f: %.1e, first half %.1e\n",
+            voigts[i][0], voigts[i][1], d, dh);
+        CHECK(st.conv_fft == 1 && st.conv_padded == 1);
+        CHECK(d < 1e-5 && dh < 1e-6);
+    }
+
+    lsdb_fft_cleanup();
+
+    return test_result("t_voigt");
+}
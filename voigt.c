@@ -0,0 +1,599 @@
+/*
+ * This file is part of the LSDB library & utilities.
+ *
+ * Copyright (C) 2025 Weizmann Institute of Science
+ *
+ * Author: Evgeny Stambulchik
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * The license text can be found in the LGPL-3.0.txt file.
+ */
+
+/*
+ * Voigt convolution via the type-I DCT. FFTW plans are shared by all the
+ * handles of the process: one plan per transform length and planner mode,
+ * created on the first use and kept until lsdb_fft_cleanup(). REDFT00 is
+ * its own inverse (up to a factor), so the same plan serves both
+ * directions. The plan cache and the FFTW planner are protected by a
+ * mutex; executing a plan is thread-safe.
+ *
+ * Environment:
+ *  LSDB_FFTW_PLANNER  estimate (default), measure, or patient
+ *  LSDB_FFTW_WISDOM   wisdom file, imported before the first planning and
+ *                     updated on lsdb_close() if new plans were made
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <fftw3.h>
+
+#include <lsdb/lsdbP.h>
+
+/* the largest prime factor of a length not worth padding */
+#define FFT_MAX_RADIX 13
+
+/* truncation of the direct Gaussian kernel, in sigmas and in grid steps */
+#define VOIGT_DIRECT_NSIGMA 6
+#define VOIGT_DIRECT_MAXHW  24
+
+typedef enum {
+    CONV_DIRECT,
+    CONV_FFT
+} conv_method_t;
+
+typedef struct _fft_scratch_t fft_scratch_t;
+
+struct _fft_scratch_t {
+    double *buf;
+    fft_scratch_t *next;
+};
+
+typedef struct {
+    size_t    n;
+    unsigned  flags;
+    fftw_plan plan;
+
+    /* free aligned buffers of 2*stride doubles */
+    fft_scratch_t *scratch;
+} fft_plan_t;
+
+static pthread_mutex_t fft_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* plans are allocated one by one, so they don't move while in use */
+static fft_plan_t **fft_plans;
+static size_t      fft_nplans, fft_aplans;
+
+static bool     fft_initialized;
+static unsigned fft_flags = FFTW_ESTIMATE;
+static bool     fft_flags_set;
+static bool     fft_wisdom_dirty;
+
+static unsigned long conv_ndirect, conv_nfft, conv_npadded;
+
+static unsigned planner_flags(lsdb_fft_planner_t planner)
+{
+    switch (planner) {
+    case LSDB_FFT_MEASURE:
+        return FFTW_MEASURE;
+    case LSDB_FFT_PATIENT:
+        return FFTW_PATIENT;
+    default:
+        return FFTW_ESTIMATE;
+    }
+}
+
+/* keep both halves of a scratch buffer equally aligned */
+static size_t fft_stride(size_t n)
+{
+    return (n + 7) & ~(size_t) 7;
+}
+
+/* called with the lock held */
+static void fft_init(void)
+{
+    const char *s;
+
+    if (fft_initialized) {
+        return;
+    }
+    fft_initialized = true;
+
+    s = getenv("LSDB_FFTW_PLANNER");
+    if (s && !fft_flags_set) {
+        if (!strcmp(s, "measure")) {
+            fft_flags = FFTW_MEASURE;
+        } else
+        if (!strcmp(s, "patient")) {
+            fft_flags = FFTW_PATIENT;
+        }
+    }
+
+    s = getenv("LSDB_FFTW_WISDOM");
+    if (s) {
+        fftw_import_wisdom_from_filename(s);
+    }
+}
+
+int lsdb_set_fft_planner(lsdb_fft_planner_t planner)
+{
+    if (planner != LSDB_FFT_ESTIMATE && planner != LSDB_FFT_MEASURE &&
+        planner != LSDB_FFT_PATIENT) {
+        return LSDB_FAILURE;
+    }
+
+    pthread_mutex_lock(&fft_lock);
+    fft_flags     = planner_flags(planner);
+    fft_flags_set = true;
+    pthread_mutex_unlock(&fft_lock);
+
+    return LSDB_SUCCESS;
+}
+
+int lsdb_import_fft_wisdom(const char *fname)
+{
+    int rc;
+
+    pthread_mutex_lock(&fft_lock);
+    rc = fftw_import_wisdom_from_filename(fname);
+    pthread_mutex_unlock(&fft_lock);
+
+    return rc ? LSDB_SUCCESS:LSDB_FAILURE;
+}
+
+int lsdb_export_fft_wisdom(const char *fname)
+{
+    int rc;
+
+    pthread_mutex_lock(&fft_lock);
+    rc = fftw_export_wisdom_to_filename(fname);
+    if (rc) {
+        fft_wisdom_dirty = false;
+    }
+    pthread_mutex_unlock(&fft_lock);
+
+    return rc ? LSDB_SUCCESS:LSDB_FAILURE;
+}
+
+/* store the wisdom in the file given in the environment, if anything new */
+void lsdb_fft_save_wisdom(void)
+{
+    const char *s = getenv("LSDB_FFTW_WISDOM");
+
+    if (!s) {
+        return;
+    }
+
+    pthread_mutex_lock(&fft_lock);
+    if (fft_wisdom_dirty && fftw_export_wisdom_to_filename(s)) {
+        fft_wisdom_dirty = false;
+    }
+    pthread_mutex_unlock(&fft_lock);
+}
+
+void lsdb_fft_cleanup(void)
+{
+    pthread_mutex_lock(&fft_lock);
+    for (size_t i = 0; i < fft_nplans; i++) {
+        fft_scratch_t *s = fft_plans[i]->scratch;
+        while (s) {
+            fft_scratch_t *next = s->next;
+            fftw_free(s->buf);
+            free(s);
+            s = next;
+        }
+        fftw_destroy_plan(fft_plans[i]->plan);
+        free(fft_plans[i]);
+    }
+    free(fft_plans);
+    fft_plans  = NULL;
+    fft_nplans = fft_aplans = 0;
+    pthread_mutex_unlock(&fft_lock);
+}
+
+static fft_scratch_t *scratch_new(size_t n)
+{
+    fft_scratch_t *s = malloc(sizeof(fft_scratch_t));
+    if (!s) {
+        return NULL;
+    }
+    s->buf = fftw_alloc_real(2*fft_stride(n));
+    if (!s->buf) {
+        free(s);
+        return NULL;
+    }
+    s->next = NULL;
+
+    return s;
+}
+
+/* called with the lock held */
+static fft_plan_t *plan_get(size_t n)
+{
+    fft_plan_t *p;
+    fft_scratch_t *s;
+
+    fft_init();
+
+    for (size_t i = 0; i < fft_nplans; i++) {
+        p = fft_plans[i];
+        if (p->n == n && p->flags == fft_flags) {
+            return p;
+        }
+    }
+
+    if (fft_nplans >= fft_aplans) {
+        size_t nalloc = fft_aplans ? 2*fft_aplans:4;
+        void *ptr = realloc(fft_plans, nalloc*sizeof(fft_plan_t *));
+        if (!ptr) {
+            return NULL;
+        }
+        fft_plans  = ptr;
+        fft_aplans = nalloc;
+    }
+
+    /* planning may overwrite the arrays, so plan on a scratch buffer */
+    p = malloc(sizeof(fft_plan_t));
+    if (!p) {
+        return NULL;
+    }
+    s = scratch_new(n);
+    if (!s) {
+        free(p);
+        return NULL;
+    }
+
+    p->n       = n;
+    p->flags   = fft_flags;
+    p->scratch = s;
+    p->plan    = fftw_plan_r2r_1d(n, s->buf, s->buf + fft_stride(n),
+        FFTW_REDFT00, fft_flags);
+    if (!p->plan) {
+        fftw_free(s->buf);
+        free(s);
+        free(p);
+        return NULL;
+    }
+
+    fft_plans[fft_nplans++] = p;
+    if (fft_flags != FFTW_ESTIMATE) {
+        fft_wisdom_dirty = true;
+    }
+
+    return p;
+}
+
+static fft_plan_t *plan_acquire(size_t n, fft_scratch_t **s)
+{
+    fft_plan_t *p;
+
+    *s = NULL;
+
+    pthread_mutex_lock(&fft_lock);
+    p = plan_get(n);
+    if (p) {
+        *s = p->scratch;
+        if (*s) {
+            p->scratch = (*s)->next;
+        } else {
+            *s = scratch_new(n);
+        }
+    }
+    pthread_mutex_unlock(&fft_lock);
+
+    if (!*s) {
+        return NULL;
+    }
+
+    return p;
+}
+
+static void plan_release(fft_plan_t *p, fft_scratch_t *s)
+{
+    pthread_mutex_lock(&fft_lock);
+    s->next = p->scratch;
+    p->scratch = s;
+    pthread_mutex_unlock(&fft_lock);
+}
+
+/*
+ * The Voigt transform, including the normalization of the DCT pair; same
+ * expressions as in lsdb_voigt_conv(), for identical results
+ */
+static void voigt_damping(double *d, size_t n, double dx,
+    double sigma, double gamma)
+{
+    for (size_t i = 0; i < n; i++) {
+        /* 2 due to symmetry - we use half-length FFT */
+        double t = 2*M_PI*i/(2*(n - 1)*dx);
+        d[i] = exp(-gamma*t - sigma*sigma*t*t/2)/(2*(n - 1));
+    }
+}
+
+/* n - 1 has no prime factors above max */
+static bool is_smooth(size_t n, size_t max)
+{
+    size_t r = n - 1;
+
+    for (size_t f = 2; f <= max && r > 1; f++) {
+        while (r % f == 0) {
+            r /= f;
+        }
+    }
+
+    return r == 1;
+}
+
+/*
+ * FFTW does well for lengths with small factors only (the DCT-I of n points
+ * is a real DFT of 2(n - 1) points); otherwise, pad to the smallest length
+ * m with m - 1 = 2^a 3^b 5^c 7^d
+ */
+static size_t fft_length(size_t n)
+{
+    size_t m;
+
+    if (is_smooth(n, FFT_MAX_RADIX)) {
+        return n;
+    }
+
+    for (m = n + 1; !is_smooth(m, 7); m++) {
+        ;
+    }
+
+    return m;
+}
+
+/*
+ * The DCT-I treats the data as mirrored about both ends. The padded points
+ * continue the mirror image about the last one, so only the far tail of a
+ * wide kernel sees the difference
+ */
+static void mirror_pad(double *dst, const double *y, size_t n, size_t m)
+{
+    memcpy(dst, y, n*sizeof(double));
+    for (size_t i = n; i < m; i++) {
+        size_t k = i - (n - 1);
+        dst[i] = k < n ? y[n - 1 - k]:0.0;
+    }
+}
+
+/*
+ * A truncated kernel is used only for pure Gaussians that are resolved by
+ * the grid (so that the sampled kernel is accurate) yet narrow
+ */
+static conv_method_t conv_method(size_t n, double dx,
+    double sigma, double gamma)
+{
+    double hw;
+
+    if (gamma != 0.0 || sigma < dx) {
+        return CONV_FFT;
+    }
+
+    hw = ceil(VOIGT_DIRECT_NSIGMA*sigma/dx);
+    if (hw <= VOIGT_DIRECT_MAXHW && hw < n) {
+        return CONV_DIRECT;
+    } else {
+        return CONV_FFT;
+    }
+}
+
+static void conv_count(conv_method_t method, bool padded, size_t count)
+{
+    pthread_mutex_lock(&fft_lock);
+    if (method == CONV_DIRECT) {
+        conv_ndirect += count;
+    } else {
+        conv_nfft += count;
+        if (padded) {
+            conv_npadded += count;
+        }
+    }
+    pthread_mutex_unlock(&fft_lock);
+}
+
+void lsdb_voigt_get_stats(lsdb_stats_t *stats)
+{
+    pthread_mutex_lock(&fft_lock);
+    stats->conv_direct = conv_ndirect;
+    stats->conv_fft    = conv_nfft;
+    stats->conv_padded = conv_npadded;
+    pthread_mutex_unlock(&fft_lock);
+}
+
+/* Gaussian convolution with a kernel truncated at VOIGT_DIRECT_NSIGMA */
+static int direct_conv(double *y, size_t n, double dx, double sigma)
+{
+    size_t hw = ceil(VOIGT_DIRECT_NSIGMA*sigma/dx), i, k;
+    double w[VOIGT_DIRECT_MAXHW + 1], wsum;
+    double *ext;
+
+    ext = malloc((n + 2*hw)*sizeof(double));
+    if (!ext) {
+        return LSDB_FAILURE;
+    }
+
+    /* same edge treatment as the DCT-I */
+    for (k = 1; k <= hw; k++) {
+        ext[hw - k]         = y[k];
+        ext[hw + n - 1 + k] = y[n - 1 - k];
+    }
+    memcpy(ext + hw, y, n*sizeof(double));
+
+    wsum = w[0] = 1.0;
+    for (k = 1; k <= hw; k++) {
+        double u = k*dx/sigma;
+        w[k] = exp(-u*u/2);
+        wsum += 2*w[k];
+    }
+    for (k = 0; k <= hw; k++) {
+        w[k] /= wsum;
+    }
+
+    for (i = 0; i < n; i++) {
+        const double *e = ext + hw + i;
+        double r = w[0]*e[0];
+        for (k = 1; k <= hw; k++) {
+            r += w[k]*(e[-(ptrdiff_t) k] + e[k]);
+        }
+        y[i] = r;
+    }
+
+    free(ext);
+
+    return LSDB_SUCCESS;
+}
+
+/*
+ * Convolution with a Voigt function; original data are replaced! Narrow
+ * Gaussians are convolved directly, otherwise via the DCT-I, padded to a
+ * length FFTW handles efficiently
+ */
+int lsdb_voigt_conv(double *y, size_t n, double dx, double sigma, double gamma)
+{
+    fft_plan_t *p;
+    fft_scratch_t *s;
+    double *in, *out;
+    size_t i, m;
+
+    if (n < 2) {
+        return LSDB_FAILURE;
+    }
+
+    if (conv_method(n, dx, sigma, gamma) == CONV_DIRECT) {
+        conv_count(CONV_DIRECT, false, 1);
+        return direct_conv(y, n, dx, sigma);
+    }
+
+    m = fft_length(n);
+
+    p = plan_acquire(m, &s);
+    if (!p) {
+        return LSDB_FAILURE;
+    }
+
+    /* the new-array execution requires the alignment of the plan */
+    out = s->buf + fft_stride(m);
+    if (m == n && fftw_alignment_of(y) == fftw_alignment_of(s->buf)) {
+        in = y;
+    } else {
+        in = s->buf;
+        mirror_pad(in, y, n, m);
+    }
+
+    fftw_execute_r2r(p->plan, in, out);
+
+    for (i = 0; i < m; i++) {
+        /* 2 due to symmetry - we use half-length FFT */
+        double t = 2*M_PI*i/(2*(m - 1)*dx);
+        out[i] *= exp(-gamma*t - sigma*sigma*t*t/2)/(2*(m - 1));
+    }
+
+    fftw_execute_r2r(p->plan, out, in);
+
+    if (in != y) {
+        memcpy(y, in, n*sizeof(double));
+    }
+
+    plan_release(p, s);
+
+    conv_count(CONV_FFT, m != n, 1);
+
+    return LSDB_SUCCESS;
+}
+
+/*
+ * Convolve count spectra of len points each, the i-th one starting at
+ * y[i*stride], with the Voigt functions of sigma[i] and gamma[i] (either may
+ * be NULL) on the grid step dx[i]. Spectra with zero widths or steps are left
+ * intact. The method is chosen per spectrum as in lsdb_voigt_conv(); the
+ * damping factors of the DCT are only recomputed when the parameters change.
+ */
+int lsdb_voigt_conv_batch(double *y, size_t stride, size_t count, size_t len,
+    const double *dx, const double *sigma, const double *gamma)
+{
+    fft_plan_t *p = NULL;
+    fft_scratch_t *s = NULL;
+    double *damp;
+    double dx_prev = 0.0, sigma_prev = 0.0, gamma_prev = 0.0;
+    size_t m = fft_length(len), ndirect = 0, nfft = 0, i, k;
+    int rc = LSDB_SUCCESS;
+
+    if (len < 2 || !dx) {
+        return LSDB_FAILURE;
+    }
+
+    damp = malloc(m*sizeof(double));
+    if (!damp) {
+        return LSDB_FAILURE;
+    }
+
+    for (i = 0; i < count; i++) {
+        double sg = sigma ? sigma[i]:0.0, gm = gamma ? gamma[i]:0.0;
+        double *yi = y + i*stride, *in, *out;
+
+        if (dx[i] <= 0.0 || (sg <= 0.0 && gm <= 0.0)) {
+            continue;
+        }
+
+        if (conv_method(len, dx[i], sg, gm) == CONV_DIRECT) {
+            if (direct_conv(yi, len, dx[i], sg) != LSDB_SUCCESS) {
+                rc = LSDB_FAILURE;
+            }
+            ndirect++;
+            continue;
+        }
+
+        if (!p) {
+            p = plan_acquire(m, &s);
+            if (!p) {
+                rc = LSDB_FAILURE;
+                break;
+            }
+        }
+
+        if (nfft == 0 || dx[i] != dx_prev ||
+            sg != sigma_prev || gm != gamma_prev) {
+            voigt_damping(damp, m, dx[i], sg, gm);
+            dx_prev    = dx[i];
+            sigma_prev = sg;
+            gamma_prev = gm;
+        }
+
+        in  = s->buf;
+        out = s->buf + fft_stride(m);
+        mirror_pad(in, yi, len, m);
+
+        fftw_execute_r2r(p->plan, in, out);
+        for (k = 0; k < m; k++) {
+            out[k] *= damp[k];
+        }
+        fftw_execute_r2r(p->plan, out, in);
+
+        memcpy(yi, in, len*sizeof(double));
+        nfft++;
+    }
+
+    if (p) {
+        plan_release(p, s);
+    }
+
+    conv_count(CONV_DIRECT, false, ndirect);
+    conv_count(CONV_FFT, m != len, nfft);
+
+    free(damp);
+
+    return rc;
+}